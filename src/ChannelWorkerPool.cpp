@@ -0,0 +1,116 @@
+#include "ChannelWorkerPool.h"
+
+// A thread that runs parts of the tasks whenever it's woken up
+class ChannelWorkerPool::Worker final : public juce::Thread
+{
+public:
+    explicit Worker(ChannelWorkerPool& pool)
+        : juce::Thread("Convolution channels"), m_pool(pool)
+    {
+        // Some systems refuse realtime threads to a plugin, the highest ordinary priority is the next best thing
+        if (!startRealtimeThread(juce::Thread::RealtimeOptions().withPriority(MHV_CHANNEL_WORKER_PRIORITY)))
+            startThread(juce::Thread::Priority::highest);
+    }
+
+    ~Worker() override
+    {
+        stopThread(-1);
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit() && !m_pool.m_shouldExit.load(std::memory_order_acquire))
+        {
+            m_pool.m_semaphore.wait();
+            while (m_pool.runNextPart()) {}
+        }
+    }
+
+private:
+    ChannelWorkerPool& m_pool;
+};
+
+ChannelWorkerPool::ChannelWorkerPool()
+{
+}
+
+ChannelWorkerPool::~ChannelWorkerPool()
+{
+    release();
+}
+
+size_t ChannelWorkerPool::getNumWorkersFor(const size_t numChannels, const size_t channelsPerWorker)
+{
+    // One thread per group of channels, the calling thread takes the first group, and a core is left to the rest of the host
+    const auto groupSize = juce::jmax((size_t)1, channelsPerWorker);
+    const auto numGroups = (numChannels + groupSize - 1) / groupSize;
+    const auto numCores = (size_t)juce::jmax(1, juce::SystemStats::getNumCpus());
+    return juce::jmin(numGroups > 0 ? numGroups - 1 : 0, numCores > 1 ? numCores - 2 : 0);
+}
+
+void ChannelWorkerPool::prepare(const size_t numWorkers, std::function<void(size_t)> runPart)
+{
+    release();
+    m_runPart = std::move(runPart);
+    m_shouldExit = false;
+    m_state = 0;
+    m_numParts = 0;
+    m_numCompleted = 0;
+    for (size_t i = 0; i < numWorkers; i++)
+        m_workers.push_back(std::make_unique<Worker>(*this));
+}
+
+void ChannelWorkerPool::release()
+{
+    if (m_workers.empty())
+        return;
+
+    // Every worker may be waiting on the semaphore
+    m_shouldExit.store(true, std::memory_order_release);
+    for (auto& worker : m_workers)
+        worker->signalThreadShouldExit();
+    m_semaphore.post(m_workers.size());
+    m_workers.clear();
+}
+
+void ChannelWorkerPool::run(const size_t numParts) noexcept
+{
+    if (numParts == 0)
+        return;
+    if (m_workers.empty() || numParts == 1)
+    {
+        for (size_t part = 0; part < numParts; part++)
+            m_runPart(part);
+        return;
+    }
+
+    // Every part of the previous task was completed before it returned, so nothing is running now
+    m_numCompleted.store(0, std::memory_order_relaxed);
+    m_numParts.store(numParts, std::memory_order_relaxed);
+    const auto generation = (m_state.load(std::memory_order_relaxed) >> 32) + 1;
+    m_state.store(generation << 32, std::memory_order_release);
+    m_semaphore.post(juce::jmin(numParts - 1, m_workers.size()));
+
+    // Help with the parts until they're all claimed, then wait for the ones the workers are still running
+    while (runNextPart()) {}
+    while (m_numCompleted.load(std::memory_order_acquire) < numParts)
+        juce::Thread::yield();
+}
+
+bool ChannelWorkerPool::runNextPart() noexcept
+{
+    auto state = m_state.load(std::memory_order_acquire);
+    while (true)
+    {
+        const auto part = (size_t)(state & 0xffffffff);
+        if (part >= m_numParts.load(std::memory_order_relaxed))
+            return false;
+        // A failed exchange reloads the state, another thread claimed the part or a new task started
+        if (m_state.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            m_runPart(part);
+            m_numCompleted.fetch_add(1, std::memory_order_release);
+            return true;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <juce_core/juce_core.h>
+#include "Semaphore.h"
+
+// How many channels are worth a thread of their own, fewer channels are processed on the audio thread only
+#define MHV_CHANNELS_PER_WORKER 4
+// The realtime priority (from 0 to 10) of the workers, the audio thread waits for the parts they claimed
+#define MHV_CHANNEL_WORKER_PRIORITY 9
+
+// This class runs the parts of a task on a few worker threads and on the thread that asks for it, and returns
+// once they're all done. It's used by the convolution engine to process groups of channels in parallel.
+// The audio thread wakes the workers with a semaphore, which never locks, and runs any part no worker picked
+// up by the time it's done with its own, so a worker that isn't woken up in time only costs the parallelism.
+// A part a worker claimed can't be taken back though, the audio thread waits for it to finish, so the workers
+// are realtime threads that the host's ordinary threads can't preempt in the middle of a part.
+class ChannelWorkerPool
+{
+// Methods
+public:
+    ChannelWorkerPool();
+    ~ChannelWorkerPool();
+    // Starts the workers, runPart is called with the index of the part to run.
+    // This allocates and must not be called from the audio thread
+    void prepare(const size_t numWorkers, std::function<void(size_t)> runPart);
+    // Stops the workers
+    void release();
+    // Returns how many threads there are besides the calling one
+    size_t getNumWorkers() const noexcept { return m_workers.size(); }
+    // Runs the parts of a task and waits for them
+    void run(const size_t numParts) noexcept;
+    // Returns how many workers are worth starting for the given channel count, with groups of the given size
+    static size_t getNumWorkersFor(const size_t numChannels, const size_t channelsPerWorker = MHV_CHANNELS_PER_WORKER);
+private:
+    class Worker;
+    // Claims the next part of the current task and runs it, returns false once they're all claimed
+    bool runNextPart() noexcept;
+// Variables
+private:
+    std::function<void(size_t)> m_runPart;
+    Semaphore m_semaphore;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    // The task's generation in the upper half, the next part to claim in the lower one,
+    // so a late worker can't claim a part of the next task before it's published
+    std::atomic<juce::uint64> m_state { 0 };
+    std::atomic<size_t> m_numParts { 0 };
+    std::atomic<size_t> m_numCompleted { 0 };
+    std::atomic<bool> m_shouldExit { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ChannelWorkerPool)
+};
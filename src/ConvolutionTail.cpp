@@ -0,0 +1,432 @@
+#include "ConvolutionTail.h"
+#include <algorithm>
+#include <limits>
+#include "SpectralKernels.h"
+
+// The thread running the queued jobs when the pool has no thread. It sleeps until a job is queued,
+// and the deadline catches the jobs it couldn't start in time
+class ConvolutionTail::Worker final : public juce::Thread
+{
+public:
+    explicit Worker(ConvolutionTail& tail)
+        : juce::Thread("Convolution tail"), m_tail(tail)
+    {
+        // Some systems refuse realtime threads to a plugin, the highest ordinary priority is the next best thing
+        if (!startRealtimeThread(juce::Thread::RealtimeOptions().withPriority(MHV_TAIL_WORKER_PRIORITY)))
+            startThread(juce::Thread::Priority::highest);
+    }
+
+    ~Worker() override
+    {
+        stopThread(-1);
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            m_tail.m_semaphore.wait();
+            while (!threadShouldExit() && m_tail.processQueuedJobs()) {}
+        }
+    }
+
+private:
+    ConvolutionTail& m_tail;
+};
+
+ConvolutionTail::ConvolutionTail()
+{
+}
+
+ConvolutionTail::~ConvolutionTail()
+{
+    stopWorker();
+}
+
+void ConvolutionTail::stopWorker()
+{
+    if (m_inPool)
+        m_pool->remove(*this);
+    m_inPool = false;
+    if (m_worker == nullptr)
+        return;
+    // The worker may be waiting on the semaphore
+    m_worker->signalThreadShouldExit();
+    m_semaphore.post();
+    m_worker.reset();
+}
+
+void ConvolutionTail::wakeWorker() noexcept
+{
+    if (m_inPool)
+        m_pool->wakeUp();
+    else
+        m_semaphore.post();
+}
+
+void ConvolutionTail::prepare(const size_t numChannels, const std::vector<PartitionedIR::Segment>& layout, const double sampleRate)
+{
+    stopWorker();
+    m_numChannels = numChannels;
+    m_workerTicks = 0;
+    m_inlineTicks = 0;
+    m_missedDeadlines = 0;
+    m_segments.clear();
+
+    // The head is processed by the engine itself
+    size_t maxPartitionSize = 0;
+    for (size_t index = 1; index < layout.size(); index++)
+    {
+        const auto& segmentLayout = layout[index];
+        auto segment = std::make_unique<Segment>();
+        segment->index = index;
+        segment->partitionSize = segmentLayout.partitionSize;
+        segment->fftSize = segmentLayout.fftSize;
+        segment->numBins = segmentLayout.numBins;
+        segment->numSlots = segmentLayout.numPartitions;
+        segment->offset = segmentLayout.offset;
+        // The output of a job is written one partition ahead of the deadline, the circular buffer holds up to there
+        segment->outputLength = segment->offset + segment->partitionSize;
+        // A job is queued once its input partition is complete, and played one segment offset after it started
+        const auto slack = (double)(segment->offset - segment->partitionSize) / juce::jmax(1.0, sampleRate);
+        segment->deadlineTicks = (juce::int64)(slack * (double)juce::Time::getHighResolutionTicksPerSecond());
+        segment->fft = std::make_unique<juce::dsp::FFT>(PartitionedIR::getFFTOrder(segment->partitionSize));
+        segment->history.assign(segment->numSlots * m_numChannels * 2 * segment->numBins, 0.0f);
+        segment->fftBuffer.assign(2 * segment->fftSize, 0.0f);
+        segment->spectrum.assign(2 * segment->numBins, 0.0f);
+        for (size_t voice = 0; voice < 2; voice++)
+        {
+            segment->overlaps[voice].assign(m_numChannels * segment->partitionSize, 0.0f);
+            segment->outputs[voice].assign(m_numChannels * segment->outputLength, 0.0f);
+        }
+        maxPartitionSize = juce::jmax(maxPartitionSize, segment->partitionSize);
+        m_segments.push_back(std::move(segment));
+    }
+
+    // The oldest job may still need its input until its deadline. The partition sizes are powers of two,
+    // so with a multiple of the largest one a partition never wraps around the buffer
+    m_inputLength = 4 * maxPartitionSize;
+    m_inputs.assign(m_numChannels * m_inputLength, 0.0f);
+
+    reset();
+    if (!isActive())
+        return;
+    if (m_pool->getNumThreads() > 0)
+    {
+        m_pool->add(*this);
+        m_inPool = true;
+    }
+    else
+    {
+        m_worker = std::make_unique<Worker>(*this);
+    }
+}
+
+void ConvolutionTail::reset() noexcept
+{
+    // Take every segment away from the worker before clearing it
+    for (auto& segment : m_segments)
+    {
+        while (segment->busy.exchange(true, std::memory_order_acquire))
+            juce::Thread::yield();
+    }
+
+    std::fill(m_inputs.begin(), m_inputs.end(), 0.0f);
+    m_position = 0;
+    for (auto& segment : m_segments)
+    {
+        std::fill(segment->history.begin(), segment->history.end(), 0.0f);
+        for (size_t voice = 0; voice < 2; voice++)
+        {
+            std::fill(segment->overlaps[voice].begin(), segment->overlaps[voice].end(), 0.0f);
+            std::fill(segment->outputs[voice].begin(), segment->outputs[voice].end(), 0.0f);
+            segment->previousIRs[voice] = nullptr;
+        }
+        for (auto& queuedIRs : segment->queuedIRs)
+            queuedIRs = {};
+        segment->queuedLinks = {};
+        segment->currentSlot = 0;
+        segment->numQueued = 0;
+        segment->numCompleted = 0;
+        segment->busy.store(false, std::memory_order_release);
+    }
+}
+
+size_t ConvolutionTail::getPrimingLength() const noexcept
+{
+    // A job queued after the switch is only played once a whole partition went through the segment
+    size_t primingLength = 0;
+    for (const auto& segment : m_segments)
+        primingLength = juce::jmax(primingLength, segment->offset + segment->partitionSize);
+    return primingLength;
+}
+
+void ConvolutionTail::pushInput(const float* const* input, const size_t numChannels, const size_t startSample, const size_t numSamples) noexcept
+{
+    if (!isActive())
+        return;
+
+    const auto position = (size_t)(m_position % (juce::int64)m_inputLength);
+    for (size_t channel = 0; channel < juce::jmin(numChannels, m_numChannels); channel++)
+        std::copy(input[channel] + startSample, input[channel] + startSample + numSamples, m_inputs.begin() + (std::ptrdiff_t)(channel * m_inputLength + position));
+}
+
+void ConvolutionTail::waitForOutput() noexcept
+{
+    // The output played now comes from the job whose input started one segment offset ago
+    for (auto& segment : m_segments)
+    {
+        if (m_position >= (juce::int64)segment->offset)
+            join(*segment, (m_position - (juce::int64)segment->offset) / (juce::int64)segment->partitionSize);
+    }
+}
+
+void ConvolutionTail::join(Segment& segment, const juce::int64 job) noexcept
+{
+    jassert(job < segment.numQueued.load());
+    if (segment.numCompleted.load(std::memory_order_acquire) <= job)
+        m_missedDeadlines.fetch_add(1, std::memory_order_relaxed);
+    while (segment.numCompleted.load(std::memory_order_acquire) <= job)
+    {
+        // The deadline is reached, if the worker isn't on it the job runs here
+        if (!segment.busy.exchange(true, std::memory_order_acquire))
+        {
+            while (segment.numCompleted.load(std::memory_order_relaxed) <= job)
+                runNextJob(segment, m_inlineTicks);
+            segment.busy.store(false, std::memory_order_release);
+            // A thread woken up for the next jobs may have found the segment busy, and gone back to sleep
+            if (segment.numCompleted.load(std::memory_order_relaxed) < segment.numQueued.load(std::memory_order_relaxed))
+                wakeWorker();
+        }
+        else
+        {
+            juce::Thread::yield();
+        }
+    }
+}
+
+void ConvolutionTail::addOutput(const size_t voice, const size_t channel, float* output, const size_t numSamples) const noexcept
+{
+    const auto& kernels = SpectralKernels::get();
+    for (const auto& segment : m_segments)
+    {
+        const auto position = (size_t)(m_position % (juce::int64)segment->outputLength);
+        kernels.add(output, output, segment->outputs[voice].data() + channel * segment->outputLength + position, numSamples);
+    }
+}
+
+void ConvolutionTail::advance(const size_t numSamples, const std::array<const PartitionedIR*, 2>& voiceIRs, const bool linked) noexcept
+{
+    m_position += (juce::int64)numSamples;
+    for (auto& segment : m_segments)
+    {
+        if (m_position % (juce::int64)segment->partitionSize != 0)
+            continue;
+
+        // An input partition is complete, the job gets the impulse responses the voices have now
+        const auto job = m_position / (juce::int64)segment->partitionSize - 1;
+        jassert(job - segment->numCompleted.load() < MHV_TAIL_JOB_QUEUE_SIZE);
+        segment->queuedIRs[(size_t)(job % MHV_TAIL_JOB_QUEUE_SIZE)] = voiceIRs;
+        segment->queuedLinks[(size_t)(job % MHV_TAIL_JOB_QUEUE_SIZE)] = linked;
+        segment->deadlines[(size_t)(job % MHV_TAIL_JOB_QUEUE_SIZE)].store(juce::Time::getHighResolutionTicks() + segment->deadlineTicks,
+                                                                          std::memory_order_relaxed);
+        segment->numQueued.store(job + 1, std::memory_order_release);
+        wakeWorker();
+    }
+}
+
+void ConvolutionTail::addImpulseResponsesInUse(std::array<const PartitionedIR*, MHV_MAX_IRS_IN_USE>& inUse, size_t& numInUse) const noexcept
+{
+    // The worker may complete a job meanwhile, it then stops using its impulse responses, but it never starts a new one
+    for (const auto& segment : m_segments)
+    {
+        const auto numQueued = segment->numQueued.load(std::memory_order_acquire);
+        for (auto job = segment->numCompleted.load(std::memory_order_acquire); job < numQueued; job++)
+        {
+            for (const auto* ir : segment->queuedIRs[(size_t)(job % MHV_TAIL_JOB_QUEUE_SIZE)])
+            {
+                if (ir == nullptr || std::find(inUse.begin(), inUse.begin() + (std::ptrdiff_t)numInUse, ir) != inUse.begin() + (std::ptrdiff_t)numInUse)
+                    continue;
+                jassert(numInUse < inUse.size());
+                if (numInUse < inUse.size())
+                    inUse[numInUse++] = ir;
+            }
+        }
+    }
+}
+
+bool ConvolutionTail::processQueuedJobs() noexcept
+{
+    // The smaller segments come first, their deadlines are the closest
+    bool ranJobs = false;
+    for (auto& segment : m_segments)
+    {
+        if (segment->numCompleted.load(std::memory_order_acquire) >= segment->numQueued.load(std::memory_order_acquire))
+            continue;
+        if (segment->busy.exchange(true, std::memory_order_acquire))
+            continue;
+
+        // The audio thread may have run it in the meantime
+        if (segment->numCompleted.load(std::memory_order_relaxed) < segment->numQueued.load(std::memory_order_acquire))
+        {
+            runNextJob(*segment, m_workerTicks);
+            ranJobs = true;
+        }
+        segment->busy.store(false, std::memory_order_release);
+    }
+    return ranJobs;
+}
+
+bool ConvolutionTail::processMostUrgentJob() noexcept
+{
+    // The segments' oldest jobs are compared, a segment's jobs run in order anyway
+    Segment* mostUrgent = nullptr;
+    auto earliestDeadline = std::numeric_limits<juce::int64>::max();
+    for (auto& segment : m_segments)
+    {
+        const auto job = segment->numCompleted.load(std::memory_order_acquire);
+        if (job >= segment->numQueued.load(std::memory_order_acquire) || segment->busy.load(std::memory_order_relaxed))
+            continue;
+        const auto deadline = segment->deadlines[(size_t)(job % MHV_TAIL_JOB_QUEUE_SIZE)].load(std::memory_order_relaxed);
+        if (deadline < earliestDeadline)
+        {
+            earliestDeadline = deadline;
+            mostUrgent = segment.get();
+        }
+    }
+    if (mostUrgent == nullptr || mostUrgent->busy.exchange(true, std::memory_order_acquire))
+        return false;
+
+    // The audio thread may have run it in the meantime
+    const auto ranJob = mostUrgent->numCompleted.load(std::memory_order_relaxed) < mostUrgent->numQueued.load(std::memory_order_acquire);
+    if (ranJob)
+        runNextJob(*mostUrgent, m_workerTicks);
+    mostUrgent->busy.store(false, std::memory_order_release);
+    return ranJob;
+}
+
+juce::int64 ConvolutionTail::getNextDeadline() const noexcept
+{
+    auto earliestDeadline = std::numeric_limits<juce::int64>::max();
+    for (const auto& segment : m_segments)
+    {
+        const auto job = segment->numCompleted.load(std::memory_order_acquire);
+        if (job < segment->numQueued.load(std::memory_order_acquire) && !segment->busy.load(std::memory_order_relaxed))
+            earliestDeadline = juce::jmin(earliestDeadline, segment->deadlines[(size_t)(job % MHV_TAIL_JOB_QUEUE_SIZE)].load(std::memory_order_relaxed));
+    }
+    return earliestDeadline;
+}
+
+size_t ConvolutionTail::getNumQueuedJobs() const noexcept
+{
+    size_t numQueued = 0;
+    for (const auto& segment : m_segments)
+        numQueued += (size_t)juce::jmax((juce::int64)0, segment->numQueued.load(std::memory_order_acquire) - segment->numCompleted.load(std::memory_order_acquire));
+    return numQueued;
+}
+
+ConvolutionTail::Stats ConvolutionTail::getStats() const noexcept
+{
+    const auto ticksPerSecond = (double)juce::Time::getHighResolutionTicksPerSecond();
+    Stats stats;
+    stats.workerSeconds = (double)m_workerTicks.load(std::memory_order_relaxed) / ticksPerSecond;
+    stats.inlineSeconds = (double)m_inlineTicks.load(std::memory_order_relaxed) / ticksPerSecond;
+    stats.missedDeadlines = m_missedDeadlines.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void ConvolutionTail::runNextJob(Segment& segment, std::atomic<juce::int64>& ticks) noexcept
+{
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    const auto job = segment.numCompleted.load(std::memory_order_relaxed);
+    const auto partitionSize = segment.partitionSize;
+    const auto numBins = segment.numBins;
+    const auto inputStart = (size_t)((job * (juce::int64)partitionSize) % (juce::int64)m_inputLength);
+    // The linked channels were identical over the whole history and the previous overlaps, so the first one is enough
+    const bool linked = segment.queuedLinks[(size_t)(job % MHV_TAIL_JOB_QUEUE_SIZE)];
+    const auto numChannelsToProcess = linked ? (size_t)1 : m_numChannels;
+
+    // Transform the input partition of every channel into the history
+    for (size_t channel = 0; channel < numChannelsToProcess; channel++)
+    {
+        const auto* channelInput = m_inputs.data() + channel * m_inputLength + inputStart;
+        std::copy(channelInput, channelInput + partitionSize, segment.fftBuffer.begin());
+        std::fill(segment.fftBuffer.begin() + (std::ptrdiff_t)partitionSize, segment.fftBuffer.end(), 0.0f);
+        segment.fft->performRealOnlyForwardTransform(segment.fftBuffer.data(), true);
+
+        auto* re = segment.history.data() + (segment.currentSlot * m_numChannels + channel) * 2 * numBins;
+        PartitionedIR::splitSpectrum(segment.fftBuffer.data(), re, re + numBins, numBins);
+    }
+    const auto* firstSpectrum = segment.history.data() + segment.currentSlot * m_numChannels * 2 * numBins;
+    for (auto channel = numChannelsToProcess; channel < m_numChannels; channel++)
+        std::copy(firstSpectrum, firstSpectrum + 2 * numBins, segment.history.begin() + (std::ptrdiff_t)((segment.currentSlot * m_numChannels + channel) * 2 * numBins));
+
+    // The job's output is played one segment offset after its input
+    const auto& kernels = SpectralKernels::get();
+    const auto outputStart = (size_t)((job * (juce::int64)partitionSize + (juce::int64)segment.offset) % (juce::int64)segment.outputLength);
+    const auto& voiceIRs = segment.queuedIRs[(size_t)(job % MHV_TAIL_JOB_QUEUE_SIZE)];
+    for (size_t voice = 0; voice < 2; voice++)
+    {
+        const auto* ir = voiceIRs[voice];
+        // Without an impulse response, or with one too short to reach this segment, the output is silent
+        if (ir == nullptr || segment.index >= ir->segments.size())
+        {
+            for (size_t channel = 0; channel < m_numChannels; channel++)
+            {
+                auto* output = segment.outputs[voice].data() + channel * segment.outputLength + outputStart;
+                std::fill(output, output + partitionSize, 0.0f);
+            }
+            segment.previousIRs[voice] = nullptr;
+            continue;
+        }
+
+        // The overlap left by another impulse response doesn't belong to this one
+        if (ir != segment.previousIRs[voice])
+        {
+            std::fill(segment.overlaps[voice].begin(), segment.overlaps[voice].end(), 0.0f);
+            segment.previousIRs[voice] = ir;
+        }
+
+        const auto& irSegment = ir->segments[segment.index];
+        const auto numPartitions = juce::jmin(irSegment.numPartitions, segment.numSlots);
+        for (size_t channel = 0; channel < numChannelsToProcess; channel++)
+        {
+            std::fill(segment.spectrum.begin(), segment.spectrum.end(), 0.0f);
+            const auto firstInput = ir->getFirstInput(channel);
+            const auto endInput = firstInput + ir->getNumInputs(channel, m_numChannels);
+            for (size_t partition = 0; partition < numPartitions; partition++)
+            {
+                const auto slot = (segment.currentSlot + partition) % segment.numSlots;
+                for (size_t input = firstInput; input < endInput; input++)
+                {
+                    const auto* x = segment.history.data() + (slot * m_numChannels + input) * 2 * numBins;
+                    const auto* h = irSegment.getPartition(ir->getChannel(input, channel), partition);
+                    kernels.multiplyAccumulate(segment.spectrum.data(), segment.spectrum.data() + numBins, x, x + numBins, h, h + numBins, numBins);
+                }
+            }
+
+            PartitionedIR::mergeSpectrum(segment.spectrum.data(), segment.spectrum.data() + numBins, segment.fftBuffer.data(), segment.fftSize);
+            segment.fft->performRealOnlyInverseTransform(segment.fftBuffer.data());
+
+            // The first half and the previous overlap make the output, the second half is the next overlap
+            auto* overlap = segment.overlaps[voice].data() + channel * partitionSize;
+            auto* output = segment.outputs[voice].data() + channel * segment.outputLength + outputStart;
+            kernels.add(output, segment.fftBuffer.data(), overlap, partitionSize);
+            std::copy(segment.fftBuffer.begin() + (std::ptrdiff_t)partitionSize, segment.fftBuffer.begin() + (std::ptrdiff_t)segment.fftSize, overlap);
+        }
+
+        // The other linked channels get the first one's output and overlap
+        const auto* firstOutput = segment.outputs[voice].data() + outputStart;
+        for (auto channel = numChannelsToProcess; channel < m_numChannels; channel++)
+        {
+            std::copy(firstOutput, firstOutput + partitionSize, segment.outputs[voice].begin() + (std::ptrdiff_t)(channel * segment.outputLength + outputStart));
+            std::copy(segment.overlaps[voice].begin(), segment.overlaps[voice].begin() + (std::ptrdiff_t)partitionSize,
+                      segment.overlaps[voice].begin() + (std::ptrdiff_t)(channel * partitionSize));
+        }
+    }
+
+    // The oldest history slot gets reused by the next job
+    segment.currentSlot = segment.currentSlot > 0 ? segment.currentSlot - 1 : segment.numSlots - 1;
+    ticks.fetch_add(juce::Time::getHighResolutionTicks() - startTicks, std::memory_order_relaxed);
+    segment.numCompleted.store(job + 1, std::memory_order_release);
+}
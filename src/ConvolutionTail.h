@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <juce_dsp/juce_dsp.h>
+#include "PartitionedIR.h"
+#include "Semaphore.h"
+#include "SharedConvolutionPool.h"
+
+// How many jobs of a segment can be queued, the deadline keeps it below 3
+#define MHV_TAIL_JOB_QUEUE_SIZE 4
+// The realtime priority (from 0 to 10) of the threads running the jobs. The audio thread waits for a job such a
+// thread already started, so it must not be preempted by the host's ordinary threads meanwhile
+#define MHV_TAIL_WORKER_PRIORITY 8
+
+// This class convolves the segments of the impulse response that follow the head (see PartitionedIR).
+// Their partitions are too large to be transformed on the audio thread without CPU spikes, so every time
+// one of their input partitions is complete a job is queued, and a worker thread computes its output ahead
+// of time. A segment starts at twice its partition size, so a job has a whole partition worth of time
+// before its output is played: that's its deadline. If the job isn't done by then, the audio thread joins
+// it (it runs the job itself, or waits for the worker to finish it), so the output never depends on the
+// worker being on time, and the engine adds no latency. A job is claimed with a flag before it runs, so the
+// audio thread only ever waits for one a worker is in the middle of, and the workers are realtime threads for that.
+// The jobs run on the threads of SharedConvolutionPool, shared by all the instances, which take the jobs with the
+// earliest deadlines first. Without any thread in the pool, the tail starts a worker of its own.
+// The state of both of the engine's voices is kept, so a new impulse response can be prepared while the
+// current one is still playing. A job queued while the engine's channels are linked (see MultiChannelConvolution)
+// only convolves the first channel, and copies its spectrum, output and overlap to the other ones. The input is
+// still stored for all the channels, the next job may not be linked anymore.
+class ConvolutionTail
+{
+public:
+    // What the tail's jobs cost since it was prepared
+    struct Stats
+    {
+        // The CPU time spent on the jobs by the worker (or the pool), and by the audio thread when they were late
+        double workerSeconds = 0.0;
+        double inlineSeconds = 0.0;
+        // The jobs that weren't done when the audio thread needed their output
+        juce::uint64 missedDeadlines = 0;
+    };
+// Methods
+public:
+    ConvolutionTail();
+    ~ConvolutionTail();
+    // Allocates the segments following the head of the layout and joins the pool (or starts the worker), the deadlines
+    // are measured at the sample rate. This must not be called from the audio thread
+    void prepare(const size_t numChannels, const std::vector<PartitionedIR::Segment>& layout, const double sampleRate);
+    // Clears the input and all the segments, it waits for the job the worker might be running
+    void reset() noexcept;
+    // Returns true if the layout has segments after the head
+    bool isActive() const noexcept { return !m_segments.empty(); }
+    // Returns how long a new impulse response takes to reach the output of every segment
+    size_t getPrimingLength() const noexcept;
+    // Stores the input samples, they must not cross a boundary of the head partitions
+    void pushInput(const float* const* input, const size_t numChannels, const size_t startSample, const size_t numSamples) noexcept;
+    // Makes sure the output of the current position is ready, running the late jobs if needed
+    void waitForOutput() noexcept;
+    // Adds the output of a voice for a channel, waitForOutput() must have been called before
+    void addOutput(const size_t voice, const size_t channel, float* output, const size_t numSamples) const noexcept;
+    // Moves the position forward and queues the jobs whose input is complete, with the current impulse response of each voice.
+    // Linked means all the channels were identical for the whole impulse response, and it has a single channel
+    void advance(const size_t numSamples, const std::array<const PartitionedIR*, 2>& voiceIRs, const bool linked) noexcept;
+    // Runs one queued job of each segment, returns false if there was nothing to do
+    bool processQueuedJobs() noexcept;
+    // Runs the queued job with the earliest deadline, returns false if there was none that no other thread had taken
+    bool processMostUrgentJob() noexcept;
+    // Returns the deadline of the most urgent queued job that no other thread is running, in high resolution ticks,
+    // or the largest value if there's none
+    juce::int64 getNextDeadline() const noexcept;
+    // Returns how many jobs are queued and not done yet
+    size_t getNumQueuedJobs() const noexcept;
+    // Returns what the jobs cost since the tail was prepared
+    Stats getStats() const noexcept;
+    // Adds the impulse responses the unfinished jobs were given to the list, unless they're already in it
+    void addImpulseResponsesInUse(std::array<const PartitionedIR*, MHV_MAX_IRS_IN_USE>& inUse, size_t& numInUse) const noexcept;
+private:
+    // A segment of uniform partitions, its state is only touched by whoever holds its busy flag
+    struct Segment
+    {
+        size_t index = 0;
+        size_t partitionSize = 0;
+        size_t fftSize = 0;
+        size_t numBins = 0;
+        size_t numSlots = 0;
+        size_t offset = 0;
+        // The output of each voice is written a few partitions ahead in a circular buffer
+        size_t outputLength = 0;
+        std::unique_ptr<juce::dsp::FFT> fft;
+        // The input spectra, for each partition slot the channels are stored next to each other
+        std::vector<float> history;
+        size_t currentSlot = 0;
+        std::vector<float> fftBuffer;
+        std::vector<float> spectrum;
+        std::array<std::vector<float>, 2> overlaps;
+        std::array<std::vector<float>, 2> outputs;
+        // The impulse response each voice used for the previous job, its overlap is dropped when it changes
+        std::array<const PartitionedIR*, 2> previousIRs {};
+        // The impulse responses of the voices when each queued job was queued
+        std::array<std::array<const PartitionedIR*, 2>, MHV_TAIL_JOB_QUEUE_SIZE> queuedIRs {};
+        // Whether the channels were linked when each queued job was queued
+        std::array<bool, MHV_TAIL_JOB_QUEUE_SIZE> queuedLinks {};
+        // When the output of each queued job is needed, in high resolution ticks, and how long after it's queued that is
+        std::array<std::atomic<juce::int64>, MHV_TAIL_JOB_QUEUE_SIZE> deadlines {};
+        juce::int64 deadlineTicks = 0;
+        std::atomic<juce::int64> numQueued { 0 };
+        std::atomic<juce::int64> numCompleted { 0 };
+        std::atomic<bool> busy { false };
+    };
+    class Worker;
+    // Internal method used to run the next job of a segment, the caller must hold its busy flag.
+    // The time it took is added to the counter
+    void runNextJob(Segment& segment, std::atomic<juce::int64>& ticks) noexcept;
+    // Internal method used to make sure a job is done, the audio thread runs it itself if the worker didn't start it,
+    // and otherwise waits for the realtime thread running it
+    void join(Segment& segment, const juce::int64 job) noexcept;
+    // Internal method used to leave the pool or stop the worker
+    void stopWorker();
+    // Internal method used to wake up a thread of the pool, or the worker, for a queued job. It never locks
+    void wakeWorker() noexcept;
+// Variables
+private:
+    size_t m_numChannels = 0;
+    // The input of every channel in a circular buffer, long enough for the oldest job that may still run
+    std::vector<float> m_inputs;
+    size_t m_inputLength = 0;
+    // The number of samples processed since the last reset
+    juce::int64 m_position = 0;
+    std::vector<std::unique_ptr<Segment>> m_segments;
+    juce::SharedResourcePointer<SharedConvolutionPool> m_pool;
+    bool m_inPool = false;
+    // Posted for the worker once per queued job, when the tail isn't in the pool
+    Semaphore m_semaphore;
+    std::unique_ptr<Worker> m_worker;
+    // The time spent on the jobs, in high resolution ticks
+    std::atomic<juce::int64> m_workerTicks { 0 };
+    std::atomic<juce::int64> m_inlineTicks { 0 };
+    std::atomic<juce::uint64> m_missedDeadlines { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ConvolutionTail)
+};
@@ -0,0 +1,68 @@
+#include "DisplayFeed.h"
+
+bool DisplayFeed::claim() noexcept
+{
+    bool expected = false;
+    if (!m_isClaimed.compare_exchange_strong(expected, true))
+        return false;
+    // Whatever was left by the previous reader is stale, and the new one has no overview to draw yet
+    Levels levels;
+    popLevels(levels);
+    Overview overview;
+    popOverview(overview);
+    m_overviewRequested = true;
+    return true;
+}
+
+void DisplayFeed::release() noexcept
+{
+    m_isClaimed = false;
+}
+
+bool DisplayFeed::takeOverviewRequest() noexcept
+{
+    return m_overviewRequested.load(std::memory_order_relaxed) && m_overviewRequested.exchange(false);
+}
+
+void DisplayFeed::pushLevels(const Levels& levels) noexcept
+{
+    const auto scope = m_levelFifo.write(1);
+    if (scope.blockSize1 > 0)
+        m_levels[(size_t)scope.startIndex1] = levels;
+}
+
+void DisplayFeed::pushOverview(const Overview& overview) noexcept
+{
+    const auto scope = m_overviewFifo.write(1);
+    if (scope.blockSize1 > 0)
+        m_overviews[(size_t)scope.startIndex1] = overview;
+}
+
+bool DisplayFeed::popLevels(Levels& levels) noexcept
+{
+    const auto numReady = m_levelFifo.getNumReady();
+    if (numReady == 0)
+        return false;
+    levels = {};
+    auto scope = m_levelFifo.read(numReady);
+    scope.forEach([this, &levels](const int index)
+    {
+        const auto& block = m_levels[(size_t)index];
+        levels.input = juce::jmax(levels.input, block.input);
+        levels.wet = juce::jmax(levels.wet, block.wet);
+        levels.output = juce::jmax(levels.output, block.output);
+    });
+    return true;
+}
+
+bool DisplayFeed::popOverview(Overview& overview) noexcept
+{
+    const auto numReady = m_overviewFifo.getNumReady();
+    if (numReady == 0)
+        return false;
+    int start1, size1, start2, size2;
+    m_overviewFifo.prepareToRead(numReady, start1, size1, start2, size2);
+    overview = m_overviews[(size_t)(size2 > 0 ? start2 + size2 - 1 : start1 + size1 - 1)];
+    m_overviewFifo.finishedRead(numReady);
+    return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <juce_core/juce_core.h>
+#include "PartitionedIR.h"
+
+// How many blocks of levels can wait for the editor, a few seconds' worth at the usual block sizes
+#define MHV_LEVEL_QUEUE_SIZE 512
+// How many impulse response overviews can wait for the editor, only the last one is drawn
+#define MHV_OVERVIEW_QUEUE_SIZE 4
+
+// This class carries what the editor displays from the audio thread to the message thread: the peak levels
+// of every block and the overview of the impulse response in use. Both go through single producer single
+// consumer FIFOs, so neither side ever waits for the other, and the audio thread drops what doesn't fit.
+// There's a single reader: an editor must claim the feed before reading it, so a second editor of the same
+// processor can't take the levels away from the first one. The audio thread only measures while it's claimed.
+class DisplayFeed
+{
+// Methods
+public:
+    // The peaks of one block, as linear gains
+    struct Levels
+    {
+        float input = 0.0f;
+        float wet = 0.0f;
+        float output = 0.0f;
+    };
+    using Overview = std::array<float, MHV_IR_OVERVIEW_SIZE>;
+
+    // Makes the caller the reader, returns false if another one already is. Called from the message thread
+    bool claim() noexcept;
+    // Lets another reader claim the feed, the audio thread stops measuring until it does
+    void release() noexcept;
+    // Returns true while a reader has claimed the feed, the audio thread skips the metering otherwise
+    bool isClaimed() const noexcept { return m_isClaimed.load(std::memory_order_relaxed); }
+    // Returns true once after a reader claimed the feed, the audio thread then pushes the current overview
+    bool takeOverviewRequest() noexcept;
+    // Pushes the levels of a block, called from the audio thread
+    void pushLevels(const Levels& levels) noexcept;
+    // Pushes the overview of the impulse response the engine was given, called from the audio thread
+    void pushOverview(const Overview& overview) noexcept;
+    // Gets the highest levels pushed since the last call, returns false if there were none. Called by the reader
+    bool popLevels(Levels& levels) noexcept;
+    // Gets the last overview pushed since the last call, returns false if there was none. Called by the reader
+    bool popOverview(Overview& overview) noexcept;
+// Variables
+private:
+    std::atomic<bool> m_isClaimed { false };
+    std::atomic<bool> m_overviewRequested { false };
+    juce::AbstractFifo m_levelFifo { MHV_LEVEL_QUEUE_SIZE };
+    std::array<Levels, MHV_LEVEL_QUEUE_SIZE> m_levels;
+    juce::AbstractFifo m_overviewFifo { MHV_OVERVIEW_QUEUE_SIZE };
+    std::array<Overview, MHV_OVERVIEW_QUEUE_SIZE> m_overviews;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DisplayFeed)
+};
@@ -0,0 +1,226 @@
+#include "GainMixer.h"
+#include "SpectralKernels.h"
+
+// The vectorised kernels only exist for floats, the compiler vectorises the double loops on its own
+static void scaleSamples(float* output, const float* a, const float gain, const float step, const size_t numSamples) noexcept
+{
+    SpectralKernels::get().scale(output, a, gain, step, numSamples);
+}
+
+static void scaleSamples(double* output, const double* a, const double gain, const double step, const size_t numSamples) noexcept
+{
+    for (size_t i = 0; i < numSamples; i++)
+        output[i] = a[i] * (gain + (double)i * step);
+}
+
+static void mixSamples(float* output, const float* a, const float aGain, const float aStep,
+                       const float* b, const float bGain, const float bStep, const size_t numSamples) noexcept
+{
+    SpectralKernels::get().mix(output, a, aGain, aStep, b, bGain, bStep, numSamples);
+}
+
+static void mixSamples(double* output, const double* a, const double aGain, const double aStep,
+                       const double* b, const double bGain, const double bStep, const size_t numSamples) noexcept
+{
+    for (size_t i = 0; i < numSamples; i++)
+        output[i] = a[i] * (aGain + (double)i * aStep) + b[i] * (bGain + (double)i * bStep);
+}
+
+template <typename SampleType>
+void GainMixer<SampleType>::Ramp::setTarget(const SampleType newTarget, const size_t rampLength) noexcept
+{
+    if (juce::approximatelyEqual(newTarget, target))
+        return;
+    target = newTarget;
+    if (rampLength == 0)
+    {
+        reset();
+        return;
+    }
+    step = (target - current) / (SampleType)rampLength;
+    samplesLeft = rampLength;
+}
+
+template <typename SampleType>
+void GainMixer<SampleType>::Ramp::reset() noexcept
+{
+    current = target;
+    step = 0;
+    samplesLeft = 0;
+}
+
+template <typename SampleType>
+size_t GainMixer<SampleType>::Ramp::getLinearLength(const size_t numSamples) const noexcept
+{
+    return samplesLeft > 0 ? juce::jmin(samplesLeft, numSamples) : numSamples;
+}
+
+template <typename SampleType>
+void GainMixer<SampleType>::Ramp::advance(const size_t numSamples) noexcept
+{
+    if (samplesLeft == 0)
+        return;
+    samplesLeft -= juce::jmin(samplesLeft, numSamples);
+    // The target is set exactly at the end, so the rounding errors don't build up
+    if (samplesLeft == 0)
+        reset();
+    else
+        current += (SampleType)numSamples * step;
+}
+
+template <typename SampleType>
+GainMixer<SampleType>::GainMixer()
+{
+    updateMixTargets();
+    reset();
+}
+
+template <typename SampleType>
+GainMixer<SampleType>::~GainMixer()
+{
+}
+
+template <typename SampleType>
+void GainMixer<SampleType>::prepare(const juce::dsp::ProcessSpec& spec, const size_t dryDelay)
+{
+    m_wetBuffer.setSize((int)spec.numChannels, (int)spec.maximumBlockSize);
+    m_dryDelayBuffer.setSize(dryDelay > 0 ? (int)spec.numChannels : 0, (int)dryDelay);
+    m_dryDelayBuffer.clear();
+    m_dryDelayPosition = 0;
+    m_rampLength = (size_t)(spec.sampleRate * MHV_GAIN_RAMP_SECONDS);
+    reset();
+}
+
+template <typename SampleType>
+void GainMixer<SampleType>::release()
+{
+    m_wetBuffer = juce::AudioBuffer<SampleType>();
+    m_dryDelayBuffer = juce::AudioBuffer<SampleType>();
+}
+
+template <typename SampleType>
+void GainMixer<SampleType>::reset() noexcept
+{
+    m_inputGain.reset();
+    m_dryGain.reset();
+    m_wetGain.reset();
+}
+
+template <typename SampleType>
+void GainMixer<SampleType>::setInputGainDecibels(const float gainDecibels) noexcept
+{
+    m_inputGain.setTarget(juce::Decibels::decibelsToGain((SampleType)gainDecibels), m_rampLength);
+}
+
+template <typename SampleType>
+void GainMixer<SampleType>::setOutputGainDecibels(const float gainDecibels) noexcept
+{
+    m_outputGain = juce::Decibels::decibelsToGain((SampleType)gainDecibels);
+    updateMixTargets();
+}
+
+template <typename SampleType>
+void GainMixer<SampleType>::setWetMixProportion(const float proportion) noexcept
+{
+    m_wetProportion = juce::jlimit((SampleType)0, (SampleType)1, (SampleType)proportion);
+    updateMixTargets();
+}
+
+template <typename SampleType>
+void GainMixer<SampleType>::updateMixTargets() noexcept
+{
+    // The balanced law, both signals are at full level in the middle
+    const auto half = (SampleType)0.5;
+    m_dryGain.setTarget(2 * juce::jmin(half, 1 - m_wetProportion), m_rampLength);
+    m_wetGain.setTarget(2 * juce::jmin(half, m_wetProportion) * m_outputGain, m_rampLength);
+}
+
+template <typename SampleType>
+size_t GainMixer<SampleType>::getMaximumBlockSize() const noexcept
+{
+    return (size_t)m_wetBuffer.getNumSamples();
+}
+
+template <typename SampleType>
+juce::dsp::AudioBlock<SampleType> GainMixer<SampleType>::getWetBlock(const size_t numChannels, const size_t numSamples) noexcept
+{
+    jassert(numSamples <= getMaximumBlockSize());
+    return juce::dsp::AudioBlock<SampleType>(m_wetBuffer)
+        .getSubsetChannelBlock(0, juce::jmin(numChannels, (size_t)m_wetBuffer.getNumChannels()))
+        .getSubBlock(0, numSamples);
+}
+
+template <typename SampleType>
+bool GainMixer<SampleType>::pushInputSamples(const juce::dsp::AudioBlock<const SampleType>& input, juce::dsp::AudioBlock<SampleType>& wetBlock) noexcept
+{
+    if (m_inputGain.samplesLeft == 0 && juce::approximatelyEqual(m_inputGain.current, (SampleType)1))
+        return false;
+
+    const auto numChannels = juce::jmin(input.getNumChannels(), wetBlock.getNumChannels());
+    const auto numSamples = juce::jmin(input.getNumSamples(), wetBlock.getNumSamples());
+    size_t start = 0;
+    while (start < numSamples)
+    {
+        // The ramp's value for a sample is the one it reaches after it
+        const auto length = m_inputGain.getLinearLength(numSamples - start);
+        for (size_t channel = 0; channel < numChannels; channel++)
+        {
+            scaleSamples(wetBlock.getChannelPointer(channel) + start, input.getChannelPointer(channel) + start,
+                         m_inputGain.current + m_inputGain.step, m_inputGain.step, length);
+        }
+        m_inputGain.advance(length);
+        start += length;
+    }
+    return true;
+}
+
+template <typename SampleType>
+void GainMixer<SampleType>::mixWetSamples(juce::dsp::AudioBlock<SampleType>& dryBlock, const juce::dsp::AudioBlock<const SampleType>& wetBlock) noexcept
+{
+    delayDrySamples(dryBlock);
+    const auto numChannels = juce::jmin(dryBlock.getNumChannels(), wetBlock.getNumChannels());
+    const auto numSamples = juce::jmin(dryBlock.getNumSamples(), wetBlock.getNumSamples());
+    size_t start = 0;
+    while (start < numSamples)
+    {
+        // Both ramps must keep their slope over the whole chunk
+        const auto length = m_wetGain.getLinearLength(m_dryGain.getLinearLength(numSamples - start));
+        for (size_t channel = 0; channel < numChannels; channel++)
+        {
+            auto* output = dryBlock.getChannelPointer(channel) + start;
+            mixSamples(output, output, m_dryGain.current + m_dryGain.step, m_dryGain.step,
+                       wetBlock.getChannelPointer(channel) + start, m_wetGain.current + m_wetGain.step, m_wetGain.step, length);
+        }
+        m_dryGain.advance(length);
+        m_wetGain.advance(length);
+        start += length;
+    }
+}
+
+template <typename SampleType>
+void GainMixer<SampleType>::delayDrySamples(juce::dsp::AudioBlock<SampleType>& dryBlock) noexcept
+{
+    const auto delay = (size_t)m_dryDelayBuffer.getNumSamples();
+    if (delay == 0)
+        return;
+
+    // Every sample is swapped with the one stored delay samples ago
+    const auto numChannels = juce::jmin(dryBlock.getNumChannels(), (size_t)m_dryDelayBuffer.getNumChannels());
+    const auto numSamples = dryBlock.getNumSamples();
+    for (size_t channel = 0; channel < numChannels; channel++)
+    {
+        auto* samples = dryBlock.getChannelPointer(channel);
+        auto* delayed = m_dryDelayBuffer.getWritePointer((int)channel);
+        auto position = m_dryDelayPosition;
+        for (size_t i = 0; i < numSamples; i++)
+        {
+            std::swap(samples[i], delayed[position]);
+            if (++position == delay)
+                position = 0;
+        }
+    }
+    m_dryDelayPosition = (m_dryDelayPosition + numSamples) % delay;
+}
+
+template class GainMixer<float>;
+template class GainMixer<double>;
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+
+// How long the gains take to reach a new value
+#define MHV_GAIN_RAMP_SECONDS 0.05
+
+// This class applies the input gain, the output gain and the dry/wet mix around the convolution engine.
+// It replaces two juce::dsp::Gain stages and a juce::dsp::DryWetMixer, which each made their own pass over
+// the block and only changed their gain at block boundaries. Here the input gain is applied while the
+// input is copied into the wet buffer, and the output gain and the balanced dry/wet law are applied
+// in the same pass that writes the output. The dry signal is read from the host's buffer, so it's never copied,
+// unless the wet path has a latency: it then goes through a delay line of the same length, so both stay aligned.
+// Every gain follows a linear per-sample ramp, so automating them doesn't produce zipper noise.
+// It works in the precision the host processes in, so the dry signal of a double precision host is never
+// rounded to floats.
+template <typename SampleType>
+class GainMixer
+{
+// Methods
+public:
+    GainMixer();
+    ~GainMixer();
+    // Allocates the wet buffer and the dry delay line, this must not be called from the audio thread
+    void prepare(const juce::dsp::ProcessSpec& spec, const size_t dryDelay = 0);
+    // Frees the buffers, when the host processes in the other precision
+    void release();
+    // Jumps to the target gains without ramping
+    void reset() noexcept;
+    // Sets the gain applied to the signal going into the convolution engine
+    void setInputGainDecibels(const float gainDecibels) noexcept;
+    // Sets the gain applied to the signal coming out of the convolution engine
+    void setOutputGainDecibels(const float gainDecibels) noexcept;
+    // Sets the dry/wet proportion, between 0 (dry only) and 1 (wet only)
+    void setWetMixProportion(const float proportion) noexcept;
+    // Returns the largest block the wet buffer can hold
+    size_t getMaximumBlockSize() const noexcept;
+    // Returns the wet buffer for the given block, the convolution engine writes its output there
+    juce::dsp::AudioBlock<SampleType> getWetBlock(const size_t numChannels, const size_t numSamples) noexcept;
+    // Copies the input with its gain into the wet block. It returns false and doesn't copy anything while the
+    // input gain is steady at unity, the engine can then read the input directly
+    bool pushInputSamples(const juce::dsp::AudioBlock<const SampleType>& input, juce::dsp::AudioBlock<SampleType>& wetBlock) noexcept;
+    // Writes the mix of the dry block and the wet block, with the output gain, to the dry block
+    void mixWetSamples(juce::dsp::AudioBlock<SampleType>& dryBlock, const juce::dsp::AudioBlock<const SampleType>& wetBlock) noexcept;
+private:
+    // A gain moving linearly towards its target
+    struct Ramp
+    {
+        SampleType current = 1;
+        SampleType target = 1;
+        SampleType step = 0;
+        size_t samplesLeft = 0;
+
+        // Sets the value the ramp moves to
+        void setTarget(const SampleType newTarget, const size_t rampLength) noexcept;
+        // Jumps to the target
+        void reset() noexcept;
+        // Returns how many samples keep the current slope, at most numSamples
+        size_t getLinearLength(const size_t numSamples) const noexcept;
+        // Moves the ramp forward
+        void advance(const size_t numSamples) noexcept;
+    };
+    // Internal method used to compute the dry and wet gains from the dry/wet proportion and the output gain
+    void updateMixTargets() noexcept;
+    // Internal method used to delay the dry signal in place by the wet path's latency
+    void delayDrySamples(juce::dsp::AudioBlock<SampleType>& dryBlock) noexcept;
+// Variables
+private:
+    juce::AudioBuffer<SampleType> m_wetBuffer;
+    // Holds the last dry samples for every channel, it's empty when the wet path has no latency
+    juce::AudioBuffer<SampleType> m_dryDelayBuffer;
+    size_t m_dryDelayPosition = 0;
+    size_t m_rampLength = 0;
+    SampleType m_outputGain = 1;
+    SampleType m_wetProportion = 0;
+    Ramp m_inputGain;
+    Ramp m_dryGain;
+    // The wet gain includes the output gain
+    Ramp m_wetGain;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (GainMixer)
+};
@@ -1,19 +1,68 @@
 #include "HelperStructs.h"
+#include <algorithm>
 
 IRData::IRData(const void* const iRdata, const size_t iRsize, const unsigned int iRindex)
     : data(iRdata), size(iRsize), index(iRindex)
 {
 }
 
-void ChainSettings::updateSettings(const ParamPointers& params)
+void ChainSettings::updateSettings(const ParamPointers& params, const juce::uint32 changes)
 {
     // Get the input and output gain as raw values as we'll be setting them using decibels
-    inputGain = params.inputGain->load();
-    outputGain = params.outputGain->load();
+    if (changes & (1 << ParamInputGain))
+        inputGain = params.inputGain->load();
+    if (changes & (1 << ParamOutputGain))
+        outputGain = params.outputGain->load();
     // Get the dry/wet mix as a normalised value as this is what the mixer expects
-    dryWet = params.dryWet->getValue();
+    if (changes & (1 << ParamDryWet))
+        dryWet = params.dryWet->getValue();
     // Get the impulse response raw value and cast it to an unsigned 
-    irIndex = (int)params.irIndex->load();
+    if (changes & (1 << ParamIRIndex))
+        irIndex = (int)params.irIndex->load();
+    if (changes & (1 << ParamUseUserIR))
+        useUserIR = params.useUserIR->load() >= 0.5f;
+    if (changes & (1 << ParamMorph))
+        morph = params.morph->load() >= 0.5f;
+    if (changes & (1 << ParamPosition))
+        position = params.position->load();
+    if (changes & (1 << ParamLayers))
+        layers = params.layers->load() >= 0.5f;
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        if (changes & (1 << (ParamNearLevel + (int)i)))
+            levels[i] = params.levels[i]->load();
+    }
+    if (changes & (1 << ParamPreDelay))
+        preDelay = params.preDelay->load();
+    if (changes & (1 << ParamLowCut))
+        lowCut = params.lowCut->load();
+    if (changes & (1 << ParamHighCut))
+        highCut = params.highCut->load();
+    if (changes & (1 << ParamTilt))
+        tilt = params.tilt->load();
+}
+
+void ChainSettings::setValue(const ParamPointers& params, const int paramIndex, const float plainValue)
+{
+    switch (paramIndex)
+    {
+        case ParamInputGain: inputGain = plainValue; break;
+        case ParamOutputGain: outputGain = plainValue; break;
+        case ParamDryWet: dryWet = params.dryWet->convertTo0to1(plainValue); break;
+        case ParamIRIndex: irIndex = juce::roundToInt(plainValue); break;
+        case ParamUseUserIR: useUserIR = plainValue >= 0.5f; break;
+        case ParamMorph: morph = plainValue >= 0.5f; break;
+        case ParamPosition: position = plainValue; break;
+        case ParamLayers: layers = plainValue >= 0.5f; break;
+        case ParamNearLevel:
+        case ParamFarLevel:
+        case ParamWhereverLevel: levels[(size_t)(paramIndex - ParamNearLevel)] = plainValue; break;
+        case ParamPreDelay: preDelay = plainValue; break;
+        case ParamLowCut: lowCut = plainValue; break;
+        case ParamHighCut: highCut = plainValue; break;
+        case ParamTilt: tilt = plainValue; break;
+        default: break;
+    }
 }
 
 bool ChainSettings::operator==(const ChainSettings& other)
@@ -21,13 +70,36 @@ bool ChainSettings::operator==(const ChainSettings& other)
     return (juce::approximatelyEqual(inputGain, other.inputGain) &&
             juce::approximatelyEqual(outputGain, other.outputGain) &&
             juce::approximatelyEqual(dryWet, other.dryWet) &&
-            irIndex == other.irIndex);
+            irIndex == other.irIndex &&
+            useUserIR == other.useUserIR &&
+            morph == other.morph &&
+            juce::approximatelyEqual(position, other.position) &&
+            layers == other.layers &&
+            std::equal(levels.begin(), levels.end(), other.levels.begin(),
+                       [](const float a, const float b) { return juce::approximatelyEqual(a, b); }) &&
+            juce::approximatelyEqual(preDelay, other.preDelay) &&
+            juce::approximatelyEqual(lowCut, other.lowCut) &&
+            juce::approximatelyEqual(highCut, other.highCut) &&
+            juce::approximatelyEqual(tilt, other.tilt));
 }
 
 ParamPointers::ParamPointers(juce::AudioProcessorValueTreeState& apvts)
     : inputGain(apvts.getRawParameterValue(MHV_PID_INPUT_GAIN)),
       outputGain(apvts.getRawParameterValue(MHV_PID_OUTPUT_GAIN)),
       dryWet(apvts.getParameter(MHV_PID_DRY_WET)),
-      irIndex(apvts.getRawParameterValue(MHV_PID_IR_INDEX))
+      irIndex(apvts.getRawParameterValue(MHV_PID_IR_INDEX)),
+      useUserIR(apvts.getRawParameterValue(MHV_PID_USE_USER_IR)),
+      morph(apvts.getRawParameterValue(MHV_PID_MORPH)),
+      position(apvts.getRawParameterValue(MHV_PID_POSITION)),
+      layers(apvts.getRawParameterValue(MHV_PID_LAYERS)),
+      levels({ apvts.getRawParameterValue(MHV_PID_NEAR_LEVEL), apvts.getRawParameterValue(MHV_PID_FAR_LEVEL),
+               apvts.getRawParameterValue(MHV_PID_WHEREVER_LEVEL) }),
+      preDelay(apvts.getRawParameterValue(MHV_PID_PRE_DELAY)),
+      lowCut(apvts.getRawParameterValue(MHV_PID_LOW_CUT)),
+      highCut(apvts.getRawParameterValue(MHV_PID_HIGH_CUT)),
+      tilt(apvts.getRawParameterValue(MHV_PID_TILT)),
+      eco(apvts.getRawParameterValue(MHV_PID_ECO)),
+      quality(apvts.getRawParameterValue(MHV_PID_QUALITY)),
+      latencyMode(apvts.getRawParameterValue(MHV_PID_LATENCY_MODE))
 {
 }
\ No newline at end of file
@@ -1,9 +1,18 @@
 #pragma once
 
+#include <array>
 #include <memory>
 #include <juce_audio_processors/juce_audio_processors.h>
 #include "ParamDefinitions.h"
 
+// The parameters the audio thread reads, in the order of their bits in a change mask
+// The levels of the layers follow each other, in the order of the embedded impulse responses
+enum ParamIndices { ParamInputGain = 0, ParamOutputGain, ParamDryWet, ParamIRIndex, ParamUseUserIR, ParamMorph, ParamPosition,
+                    ParamLayers, ParamNearLevel, ParamFarLevel, ParamWhereverLevel, ParamPreDelay,
+                    ParamLowCut, ParamHighCut, ParamTilt, ParamCount };
+// The change mask with every parameter
+#define MHV_ALL_PARAMS ((juce::uint32)((1 << ParamCount) - 1))
+
 // This struct represents the plugin's data tree parameter pointers
 struct ParamPointers
 {
@@ -11,6 +20,19 @@ struct ParamPointers
     std::atomic<float>* outputGain;
     juce::RangedAudioParameter* dryWet;
     std::atomic<float>* irIndex;
+    std::atomic<float>* useUserIR;
+    std::atomic<float>* morph;
+    std::atomic<float>* position;
+    std::atomic<float>* layers;
+    std::array<std::atomic<float>*, MHV_IR_COUNT> levels;
+    std::atomic<float>* preDelay;
+    std::atomic<float>* lowCut;
+    std::atomic<float>* highCut;
+    std::atomic<float>* tilt;
+    // Only read when the plugin is prepared
+    std::atomic<float>* eco;
+    std::atomic<float>* quality;
+    std::atomic<float>* latencyMode;
 
     ParamPointers(juce::AudioProcessorValueTreeState& apvts);
 };
@@ -22,12 +44,30 @@ struct ChainSettings
     float outputGain = MHV_PV_DEFAULT_GAIN;
     float dryWet = MHV_PV_DEFAULT_MIX;
     int irIndex = MHV_INVALID_IR_INDEX;
+    // When it's on, the user's impulse response plays instead of the selected one
+    bool useUserIR = MHV_PV_DEFAULT_USE_USER_IR;
+    // When the morph is on, the embedded impulse responses are blended at the position instead
+    bool morph = MHV_PV_DEFAULT_MORPH;
+    float position = MHV_PV_DEFAULT_POSITION;
+    // When the layers are on, the embedded impulse responses are stacked at their levels instead, whatever the morph
+    bool layers = MHV_PV_DEFAULT_LAYERS;
+    std::array<float, MHV_IR_COUNT> levels = { MHV_PV_DEFAULT_NEAR_LEVEL, MHV_PV_DEFAULT_LEVEL, MHV_PV_DEFAULT_LEVEL };
+    // The wet signal is delayed by this many milliseconds before the convolution
+    float preDelay = MHV_PV_DEFAULT_PRE_DELAY;
+    // The tone baked into the impulse response
+    float lowCut = MHV_PV_MIN_LOW_CUT;
+    float highCut = MHV_PV_MAX_HIGH_CUT;
+    float tilt = MHV_PV_DEFAULT_TILT;
 
     // Comparison operator overload to measure if two ChainSettings are equal
     bool operator==(const ChainSettings& other);
+    // Returns true if the engine plays a blend of the embedded impulse responses rather than the selected one
+    bool isBlending() const noexcept { return morph || layers; }
     
-    // Updates the settings with the new parameters values
-    void updateSettings(const ParamPointers& params);
+    // Updates the settings with the new values of the parameters in the change mask
+    void updateSettings(const ParamPointers& params, const juce::uint32 changes = MHV_ALL_PARAMS);
+    // Sets the setting of a parameter from its plain (not normalised) value
+    void setValue(const ParamPointers& params, const int paramIndex, const float plainValue);
 };
 
 // This struct represents the impulse response data
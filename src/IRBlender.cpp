@@ -0,0 +1,240 @@
+#include "IRBlender.h"
+#include <algorithm>
+#include <cmath>
+
+// The thread blending the impulse responses. It sleeps until the audio thread sets new weights, and only
+// polls while replaced blends wait to be freed
+class IRBlender::Worker final : public juce::Thread
+{
+public:
+    explicit Worker(IRBlender& blender)
+        : juce::Thread("Impulse response blend"), m_blender(blender)
+    {
+        startThread(juce::Thread::Priority::low);
+    }
+
+    ~Worker() override
+    {
+        signalThreadShouldExit();
+        m_blender.m_wakeUp.signal();
+        stopThread(-1);
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            bool blended = false;
+            bool hasRetired = false;
+            {
+                const juce::ScopedLock lock(m_blender.m_lock);
+                blended = m_blender.processRequests();
+                m_blender.m_publisher.collectGarbage();
+                hasRetired = m_blender.m_publisher.hasRetired();
+            }
+            // It waits even after a blend, so a sweep is blended at most once per poll
+            if (blended)
+                wait(MHV_BLEND_POLL_MS);
+            else
+                m_blender.m_wakeUp.wait(hasRetired ? MHV_BLEND_POLL_MS : -1);
+        }
+    }
+
+private:
+    IRBlender& m_blender;
+};
+
+// Returns the channel of a source feeding a channel of the blend, or -1 if none does
+static int getSourceChannel(const PartitionedIR& source, const bool trueStereo, const size_t channel)
+{
+    if (!trueStereo || source.isTrueStereo())
+        return (int)(channel % source.numChannels);
+    // In an impulse response that isn't true stereo, an input doesn't feed the other output
+    const auto input = channel / 2;
+    const auto output = channel % 2;
+    return input == output ? (int)source.getChannel(output, output) : -1;
+}
+
+IRBlender::IRBlender(const IRPublisher::Usage& usage)
+    : m_publisher(usage)
+{
+    m_blendedWeights.fill(std::numeric_limits<float>::quiet_NaN());
+}
+
+IRBlender::~IRBlender()
+{
+    m_worker.reset();
+}
+
+void IRBlender::prepare(const std::array<std::shared_ptr<const PartitionedIR>, MHV_IR_COUNT>& sources)
+{
+    const juce::ScopedLock lock(m_lock);
+    // An instance that's never prepared, like one a host creates to scan the plugin, never starts the thread
+    if (m_worker == nullptr)
+        m_worker = std::make_unique<Worker>(*this);
+    m_sources = sources;
+    // The blend is made again for the new settings, so the engine gets it as soon as it's prepared
+    m_blendedWeights.fill(std::numeric_limits<float>::quiet_NaN());
+    processRequests();
+}
+
+void IRBlender::setWeights(const std::array<float, MHV_IR_COUNT>& weights, const bool normalise) noexcept
+{
+    // There's a single writer, the sequence tells the blending thread when it may have read a mix of old and new weights
+    m_weightsSequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < weights.size(); i++)
+        m_weights[i].store(weights[i], std::memory_order_relaxed);
+    m_normalise.store(normalise, std::memory_order_relaxed);
+    m_weightsSequence.fetch_add(1, std::memory_order_release);
+    m_wakeUp.signal();
+}
+
+bool IRBlender::readWeights(std::array<float, MHV_IR_COUNT>& weights, bool& normalise) const noexcept
+{
+    const auto sequence = m_weightsSequence.load(std::memory_order_acquire);
+    if ((sequence & 1) != 0)
+        return false;
+    for (size_t i = 0; i < weights.size(); i++)
+        weights[i] = m_weights[i].load(std::memory_order_relaxed);
+    normalise = m_normalise.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return m_weightsSequence.load(std::memory_order_relaxed) == sequence;
+}
+
+std::shared_ptr<const PartitionedIR> IRBlender::find(const PartitionedIR* ir) const
+{
+    const juce::ScopedLock lock(m_lock);
+    return m_publisher.find(ir);
+}
+
+std::array<float, MHV_IR_COUNT> IRBlender::getWeights(const float position) noexcept
+{
+    // Every impulse response fades in from its neighbours' positions. The recordings are uncorrelated, so their powers
+    // add up: the weights follow a quarter of a cosine and a sine, whose squares always sum to 1, and the blend doesn't
+    // dip by 3 dB halfway like it would with linear weights
+    const auto clampedPosition = juce::jlimit(0.0f, (float)(MHV_IR_COUNT - 1), position);
+    std::array<float, MHV_IR_COUNT> weights {};
+    for (size_t i = 0; i < weights.size(); i++)
+    {
+        const auto distance = std::abs(clampedPosition - (float)i);
+        weights[i] = distance < 1.0f ? std::cos(distance * juce::MathConstants<float>::halfPi) : 0.0f;
+    }
+    return weights;
+}
+
+std::shared_ptr<const PartitionedIR> IRBlender::blend(const std::array<std::shared_ptr<const PartitionedIR>, MHV_IR_COUNT>& sources,
+                                                      const std::array<float, MHV_IR_COUNT>& weights)
+{
+    // The impulse responses without weight are left out, the longest one gives the layout
+    // and the heaviest one the late tail's networks
+    size_t numUsed = 0;
+    const PartitionedIR* longest = nullptr;
+    size_t heaviest = 0;
+    size_t numChannels = 0;
+    size_t decayLength = 0;
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        if (sources[i] == nullptr || weights[i] <= 0.0f)
+            continue;
+        numUsed++;
+        if (longest == nullptr || sources[i]->lengthInSamples > longest->lengthInSamples)
+            longest = sources[i].get();
+        if (sources[heaviest] == nullptr || weights[i] > weights[heaviest])
+            heaviest = i;
+        numChannels = juce::jmax(numChannels, sources[i]->numChannels);
+        decayLength = juce::jmax(decayLength, sources[i]->decayLengthInSamples);
+    }
+    if (numUsed == 0)
+        return nullptr;
+    // A single impulse response at full weight is used as it is
+    if (numUsed == 1 && juce::approximatelyEqual(weights[heaviest], 1.0f))
+        return sources[heaviest];
+
+    auto ir = std::make_shared<PartitionedIR>();
+    ir->numChannels = numChannels;
+    ir->lengthInSamples = longest->lengthInSamples;
+    ir->decayLengthInSamples = decayLength;
+    ir->sampleRate = longest->sampleRate;
+    // The networks can't be blended, the heaviest one's play at the level of all the weighted tails, so the
+    // late tail follows the weights instead of jumping to full level, and only its decay switches at the midpoints
+    if (sources[heaviest]->lateReverb != nullptr)
+    {
+        std::vector<std::pair<const LateReverb*, float>> weighted;
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            if (sources[i] != nullptr && weights[i] > 0.0f)
+                weighted.emplace_back(sources[i]->lateReverb.get(), weights[i]);
+        }
+        ir->lateReverb = sources[heaviest]->lateReverb->withBlendedLevels(weighted);
+    }
+    ir->segments = PartitionedIR::getLayout(longest->segments.front().partitionSize, ir->lengthInSamples);
+    for (auto& segment : ir->segments)
+        segment.spectra.assign(ir->numChannels * segment.numPartitions * 2 * segment.numBins, 0.0f);
+
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        if (sources[i] == nullptr || weights[i] <= 0.0f)
+            continue;
+        const auto& source = *sources[i];
+        // The layout of a shorter impulse response is a prefix of the longest one's
+        for (size_t s = 0; s < source.segments.size(); s++)
+        {
+            const auto& from = source.segments[s];
+            const auto& to = ir->segments[s];
+            for (size_t channel = 0; channel < ir->numChannels; channel++)
+            {
+                const auto sourceChannel = getSourceChannel(source, ir->isTrueStereo(), channel);
+                if (sourceChannel < 0)
+                    continue;
+                for (size_t partition = 0; partition < from.numPartitions; partition++)
+                {
+                    auto* spectrum = const_cast<float*>(to.getPartition(channel, partition));
+                    juce::FloatVectorOperations::addWithMultiply(spectrum, from.getPartition((size_t)sourceChannel, partition),
+                                                                 weights[i], (int)(2 * from.numBins));
+                }
+            }
+        }
+        // The overview is only drawn, blending the peaks is close enough
+        for (size_t slice = 0; slice < ir->overview.size(); slice++)
+            ir->overview[slice] += weights[i] * source.overview[slice];
+    }
+    // Its peak is 1, like the sources'
+    const auto overviewPeak = *std::max_element(ir->overview.begin(), ir->overview.end());
+    if (overviewPeak > 0.0f)
+    {
+        for (auto& slice : ir->overview)
+            slice /= overviewPeak;
+    }
+    return ir;
+}
+
+std::array<float, MHV_IR_COUNT> IRBlender::normalise(const std::array<float, MHV_IR_COUNT>& levels) noexcept
+{
+    // The sources are about as loud as each other, and the energies of uncorrelated signals add up,
+    // so the levels are scaled to a unit sum of squares
+    float squaredLevels = 0.0f;
+    for (const auto level : levels)
+        squaredLevels += level * level;
+    std::array<float, MHV_IR_COUNT> weights {};
+    if (squaredLevels <= 0.0f)
+        return weights;
+    const auto scale = 1.0f / std::sqrt(squaredLevels);
+    for (size_t i = 0; i < levels.size(); i++)
+        weights[i] = levels[i] * scale;
+    return weights;
+}
+
+bool IRBlender::processRequests()
+{
+    std::array<float, MHV_IR_COUNT> weights;
+    bool normaliseWeights = false;
+    if (m_sources.front() == nullptr || !readWeights(weights, normaliseWeights)
+        || (weights == m_blendedWeights && normaliseWeights == m_blendedNormalise))
+        return false;
+    m_blendedWeights = weights;
+    m_blendedNormalise = normaliseWeights;
+    // Without any weight the blend returns nothing, and the engine is left to the selected impulse response
+    m_publisher.publish(blend(m_sources, normaliseWeights ? normalise(weights) : weights));
+    return true;
+}
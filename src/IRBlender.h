@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <juce_core/juce_core.h>
+#include "ParamDefinitions.h"
+#include "IRPublisher.h"
+#include "Semaphore.h"
+
+// The shortest time between two blends, so a fast sweep is blended at most this often. It's also how often
+// the blending thread looks for blends it can free, while some wait to be
+#define MHV_BLEND_POLL_MS 20
+
+// This class blends the embedded impulse responses on a background thread, for the morph and the layers.
+// The morph position goes from the first one (0) to the last one (MHV_IR_COUNT - 1), and a position between two of
+// them blends their partition spectra at a constant power. The layers give each one a level, and their sum is normalised so
+// it's as loud as a single one. The transform is linear, so this is the same as blending the impulse responses
+// themselves, without any FFT: the engine keeps running a single convolution whatever the weights, and crossfades
+// to every new blend like it does to any new impulse response. The blends are handed to the audio thread with an
+// atomic pointer and retired like the user's impulse responses (see IRPublisher).
+// In the hybrid mode the early parts are blended and the late tail is played by the networks of the heaviest one,
+// at the level of the weighted sum of all the tails. The thread is started when the blender is first prepared,
+// and sleeps until the audio thread sets new weights.
+class IRBlender
+{
+// Methods
+public:
+    // The usage is where the audio thread says which impulse responses the engine still points to
+    explicit IRBlender(const IRPublisher::Usage& usage);
+    ~IRBlender();
+    // Sets the impulse responses to blend, all prepared with the same settings, and blends them with the current
+    // weights. This blocks and allocates, so it must not be called from the audio thread
+    void prepare(const std::array<std::shared_ptr<const PartitionedIR>, MHV_IR_COUNT>& sources);
+    // Sets the weights the blending thread works towards, normalised or used as they are. It only stores them and
+    // wakes the blending thread up, without locking, so it's safe on the audio thread. Without any weight the blending
+    // stops, and the last blend is freed once the engine is done with it
+    void setWeights(const std::array<float, MHV_IR_COUNT>& weights, const bool normalise) noexcept;
+    // Returns the blend ready for the engine, or nullptr if there's none. Called from the audio thread
+    const PartitionedIR* get() const noexcept { return m_publisher.get(); }
+    // Returns a number that changes each time a new blend is published
+    juce::uint32 getVersion() const noexcept { return m_publisher.getVersion(); }
+    // Returns an impulse response this class published, if it's still held (published or waiting to be freed), or nullptr.
+    // It's used by the threads that build on it, this takes a lock so it must not be called from the audio thread
+    std::shared_ptr<const PartitionedIR> find(const PartitionedIR* ir) const;
+    // Returns the weight of every impulse response at a morph position
+    static std::array<float, MHV_IR_COUNT> getWeights(const float position) noexcept;
+    // Scales levels so the blend is as loud as a single impulse response, the recordings of a room at different
+    // places being uncorrelated. A single level is scaled to 1, whatever it is
+    static std::array<float, MHV_IR_COUNT> normalise(const std::array<float, MHV_IR_COUNT>& levels) noexcept;
+    // Returns the blend of impulse responses prepared with the same settings, with the given weights
+    static std::shared_ptr<const PartitionedIR> blend(const std::array<std::shared_ptr<const PartitionedIR>, MHV_IR_COUNT>& sources,
+                                                      const std::array<float, MHV_IR_COUNT>& weights);
+private:
+    class Worker;
+    // Internal method used to blend for the current weights if they changed, returns true if it did
+    bool processRequests();
+    // Internal method used to read the weights, returns false if they were being written
+    bool readWeights(std::array<float, MHV_IR_COUNT>& weights, bool& normalise) const noexcept;
+// Variables
+private:
+    // Guards everything but the atomics, it's never taken on the audio thread
+    mutable juce::CriticalSection m_lock;
+    std::array<std::shared_ptr<const PartitionedIR>, MHV_IR_COUNT> m_sources;
+    // The weights the audio thread asks for. The sequence is odd while they're written, a read that saw it change
+    // is tried again once the audio thread wakes the blending thread up after writing them
+    std::array<std::atomic<float>, MHV_IR_COUNT> m_weights {};
+    std::atomic<bool> m_normalise { false };
+    std::atomic<juce::uint32> m_weightsSequence { 0 };
+    // The weights of the current blend, NaN before the first one
+    std::array<float, MHV_IR_COUNT> m_blendedWeights {};
+    bool m_blendedNormalise = false;
+    IRPublisher m_publisher;
+    WakeUpSignal m_wakeUp;
+    std::unique_ptr<Worker> m_worker;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (IRBlender)
+};
@@ -0,0 +1,44 @@
+#include "IRCache.h"
+
+void IRCache::prepare(const std::array<const IRData, MHV_IR_COUNT>& irDataArray, const double sampleRate, const size_t partitionSize,
+                      const bool hybrid)
+{
+    if (juce::approximatelyEqual(sampleRate, m_sampleRate) && partitionSize == m_partitionSize && hybrid == m_hybrid)
+        return;
+
+    // The impulse responses another instance already prepared for these settings are shared,
+    // the old ones are freed here unless another instance still uses them
+    for (const auto& irData : irDataArray)
+    {
+        m_partitionedIRs[irData.index] = m_store->get(irData, sampleRate, partitionSize, true, hybrid);
+    }
+    m_sampleRate = sampleRate;
+    m_partitionSize = partitionSize;
+    m_hybrid = hybrid;
+}
+
+const PartitionedIR* IRCache::get(const unsigned int index) const noexcept
+{
+    if (index >= m_partitionedIRs.size())
+        return nullptr;
+    return m_partitionedIRs[index].get();
+}
+
+double IRCache::getMaxBandwidth(const std::array<const IRData, MHV_IR_COUNT>& irDataArray)
+{
+    double maxBandwidth = 0.0;
+    for (const auto& irData : irDataArray)
+        maxBandwidth = juce::jmax(maxBandwidth, m_store->getBandwidth(irData));
+    return maxBandwidth;
+}
+
+size_t IRCache::getMaxLength() const noexcept
+{
+    size_t maxLength = 0;
+    for (const auto& partitionedIR : m_partitionedIRs)
+    {
+        if (partitionedIR != nullptr)
+            maxLength = juce::jmax(maxLength, partitionedIR->lengthInSamples);
+    }
+    return maxLength;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include "ParamDefinitions.h"
+#include "HelperStructs.h"
+#include "PartitionedIR.h"
+#include "SharedIRStore.h"
+
+// This class holds the embedded impulse responses already decoded, resampled to the session's
+// sample rate, normalised and partitioned. It's built in prepareToPlay, so selecting an impulse
+// response on the audio thread is only a lookup. The impulse responses come from the process-wide
+// SharedIRStore, so instances running with the same settings share them.
+class IRCache
+{
+// Methods
+public:
+    // Builds all the impulse responses, this decodes and allocates so it must not be called from the audio thread.
+    // Nothing is rebuilt if the sample rate, the partition size and the hybrid mode didn't change
+    void prepare(const std::array<const IRData, MHV_IR_COUNT>& irDataArray, const double sampleRate, const size_t partitionSize,
+                 const bool hybrid);
+    // Returns the prepared impulse response, or nullptr if the cache wasn't prepared yet
+    const PartitionedIR* get(const unsigned int index) const noexcept;
+    // Returns all the prepared impulse responses, they're null before prepare()
+    const std::array<std::shared_ptr<const PartitionedIR>, MHV_IR_COUNT>& getAll() const noexcept { return m_partitionedIRs; }
+    // Returns the length of the longest impulse response
+    size_t getMaxLength() const noexcept;
+    // Returns the widest bandwidth of the impulse responses, it can be called before prepare()
+    double getMaxBandwidth(const std::array<const IRData, MHV_IR_COUNT>& irDataArray);
+// Variables
+private:
+    juce::SharedResourcePointer<SharedIRStore> m_store;
+    std::array<std::shared_ptr<const PartitionedIR>, MHV_IR_COUNT> m_partitionedIRs;
+    double m_sampleRate = 0.0;
+    size_t m_partitionSize = 0;
+    bool m_hybrid = false;
+};
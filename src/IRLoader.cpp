@@ -0,0 +1,224 @@
+#include "IRLoader.h"
+#include <juce_dsp/juce_dsp.h>
+#include "IRPack.h"
+
+// Returns a copy of an entry's samples, the pack itself is read only
+static juce::AudioBuffer<float> copyFromPack(const IRData& irData, const IRPack::Entry& entry)
+{
+    const auto samples = IRPack::getSamples(irData.data, entry);
+    juce::AudioBuffer<float> buffer((int)samples.numChannels, (int)samples.numSamples);
+    juce::dsp::AudioBlock<float>(buffer).copyFrom(samples.getBlock());
+    return buffer;
+}
+
+juce::AudioBuffer<float> IRLoader::decode(const IRData& irData, double& sourceSampleRate)
+{
+    // A pack holds the impulse response as it was recorded, only its tail is cut
+    IRPack::Entry entry;
+    if (IRPack::findNative(irData.data, irData.size, irData.index, entry))
+    {
+        sourceSampleRate = entry.sampleRate;
+        return copyFromPack(irData, entry);
+    }
+
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    // The stream doesn't own the data, the impulse responses are embedded in the binary
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(std::make_unique<juce::MemoryInputStream>(irData.data, irData.size, false)));
+    if (reader == nullptr)
+        return {};
+
+    juce::AudioBuffer<float> buffer((int)reader->numChannels, (int)reader->lengthInSamples);
+    reader->read(&buffer, 0, buffer.getNumSamples(), 0, true, true);
+    sourceSampleRate = reader->sampleRate;
+    return buffer;
+}
+
+juce::AudioBuffer<float> IRLoader::decodeFile(const juce::File& file, double& sourceSampleRate, const double maxSeconds,
+                                              const std::function<bool()>& shouldStop, juce::String& error)
+{
+    // The mapping must outlive the reader, the stream reads straight from it
+    juce::MemoryMappedFile mappedFile(file, juce::MemoryMappedFile::readOnly);
+    if (mappedFile.getData() == nullptr)
+    {
+        error = "can't open " + file.getFullPathName();
+        return {};
+    }
+
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(std::make_unique<juce::MemoryInputStream>(mappedFile.getData(), mappedFile.getSize(), false)));
+    if (reader == nullptr || reader->numChannels == 0 || reader->lengthInSamples <= 0 || reader->sampleRate <= 0.0)
+    {
+        error = file.getFileName() + " isn't an audio file that can be read";
+        return {};
+    }
+
+    const auto numChannels = reader->numChannels == 1 || reader->numChannels == 4 ? (int)reader->numChannels : 2;
+    const auto length = (int)juce::jmin(reader->lengthInSamples, (juce::int64)(maxSeconds * reader->sampleRate));
+    juce::AudioBuffer<float> buffer(numChannels, length);
+
+    // The file is decoded in chunks, so a newer request doesn't have to wait for a long file
+    const int chunkSize = 65536;
+    for (int start = 0; start < length; start += chunkSize)
+    {
+        if (shouldStop())
+            return {};
+        const auto numSamples = juce::jmin(chunkSize, length - start);
+        reader->read(&buffer, start, numSamples, start, true, numChannels > 1);
+    }
+    sourceSampleRate = reader->sampleRate;
+    return buffer;
+}
+
+void IRLoader::trim(juce::AudioBuffer<float>& buffer, const double sampleRate, const float floorDecibels)
+{
+    const auto length = buffer.getNumSamples();
+    if (length == 0 || floorDecibels >= 0.0f)
+        return;
+
+    // The energy of every sample, over all the channels
+    std::vector<double> energies((size_t)length, 0.0);
+    for (int channel = 0; channel < buffer.getNumChannels(); channel++)
+    {
+        const auto* samples = buffer.getReadPointer(channel);
+        for (int i = 0; i < length; i++)
+            energies[(size_t)i] += (double)samples[i] * (double)samples[i];
+    }
+    double totalEnergy = 0.0;
+    for (const auto energy : energies)
+        totalEnergy += energy;
+    if (totalEnergy <= 0.0)
+        return;
+    const auto floorEnergy = totalEnergy * std::pow(10.0, (double)floorDecibels / 10.0);
+
+    // The start is where the energy before it stops being negligible
+    int start = 0;
+    for (double energyBefore = 0.0; start < length - 1 && energyBefore + energies[(size_t)start] <= floorEnergy; start++)
+        energyBefore += energies[(size_t)start];
+
+    // The end is where the energy left after it becomes negligible, like reading the Schroeder decay curve
+    int end = length;
+    for (double energyAfter = 0.0; end > start + 1 && energyAfter + energies[(size_t)end - 1] <= floorEnergy; end--)
+        energyAfter += energies[(size_t)end - 1];
+
+    if (start == 0 && end == length)
+        return;
+
+    juce::AudioBuffer<float> trimmed(buffer.getNumChannels(), end - start);
+    for (int channel = 0; channel < buffer.getNumChannels(); channel++)
+        trimmed.copyFrom(channel, 0, buffer, channel, start, end - start);
+
+    // A short fade out, so the cut doesn't click
+    if (end < length)
+    {
+        const auto fadeLength = juce::jmin(trimmed.getNumSamples(), juce::jmax(1, juce::roundToInt(sampleRate * MHV_IR_TRIM_FADE_SECONDS)));
+        trimmed.applyGainRamp(trimmed.getNumSamples() - fadeLength, fadeLength, 1.0f, 0.0f);
+    }
+    buffer = std::move(trimmed);
+}
+
+float IRLoader::getTrimFloorDecibels(const int trimChoice) noexcept
+{
+    // The order of the trim parameter's choices
+    const float floors[] = { 0.0f, -60.0f, -80.0f, -96.0f };
+    return floors[juce::jlimit(0, (int)std::size(floors) - 1, trimChoice)];
+}
+
+juce::AudioBuffer<float> IRLoader::resample(const juce::AudioBuffer<float>& buffer, const double sourceSampleRate, const double destSampleRate)
+{
+    if (juce::approximatelyEqual(sourceSampleRate, destSampleRate))
+        return buffer;
+
+    // Read the source through a resampling source, the ratio is how fast we move through the source
+    const auto ratio = sourceSampleRate / destSampleRate;
+    const auto finalSize = juce::roundToInt(juce::jmax(1.0, buffer.getNumSamples() / ratio));
+    juce::AudioBuffer<float> original(buffer);
+    juce::MemoryAudioSource memorySource(original, false);
+    juce::ResamplingAudioSource resamplingSource(&memorySource, false, buffer.getNumChannels());
+    resamplingSource.setResamplingRatio(ratio);
+    resamplingSource.prepareToPlay(finalSize, sourceSampleRate);
+
+    juce::AudioBuffer<float> result(buffer.getNumChannels(), finalSize);
+    resamplingSource.getNextAudioBlock(juce::AudioSourceChannelInfo(result));
+    return result;
+}
+
+double IRLoader::measureBandwidth(const juce::AudioBuffer<float>& buffer, const double sampleRate)
+{
+    const auto fftSize = 1 << MHV_IR_BANDWIDTH_FFT_ORDER;
+    const auto numBins = (size_t)fftSize / 2 + 1;
+    const auto hopSize = fftSize / 2;
+    juce::dsp::FFT fft(MHV_IR_BANDWIDTH_FFT_ORDER);
+    std::vector<float> window((size_t)fftSize);
+    juce::dsp::WindowingFunction<float>::fillWindowingTables(window.data(), (size_t)fftSize, juce::dsp::WindowingFunction<float>::hann, false);
+
+    // The power spectra of all the frames and channels are summed, a short impulse response is a single zero padded frame
+    std::vector<double> power(numBins, 0.0);
+    std::vector<float> frame(2 * (size_t)fftSize);
+    for (int channel = 0; channel < buffer.getNumChannels(); channel++)
+    {
+        const auto* samples = buffer.getReadPointer(channel);
+        for (int start = 0; start < juce::jmax(1, buffer.getNumSamples() - hopSize); start += hopSize)
+        {
+            std::fill(frame.begin(), frame.end(), 0.0f);
+            const auto length = juce::jmin(fftSize, buffer.getNumSamples() - start);
+            for (int i = 0; i < length; i++)
+                frame[(size_t)i] = samples[start + i] * window[(size_t)i];
+            fft.performFrequencyOnlyForwardTransform(frame.data(), true);
+            for (size_t bin = 0; bin < numBins; bin++)
+                power[bin] += (double)frame[bin] * (double)frame[bin];
+        }
+    }
+
+    double totalPower = 0.0;
+    for (const auto binPower : power)
+        totalPower += binPower;
+    if (totalPower <= 0.0)
+        return 0.0;
+
+    // Walk down from the top until the energy above is no longer negligible
+    const auto floorPower = totalPower * std::pow(10.0, MHV_IR_BANDWIDTH_FLOOR_DECIBELS / 10.0);
+    auto bin = numBins;
+    for (double powerAbove = 0.0; bin > 1 && powerAbove + power[bin - 1] <= floorPower; bin--)
+        powerAbove += power[bin - 1];
+    return (double)bin * sampleRate / (double)fftSize;
+}
+
+void IRLoader::normalise(juce::AudioBuffer<float>& buffer)
+{
+    // Find the channel with the most energy
+    float maxSumSquared = 0.0f;
+    for (int channel = 0; channel < buffer.getNumChannels(); channel++)
+    {
+        const auto* samples = buffer.getReadPointer(channel);
+        float sumSquared = 0.0f;
+        for (int i = 0; i < buffer.getNumSamples(); i++)
+            sumSquared += samples[i] * samples[i];
+        maxSumSquared = juce::jmax(maxSumSquared, sumSquared);
+    }
+
+    // Silent impulse responses are left alone
+    if (maxSumSquared <= 0.0f)
+        return;
+
+    buffer.applyGain(0.125f / std::sqrt(maxSumSquared));
+}
+
+juce::AudioBuffer<float> IRLoader::load(const IRData& irData, const double sampleRate, const bool normalise)
+{
+    // The common rates are in the pack already, normalised
+    IRPack::Entry entry;
+    if (IRPack::find(irData.data, irData.size, irData.index, sampleRate, normalise, entry))
+        return copyFromPack(irData, entry);
+
+    double sourceSampleRate = sampleRate;
+    auto buffer = IRLoader::decode(irData, sourceSampleRate);
+    if (buffer.getNumSamples() == 0)
+        return buffer;
+
+    buffer = IRLoader::resample(buffer, sourceSampleRate, sampleRate);
+    if (normalise)
+        IRLoader::normalise(buffer);
+    return buffer;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <functional>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include "HelperStructs.h"
+
+// How long the fade applied where the tail is cut lasts
+#define MHV_IR_TRIM_FADE_SECONDS 0.005
+// The bandwidth of an impulse response is where the energy above it falls below this level, relative to its total energy
+#define MHV_IR_BANDWIDTH_FLOOR_DECIBELS -60.0
+// The FFT order of the frames the bandwidth is measured with
+#define MHV_IR_BANDWIDTH_FFT_ORDER 12
+
+// This struct groups the helpers used to turn an impulse response file into a ready to use sample buffer
+struct IRLoader
+{
+    // Decodes the impulse response's audio file data, or copies it out of an impulse response pack (see IRPack.h),
+    // returns an empty buffer if the data can't be read
+    static juce::AudioBuffer<float> decode(const IRData& irData, double& sourceSampleRate);
+    // Decodes an impulse response file through a memory mapping, so the file is read without being copied first.
+    // Files longer than maxSeconds are cut, mono, stereo and true stereo (four channels) files are kept as they are
+    // and the others are reduced to their first two channels. shouldStop is checked between chunks, the
+    // decoding gives up (and returns an empty buffer) once it returns true
+    static juce::AudioBuffer<float> decodeFile(const juce::File& file, double& sourceSampleRate, const double maxSeconds,
+                                               const std::function<bool()>& shouldStop, juce::String& error);
+    // Removes the leading silence and cuts the tail once the energy left falls below the given floor, relative
+    // to the whole impulse response's energy. The channels are cut together so they stay aligned
+    static void trim(juce::AudioBuffer<float>& buffer, const double sampleRate, const float floorDecibels);
+    // Returns the energy floor of a trim choice, or 0 when the impulse response isn't trimmed
+    static float getTrimFloorDecibels(const int trimChoice) noexcept;
+    // Resamples the buffer from the source sample rate to the destination one
+    static juce::AudioBuffer<float> resample(const juce::AudioBuffer<float>& buffer, const double sourceSampleRate, const double destSampleRate);
+    // Returns the frequency above which the impulse response holds a negligible part of its energy,
+    // or 0 if it's silent. It's measured on the averaged spectrum of overlapping windowed frames
+    static double measureBandwidth(const juce::AudioBuffer<float>& buffer, const double sampleRate);
+    // Normalises the buffer the same way juce::dsp::Convolution does, so the wet level stays the same
+    static void normalise(juce::AudioBuffer<float>& buffer);
+    // Decodes, resamples and (unless asked not to) normalises the impulse response in one go. From a pack
+    // that holds it at the sample rate, it's only copied
+    static juce::AudioBuffer<float> load(const IRData& irData, const double sampleRate, const bool normalise = true);
+};
@@ -0,0 +1,148 @@
+#include "IRPack.h"
+#include <cstring>
+#include "IRLoader.h"
+#include "PartitionedIR.h"
+
+// Returns the offset rounded up to the pack's alignment
+static juce::uint64 alignOffset(const juce::uint64 offset) noexcept
+{
+    return (offset + MHV_IR_PACK_ALIGNMENT - 1) / MHV_IR_PACK_ALIGNMENT * MHV_IR_PACK_ALIGNMENT;
+}
+
+// Reads the header, returns false if the data isn't a pack of this version or its samples can't be read in place
+static bool readHeader(const void* data, const size_t size, IRPack::Header& header) noexcept
+{
+    if (data == nullptr || size < sizeof(IRPack::Header) || juce::ByteOrder::isBigEndian()
+        || reinterpret_cast<juce::pointer_sized_uint>(data) % alignof(float) != 0)
+        return false;
+    std::memcpy(&header, data, sizeof(header));
+    return header.magic == MHV_IR_PACK_MAGIC && header.version == MHV_IR_PACK_VERSION
+        && sizeof(IRPack::Header) + (size_t)header.numEntries * sizeof(IRPack::Entry) <= size;
+}
+
+// Reads an entry, returns false if its samples don't fit in the pack
+static bool readEntry(const void* data, const size_t size, const juce::uint32 index, IRPack::Entry& entry) noexcept
+{
+    std::memcpy(&entry, static_cast<const char*>(data) + sizeof(IRPack::Header) + index * sizeof(IRPack::Entry), sizeof(entry));
+    if (entry.numChannels == 0 || entry.numChannels > MHV_IR_PACK_MAX_CHANNELS || entry.numSamples == 0)
+        return false;
+    const auto end = entry.offset + (entry.numChannels - 1) * entry.channelStride + entry.numSamples * sizeof(float);
+    return entry.offset % MHV_IR_PACK_ALIGNMENT == 0 && entry.channelStride >= entry.numSamples * sizeof(float) && end <= size;
+}
+
+// Reads the first entry matching a test, returns false if there's none
+template <typename Predicate>
+static bool findEntry(const void* data, const size_t size, IRPack::Entry& entry, Predicate&& matches) noexcept
+{
+    IRPack::Header header;
+    if (!readHeader(data, size, header))
+        return false;
+    for (juce::uint32 i = 0; i < header.numEntries; i++)
+    {
+        if (readEntry(data, size, i, entry) && matches(entry))
+            return true;
+    }
+    return false;
+}
+
+bool IRPack::isValid(const void* data, const size_t size) noexcept
+{
+    Header header;
+    return readHeader(data, size, header);
+}
+
+bool IRPack::find(const void* data, const size_t size, const unsigned int irIndex, const double sampleRate, const bool normalised,
+                  Entry& entry) noexcept
+{
+    return findEntry(data, size, entry, [&](const Entry& candidate)
+    {
+        return candidate.irIndex == irIndex && juce::approximatelyEqual(candidate.sampleRate, sampleRate)
+            && ((candidate.flags & MHV_IR_PACK_NORMALISED) != 0) == normalised;
+    });
+}
+
+bool IRPack::findNative(const void* data, const size_t size, const unsigned int irIndex, Entry& entry) noexcept
+{
+    return findEntry(data, size, entry, [&](const Entry& candidate)
+    {
+        return candidate.irIndex == irIndex && (candidate.flags & MHV_IR_PACK_NATIVE) != 0;
+    });
+}
+
+IRPack::Samples IRPack::getSamples(const void* data, const Entry& entry) noexcept
+{
+    // The entry was read from a pack that passed readHeader, so the offsets keep the samples aligned
+    const auto* start = static_cast<const char*>(data) + entry.offset;
+    Samples samples;
+    samples.numChannels = entry.numChannels;
+    samples.numSamples = entry.numSamples;
+    for (juce::uint32 channel = 0; channel < entry.numChannels; channel++)
+        samples.channels[channel] = reinterpret_cast<const float*>(start + channel * entry.channelStride);
+    return samples;
+}
+
+juce::MemoryBlock IRPack::build(const std::vector<Source>& sources)
+{
+    // Every impulse response at its own rate, then normalised at each common rate
+    struct Packed
+    {
+        Entry entry;
+        juce::AudioBuffer<float> buffer;
+    };
+    std::vector<Packed> packed;
+    for (const auto& source : sources)
+    {
+        jassert(source.buffer.getNumChannels() <= MHV_IR_PACK_MAX_CHANNELS);
+        const auto bandwidth = IRLoader::measureBandwidth(source.buffer, source.sampleRate);
+
+        // The tail is cut before resampling, so every rate holds the same part of the recording. Past the
+        // decay floor there's nothing audible left, so it needs no fade
+        auto native = source.buffer;
+        const auto decayLength = PartitionedIR::getDecayLength(native, MHV_DECAY_FLOOR_DECIBELS);
+        native.setSize(native.getNumChannels(), juce::jmax(1, (int)decayLength), true);
+
+        Entry nativeEntry;
+        nativeEntry.irIndex = source.irIndex;
+        nativeEntry.flags = MHV_IR_PACK_NATIVE;
+        nativeEntry.sampleRate = source.sampleRate;
+        nativeEntry.bandwidth = bandwidth;
+        packed.push_back({ nativeEntry, native });
+
+        // The same steps as IRLoader::load, so a rate read from the pack sounds like one resampled when it's prepared
+        for (const auto sampleRate : sampleRates)
+        {
+            auto buffer = IRLoader::resample(native, source.sampleRate, sampleRate);
+            IRLoader::normalise(buffer);
+            auto entry = nativeEntry;
+            entry.flags = MHV_IR_PACK_NORMALISED;
+            entry.sampleRate = sampleRate;
+            packed.push_back({ entry, std::move(buffer) });
+        }
+    }
+
+    // The samples come after the entries, every channel on an aligned offset
+    auto offset = alignOffset(sizeof(Header) + packed.size() * sizeof(Entry));
+    for (auto& item : packed)
+    {
+        item.entry.numChannels = (juce::uint32)item.buffer.getNumChannels();
+        item.entry.numSamples = (juce::uint32)item.buffer.getNumSamples();
+        item.entry.channelStride = alignOffset(item.entry.numSamples * sizeof(float));
+        item.entry.offset = offset;
+        offset += item.entry.numChannels * item.entry.channelStride;
+    }
+
+    juce::MemoryBlock block((size_t)offset, true);
+    auto* bytes = static_cast<char*>(block.getData());
+    Header header;
+    header.numEntries = (juce::uint32)packed.size();
+    std::memcpy(bytes, &header, sizeof(header));
+    for (size_t i = 0; i < packed.size(); i++)
+    {
+        const auto& item = packed[i];
+        std::memcpy(bytes + sizeof(Header) + i * sizeof(Entry), &item.entry, sizeof(Entry));
+        for (juce::uint32 channel = 0; channel < item.entry.numChannels; channel++)
+            std::memcpy(bytes + item.entry.offset + channel * item.entry.channelStride, item.buffer.getReadPointer((int)channel),
+                        item.entry.numSamples * sizeof(float));
+    }
+    return block;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <juce_dsp/juce_dsp.h>
+
+// Identifies a pack, "MHVP" read as a little endian number
+#define MHV_IR_PACK_MAGIC 0x5056484du
+// Bumped whenever the layout changes, a pack of another version isn't read
+#define MHV_IR_PACK_VERSION 1u
+// Every channel's samples start on a multiple of this many bytes from the start of the pack, which is itself
+// aligned to it in the binary
+#define MHV_IR_PACK_ALIGNMENT 64
+// The most channels an impulse response can have in a pack, for true stereo
+#define MHV_IR_PACK_MAX_CHANNELS 4
+// The entry flags: the samples are normalised, or they're the recording's own (un-normalised, at its own rate)
+#define MHV_IR_PACK_NORMALISED 1u
+#define MHV_IR_PACK_NATIVE 2u
+
+// The pack embedded in the plugin. MyHallwayVerbIRPack writes it at build time as a source file defining these
+namespace IRPackData
+{
+    alignas(MHV_IR_PACK_ALIGNMENT) extern const unsigned char data[];
+    extern const size_t size;
+}
+
+// This struct groups the helpers around the impulse response pack, the blob the embedded impulse responses are
+// stored in. It's written at build time by the MyHallwayVerbIRPack tool, from the WAV files in res/, so an
+// instance doesn't have to parse the files, convert them to float, resample and normalise them: the samples
+// are read where they are in the binary. Every impulse response is stored at its own rate without normalising
+// (to measure its bandwidth, and to resample it for the other rates), and normalised at the common rates in
+// sampleRates. All of them have their tail cut where it falls below MHV_DECAY_FLOOR_DECIBELS.
+// The partition spectra aren't stored, they depend on the host's block size and the quality mode.
+// The numbers are little endian, a big endian machine doesn't read the pack.
+struct IRPack
+{
+    // The common sample rates the impulse responses are normalised at, any other one is resampled when it's prepared
+    static constexpr std::array<double, 3> sampleRates { 44100.0, 48000.0, 96000.0 };
+
+    // The start of the pack, followed by the entries
+    struct Header
+    {
+        juce::uint32 magic = MHV_IR_PACK_MAGIC;
+        juce::uint32 version = MHV_IR_PACK_VERSION;
+        juce::uint32 numEntries = 0;
+        juce::uint32 reserved = 0;
+    };
+    // An impulse response at a sample rate, its channels are numSamples floats each, channelStride bytes apart
+    struct Entry
+    {
+        juce::uint32 irIndex = 0;
+        juce::uint32 numChannels = 0;
+        juce::uint32 numSamples = 0;
+        juce::uint32 flags = 0;
+        double sampleRate = 0.0;
+        // The bandwidth of the recording, measured on the native entry before its tail is cut
+        double bandwidth = 0.0;
+        juce::uint64 offset = 0;
+        juce::uint64 channelStride = 0;
+    };
+    // The samples of an entry where they are in the pack, which is read only
+    struct Samples
+    {
+        std::array<const float*, MHV_IR_PACK_MAX_CHANNELS> channels {};
+        size_t numChannels = 0;
+        size_t numSamples = 0;
+
+        // Returns the samples as a block, which points to the channels array so it mustn't outlive this
+        juce::dsp::AudioBlock<const float> getBlock() const noexcept
+        {
+            return juce::dsp::AudioBlock<const float>(channels.data(), numChannels, numSamples);
+        }
+    };
+    // An impulse response to pack, as it was decoded
+    struct Source
+    {
+        unsigned int irIndex = 0;
+        juce::AudioBuffer<float> buffer;
+        double sampleRate = 0.0;
+    };
+
+    // Returns true if the data is a pack of this version that can be read on this machine, and is aligned for its samples
+    static bool isValid(const void* data, const size_t size) noexcept;
+    // Reads the entry of an impulse response normalised (or not) at a sample rate, returns false if the pack doesn't have it.
+    // The entries are copied out, the pack may not be aligned for them
+    static bool find(const void* data, const size_t size, const unsigned int irIndex, const double sampleRate, const bool normalised,
+                     Entry& entry) noexcept;
+    // Reads the entry of an impulse response at its own rate without normalising, returns false if the pack doesn't have it
+    static bool findNative(const void* data, const size_t size, const unsigned int irIndex, Entry& entry) noexcept;
+    // Returns the entry's samples in the pack, nothing is copied
+    static Samples getSamples(const void* data, const Entry& entry) noexcept;
+    // Returns a pack of the impulse responses: their tails are cut, and they're stored at their own rate and
+    // normalised at the common rates. This resamples and allocates, it's meant for the build
+    static juce::MemoryBlock build(const std::vector<Source>& sources);
+};
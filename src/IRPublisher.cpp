@@ -0,0 +1,51 @@
+#include "IRPublisher.h"
+#include <algorithm>
+
+void IRPublisher::Usage::finishBlock(const std::array<const PartitionedIR*, MHV_MAX_IRS_IN_USE>& inUse) noexcept
+{
+    // The list is stored before the count, so a count read by a publisher comes with a list at least as recent
+    for (size_t i = 0; i < inUse.size(); i++)
+        m_inUse[i].store(inUse[i], std::memory_order_release);
+    m_blockCount.fetch_add(1, std::memory_order_release);
+}
+
+std::shared_ptr<const PartitionedIR> IRPublisher::find(const PartitionedIR* ir) const
+{
+    if (ir == nullptr)
+        return nullptr;
+    if (m_current.get() == ir)
+        return m_current;
+    for (const auto& retired : m_retired)
+    {
+        if (retired.ir.get() == ir)
+            return retired.ir;
+    }
+    return nullptr;
+}
+
+void IRPublisher::publish(std::shared_ptr<const PartitionedIR> ir)
+{
+    m_published.store(ir.get(), std::memory_order_release);
+    m_version.fetch_add(1, std::memory_order_release);
+    // A block that read the old pointer has finished once the count went up twice from here, after that
+    // the old impulse response can only be reached through the engine
+    if (m_current != nullptr)
+        m_retired.push_back({ m_current, m_usage.m_blockCount.load(std::memory_order_acquire) });
+    m_current = std::move(ir);
+}
+
+void IRPublisher::collectGarbage()
+{
+    if (m_retired.empty())
+        return;
+
+    const auto blockCount = m_usage.m_blockCount.load(std::memory_order_acquire);
+    std::array<const PartitionedIR*, MHV_MAX_IRS_IN_USE> inUse;
+    for (size_t i = 0; i < inUse.size(); i++)
+        inUse[i] = m_usage.m_inUse[i].load(std::memory_order_acquire);
+
+    m_retired.erase(std::remove_if(m_retired.begin(), m_retired.end(), [&](const Retired& retired)
+    {
+        return blockCount >= retired.blockCount + 2 && std::find(inUse.begin(), inUse.end(), retired.ir.get()) == inUse.end();
+    }), m_retired.end());
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <juce_core/juce_core.h>
+#include "PartitionedIR.h"
+
+// This class hands the impulse responses built on a background thread (the user's one, the blends, the shaped ones)
+// to the audio thread with an atomic pointer. The engine only keeps plain pointers, so a replaced impulse response
+// is retired, and only freed once the audio thread finished a whole block after it was replaced and the engine
+// said it doesn't point to it anymore. The audio thread says it once per block, to a Usage shared by all the
+// publishers of a processor.
+// Everything but get() and getVersion() is called by the owner's thread, under the owner's lock.
+class IRPublisher
+{
+public:
+    // What the engine points to at the end of the audio thread's last block
+    class Usage
+    {
+    public:
+        // Stores the impulse responses the engine still points to, at the end of every block on the audio thread
+        void finishBlock(const std::array<const PartitionedIR*, MHV_MAX_IRS_IN_USE>& inUse) noexcept;
+    private:
+        friend class IRPublisher;
+        std::atomic<juce::uint64> m_blockCount { 0 };
+        std::array<std::atomic<const PartitionedIR*>, MHV_MAX_IRS_IN_USE> m_inUse {};
+    };
+// Methods
+public:
+    explicit IRPublisher(const Usage& usage) : m_usage(usage) {}
+    // Returns the impulse response published last, or nullptr if there's none. Called from the audio thread
+    const PartitionedIR* get() const noexcept { return m_published.load(std::memory_order_acquire); }
+    // Returns a number that changes each time an impulse response is published
+    juce::uint32 getVersion() const noexcept { return m_version.load(std::memory_order_acquire); }
+    // Returns the impulse response published last, for the owner's thread
+    const std::shared_ptr<const PartitionedIR>& getCurrent() const noexcept { return m_current; }
+    // Returns an impulse response this publisher handed over, if it's still held (published or waiting to be freed), or nullptr
+    std::shared_ptr<const PartitionedIR> find(const PartitionedIR* ir) const;
+    // Hands a new impulse response to the audio thread, nullptr included, and retires the previous one
+    void publish(std::shared_ptr<const PartitionedIR> ir);
+    // Frees the retired impulse responses the audio thread can't be using
+    void collectGarbage();
+    // Returns true while retired impulse responses wait to be freed, the owner's thread then looks for them again later
+    bool hasRetired() const noexcept { return !m_retired.empty(); }
+private:
+    // A published impulse response that was replaced, and the block count when it was
+    struct Retired
+    {
+        std::shared_ptr<const PartitionedIR> ir;
+        juce::uint64 blockCount = 0;
+    };
+// Variables
+private:
+    const Usage& m_usage;
+    std::shared_ptr<const PartitionedIR> m_current;
+    std::vector<Retired> m_retired;
+    std::atomic<const PartitionedIR*> m_published { nullptr };
+    std::atomic<juce::uint32> m_version { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (IRPublisher)
+};
@@ -0,0 +1,248 @@
+#include "IRToneShaper.h"
+#include <cmath>
+#include <complex>
+
+// The thread shaping the impulse responses. It sleeps until the audio thread sets a new request, and only
+// polls while replaced impulse responses wait to be freed
+class IRToneShaper::Worker final : public juce::Thread
+{
+public:
+    explicit Worker(IRToneShaper& shaper)
+        : juce::Thread("Impulse response tone"), m_shaper(shaper)
+    {
+        startThread(juce::Thread::Priority::low);
+    }
+
+    ~Worker() override
+    {
+        signalThreadShouldExit();
+        m_shaper.m_wakeUp.signal();
+        stopThread(-1);
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            bool shaped = false;
+            bool hasRetired = false;
+            {
+                const juce::ScopedLock lock(m_shaper.m_lock);
+                shaped = m_shaper.processRequests();
+                m_shaper.m_publisher.collectGarbage();
+                hasRetired = m_shaper.m_publisher.hasRetired();
+            }
+            // It waits even after a shape, so a sweep is shaped at most once per poll
+            if (shaped)
+                wait(MHV_TONE_POLL_MS);
+            else
+                m_shaper.m_wakeUp.wait(hasRetired ? MHV_TONE_POLL_MS : -1);
+        }
+    }
+
+private:
+    IRToneShaper& m_shaper;
+};
+
+// A second order section of the tone, normalised so a0 is 1
+struct ToneSection
+{
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+};
+
+// Returns the sections applying a tone at a sample rate: Butterworth high and low pass filters for the cuts,
+// and a high shelf for the tilt, turned down by half its gain so the pivot is left as it is
+static std::vector<ToneSection> designTone(const IRToneShaper::Tone& tone, const double sampleRate)
+{
+    std::vector<ToneSection> sections;
+    const auto maxFrequency = MHV_TONE_MAX_FREQUENCY_RATIO * sampleRate;
+    const auto addPass = [&](const double frequency, const bool highPass)
+    {
+        const auto w0 = juce::MathConstants<double>::twoPi * frequency / sampleRate;
+        const auto c = std::cos(w0);
+        const auto alpha = std::sin(w0) / juce::MathConstants<double>::sqrt2;
+        const auto a0 = 1.0 + alpha;
+        const auto b1 = highPass ? -(1.0 + c) : 1.0 - c;
+        sections.push_back({ 0.5 * std::abs(b1) / a0, b1 / a0, 0.5 * std::abs(b1) / a0, -2.0 * c / a0, (1.0 - alpha) / a0 });
+    };
+    if (tone.lowCut > MHV_PV_MIN_LOW_CUT && tone.lowCut < maxFrequency)
+        addPass((double)tone.lowCut, true);
+    if (tone.highCut < MHV_PV_MAX_HIGH_CUT && tone.highCut < maxFrequency)
+        addPass((double)tone.highCut, false);
+    if (!juce::approximatelyEqual(tone.tilt, 0.0f) && MHV_TONE_TILT_PIVOT_HZ < maxFrequency)
+    {
+        const auto a = std::pow(10.0, (double)tone.tilt / 40.0);
+        const auto sqrtA = std::sqrt(a);
+        const auto w0 = juce::MathConstants<double>::twoPi * MHV_TONE_TILT_PIVOT_HZ / sampleRate;
+        const auto c = std::cos(w0);
+        const auto alpha = std::sin(w0) / juce::MathConstants<double>::sqrt2;
+        const auto a0 = (a + 1.0) - (a - 1.0) * c + 2.0 * sqrtA * alpha;
+        const auto scale = 1.0 / (a * a0);
+        sections.push_back({ a * ((a + 1.0) + (a - 1.0) * c + 2.0 * sqrtA * alpha) * scale,
+                             -2.0 * a * ((a - 1.0) + (a + 1.0) * c) * scale,
+                             a * ((a + 1.0) + (a - 1.0) * c - 2.0 * sqrtA * alpha) * scale,
+                             2.0 * ((a - 1.0) - (a + 1.0) * c) / a0,
+                             ((a + 1.0) - (a - 1.0) * c - 2.0 * sqrtA * alpha) / a0 });
+    }
+    return sections;
+}
+
+// Returns the gain of the sections in decibels at a frequency
+static double getToneResponse(const std::vector<ToneSection>& sections, const double frequency, const double sampleRate)
+{
+    const auto z = std::polar(1.0, -juce::MathConstants<double>::twoPi * frequency / sampleRate);
+    std::complex<double> response(1.0, 0.0);
+    for (const auto& section : sections)
+        response *= (section.b0 + section.b1 * z + section.b2 * z * z) / (1.0 + section.a1 * z + section.a2 * z * z);
+    return 20.0 * std::log10(juce::jmax(std::abs(response), 1.0e-12));
+}
+
+bool IRToneShaper::Tone::isFlat() const noexcept
+{
+    return lowCut <= MHV_PV_MIN_LOW_CUT && highCut >= MHV_PV_MAX_HIGH_CUT && juce::approximatelyEqual(tilt, 0.0f);
+}
+
+bool IRToneShaper::Tone::operator==(const Tone& other) const noexcept
+{
+    return juce::approximatelyEqual(lowCut, other.lowCut) && juce::approximatelyEqual(highCut, other.highCut)
+        && juce::approximatelyEqual(tilt, other.tilt);
+}
+
+IRToneShaper::IRToneShaper(const IRPublisher::Usage& usage)
+    : m_publisher(usage)
+{
+}
+
+IRToneShaper::~IRToneShaper()
+{
+    m_worker.reset();
+}
+
+void IRToneShaper::prepare(const std::array<std::shared_ptr<const PartitionedIR>, MHV_IR_COUNT>& embedded, const PartitionedIR* source,
+                           const Tone& tone)
+{
+    const juce::ScopedLock lock(m_lock);
+    // An instance that's never prepared, like one a host creates to scan the plugin, never starts the thread
+    if (m_worker == nullptr)
+        m_worker = std::make_unique<Worker>(*this);
+    m_embedded = embedded;
+    // The source is shaped again for the new settings, so the engine gets it as soon as it's prepared
+    m_hasShaped = false;
+    setRequest(source, tone);
+    processRequests();
+}
+
+void IRToneShaper::setRequest(const PartitionedIR* source, const Tone& tone) noexcept
+{
+    // There's a single writer, the sequence tells the shaping thread when it may have read a mix of old and new values
+    m_requestSequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_requestedSource.store(source, std::memory_order_relaxed);
+    m_requestedLowCut.store(tone.lowCut, std::memory_order_relaxed);
+    m_requestedHighCut.store(tone.highCut, std::memory_order_relaxed);
+    m_requestedTilt.store(tone.tilt, std::memory_order_relaxed);
+    m_requestSequence.fetch_add(1, std::memory_order_release);
+    m_wakeUp.signal();
+}
+
+bool IRToneShaper::readRequest(const PartitionedIR*& source, Tone& tone) const noexcept
+{
+    const auto sequence = m_requestSequence.load(std::memory_order_acquire);
+    if ((sequence & 1) != 0)
+        return false;
+    source = m_requestedSource.load(std::memory_order_relaxed);
+    tone.lowCut = m_requestedLowCut.load(std::memory_order_relaxed);
+    tone.highCut = m_requestedHighCut.load(std::memory_order_relaxed);
+    tone.tilt = m_requestedTilt.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return m_requestSequence.load(std::memory_order_relaxed) == sequence;
+}
+
+const PartitionedIR* IRToneShaper::get(const PartitionedIR* source) const noexcept
+{
+    // A shaped impulse response made from another source is of no use, the one asked for is on its way
+    const auto* shaped = m_publisher.get();
+    return shaped != nullptr && shaped->source.get() == source ? shaped : nullptr;
+}
+
+std::shared_ptr<const PartitionedIR> IRToneShaper::shape(const std::shared_ptr<const PartitionedIR>& sourceIR, const Tone& tone)
+{
+    const auto& source = *sourceIR;
+    const auto sections = designTone(tone, source.sampleRate);
+    auto ir = std::make_shared<PartitionedIR>();
+    ir->numChannels = source.numChannels;
+    ir->lengthInSamples = source.lengthInSamples;
+    ir->decayLengthInSamples = source.decayLengthInSamples;
+    ir->sampleRate = source.sampleRate;
+    // The overview is only drawn, the tone barely changes the envelope
+    ir->overview = source.overview;
+    ir->source = sourceIR;
+    if (source.lateReverb != nullptr)
+    {
+        ir->lateReverb = source.lateReverb->withResponse([&](const double frequency)
+        {
+            return getToneResponse(sections, frequency, source.sampleRate);
+        });
+    }
+
+    // The filters run in double precision, their ringing past the end of the impulse response is inaudible
+    auto buffer = source.getBuffer();
+    for (int channel = 0; channel < buffer.getNumChannels(); channel++)
+    {
+        auto* samples = buffer.getWritePointer(channel);
+        for (const auto& section : sections)
+        {
+            double state1 = 0.0, state2 = 0.0;
+            for (int i = 0; i < buffer.getNumSamples(); i++)
+            {
+                const auto input = (double)samples[i];
+                const auto output = section.b0 * input + state1;
+                state1 = section.b1 * input - section.a1 * output + state2;
+                state2 = section.b2 * input - section.a2 * output;
+                samples[i] = (float)output;
+            }
+        }
+    }
+    ir->segments = PartitionedIR::getLayout(source.segments.front().partitionSize, ir->lengthInSamples);
+    PartitionedIR::transformSegments(ir->segments, buffer);
+    return ir;
+}
+
+bool IRToneShaper::processRequests()
+{
+    const PartitionedIR* source = nullptr;
+    Tone tone;
+    if (!readRequest(source, tone))
+        return false;
+    const auto flat = source == nullptr || tone.isFlat();
+    if (m_hasShaped && tone == m_shapedTone && (flat ? m_shapedSource == nullptr : source == m_shapedSource.get()))
+        return false;
+    // A flat tone plays the source itself, the last shaped impulse response is freed
+    if (flat)
+    {
+        m_hasShaped = true;
+        m_shapedSource = nullptr;
+        m_shapedTone = tone;
+        if (m_publisher.getCurrent() != nullptr)
+            m_publisher.publish(nullptr);
+        return true;
+    }
+
+    std::shared_ptr<const PartitionedIR> sourceIR;
+    for (const auto& embedded : m_embedded)
+    {
+        if (embedded.get() == source)
+            sourceIR = embedded;
+    }
+    if (sourceIR == nullptr && findSource != nullptr)
+        sourceIR = findSource(source);
+    // A source that was freed already was replaced, the audio thread asks for the new one. Nothing is
+    // recorded, so the address is looked up again with the next request if it's reused by another impulse response
+    if (sourceIR == nullptr)
+        return false;
+    m_hasShaped = true;
+    m_shapedSource = sourceIR;
+    m_shapedTone = tone;
+    m_publisher.publish(shape(sourceIR, tone));
+    return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <juce_core/juce_core.h>
+#include "ParamDefinitions.h"
+#include "IRPublisher.h"
+#include "Semaphore.h"
+
+// The shortest time between two shapes, so a fast sweep is shaped at most this often, always with the last tone
+// asked for. It's also how often the shaping thread looks for shaped impulse responses it can free, while some wait to be
+#define MHV_TONE_POLL_MS 30
+// The tilt turns around this frequency, it's left as it is there
+#define MHV_TONE_TILT_PIVOT_HZ 1000.0
+// The filters are left out past this fraction of the impulse response's sample rate, where they wouldn't do anything
+#define MHV_TONE_MAX_FREQUENCY_RATIO 0.45
+
+// This class bakes the wet tone (a low cut, a high cut and a tilt) into an impulse response on a background thread,
+// so the tone costs nothing per sample: the engine convolves with the shaped impulse response instead of the
+// original one, and crossfades to it like to any new impulse response. The partitions are transformed back to
+// the time domain, filtered with causal second order sections, and transformed again. Multiplying the partition
+// spectra by the filters' response would skip the round trip, but the head's few bins can't hold a low cut, and
+// the filters' ringing would wrap around the partitions. In the hybrid mode the late tail's equalisers get the
+// filters' response at their bands. The tone follows its parameters asynchronously, the shaped impulse responses
+// are handed to the audio thread with an atomic pointer and retired like the blends (see IRPublisher). The thread is
+// started when the shaper is first prepared, and sleeps until the audio thread asks for a new tone or source.
+class IRToneShaper
+{
+public:
+    // The tone of the wet signal, the lowest low cut, the highest high cut and no tilt leave it as it is
+    struct Tone
+    {
+        float lowCut = MHV_PV_MIN_LOW_CUT;
+        float highCut = MHV_PV_MAX_HIGH_CUT;
+        float tilt = MHV_PV_DEFAULT_TILT;
+
+        // Returns true if the tone leaves the impulse response as it is
+        bool isFlat() const noexcept;
+        // Comparison operator overload, the shaping thread only works for new tones
+        bool operator==(const Tone& other) const noexcept;
+    };
+// Methods
+public:
+    // The usage is where the audio thread says which impulse responses the engine still points to
+    explicit IRToneShaper(const IRPublisher::Usage& usage);
+    ~IRToneShaper();
+    // Sets the embedded impulse responses for new settings, and shapes the source with the tone right away.
+    // This blocks and allocates, so it must not be called from the audio thread
+    void prepare(const std::array<std::shared_ptr<const PartitionedIR>, MHV_IR_COUNT>& embedded, const PartitionedIR* source, const Tone& tone);
+    // Sets the impulse response to shape and its tone. It only stores them and wakes the shaping thread up, without
+    // locking, so it's safe on the audio thread. A flat tone stops the shaping, and the last shaped impulse response is freed once the engine is done with it
+    void setRequest(const PartitionedIR* source, const Tone& tone) noexcept;
+    // Returns the shaped version of an impulse response, or nullptr if it isn't ready. Called from the audio thread
+    const PartitionedIR* get(const PartitionedIR* source) const noexcept;
+    // Returns a number that changes each time a new shaped impulse response is published
+    juce::uint32 getVersion() const noexcept { return m_publisher.getVersion(); }
+    // Returns an impulse response with a tone baked in, its source is kept in it
+    static std::shared_ptr<const PartitionedIR> shape(const std::shared_ptr<const PartitionedIR>& source, const Tone& tone);
+    // Called on the shaping thread to find the impulse responses that aren't embedded (the user's one and the blends),
+    // it returns nullptr for one that was already freed
+    std::function<std::shared_ptr<const PartitionedIR>(const PartitionedIR*)> findSource;
+private:
+    class Worker;
+    // Internal method used to shape for the current request if it changed, returns true if it did
+    bool processRequests();
+    // Internal method used to read the request, returns false if it was being written
+    bool readRequest(const PartitionedIR*& source, Tone& tone) const noexcept;
+// Variables
+private:
+    // Guards everything but the atomics, it's never taken on the audio thread
+    juce::CriticalSection m_lock;
+    std::array<std::shared_ptr<const PartitionedIR>, MHV_IR_COUNT> m_embedded;
+    // The request of the audio thread. The sequence is odd while it's written, a read that saw it change
+    // is tried again once the audio thread wakes the shaping thread up after writing it
+    std::atomic<const PartitionedIR*> m_requestedSource { nullptr };
+    std::atomic<float> m_requestedLowCut { MHV_PV_MIN_LOW_CUT };
+    std::atomic<float> m_requestedHighCut { MHV_PV_MAX_HIGH_CUT };
+    std::atomic<float> m_requestedTilt { MHV_PV_DEFAULT_TILT };
+    std::atomic<juce::uint32> m_requestSequence { 0 };
+    // What the current impulse response was shaped for, until the first request. The source is held for the
+    // same reason as in a shaped impulse response, it's nullptr after a flat tone
+    bool m_hasShaped = false;
+    std::shared_ptr<const PartitionedIR> m_shapedSource;
+    Tone m_shapedTone;
+    IRPublisher m_publisher;
+    WakeUpSignal m_wakeUp;
+    std::unique_ptr<Worker> m_worker;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (IRToneShaper)
+};
@@ -0,0 +1,58 @@
+#include "IRWaveformView.h"
+
+IRWaveformView::IRWaveformView()
+{
+    setInterceptsMouseClicks(false, false);
+}
+
+IRWaveformView::~IRWaveformView()
+{
+}
+
+void IRWaveformView::setOverview(const DisplayFeed::Overview& overview)
+{
+    m_overview = overview;
+    m_hasOverview = true;
+    updatePath();
+    repaint();
+}
+
+void IRWaveformView::paint(juce::Graphics& g)
+{
+    g.setColour(juce::Colours::black.withAlpha(0.6f));
+    g.fillRect(getLocalBounds());
+    if (!m_hasOverview)
+        return;
+    g.setColour(juce::Colours::skyblue);
+    g.fillPath(m_path);
+}
+
+void IRWaveformView::resized()
+{
+    updatePath();
+}
+
+void IRWaveformView::updatePath()
+{
+    m_path.clear();
+    if (!m_hasOverview || getWidth() <= 0)
+        return;
+    const auto width = (float)getWidth();
+    const auto centre = (float)getHeight() * 0.5f;
+    // Returns the half height of the envelope for a slice
+    const auto getHalfHeight = [this, centre](const size_t slice)
+    {
+        const auto decibels = juce::Decibels::gainToDecibels(m_overview[slice], MHV_WAVEFORM_FLOOR_DECIBELS);
+        return centre * (1.0f - decibels / MHV_WAVEFORM_FLOOR_DECIBELS);
+    };
+    // The upper edge from left to right, then the lower edge back
+    const auto sliceWidth = width / (float)m_overview.size();
+    m_path.preallocateSpace(6 * (int)m_overview.size() + 4);
+    m_path.startNewSubPath(0.0f, centre);
+    for (size_t slice = 0; slice < m_overview.size(); slice++)
+        m_path.lineTo(((float)slice + 0.5f) * sliceWidth, centre - getHalfHeight(slice));
+    m_path.lineTo(width, centre);
+    for (size_t slice = m_overview.size(); slice-- > 0;)
+        m_path.lineTo(((float)slice + 0.5f) * sliceWidth, centre + getHalfHeight(slice));
+    m_path.closeSubPath();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <juce_gui_basics/juce_gui_basics.h>
+#include "DisplayFeed.h"
+
+// The range the impulse response is drawn over, in decibels under its peak
+#define MHV_WAVEFORM_FLOOR_DECIBELS -60.0f
+
+// This component draws the overview of the impulse response in use, as an envelope mirrored around its centre
+// line, on a decibel scale so the tail stays visible. The path is only rebuilt when the overview or the size
+// changes, so repainting it costs a single fill
+class IRWaveformView final : public juce::Component
+{
+// Methods
+public:
+    IRWaveformView();
+    ~IRWaveformView() override;
+    // Shows a new overview
+    void setOverview(const DisplayFeed::Overview& overview);
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+private:
+    // Internal method used to build the envelope's path from the overview, for the current size
+    void updatePath();
+// Variables
+private:
+    DisplayFeed::Overview m_overview {};
+    bool m_hasOverview = false;
+    juce::Path m_path;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (IRWaveformView)
+};
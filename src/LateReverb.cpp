@@ -0,0 +1,543 @@
+#include "LateReverb.h"
+#include <algorithm>
+#include <cmath>
+#include <complex>
+
+// The normalised echo density is measured over windows this long
+#define MHV_ECHO_DENSITY_WINDOW_SECONDS 0.02
+// The late decay time is read between those levels of the energy decay curve, relative to the level at the split
+#define MHV_LATE_DECAY_FIT_START_DECIBELS -3.0
+#define MHV_LATE_DECAY_FIT_END_DECIBELS -23.0
+// A band whose curve doesn't fall this far before the end of the impulse response has no usable decay time
+#define MHV_LATE_DECAY_MIN_RANGE_DECIBELS -13.0
+#define MHV_LATE_MIN_DECAY_SECONDS 0.05
+#define MHV_LATE_MAX_DECAY_SECONDS 10.0
+// How many times the equaliser's gains are corrected for the overlap of its bands
+#define MHV_LATE_EQUALISER_ITERATIONS 4
+
+// The signs of the lines' input and output gains, a different row per network decorrelates the channels
+static const float lineSigns[4][MHV_FDN_NUM_LINES] = { {  1.0f,  1.0f, -1.0f,  1.0f, -1.0f, -1.0f,  1.0f, -1.0f },
+                                                       {  1.0f, -1.0f,  1.0f,  1.0f, -1.0f,  1.0f, -1.0f, -1.0f },
+                                                       { -1.0f,  1.0f,  1.0f, -1.0f,  1.0f,  1.0f,  1.0f, -1.0f },
+                                                       {  1.0f,  1.0f,  1.0f, -1.0f, -1.0f,  1.0f, -1.0f,  1.0f } };
+
+static double getBandCentre(const size_t band) noexcept
+{
+    return MHV_LATE_FIRST_BAND_HZ * std::pow(2.0, (double)band);
+}
+
+// A band is only analysed if its upper edge stays clear of the Nyquist frequency
+static bool isBandUsable(const size_t band, const double sampleRate) noexcept
+{
+    return getBandCentre(band) * juce::MathConstants<double>::sqrt2 < 0.45 * sampleRate;
+}
+
+// Returns the energy of every sample of the summed channels filtered by an octave band-pass (two band-pass biquads)
+static std::vector<double> getBandEnergies(const juce::dsp::AudioBlock<const float>& block, const std::vector<size_t>& channels,
+                                           const size_t band, const double sampleRate)
+{
+    const auto length = block.getNumSamples();
+    const auto w0 = juce::MathConstants<double>::twoPi * getBandCentre(band) / sampleRate;
+    const auto alpha = std::sin(w0) / (2.0 * juce::MathConstants<double>::sqrt2);
+    const auto a0 = 1.0 + alpha;
+    const auto b0 = alpha / a0, b2 = -alpha / a0, a1 = -2.0 * std::cos(w0) / a0, a2 = (1.0 - alpha) / a0;
+
+    std::vector<double> energies(length, 0.0);
+    std::vector<double> filtered(length);
+    for (const auto channel : channels)
+    {
+        const auto* samples = block.getChannelPointer(channel);
+        for (size_t i = 0; i < length; i++)
+            filtered[i] = (double)samples[i];
+        for (int pass = 0; pass < 2; pass++)
+        {
+            double s1 = 0.0, s2 = 0.0;
+            for (auto& sample : filtered)
+            {
+                const auto x = sample;
+                sample = b0 * x + s1;
+                s1 = -a1 * sample + s2;
+                s2 = b2 * x - a2 * sample;
+            }
+        }
+        for (size_t i = 0; i < length; i++)
+            energies[i] += filtered[i] * filtered[i];
+    }
+    return energies;
+}
+
+// Returns the decay time read from the energy decay curve after the split, or 0 if the curve is too short for it
+static double fitDecayTime(const std::vector<double>& energies, const size_t splitStart, const double sampleRate)
+{
+    // The backward integrated energy, in decibels relative to the split
+    const auto length = energies.size();
+    if (splitStart >= length)
+        return 0.0;
+    std::vector<double> curve(length - splitStart);
+    double energyAfter = 0.0;
+    for (auto i = length; i > splitStart; i--)
+    {
+        energyAfter += energies[i - 1];
+        curve[i - 1 - splitStart] = energyAfter;
+    }
+    const auto splitEnergy = curve.front();
+    if (splitEnergy <= 0.0)
+        return 0.0;
+    for (auto& level : curve)
+        level = 10.0 * std::log10(juce::jmax(level / splitEnergy, 1.0e-30));
+
+    // The end of the impulse response bends the curve down, so the fit stops before it if the range isn't reached
+    size_t first = 0;
+    while (first < curve.size() && curve[first] > MHV_LATE_DECAY_FIT_START_DECIBELS)
+        first++;
+    auto last = first;
+    while (last < curve.size() && curve[last] > MHV_LATE_DECAY_FIT_END_DECIBELS)
+        last++;
+    if (last >= curve.size() || last <= first)
+    {
+        last = first;
+        while (last < curve.size() && curve[last] > MHV_LATE_DECAY_MIN_RANGE_DECIBELS)
+            last++;
+        if (last >= curve.size() || last <= first)
+            return 0.0;
+    }
+
+    // A straight line through the curve between the two levels
+    const auto count = (double)(last - first);
+    double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+    for (auto i = first; i < last; i++)
+    {
+        const auto x = (double)(i - first);
+        sumX += x;
+        sumY += curve[i];
+        sumXX += x * x;
+        sumXY += x * curve[i];
+    }
+    const auto slope = (count * sumXY - sumX * sumY) / (count * sumXX - sumX * sumX);
+    if (!(slope < 0.0))
+        return MHV_LATE_MAX_DECAY_SECONDS;
+    return juce::jlimit(MHV_LATE_MIN_DECAY_SECONDS, MHV_LATE_MAX_DECAY_SECONDS, -60.0 / (slope * sampleRate));
+}
+
+// Returns where the normalised echo density of a channel first reaches 1, from its loudest sample on
+static double measureMixingTime(const float* samples, const size_t length, const double sampleRate)
+{
+    const auto window = (size_t)juce::jmax(16, juce::roundToInt(MHV_ECHO_DENSITY_WINDOW_SECONDS * sampleRate));
+    const auto hop = juce::jmax((size_t)1, window / 20);
+    size_t peak = 0;
+    for (size_t i = 1; i < length; i++)
+    {
+        if (std::abs(samples[i]) > std::abs(samples[peak]))
+            peak = i;
+    }
+
+    // The fraction of samples above the standard deviation, relative to the one of Gaussian noise
+    const auto gaussianFraction = std::erfc(1.0 / juce::MathConstants<double>::sqrt2);
+    const auto end = juce::jmin(length, (size_t)(MHV_LATE_MAX_SPLIT_SECONDS * sampleRate) + window);
+    for (auto start = peak; start + window <= end; start += hop)
+    {
+        double energy = 0.0;
+        for (size_t i = start; i < start + window; i++)
+            energy += (double)samples[i] * (double)samples[i];
+        const auto deviation = std::sqrt(energy / (double)window);
+        size_t numAbove = 0;
+        for (size_t i = start; i < start + window; i++)
+            numAbove += (double)std::abs(samples[i]) > deviation ? 1 : 0;
+        if ((double)numAbove / (double)window >= gaussianFraction)
+            return ((double)start + (double)window / 2.0) / sampleRate;
+    }
+    return MHV_LATE_MAX_SPLIT_SECONDS;
+}
+
+static bool isPrime(const size_t value) noexcept
+{
+    if (value < 2)
+        return false;
+    for (size_t divisor = 2; divisor * divisor <= value; divisor++)
+    {
+        if (value % divisor == 0)
+            return false;
+    }
+    return true;
+}
+
+// Returns a second order section of the equaliser, a low shelf for the first band, a high shelf for the last one
+// and a peak for the others
+static LateReverb::Biquad designBand(const size_t band, const double gainDecibels, const double sampleRate) noexcept
+{
+    const auto a = std::pow(10.0, gainDecibels / 40.0);
+    const auto sqrtA = std::sqrt(a);
+    double b0, b1, b2, a0, a1, a2;
+    if (band == 0 || band == MHV_LATE_NUM_BANDS - 1)
+    {
+        // The shelves turn over halfway to the next band
+        const auto frequency = band == 0 ? getBandCentre(band) * juce::MathConstants<double>::sqrt2
+                                         : getBandCentre(band) / juce::MathConstants<double>::sqrt2;
+        const auto w0 = juce::MathConstants<double>::twoPi * frequency / sampleRate;
+        const auto c = std::cos(w0);
+        const auto alpha = std::sin(w0) / juce::MathConstants<double>::sqrt2;
+        const auto sign = band == 0 ? 1.0 : -1.0;
+        b0 = a * ((a + 1.0) - sign * (a - 1.0) * c + 2.0 * sqrtA * alpha);
+        b1 = sign * 2.0 * a * ((a - 1.0) - sign * (a + 1.0) * c);
+        b2 = a * ((a + 1.0) - sign * (a - 1.0) * c - 2.0 * sqrtA * alpha);
+        a0 = (a + 1.0) + sign * (a - 1.0) * c + 2.0 * sqrtA * alpha;
+        a1 = -sign * 2.0 * ((a - 1.0) + sign * (a + 1.0) * c);
+        a2 = (a + 1.0) + sign * (a - 1.0) * c - 2.0 * sqrtA * alpha;
+    }
+    else
+    {
+        const auto w0 = juce::MathConstants<double>::twoPi * getBandCentre(band) / sampleRate;
+        const auto c = std::cos(w0);
+        const auto alpha = std::sin(w0) / (2.0 * juce::MathConstants<double>::sqrt2);
+        b0 = 1.0 + alpha * a;
+        b1 = -2.0 * c;
+        b2 = 1.0 - alpha * a;
+        a0 = 1.0 + alpha / a;
+        a1 = -2.0 * c;
+        a2 = 1.0 - alpha / a;
+    }
+    return { (float)(b0 / a0), (float)(b1 / a0), (float)(b2 / a0), (float)(a1 / a0), (float)(a2 / a0) };
+}
+
+// Returns the equaliser's gain in decibels at a frequency
+static double getEqualiserResponse(const std::array<LateReverb::Biquad, MHV_LATE_NUM_BANDS>& equaliser, const double frequency,
+                                   const double sampleRate)
+{
+    const auto z = std::polar(1.0, -juce::MathConstants<double>::twoPi * frequency / sampleRate);
+    std::complex<double> response(1.0, 0.0);
+    for (const auto& biquad : equaliser)
+        response *= ((double)biquad.b0 + (double)biquad.b1 * z + (double)biquad.b2 * z * z) / (1.0 + (double)biquad.a1 * z + (double)biquad.a2 * z * z);
+    return 20.0 * std::log10(juce::jmax(std::abs(response), 1.0e-12));
+}
+
+// Returns the network's output for a unit impulse
+static std::vector<float> renderNetwork(const LateReverb::Network& network, const size_t length, const double sampleRate)
+{
+    LateReverbState state;
+    state.prepare(LateReverb::getMaxDelayFor(sampleRate));
+    std::vector<float> impulse(length, 0.0f), output(length, 0.0f);
+    if (length > 0)
+        impulse[0] = 1.0f;
+    state.process(network, impulse.data(), output.data(), length);
+    return output;
+}
+
+// Designs the delay lines of a network and fits their absorption to the decay times at a low and a high frequency
+static LateReverb::Network designNetwork(const std::array<float, MHV_LATE_NUM_BANDS>& decayTimes, const size_t networkIndex,
+                                         const double sampleRate)
+{
+    LateReverb::Network network;
+    network.enabled = true;
+    network.decayTimes = decayTimes;
+
+    // The usable bands are split in a low and a high half, each half gives a decay time at its mean frequency
+    std::vector<size_t> bands;
+    for (size_t band = 0; band < MHV_LATE_NUM_BANDS; band++)
+    {
+        if (decayTimes[band] > 0.0f)
+            bands.push_back(band);
+    }
+    jassert(!bands.empty());
+    const auto half = juce::jmax((size_t)1, bands.size() / 2);
+    double lowTime = 0.0, lowOctave = 0.0, highTime = 0.0, highOctave = 0.0;
+    for (size_t i = 0; i < bands.size(); i++)
+    {
+        auto& time = i < half ? lowTime : highTime;
+        auto& octave = i < half ? lowOctave : highOctave;
+        time += (double)decayTimes[bands[i]];
+        octave += (double)bands[i];
+    }
+    lowTime /= (double)half;
+    lowOctave /= (double)half;
+    const auto numHigh = bands.size() - half;
+    highTime = numHigh > 0 ? highTime / (double)numHigh : lowTime;
+    highOctave = numHigh > 0 ? highOctave / (double)numHigh : lowOctave + 1.0;
+    const auto cosLow = std::cos(juce::MathConstants<double>::twoPi * MHV_LATE_FIRST_BAND_HZ * std::pow(2.0, lowOctave) / sampleRate);
+    const auto cosHigh = std::cos(juce::MathConstants<double>::twoPi * MHV_LATE_FIRST_BAND_HZ * std::pow(2.0, highOctave) / sampleRate);
+
+    // Every network spreads its lines a little differently, the lengths are primes so the echoes don't line up
+    const auto stretch = 1.0 + 0.03 * (double)(networkIndex % 4);
+    const auto signs = lineSigns[networkIndex % 4];
+    const auto outputSigns = lineSigns[(networkIndex + 1) % 4];
+    const auto lineScale = 1.0f / std::sqrt((float)MHV_FDN_NUM_LINES);
+    for (size_t line = 0; line < MHV_FDN_NUM_LINES; line++)
+    {
+        const auto seconds = MHV_FDN_MIN_DELAY_SECONDS * std::pow(MHV_FDN_MAX_DELAY_SECONDS / MHV_FDN_MIN_DELAY_SECONDS,
+                                                                  (double)line / (double)(MHV_FDN_NUM_LINES - 1));
+        auto delay = (size_t)juce::jmax(2, juce::roundToInt(seconds * stretch * sampleRate));
+        while (!isPrime(delay))
+            delay++;
+        network.delays[line] = delay;
+
+        // The gains the line must have at both frequencies, and the pole of the one pole filter with that ratio:
+        // (1 - r) p^2 - 2 (cosLow - r cosHigh) p + (1 - r) = 0, with r the squared ratio of the high gain to the low one
+        const auto lowGain = std::pow(10.0, -3.0 * (double)delay / (sampleRate * lowTime));
+        const auto highGain = std::pow(10.0, -3.0 * (double)delay / (sampleRate * highTime));
+        const auto ratio = (highGain * highGain) / (lowGain * lowGain);
+        double pole = 0.0;
+        if (std::abs(1.0 - ratio) > 1.0e-9)
+        {
+            const auto a = 1.0 - ratio;
+            const auto b = -2.0 * (cosLow - ratio * cosHigh);
+            const auto discriminant = juce::jmax(0.0, b * b - 4.0 * a * a);
+            const auto root1 = (-b + std::sqrt(discriminant)) / (2.0 * a);
+            const auto root2 = (-b - std::sqrt(discriminant)) / (2.0 * a);
+            pole = juce::jlimit(-0.99, 0.99, std::abs(root1) < std::abs(root2) ? root1 : root2);
+        }
+        // The filter's largest gain (at DC or at the Nyquist frequency) must stay below 1
+        auto gain = lowGain * std::sqrt(1.0 - 2.0 * pole * cosLow + pole * pole) / (1.0 - pole);
+        gain = juce::jmin(gain, 0.9999 * (1.0 - std::abs(pole)) / (1.0 - pole));
+        network.gains[line] = (float)(gain * (1.0 - pole));
+        network.poles[line] = (float)pole;
+        network.inputGains[line] = signs[line] * lineScale;
+        network.outputGains[line] = outputSigns[line] * lineScale;
+    }
+    return network;
+}
+
+// Sets the network's equaliser so its level in every band matches the impulse response's after the crossfade
+static void fitLevels(LateReverb::Network& network, const std::vector<double>& windowEnergies, const size_t fitStart,
+                      const size_t fitEnd, const double sampleRate)
+{
+    auto output = renderNetwork(network, fitEnd, sampleRate);
+    juce::AudioBuffer<float> rendered(1, (int)fitEnd);
+    rendered.copyFrom(0, 0, output.data(), (int)fitEnd);
+
+    std::array<double, MHV_LATE_NUM_BANDS> targets {};
+    for (size_t band = 0; band < MHV_LATE_NUM_BANDS; band++)
+    {
+        if (network.decayTimes[band] <= 0.0f)
+            continue;
+        const auto energies = getBandEnergies(rendered, { 0 }, band, sampleRate);
+        double networkEnergy = 0.0;
+        for (auto i = fitStart; i < fitEnd; i++)
+            networkEnergy += energies[i];
+        if (networkEnergy > 0.0 && windowEnergies[band] > 0.0)
+            targets[band] = 10.0 * std::log10(windowEnergies[band] / networkEnergy);
+    }
+    // The bands above the Nyquist frequency keep the gain of the last usable one, so the top shelf doesn't jump
+    for (size_t band = 1; band < MHV_LATE_NUM_BANDS; band++)
+    {
+        if (network.decayTimes[band] <= 0.0f)
+            targets[band] = targets[band - 1];
+    }
+
+    // The bands overlap, so the gains are corrected a few times with the response they actually give
+    auto gains = targets;
+    for (int iteration = 0; iteration <= MHV_LATE_EQUALISER_ITERATIONS; iteration++)
+    {
+        for (size_t band = 0; band < MHV_LATE_NUM_BANDS; band++)
+            network.equaliser[band] = isBandUsable(band, sampleRate) ? designBand(band, gains[band], sampleRate) : LateReverb::Biquad();
+        if (iteration == MHV_LATE_EQUALISER_ITERATIONS)
+        {
+            for (size_t band = 0; band < MHV_LATE_NUM_BANDS; band++)
+                network.levels[band] = (float)gains[band];
+            break;
+        }
+        for (size_t band = 0; band < MHV_LATE_NUM_BANDS; band++)
+        {
+            if (isBandUsable(band, sampleRate))
+                gains[band] += targets[band] - getEqualiserResponse(network.equaliser, getBandCentre(band), sampleRate);
+        }
+    }
+}
+
+size_t LateReverb::getMaxDelayFor(const double sampleRate) noexcept
+{
+    // The longest line of the most stretched network, with room for the next prime
+    return (size_t)std::ceil(MHV_FDN_MAX_DELAY_SECONDS * 1.09 * sampleRate) + 64;
+}
+
+std::shared_ptr<const LateReverb> LateReverb::fit(const juce::dsp::AudioBlock<const float>& block, const double sampleRate)
+{
+    const auto length = block.getNumSamples();
+    const auto numChannels = block.getNumChannels();
+    if (numChannels == 0 || sampleRate <= 0.0)
+        return nullptr;
+
+    // The split is at the latest mixing time of the channels
+    double mixingTime = MHV_LATE_MIN_SPLIT_SECONDS;
+    for (size_t channel = 0; channel < numChannels; channel++)
+        mixingTime = juce::jmax(mixingTime, measureMixingTime(block.getChannelPointer(channel), length, sampleRate));
+
+    auto lateReverb = std::make_shared<LateReverb>();
+    lateReverb->sampleRate = sampleRate;
+    lateReverb->mixingTimeSeconds = juce::jlimit(MHV_LATE_MIN_SPLIT_SECONDS, MHV_LATE_MAX_SPLIT_SECONDS, mixingTime);
+    lateReverb->splitStart = (size_t)juce::roundToInt(lateReverb->mixingTimeSeconds * sampleRate);
+    lateReverb->splitLength = (size_t)juce::jmax(1, juce::roundToInt(MHV_LATE_CROSSFADE_SECONDS * sampleRate));
+    const auto fitStart = lateReverb->splitStart + lateReverb->splitLength;
+    const auto fitEnd = fitStart + (size_t)juce::roundToInt(MHV_LATE_FIT_WINDOW_SECONDS * sampleRate);
+    // There must be a tail after the level window for the decay to be measured
+    if (fitEnd + (fitEnd - fitStart) > length)
+        return nullptr;
+
+    // A network plays the tail of every output channel, fed by that channel. With a true stereo impulse response
+    // it stands in for the tails of both inputs reaching the output
+    const bool isTrueStereo = numChannels == 4;
+    lateReverb->networks.resize(numChannels);
+    for (size_t channel = 0; channel < numChannels; channel++)
+    {
+        if (isTrueStereo && channel != 0 && channel != 3)
+            continue;
+        const auto sources = isTrueStereo ? std::vector<size_t> { channel, channel == 0 ? (size_t)2 : (size_t)1 }
+                                          : std::vector<size_t> { channel };
+
+        std::array<float, MHV_LATE_NUM_BANDS> decayTimes {};
+        std::vector<double> windowEnergies(MHV_LATE_NUM_BANDS, 0.0);
+        for (size_t band = 0; band < MHV_LATE_NUM_BANDS; band++)
+        {
+            if (!isBandUsable(band, sampleRate))
+                continue;
+            const auto energies = getBandEnergies(block, sources, band, sampleRate);
+            decayTimes[band] = (float)fitDecayTime(energies, lateReverb->splitStart, sampleRate);
+            for (auto i = fitStart; i < fitEnd; i++)
+                windowEnergies[band] += energies[i];
+        }
+        // Without a single decay time the tail is too short or too noisy to be replaced
+        if (std::all_of(decayTimes.begin(), decayTimes.end(), [](const float time) { return time <= 0.0f; }))
+            return nullptr;
+
+        auto& network = lateReverb->networks[channel];
+        network = designNetwork(decayTimes, channel, sampleRate);
+        fitLevels(network, windowEnergies, fitStart, fitEnd, sampleRate);
+        for (size_t band = 0; band < MHV_LATE_NUM_BANDS; band++)
+            network.tailEnergies[band] = (float)windowEnergies[band];
+    }
+    return lateReverb;
+}
+
+juce::AudioBuffer<float> LateReverb::getEarlyPart(const juce::dsp::AudioBlock<const float>& block) const
+{
+    const auto length = juce::jmin(block.getNumSamples(), splitStart + splitLength);
+    juce::AudioBuffer<float> early((int)block.getNumChannels(), (int)length);
+    for (size_t channel = 0; channel < block.getNumChannels(); channel++)
+    {
+        // What the network plays is taken out before the crossfade, so the sum fades from one to the other
+        const auto& network = networks[channel];
+        const auto rendered = network.enabled ? renderNetwork(network, length, sampleRate) : std::vector<float>(length, 0.0f);
+        const auto* samples = block.getChannelPointer(channel);
+        auto* output = early.getWritePointer((int)channel);
+        for (size_t i = 0; i < length; i++)
+        {
+            const auto fadeIn = i < splitStart ? 0.0
+                                               : 0.5 - 0.5 * std::cos(juce::MathConstants<double>::pi * ((double)(i - splitStart) + 0.5) / (double)splitLength);
+            output[i] = (float)(((double)samples[i] - (double)rendered[i]) * (1.0 - fadeIn));
+        }
+    }
+    return early;
+}
+
+std::shared_ptr<const LateReverb> LateReverb::withResponse(const std::function<double(double)>& getGainDecibels) const
+{
+    auto lateReverb = std::make_shared<LateReverb>(*this);
+    for (auto& network : lateReverb->networks)
+    {
+        if (!network.enabled)
+            continue;
+        for (size_t band = 0; band < MHV_LATE_NUM_BANDS; band++)
+        {
+            if (isBandUsable(band, sampleRate))
+                network.equaliser[band] = designBand(band, (double)network.levels[band] + getGainDecibels(getBandCentre(band)), sampleRate);
+        }
+    }
+    return lateReverb;
+}
+
+std::shared_ptr<const LateReverb> LateReverb::withBlendedLevels(const std::vector<std::pair<const LateReverb*, float>>& weighted) const
+{
+    auto lateReverb = std::make_shared<LateReverb>(*this);
+    for (size_t n = 0; n < lateReverb->networks.size(); n++)
+    {
+        auto& network = lateReverb->networks[n];
+        if (!network.enabled)
+            continue;
+        for (size_t band = 0; band < MHV_LATE_NUM_BANDS; band++)
+        {
+            // A tail without a network for the channel is left to the convolution
+            double energy = 0.0;
+            for (const auto& [other, weight] : weighted)
+            {
+                if (other != nullptr && n < other->networks.size() && other->networks[n].enabled)
+                    energy += (double)(weight * weight) * (double)other->networks[n].tailEnergies[band];
+            }
+            if (!isBandUsable(band, sampleRate) || network.tailEnergies[band] <= 0.0f || energy <= 0.0)
+                continue;
+            // The network's level moves by the ratio of the sum's energy to its own tail's, and the levels are
+            // kept, so a tone is applied to the blend like to any other tail
+            network.levels[band] += (float)(10.0 * std::log10(energy / (double)network.tailEnergies[band]));
+            network.tailEnergies[band] = (float)energy;
+            network.equaliser[band] = designBand(band, (double)network.levels[band], sampleRate);
+        }
+    }
+    return lateReverb;
+}
+
+void LateReverbState::prepare(const size_t maxDelay)
+{
+    m_maxDelay = maxDelay;
+    m_lines.assign(MHV_FDN_NUM_LINES * m_maxDelay, 0.0f);
+    reset();
+}
+
+void LateReverbState::reset() noexcept
+{
+    std::fill(m_lines.begin(), m_lines.end(), 0.0f);
+    m_absorptionStates = {};
+    m_equaliserStates = {};
+    m_position = 0;
+}
+
+void LateReverbState::process(const LateReverb::Network& network, const float* input, float* output, const size_t numSamples) noexcept
+{
+    jassert(m_maxDelay >= *std::max_element(network.delays.begin(), network.delays.end()));
+    // The tail decays into denormals
+    juce::ScopedNoDenormals noDenormals;
+    const auto matrixScale = 1.0f / std::sqrt((float)MHV_FDN_NUM_LINES);
+    for (size_t i = 0; i < numSamples; i++)
+    {
+        // Read the lines through their absorption filters
+        std::array<float, MHV_FDN_NUM_LINES> lines;
+        float sum = 0.0f;
+        for (size_t line = 0; line < MHV_FDN_NUM_LINES; line++)
+        {
+            auto readPosition = m_position + m_maxDelay - network.delays[line];
+            if (readPosition >= m_maxDelay)
+                readPosition -= m_maxDelay;
+            auto& state = m_absorptionStates[line];
+            state = network.gains[line] * m_lines[line * m_maxDelay + readPosition] + network.poles[line] * state;
+            lines[line] = state;
+            sum += network.outputGains[line] * state;
+        }
+
+        // Feed them back through the Hadamard matrix, with the input
+        for (size_t size = 1; size < MHV_FDN_NUM_LINES; size *= 2)
+        {
+            for (size_t start = 0; start < MHV_FDN_NUM_LINES; start += 2 * size)
+            {
+                for (auto line = start; line < start + size; line++)
+                {
+                    const auto a = lines[line];
+                    const auto b = lines[line + size];
+                    lines[line] = a + b;
+                    lines[line + size] = a - b;
+                }
+            }
+        }
+        for (size_t line = 0; line < MHV_FDN_NUM_LINES; line++)
+            m_lines[line * m_maxDelay + m_position] = matrixScale * lines[line] + network.inputGains[line] * input[i];
+        if (++m_position == m_maxDelay)
+            m_position = 0;
+
+        // The equaliser sets the level of every band
+        for (size_t band = 0; band < MHV_LATE_NUM_BANDS; band++)
+        {
+            const auto& biquad = network.equaliser[band];
+            auto& state = m_equaliserStates[band];
+            const auto x = sum;
+            sum = biquad.b0 * x + state[0];
+            state[0] = biquad.b1 * x - biquad.a1 * sum + state[1];
+            state[1] = biquad.b2 * x - biquad.a2 * sum;
+        }
+        output[i] += sum;
+    }
+}
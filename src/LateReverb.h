@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <juce_dsp/juce_dsp.h>
+
+// How many delay lines the feedback delay network uses, the feedback matrix is a Hadamard matrix of that size
+#define MHV_FDN_NUM_LINES 8
+// The delay lines' lengths are spread between those
+#define MHV_FDN_MIN_DELAY_SECONDS 0.011
+#define MHV_FDN_MAX_DELAY_SECONDS 0.043
+// The octave bands the impulse response is analysed in, from 125 Hz to 8 kHz
+#define MHV_LATE_NUM_BANDS 7
+#define MHV_LATE_FIRST_BAND_HZ 125.0
+// The convolution hands over to the network at the mixing time, kept within these bounds
+#define MHV_LATE_MIN_SPLIT_SECONDS 0.02
+#define MHV_LATE_MAX_SPLIT_SECONDS 0.25
+// How long the convolution and the network crossfade over
+#define MHV_LATE_CROSSFADE_SECONDS 0.02
+// The part after the crossfade where the network's level is matched to the impulse response's
+#define MHV_LATE_FIT_WINDOW_SECONDS 0.1
+
+// This struct holds the feedback delay networks fitted to the late tail of an impulse response, for the hybrid mode.
+// The impulse response is analysed once, when it's prepared: its mixing time (where the normalised echo density
+// reaches 1) is where the convolution hands over, and the energy decay curve of every octave band gives the
+// decay times the networks' absorption filters are fitted to, at a low and a high frequency. The networks'
+// level in every band is then matched to the impulse response's right after the crossfade, with a graphic
+// equaliser on their output.
+// A network is fed by a single channel, so what it plays is known exactly: the early part the convolution
+// keeps is the impulse response faded out, minus what the network plays before it's faded in. The sum of
+// both is then a crossfade between the measured impulse response and the network.
+// Once fitted it's never modified, so it can be shared like the impulse response it belongs to.
+struct LateReverb
+{
+    // A second order section of the equaliser
+    struct Biquad
+    {
+        float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+    };
+
+    // The network playing the tail of one output channel
+    struct Network
+    {
+        bool enabled = false;
+        std::array<size_t, MHV_FDN_NUM_LINES> delays {};
+        // The one pole absorption filter of every line, y = gain * x + pole * y
+        std::array<float, MHV_FDN_NUM_LINES> gains {};
+        std::array<float, MHV_FDN_NUM_LINES> poles {};
+        std::array<float, MHV_FDN_NUM_LINES> inputGains {};
+        std::array<float, MHV_FDN_NUM_LINES> outputGains {};
+        std::array<Biquad, MHV_LATE_NUM_BANDS> equaliser {};
+        // The gain of every band of the equaliser, in decibels
+        std::array<float, MHV_LATE_NUM_BANDS> levels {};
+        // The decay times measured in every band, 0 for the bands above the Nyquist frequency
+        std::array<float, MHV_LATE_NUM_BANDS> decayTimes {};
+        // The impulse response's energy in every band over the window its level was matched in, to blend the tails
+        std::array<float, MHV_LATE_NUM_BANDS> tailEnergies {};
+    };
+
+    // One network per channel of the impulse response, only the ones from an input to the same output are enabled
+    std::vector<Network> networks;
+    double sampleRate = 0.0;
+    double mixingTimeSeconds = 0.0;
+    // Where the crossfade starts and how long it lasts
+    size_t splitStart = 0;
+    size_t splitLength = 0;
+
+    // Fits the networks to a (partitioned IR style) impulse response, returns nullptr if it's too short to have a late
+    // tail worth replacing. This allocates and takes a while, so it must not be called from the audio thread
+    static std::shared_ptr<const LateReverb> fit(const juce::dsp::AudioBlock<const float>& block, const double sampleRate);
+    // Returns the early part the convolution keeps
+    juce::AudioBuffer<float> getEarlyPart(const juce::dsp::AudioBlock<const float>& block) const;
+    // Returns a copy whose equalisers also apply a response, given in decibels at a frequency. It's matched at the
+    // centre of every band, which is close enough for smooth responses. This allocates, like fit()
+    std::shared_ptr<const LateReverb> withResponse(const std::function<double(double)>& getGainDecibels) const;
+    // Returns a copy playing the late tail of a blend: the networks keep their decay times, and their level in every band
+    // is the one of the weighted sum of the tails, which are uncorrelated so their energies add up. This allocates, like fit()
+    std::shared_ptr<const LateReverb> withBlendedLevels(const std::vector<std::pair<const LateReverb*, float>>& weighted) const;
+    // Returns the longest delay a network can have at the given sample rate
+    static size_t getMaxDelayFor(const double sampleRate) noexcept;
+};
+
+// This class runs a network for one channel. Its buffers are allocated once for the longest delay, so it can
+// switch to the network of another impulse response on the audio thread
+class LateReverbState
+{
+// Methods
+public:
+    // Allocates the delay lines, this must not be called from the audio thread
+    void prepare(const size_t maxDelay);
+    // Clears the delay lines and the filters
+    void reset() noexcept;
+    // Adds the network's output for the input samples to the output samples
+    void process(const LateReverb::Network& network, const float* input, float* output, const size_t numSamples) noexcept;
+// Variables
+private:
+    size_t m_maxDelay = 0;
+    size_t m_position = 0;
+    // The delay lines one after the other
+    std::vector<float> m_lines;
+    std::array<float, MHV_FDN_NUM_LINES> m_absorptionStates {};
+    std::array<std::array<float, 2>, MHV_LATE_NUM_BANDS> m_equaliserStates {};
+};
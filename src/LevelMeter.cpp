@@ -0,0 +1,59 @@
+#include "LevelMeter.h"
+
+// How much of the width the name takes
+#define MHV_METER_NAME_PROPORTION 0.15f
+
+LevelMeter::LevelMeter(const juce::String& name)
+    : m_name(name)
+{
+    setInterceptsMouseClicks(false, false);
+}
+
+LevelMeter::~LevelMeter()
+{
+}
+
+void LevelMeter::update(const float peak, const float elapsedSeconds)
+{
+    const auto fallen = m_decibels - MHV_METER_FALL_DECIBELS_PER_SECOND * elapsedSeconds;
+    m_decibels = juce::jlimit(MHV_METER_FLOOR_DECIBELS, MHV_METER_CEILING_DECIBELS,
+                              juce::jmax(fallen, juce::Decibels::gainToDecibels(peak, MHV_METER_FLOOR_DECIBELS)));
+    const auto barEnd = getBarEnd(m_decibels);
+    if (barEnd == m_barEnd)
+        return;
+    // Only the stretch between the old and the new end of the bar changed
+    const auto left = juce::jmin(barEnd, m_barEnd);
+    repaint(left, 0, juce::jmax(barEnd, m_barEnd) - left, getHeight());
+    m_barEnd = barEnd;
+}
+
+void LevelMeter::paint(juce::Graphics& g)
+{
+    const auto bounds = getLocalBounds();
+    g.setColour(juce::Colours::black.withAlpha(0.6f));
+    g.fillRect(bounds.withLeft(m_barStart));
+    // The bar turns red above 0 dBFS
+    const auto zeroEnd = getBarEnd(0.0f);
+    g.setColour(juce::Colours::limegreen);
+    g.fillRect(bounds.withLeft(m_barStart).withRight(juce::jmin(m_barEnd, zeroEnd)).reduced(0, 1));
+    if (m_barEnd > zeroEnd)
+    {
+        g.setColour(juce::Colours::red);
+        g.fillRect(bounds.withLeft(zeroEnd).withRight(m_barEnd).reduced(0, 1));
+    }
+    g.setColour(juce::Colours::white);
+    g.setFont((float)getHeight());
+    g.drawText(m_name, bounds.withRight(m_barStart), juce::Justification::centredLeft, false);
+}
+
+void LevelMeter::resized()
+{
+    m_barStart = (int)((float)getWidth() * MHV_METER_NAME_PROPORTION);
+    m_barEnd = getBarEnd(m_decibels);
+}
+
+int LevelMeter::getBarEnd(const float decibels) const noexcept
+{
+    const auto proportion = (decibels - MHV_METER_FLOOR_DECIBELS) / (MHV_METER_CEILING_DECIBELS - MHV_METER_FLOOR_DECIBELS);
+    return m_barStart + juce::roundToInt(proportion * (float)(getWidth() - m_barStart));
+}
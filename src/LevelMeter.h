@@ -0,0 +1,35 @@
+#pragma once
+
+#include <juce_gui_basics/juce_gui_basics.h>
+
+// The range the meters show, in decibels
+#define MHV_METER_FLOOR_DECIBELS -60.0f
+#define MHV_METER_CEILING_DECIBELS 6.0f
+// How fast a meter falls back once the level drops
+#define MHV_METER_FALL_DECIBELS_PER_SECOND 24.0f
+
+// This component is a horizontal peak meter with its name on the left. It's updated by the editor's timer, and only
+// repaints the part of the bar that moved, when it moved by a whole pixel, so an idle meter costs nothing to draw
+class LevelMeter final : public juce::Component
+{
+// Methods
+public:
+    explicit LevelMeter(const juce::String& name);
+    ~LevelMeter() override;
+    // Shows the peak measured since the last update, the bar rises to it at once or falls back towards it
+    void update(const float peak, const float elapsedSeconds);
+    void paint(juce::Graphics& g) override;
+    void resized() override;
+private:
+    // Internal method used to get where the bar ends for a level, in pixels from the left of the component
+    int getBarEnd(const float decibels) const noexcept;
+// Variables
+private:
+    juce::String m_name;
+    float m_decibels = MHV_METER_FLOOR_DECIBELS;
+    // Where the bar was drawn last, and where the bar area starts after the name
+    int m_barEnd = 0;
+    int m_barStart = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LevelMeter)
+};
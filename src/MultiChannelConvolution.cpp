@@ -0,0 +1,456 @@
+#include "MultiChannelConvolution.h"
+#include "SpectralKernels.h"
+
+MultiChannelConvolution::MultiChannelConvolution()
+{
+}
+
+MultiChannelConvolution::~MultiChannelConvolution()
+{
+    // The workers use the engine's buffers
+    m_pool.release();
+}
+
+size_t MultiChannelConvolution::getPartitionSizeFor(const juce::uint32 maximumBlockSize)
+{
+    return (size_t)juce::nextPowerOfTwo(juce::jmax((int)maximumBlockSize, MHV_MIN_PARTITION_SIZE));
+}
+
+void MultiChannelConvolution::prepare(const juce::dsp::ProcessSpec& spec)
+{
+    const auto partitionSize = MultiChannelConvolution::getPartitionSizeFor(spec.maximumBlockSize);
+    // The impulse responses were prepared for the old settings, a new one must be set after this
+    for (auto& voice : m_voices)
+        voice.ir = nullptr;
+    m_pendingIR = nullptr;
+
+    m_numChannels = (size_t)juce::jmax((juce::uint32)1, spec.numChannels);
+    m_sampleRate = spec.sampleRate;
+    m_partitionSize = partitionSize;
+    m_fftSize = 2 * partitionSize;
+    m_numBins = partitionSize + 1;
+    m_fadeLength = (size_t)juce::jmax(1, juce::roundToInt(spec.sampleRate * MHV_IR_CROSSFADE_SECONDS));
+
+    m_inputs.assign(m_numChannels * m_partitionSize, 0.0f);
+    // The pool is stopped while the buffers it uses are reallocated
+    m_pool.release();
+    const auto numWorkers = ChannelWorkerPool::getNumWorkersFor(m_numChannels, m_channelsPerWorker);
+    m_scratches.resize(numWorkers + 1);
+    for (auto& scratch : m_scratches)
+    {
+        scratch.fft = std::make_unique<juce::dsp::FFT>(PartitionedIR::getFFTOrder(partitionSize));
+        scratch.fftBuffer.assign(2 * m_fftSize, 0.0f);
+        scratch.spectrum.assign(2 * m_numBins, 0.0f);
+        scratch.fadeBuffer.assign(m_partitionSize, 0.0f);
+    }
+    m_conversionLength = m_usesDoublePrecision ? (size_t)spec.maximumBlockSize : 0;
+    m_conversionBuffer.assign(m_numChannels * m_conversionLength, 0.0f);
+    m_conversionBuffer.shrink_to_fit();
+    m_inputPointers.assign(m_numChannels, nullptr);
+    m_outputPointers.assign(m_numChannels, nullptr);
+    for (auto& voice : m_voices)
+    {
+        voice.accumulators.assign(m_numChannels * 2 * m_numBins, 0.0f);
+        voice.overlaps.assign(m_numChannels * m_partitionSize, 0.0f);
+        // The networks of the impulse responses prepared at this sample rate fit in these delay lines
+        voice.lateReverbs.clear();
+        voice.lateReverbs.shrink_to_fit();
+        if (m_usesLateReverb)
+        {
+            voice.lateReverbs.resize(m_numChannels);
+            for (auto& lateReverb : voice.lateReverbs)
+                lateReverb.prepare(LateReverb::getMaxDelayFor(spec.sampleRate));
+        }
+    }
+
+    allocateHistory();
+    reset();
+    m_pool.prepare(numWorkers, [this](const size_t part) { processChannelGroup(part); });
+}
+
+void MultiChannelConvolution::allocateHistory()
+{
+    // The head's history is kept here, the larger partitions are handled by the tail
+    const auto layout = PartitionedIR::getLayout(m_partitionSize, m_reservedLength);
+    m_numSlots = layout.front().numPartitions;
+    m_history.assign(m_numSlots * m_numChannels * 2 * m_numBins, 0.0f);
+    m_tail.prepare(m_numChannels, layout, m_sampleRate);
+    // The channels must have been identical for the whole impulse response before they can be linked
+    const auto& lastSegment = layout.back();
+    m_numLinkPartitions = (lastSegment.offset + lastSegment.numPartitions * lastSegment.partitionSize) / m_partitionSize + 1;
+}
+
+void MultiChannelConvolution::reset()
+{
+    std::fill(m_inputs.begin(), m_inputs.end(), 0.0f);
+    std::fill(m_history.begin(), m_history.end(), 0.0f);
+    for (auto& voice : m_voices)
+    {
+        std::fill(voice.accumulators.begin(), voice.accumulators.end(), 0.0f);
+        std::fill(voice.overlaps.begin(), voice.overlaps.end(), 0.0f);
+        resetLateReverbs(voice);
+    }
+
+    m_tail.reset();
+
+    // Finish any crossfade right away, an impulse response being prepared starts over
+    if (m_fadeSamplesLeft > 0)
+        m_voices[1 - m_activeVoice].ir = nullptr;
+    m_fadeSamplesLeft = 0;
+    m_primingSamplesLeft = m_voices[1 - m_activeVoice].ir != nullptr ? m_tail.getPrimingLength() : 0;
+    m_inputPosition = 0;
+    m_currentSlot = 0;
+    // All the channels are silent now, so they're identical
+    m_partitionsUntilLinked = 0;
+}
+
+void MultiChannelConvolution::reserveLength(const size_t lengthInSamples)
+{
+    if (lengthInSamples <= m_reservedLength)
+        return;
+
+    // Growing the history loses its content, so the engine starts from silence again
+    m_reservedLength = lengthInSamples;
+    allocateHistory();
+    reset();
+}
+
+void MultiChannelConvolution::getImpulseResponsesInUse(std::array<const PartitionedIR*, MHV_MAX_IRS_IN_USE>& inUse) const noexcept
+{
+    inUse = {};
+    size_t numInUse = 0;
+    for (const auto* ir : { m_voices[0].ir, m_voices[1].ir, m_pendingIR })
+    {
+        if (ir != nullptr)
+            inUse[numInUse++] = ir;
+    }
+    m_tail.addImpulseResponsesInUse(inUse, numInUse);
+}
+
+void MultiChannelConvolution::setImpulseResponse(const PartitionedIR* newIR)
+{
+    if (newIR == nullptr)
+        return;
+
+    jassert(newIR->segments.front().partitionSize == m_partitionSize);
+    // The history can't grow on the audio thread, a longer impulse response must be reserved for beforehand
+    jassert(newIR->lengthInSamples <= m_reservedLength);
+    if (newIR->lengthInSamples > m_reservedLength)
+        return;
+
+    auto& activeVoice = m_voices[m_activeVoice];
+    auto& idleVoice = m_voices[1 - m_activeVoice];
+    // The first impulse response is used right away, there's nothing to crossfade from
+    if (activeVoice.ir == nullptr)
+    {
+        resetLateReverbs(activeVoice);
+        activeVoice.ir = newIR;
+        m_pendingIR = nullptr;
+        return;
+    }
+
+    // Going back to the current impulse response drops the one being prepared
+    const bool idleVoiceIsPriming = idleVoice.ir != nullptr && m_fadeSamplesLeft == 0;
+    if (newIR == activeVoice.ir)
+    {
+        if (idleVoiceIsPriming)
+            idleVoice.ir = nullptr;
+        m_pendingIR = nullptr;
+        return;
+    }
+
+    // The latest request wins, it will be picked up once the current switch ends
+    m_pendingIR = idleVoiceIsPriming && newIR == idleVoice.ir ? nullptr : newIR;
+}
+
+void MultiChannelConvolution::updateVoices() noexcept
+{
+    auto& idleVoice = m_voices[1 - m_activeVoice];
+    // The idle voice gets the pending impulse response, the tail starts computing it while the active voice still plays
+    if (m_pendingIR != nullptr && idleVoice.ir == nullptr)
+    {
+        // Its delay networks start now too, so their tail has built up a little when the voice is faded in
+        resetLateReverbs(idleVoice);
+        idleVoice.ir = m_pendingIR;
+        m_pendingIR = nullptr;
+        m_primingSamplesLeft = m_tail.getPrimingLength();
+    }
+
+    // Once its tail is ready it becomes the active voice. It starts without any overlap,
+    // its gain is still close to zero while it settles
+    if (idleVoice.ir != nullptr && m_fadeSamplesLeft == 0 && m_primingSamplesLeft == 0)
+    {
+        std::fill(idleVoice.overlaps.begin(), idleVoice.overlaps.end(), 0.0f);
+        m_activeVoice = 1 - m_activeVoice;
+        m_fadeSamplesLeft = m_fadeLength;
+    }
+}
+
+float* MultiChannelConvolution::getHistorySlot(const size_t slot, const size_t channel) noexcept
+{
+    return m_history.data() + (slot * m_numChannels + channel) * 2 * m_numBins;
+}
+
+bool MultiChannelConvolution::inputsAreIdentical(const float* const* input, const size_t numChannels, const size_t start, const size_t numSamples) noexcept
+{
+    for (size_t channel = 1; channel < numChannels; channel++)
+    {
+        if (std::memcmp(input[0] + start, input[channel] + start, numSamples * sizeof(float)) != 0)
+            return false;
+    }
+    return true;
+}
+
+bool MultiChannelConvolution::voicesAreMono() const noexcept
+{
+    for (const auto& voice : m_voices)
+    {
+        if (voice.ir != nullptr && voice.ir->numChannels > 1)
+            return false;
+    }
+    return true;
+}
+
+bool MultiChannelConvolution::voicesHaveLateReverb() const noexcept
+{
+    for (const auto& voice : m_voices)
+    {
+        if (voice.ir != nullptr && voice.ir->lateReverb != nullptr)
+            return true;
+    }
+    return false;
+}
+
+void MultiChannelConvolution::resetLateReverbs(Voice& voice) noexcept
+{
+    for (auto& lateReverb : voice.lateReverbs)
+        lateReverb.reset();
+}
+
+void MultiChannelConvolution::processSamples(const float* const* input, float* const* output, const size_t numChannels, const size_t numSamples) noexcept
+{
+    size_t numProcessed = 0;
+    while (numProcessed < numSamples)
+    {
+        // Impulse responses are only swapped at partition boundaries
+        const bool blockStarted = m_inputPosition == 0;
+        if (blockStarted)
+            updateVoices();
+
+        const auto numToProcess = juce::jmin(numSamples - numProcessed, m_partitionSize - m_inputPosition);
+        const bool blockFinished = m_inputPosition + numToProcess == m_partitionSize;
+
+        // Identical channels are only processed once, as long as their history and impulse response are identical too
+        bool linked = false;
+        if (numChannels > 1)
+        {
+            if (inputsAreIdentical(input, numChannels, numProcessed, numToProcess))
+                linked = m_partitionsUntilLinked == 0 && voicesAreMono() && !voicesHaveLateReverb();
+            else
+                m_partitionsUntilLinked = m_numLinkPartitions;
+        }
+        const auto numChannelsToProcess = linked ? (size_t)1 : numChannels;
+
+        // The tail stores every channel, even linked ones: the job this input belongs to may not be linked anymore
+        m_tail.pushInput(input, numChannels, numProcessed, numToProcess);
+        m_tail.waitForOutput();
+
+        // Append the new samples to the current partition
+        for (size_t channel = 0; channel < numChannelsToProcess; channel++)
+        {
+            std::copy(input[channel] + numProcessed, input[channel] + numProcessed + numToProcess,
+                      m_inputs.begin() + (std::ptrdiff_t)(channel * m_partitionSize + m_inputPosition));
+        }
+
+        // Convolve the channels, by groups when there are enough of them to keep the workers busy
+        m_chunk.output = output;
+        m_chunk.numChannels = numChannelsToProcess;
+        m_chunk.numParts = juce::jmin(m_scratches.size(), (numChannelsToProcess + m_channelsPerWorker - 1) / m_channelsPerWorker);
+        m_chunk.start = numProcessed;
+        m_chunk.numSamples = numToProcess;
+        m_chunk.blockStarted = blockStarted;
+        m_pool.run(m_chunk.numParts);
+
+        if (linked)
+        {
+            copyLinkedState(numChannels, numToProcess, blockStarted, blockFinished);
+            for (size_t channel = 1; channel < numChannels; channel++)
+                std::copy(output[0] + numProcessed, output[0] + numProcessed + numToProcess, output[channel] + numProcessed);
+        }
+
+        auto& fadingVoice = m_voices[1 - m_activeVoice];
+        if (m_fadeSamplesLeft > 0)
+        {
+            m_fadeSamplesLeft -= juce::jmin(m_fadeSamplesLeft, numToProcess);
+            if (m_fadeSamplesLeft == 0)
+                fadingVoice.ir = nullptr;
+        }
+        else if (fadingVoice.ir != nullptr)
+        {
+            m_primingSamplesLeft -= juce::jmin(m_primingSamplesLeft, numToProcess);
+        }
+        // A job queued now covers input within the partitions the channels must have been identical for, so it's linked too
+        m_tail.advance(numToProcess, { m_voices[0].ir, m_voices[1].ir }, linked);
+
+        m_inputPosition += numToProcess;
+        if (blockFinished)
+        {
+            // Move to the next partition, the oldest history slot gets reused
+            std::fill(m_inputs.begin(), m_inputs.end(), 0.0f);
+            m_inputPosition = 0;
+            m_currentSlot = m_currentSlot > 0 ? m_currentSlot - 1 : m_numSlots - 1;
+            if (m_partitionsUntilLinked > 0)
+                m_partitionsUntilLinked--;
+        }
+
+        numProcessed += numToProcess;
+    }
+}
+
+void MultiChannelConvolution::processChannelGroup(const size_t part) noexcept
+{
+    // The groups hold whole pairs of channels, with a true stereo impulse response both channels of a pair are read for each of them
+    auto& scratch = m_scratches[part];
+    const auto numPairs = (m_chunk.numChannels + 1) / 2;
+    const auto firstChannel = juce::jmin(m_chunk.numChannels, 2 * (part * numPairs / m_chunk.numParts));
+    const auto endChannel = juce::jmin(m_chunk.numChannels, 2 * ((part + 1) * numPairs / m_chunk.numParts));
+
+    for (size_t channel = firstChannel; channel < endChannel; channel++)
+        transformInput(channel, scratch);
+
+    // The previous partitions only change once per partition, so they're summed once.
+    // An impulse response that is still being prepared isn't played yet
+    const auto fadingVoiceIndex = 1 - m_activeVoice;
+    if (m_chunk.blockStarted)
+    {
+        accumulatePastPartitions(m_voices[m_activeVoice], firstChannel, endChannel);
+        if (m_fadeSamplesLeft > 0)
+            accumulatePastPartitions(m_voices[fadingVoiceIndex], firstChannel, endChannel);
+    }
+
+    for (size_t channel = firstChannel; channel < endChannel; channel++)
+    {
+        auto* channelOutput = m_chunk.output[channel] + m_chunk.start;
+        renderVoice(m_activeVoice, channel, channelOutput, m_chunk.numSamples, scratch);
+        if (m_fadeSamplesLeft == 0)
+        {
+            // The delay networks of an impulse response being prepared already run, their output isn't played yet
+            if (m_voices[fadingVoiceIndex].ir != nullptr)
+            {
+                std::fill(scratch.fadeBuffer.begin(), scratch.fadeBuffer.begin() + (std::ptrdiff_t)m_chunk.numSamples, 0.0f);
+                renderLateReverb(fadingVoiceIndex, channel, scratch.fadeBuffer.data(), m_chunk.numSamples);
+            }
+            continue;
+        }
+
+        // Crossfade linearly from the old impulse response to the new one, the samples after the end of the fade are already right
+        renderVoice(fadingVoiceIndex, channel, scratch.fadeBuffer.data(), m_chunk.numSamples, scratch);
+        const auto fadeStep = 1.0f / (float)m_fadeLength;
+        const auto fadeIn = (float)(m_fadeLength - m_fadeSamplesLeft + 1) * fadeStep;
+        SpectralKernels::get().mix(channelOutput, channelOutput, fadeIn, fadeStep, scratch.fadeBuffer.data(), 1.0f - fadeIn, -fadeStep,
+                                   juce::jmin(m_chunk.numSamples, m_fadeSamplesLeft));
+    }
+}
+
+void MultiChannelConvolution::transformInput(const size_t channel, Scratch& scratch) noexcept
+{
+    // The partition is zero padded to the FFT size
+    const auto* channelInput = m_inputs.data() + channel * m_partitionSize;
+    std::copy(channelInput, channelInput + m_partitionSize, scratch.fftBuffer.begin());
+    std::fill(scratch.fftBuffer.begin() + (std::ptrdiff_t)m_partitionSize, scratch.fftBuffer.end(), 0.0f);
+    scratch.fft->performRealOnlyForwardTransform(scratch.fftBuffer.data(), true);
+
+    auto* re = getHistorySlot(m_currentSlot, channel);
+    PartitionedIR::splitSpectrum(scratch.fftBuffer.data(), re, re + m_numBins, m_numBins);
+}
+
+void MultiChannelConvolution::accumulatePastPartitions(Voice& voice, const size_t firstChannel, const size_t endChannel) noexcept
+{
+    std::fill(voice.accumulators.begin() + (std::ptrdiff_t)(firstChannel * 2 * m_numBins),
+              voice.accumulators.begin() + (std::ptrdiff_t)(endChannel * 2 * m_numBins), 0.0f);
+
+    // One pass over the history, every partition of the impulse response is used by all the channels in a row
+    const auto& kernels = SpectralKernels::get();
+    const auto& head = voice.ir->segments.front();
+    const auto numPartitions = juce::jmin(head.numPartitions, m_numSlots);
+    for (size_t partition = 1; partition < numPartitions; partition++)
+    {
+        const auto slot = (m_currentSlot + partition) % m_numSlots;
+        for (size_t channel = firstChannel; channel < endChannel; channel++)
+        {
+            auto* acc = voice.accumulators.data() + channel * 2 * m_numBins;
+            const auto firstInput = voice.ir->getFirstInput(channel);
+            for (size_t input = firstInput; input < firstInput + voice.ir->getNumInputs(channel, m_chunk.numChannels); input++)
+            {
+                const auto* h = head.getPartition(voice.ir->getChannel(input, channel), partition);
+                const auto* x = getHistorySlot(slot, input);
+                kernels.multiplyAccumulate(acc, acc + m_numBins, x, x + m_numBins, h, h + m_numBins, m_numBins);
+            }
+        }
+    }
+}
+
+void MultiChannelConvolution::renderVoice(const size_t voiceIndex, const size_t channel, float* output, const size_t numSamples, Scratch& scratch) noexcept
+{
+    auto& voice = m_voices[voiceIndex];
+    // The current partition is added to the sum of the previous ones
+    const auto* acc = voice.accumulators.data() + channel * 2 * m_numBins;
+    std::copy(acc, acc + 2 * m_numBins, scratch.spectrum.begin());
+    const auto& kernels = SpectralKernels::get();
+    const auto firstInput = voice.ir->getFirstInput(channel);
+    for (size_t input = firstInput; input < firstInput + voice.ir->getNumInputs(channel, m_chunk.numChannels); input++)
+    {
+        const auto* h = voice.ir->segments.front().getPartition(voice.ir->getChannel(input, channel), 0);
+        const auto* x = getHistorySlot(m_currentSlot, input);
+        kernels.multiplyAccumulate(scratch.spectrum.data(), scratch.spectrum.data() + m_numBins, x, x + m_numBins, h, h + m_numBins, m_numBins);
+    }
+
+    PartitionedIR::mergeSpectrum(scratch.spectrum.data(), scratch.spectrum.data() + m_numBins, scratch.fftBuffer.data(), m_fftSize);
+    scratch.fft->performRealOnlyInverseTransform(scratch.fftBuffer.data());
+
+    // Add the tail of the previous partition
+    auto* overlap = voice.overlaps.data() + channel * m_partitionSize;
+    kernels.add(output, scratch.fftBuffer.data() + m_inputPosition, overlap + m_inputPosition, numSamples);
+
+    // Once the partition is complete, its second half becomes the next overlap
+    if (m_inputPosition + numSamples == m_partitionSize)
+        std::copy(scratch.fftBuffer.begin() + (std::ptrdiff_t)m_partitionSize, scratch.fftBuffer.begin() + (std::ptrdiff_t)m_fftSize, overlap);
+
+    // The larger partitions were computed ahead of time
+    m_tail.addOutput(voiceIndex, channel, output, numSamples);
+    renderLateReverb(voiceIndex, channel, output, numSamples);
+}
+
+void MultiChannelConvolution::renderLateReverb(const size_t voiceIndex, const size_t channel, float* output, const size_t numSamples) noexcept
+{
+    auto& voice = m_voices[voiceIndex];
+    if (voice.ir->lateReverb == nullptr || channel >= voice.lateReverbs.size())
+        return;
+    // The network of the impulse response's channel from this input to this output was taken out of its early part
+    const auto& network = voice.ir->lateReverb->networks[voice.ir->getChannel(channel, channel)];
+    if (network.enabled)
+        voice.lateReverbs[channel].process(network, m_inputs.data() + channel * m_partitionSize + m_inputPosition, output, numSamples);
+}
+
+void MultiChannelConvolution::copyLinkedState(const size_t numChannels, const size_t numSamples, const bool blockStarted, const bool blockFinished) noexcept
+{
+    const auto* firstInput = m_inputs.data() + m_inputPosition;
+    const auto* firstSpectrum = getHistorySlot(m_currentSlot, 0);
+    for (size_t channel = 1; channel < numChannels; channel++)
+    {
+        std::copy(firstInput, firstInput + numSamples, m_inputs.begin() + (std::ptrdiff_t)(channel * m_partitionSize + m_inputPosition));
+        std::copy(firstSpectrum, firstSpectrum + 2 * m_numBins, getHistorySlot(m_currentSlot, channel));
+
+        for (auto& voice : m_voices)
+        {
+            if (voice.ir == nullptr)
+                continue;
+            if (blockStarted)
+                std::copy(voice.accumulators.begin(), voice.accumulators.begin() + (std::ptrdiff_t)(2 * m_numBins),
+                          voice.accumulators.begin() + (std::ptrdiff_t)(channel * 2 * m_numBins));
+            if (blockFinished)
+                std::copy(voice.overlaps.begin(), voice.overlaps.begin() + (std::ptrdiff_t)m_partitionSize,
+                          voice.overlaps.begin() + (std::ptrdiff_t)(channel * m_partitionSize));
+        }
+    }
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <juce_dsp/juce_dsp.h>
+#include "ChannelWorkerPool.h"
+#include "ConvolutionTail.h"
+#include "PartitionedIR.h"
+
+// The smallest partition the engine uses, smaller host blocks are gathered until a partition is full
+#define MHV_MIN_PARTITION_SIZE 64
+// How long the crossfade between two impulse responses lasts
+#define MHV_IR_CROSSFADE_SECONDS 0.05
+
+// This class convolves every channel of a block with one shared, partitioned impulse response.
+// It's a non uniformly partitioned, zero latency overlap-add convolution. The head of the impulse
+// response uses small partitions and is computed here on the audio thread: each channel keeps its own
+// input history, but the impulse response partitions are stored only once and every channel is
+// multiplied with a partition while it's still in the cache. The input spectra are stored channel
+// after channel for every partition slot, so a multiply-accumulate pass walks the memory linearly.
+// The rest of the impulse response uses larger partitions, computed ahead of time by ConvolutionTail,
+// so the audio thread's load stays low and flat whatever the block size.
+// When all the channels receive the same signal (a mono source on a stereo track) the first
+// channel is convolved once and its result and state are copied to the other channels.
+// With many channels (surround and immersive layouts) the head is processed by groups of channels, spread
+// over a few worker threads. The channels cycle over the impulse response's channels, so with a stereo
+// impulse response the left and right speakers of every layout get the left and right channels.
+// The spectra are computed in single precision, juce::dsp::FFT only works on floats, so double precision
+// blocks are converted to floats on their way in and back on their way out.
+// An impulse response prepared for the hybrid mode only holds its early part, every voice then runs the
+// delay networks fitted to its late tail, one per channel, next to the convolution.
+class MultiChannelConvolution
+{
+// Methods
+public:
+    MultiChannelConvolution();
+    ~MultiChannelConvolution();
+    // Prepares the engine and forgets the impulse response, this allocates and must not be called from the audio thread
+    void prepare(const juce::dsp::ProcessSpec& spec);
+    // Sets whether the engine gets double precision blocks, the conversion buffer is only allocated for them.
+    // It's applied by the next call to prepare()
+    void setUsesDoublePrecision(const bool usesDoublePrecision) noexcept { m_usesDoublePrecision = usesDoublePrecision; }
+    // Sets whether the impulse responses may come with a late reverb (the hybrid mode), the delay networks are
+    // only allocated for them. It's applied by the next call to prepare()
+    void setUsesLateReverb(const bool usesLateReverb) noexcept { m_usesLateReverb = usesLateReverb; }
+    // Sets how many channels make a group worth a worker thread, groups hold whole pairs of channels so it's at least 2.
+    // Offline renders use smaller groups, they can take every core. It's applied by the next call to prepare()
+    void setChannelsPerWorker(const size_t channelsPerWorker) noexcept { m_channelsPerWorker = juce::jmax((size_t)2, channelsPerWorker); }
+    // Clears the input history and the overlap buffers
+    void reset();
+    // Processes a block, the impulse response's partition size must match getPartitionSize()
+    template <typename ProcessContext>
+    void process(const ProcessContext& context) noexcept
+    {
+        const auto& inputBlock = context.getInputBlock();
+        auto& outputBlock = context.getOutputBlock();
+        const auto numChannels = juce::jmin(inputBlock.getNumChannels(), outputBlock.getNumChannels(), m_numChannels);
+        const auto numSamples = outputBlock.getNumSamples();
+
+        // Without an impulse response the signal goes through untouched
+        if (context.isBypassed || m_voices[m_activeVoice].ir == nullptr)
+        {
+            if (context.usesSeparateInputAndOutputBlocks())
+                outputBlock.copyFrom(inputBlock);
+            return;
+        }
+
+        if constexpr (std::is_same_v<typename ProcessContext::SampleType, float>)
+        {
+            for (size_t channel = 0; channel < numChannels; channel++)
+            {
+                m_inputPointers[channel] = inputBlock.getChannelPointer(channel);
+                m_outputPointers[channel] = outputBlock.getChannelPointer(channel);
+            }
+            processSamples(m_inputPointers.data(), m_outputPointers.data(), numChannels, numSamples);
+        }
+        else
+        {
+            // The samples go through the conversion buffer, in parts if the block is larger than announced
+            jassert(m_conversionLength > 0);
+            for (size_t start = 0; start < numSamples && m_conversionLength > 0; start += m_conversionLength)
+            {
+                const auto length = juce::jmin(m_conversionLength, numSamples - start);
+                for (size_t channel = 0; channel < numChannels; channel++)
+                {
+                    auto* samples = m_conversionBuffer.data() + channel * m_conversionLength;
+                    const auto* input = inputBlock.getChannelPointer(channel) + start;
+                    for (size_t i = 0; i < length; i++)
+                        samples[i] = (float)input[i];
+                    m_inputPointers[channel] = samples;
+                    m_outputPointers[channel] = samples;
+                }
+                processSamples(m_inputPointers.data(), m_outputPointers.data(), numChannels, length);
+                for (size_t channel = 0; channel < numChannels; channel++)
+                {
+                    const auto* samples = m_conversionBuffer.data() + channel * m_conversionLength;
+                    auto* output = outputBlock.getChannelPointer(channel) + start;
+                    for (size_t i = 0; i < length; i++)
+                        output[i] = (typename ProcessContext::SampleType)samples[i];
+                }
+            }
+        }
+    }
+    // Sets the impulse response. Its tail is computed first, then it's swapped in with a crossfade at a partition boundary.
+    // The engine doesn't own the impulse response, so it must outlive its use here. It must fit in the reserved length,
+    // a longer one is refused, so this never allocates
+    void setImpulseResponse(const PartitionedIR* newIR);
+    // Makes sure the input history can hold an impulse response of the given length. This allocates and restarts the tail,
+    // so it must not be called while the engine processes
+    void reserveLength(const size_t lengthInSamples);
+    // Returns the length of impulse response the input history can hold
+    size_t getReservedLength() const noexcept { return m_reservedLength; }
+    // Lists the impulse responses the engine and its tail still point to, the rest of the list is left empty.
+    // Called from the audio thread between blocks, an impulse response missing from the list can be freed
+    void getImpulseResponsesInUse(std::array<const PartitionedIR*, MHV_MAX_IRS_IN_USE>& inUse) const noexcept;
+    // Returns the partition size chosen in prepare()
+    size_t getPartitionSize() const noexcept { return m_partitionSize; }
+    // Returns true while a new impulse response is pending, being prepared or crossfaded in
+    bool isChangingImpulseResponse() const noexcept { return m_pendingIR != nullptr || m_voices[1 - m_activeVoice].ir != nullptr; }
+    // Returns the partition size used for the given maximum block size
+    static size_t getPartitionSizeFor(const juce::uint32 maximumBlockSize);
+private:
+    // An impulse response with its accumulated spectra and overlap buffers,
+    // there are two of them so the engine can crossfade between impulse responses
+    struct Voice
+    {
+        const PartitionedIR* ir = nullptr;
+        std::vector<float> accumulators;
+        std::vector<float> overlaps;
+        // The delay networks of every channel, empty unless the engine uses late reverbs
+        std::vector<LateReverbState> lateReverbs;
+    };
+    // The working buffers of a group of channels, each thread working on a group has its own
+    struct Scratch
+    {
+        std::unique_ptr<juce::dsp::FFT> fft;
+        std::vector<float> fftBuffer;
+        std::vector<float> spectrum;
+        std::vector<float> fadeBuffer;
+    };
+    // What the channel groups process in the current part of the block
+    struct Chunk
+    {
+        float* const* output = nullptr;
+        size_t numChannels = 0;
+        size_t numParts = 1;
+        size_t start = 0;
+        size_t numSamples = 0;
+        bool blockStarted = false;
+    };
+    // Internal method used to convolve the given channels
+    void processSamples(const float* const* input, float* const* output, const size_t numChannels, const size_t numSamples) noexcept;
+    // Internal method used to convolve a group of channels for the current chunk, it can run on any thread
+    void processChannelGroup(const size_t part) noexcept;
+    // Internal method used to transform the current input partition of a channel into the history
+    void transformInput(const size_t channel, Scratch& scratch) noexcept;
+    // Internal method used to sum the contribution of all the previous input partitions
+    void accumulatePastPartitions(Voice& voice, const size_t firstChannel, const size_t endChannel) noexcept;
+    // Internal method used to compute a voice's output for a channel
+    void renderVoice(const size_t voiceIndex, const size_t channel, float* output, const size_t numSamples, Scratch& scratch) noexcept;
+    // Internal method used to add the output of a voice's delay network for a channel, if its impulse response has a late reverb
+    void renderLateReverb(const size_t voiceIndex, const size_t channel, float* output, const size_t numSamples) noexcept;
+    // Internal method used to clear a voice's delay networks before it starts a new impulse response
+    void resetLateReverbs(Voice& voice) noexcept;
+    // Internal method used to copy the state of the first channel to the other ones
+    void copyLinkedState(const size_t numChannels, const size_t numSamples, const bool blockStarted, const bool blockFinished) noexcept;
+    // Internal method used to start preparing the pending impulse response, and to crossfade to it once it's ready
+    void updateVoices() noexcept;
+    // Internal method used to allocate the input history for the reserved length
+    void allocateHistory();
+    // Returns the spectrum stored for a channel in a history slot
+    float* getHistorySlot(const size_t slot, const size_t channel) noexcept;
+    // Returns true if the impulse responses in use have a single channel
+    bool voicesAreMono() const noexcept;
+    // Returns true if an impulse response in use has a late reverb, its delay networks can't be linked
+    bool voicesHaveLateReverb() const noexcept;
+    // Returns true if all the channels hold the same samples
+    static bool inputsAreIdentical(const float* const* input, const size_t numChannels, const size_t start, const size_t numSamples) noexcept;
+// Variables
+private:
+    size_t m_numChannels = 0;
+    // The tail's deadlines are measured at this rate
+    double m_sampleRate = 0.0;
+    size_t m_partitionSize = 0;
+    size_t m_fftSize = 0;
+    size_t m_numBins = 0;
+    size_t m_numSlots = 1;
+    size_t m_reservedLength = 0;
+    // The samples of the current input partition for each channel
+    std::vector<float> m_inputs;
+    // The input spectra, for each partition slot the channels are stored next to each other
+    std::vector<float> m_history;
+    // Working buffers, one set per channel group
+    std::vector<Scratch> m_scratches;
+    size_t m_channelsPerWorker = MHV_CHANNELS_PER_WORKER;
+    // Holds double precision blocks converted to floats, it's empty in single precision
+    bool m_usesDoublePrecision = false;
+    std::vector<float> m_conversionBuffer;
+    size_t m_conversionLength = 0;
+    bool m_usesLateReverb = false;
+    std::vector<const float*> m_inputPointers;
+    std::vector<float*> m_outputPointers;
+    std::array<Voice, 2> m_voices;
+    size_t m_activeVoice = 0;
+    const PartitionedIR* m_pendingIR = nullptr;
+    size_t m_fadeLength = 0;
+    size_t m_fadeSamplesLeft = 0;
+    // How long the idle voice's impulse response still needs before its tail is ready
+    size_t m_primingSamplesLeft = 0;
+    size_t m_inputPosition = 0;
+    size_t m_currentSlot = 0;
+    // How many full partitions must still be identical before the channels can be processed as one
+    size_t m_partitionsUntilLinked = 0;
+    size_t m_numLinkPartitions = 1;
+    // The segments after the head
+    ConvolutionTail m_tail;
+    // The threads processing the channel groups, and what they're working on
+    ChannelWorkerPool m_pool;
+    Chunk m_chunk;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MultiChannelConvolution)
+};
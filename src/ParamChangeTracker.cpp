@@ -0,0 +1,101 @@
+#include "ParamChangeTracker.h"
+
+// The IDs of the parameters, in the order of ParamIndices
+static const char* const trackedParameterIDs[ParamCount] = { MHV_PID_INPUT_GAIN, MHV_PID_OUTPUT_GAIN, MHV_PID_DRY_WET, MHV_PID_IR_INDEX,
+                                                             MHV_PID_USE_USER_IR, MHV_PID_MORPH, MHV_PID_POSITION, MHV_PID_LAYERS, MHV_PID_NEAR_LEVEL,
+                                                             MHV_PID_FAR_LEVEL, MHV_PID_WHEREVER_LEVEL, MHV_PID_PRE_DELAY,
+                                                             MHV_PID_LOW_CUT, MHV_PID_HIGH_CUT, MHV_PID_TILT };
+
+ParamChangeTracker::ParamChangeTracker(juce::AudioProcessorValueTreeState& apvts)
+    : m_apvts(apvts)
+{
+    for (const auto* parameterID : trackedParameterIDs)
+        m_apvts.addParameterListener(parameterID, this);
+}
+
+ParamChangeTracker::~ParamChangeTracker()
+{
+    for (const auto* parameterID : trackedParameterIDs)
+        m_apvts.removeParameterListener(parameterID, this);
+}
+
+int ParamChangeTracker::getParamIndex(const juce::String& parameterID) noexcept
+{
+    for (int paramIndex = 0; paramIndex < ParamCount; paramIndex++)
+    {
+        if (parameterID == trackedParameterIDs[paramIndex])
+            return paramIndex;
+    }
+    return -1;
+}
+
+juce::StringArray ParamChangeTracker::getParamIDs()
+{
+    return juce::StringArray(trackedParameterIDs, (int)ParamCount);
+}
+
+void ParamChangeTracker::parameterChanged(const juce::String& parameterID, float newValue)
+{
+    juce::ignoreUnused(newValue);
+    const auto paramIndex = getParamIndex(parameterID);
+    if (paramIndex < 0)
+        return;
+    // The parameter's value is stored before its listeners are called, and its version is bumped
+    // before the global one, so the audio thread never sees the new version with the old value
+    m_paramVersions[(size_t)paramIndex].fetch_add(1, std::memory_order_release);
+    m_version.fetch_add(1, std::memory_order_release);
+}
+
+juce::uint32 ParamChangeTracker::fetchChanges() noexcept
+{
+    const auto version = m_version.load(std::memory_order_acquire);
+    if (version == m_seenVersion)
+        return 0;
+    m_seenVersion = version;
+
+    juce::uint32 changes = 0;
+    for (size_t paramIndex = 0; paramIndex < m_paramVersions.size(); paramIndex++)
+    {
+        const auto paramVersion = m_paramVersions[paramIndex].load(std::memory_order_acquire);
+        if (paramVersion != m_seenParamVersions[paramIndex])
+        {
+            m_seenParamVersions[paramIndex] = paramVersion;
+            changes |= (juce::uint32)1 << paramIndex;
+        }
+    }
+    return changes;
+}
+
+bool ParamChangeTracker::scheduleChange(const int paramIndex, const float plainValue, const juce::int64 position) noexcept
+{
+    if (paramIndex < 0 || paramIndex >= ParamCount)
+        return false;
+    const auto scope = m_fifo.write(1);
+    if (scope.blockSize1 == 0)
+        return false;
+    m_scheduledChanges[(size_t)scope.startIndex1] = { paramIndex, plainValue, position };
+    return true;
+}
+
+bool ParamChangeTracker::getNextChangeBefore(const juce::int64 end, ScheduledChange& change) const noexcept
+{
+    if (m_fifo.getNumReady() == 0)
+        return false;
+    int start1, size1, start2, size2;
+    m_fifo.prepareToRead(1, start1, size1, start2, size2);
+    const auto& nextChange = m_scheduledChanges[(size_t)start1];
+    if (nextChange.position >= end)
+        return false;
+    change = nextChange;
+    return true;
+}
+
+void ParamChangeTracker::popChange() noexcept
+{
+    m_fifo.finishedRead(1);
+}
+
+void ParamChangeTracker::clearScheduledChanges() noexcept
+{
+    m_fifo.reset();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <juce_audio_processors/juce_audio_processors.h>
+#include "HelperStructs.h"
+
+// How many scheduled parameter changes can wait in the queue
+#define MHV_SCHEDULED_CHANGE_QUEUE_SIZE 1024
+
+// This class tells the audio thread which parameters changed, and when.
+// Every parameter has a version counter bumped by its listener, and a global counter is bumped after it,
+// so a block in which nothing changed costs a single atomic load. Hosts only hand the parameters over
+// between blocks, so those changes apply from the start of the next block. Changes can also be scheduled
+// at a sample position of the processor's timeline (the samples processed since prepareToPlay), the block
+// is then split there, so an offline render lands them on the same sample whatever its block size.
+class ParamChangeTracker final : private juce::AudioProcessorValueTreeState::Listener
+{
+// Methods
+public:
+    // A change of a parameter at a position of the timeline
+    struct ScheduledChange
+    {
+        int paramIndex = 0;
+        float plainValue = 0.0f;
+        juce::int64 position = 0;
+    };
+
+    explicit ParamChangeTracker(juce::AudioProcessorValueTreeState& apvts);
+    ~ParamChangeTracker() override;
+    // Returns the mask of the parameters changed since the last call (see ParamIndices), called from the audio thread
+    juce::uint32 fetchChanges() noexcept;
+    // Schedules a change, the changes must be scheduled in the order of their positions and from a single thread.
+    // Returns false if the queue is full
+    bool scheduleChange(const int paramIndex, const float plainValue, const juce::int64 position) noexcept;
+    // Gets the next scheduled change if it comes before the given position, called from the audio thread
+    bool getNextChangeBefore(const juce::int64 end, ScheduledChange& change) const noexcept;
+    // Removes the change returned by getNextChangeBefore(), called from the audio thread
+    void popChange() noexcept;
+    // Drops the scheduled changes, this must not be called while the processor is processing
+    void clearScheduledChanges() noexcept;
+    // Returns the index of a parameter ID, or -1 if it isn't one of the parameters the audio thread reads
+    static int getParamIndex(const juce::String& parameterID) noexcept;
+    // Returns the IDs of the parameters the audio thread reads, in the order of ParamIndices
+    static juce::StringArray getParamIDs();
+private:
+    // Called by the thread that changed the parameter, the audio thread itself with some hosts
+    void parameterChanged(const juce::String& parameterID, float newValue) override;
+// Variables
+private:
+    juce::AudioProcessorValueTreeState& m_apvts;
+    std::atomic<juce::uint32> m_version { 0 };
+    std::array<std::atomic<juce::uint32>, ParamCount> m_paramVersions {};
+    // The versions the audio thread saw last
+    juce::uint32 m_seenVersion = 0;
+    std::array<juce::uint32, ParamCount> m_seenParamVersions {};
+    juce::AbstractFifo m_fifo { MHV_SCHEDULED_CHANGE_QUEUE_SIZE };
+    std::array<ScheduledChange, MHV_SCHEDULED_CHANGE_QUEUE_SIZE> m_scheduledChanges;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ParamChangeTracker)
+};
@@ -4,10 +4,38 @@
 #define MHV_PID_OUTPUT_GAIN "outputGain"
 #define MHV_PID_DRY_WET "dryWet"
 #define MHV_PID_IR_INDEX "irIndex"
+#define MHV_PID_IR_TRIM "irTrim"
+#define MHV_PID_USE_USER_IR "useUserIR"
+#define MHV_PID_ECO "eco"
+#define MHV_PID_QUALITY "quality"
+#define MHV_PID_MORPH "morph"
+#define MHV_PID_POSITION "position"
+#define MHV_PID_LATENCY_MODE "latencyMode"
+#define MHV_PID_LAYERS "layers"
+#define MHV_PID_NEAR_LEVEL "nearLevel"
+#define MHV_PID_FAR_LEVEL "farLevel"
+#define MHV_PID_WHEREVER_LEVEL "whereverLevel"
+#define MHV_PID_PRE_DELAY "preDelay"
+#define MHV_PID_LOW_CUT "lowCut"
+#define MHV_PID_HIGH_CUT "highCut"
+#define MHV_PID_TILT "tilt"
 
 #define MHV_NEAR_STR "Near..."
 #define MHV_FAR_STR "Far..."
 #define MHV_WHEREVER_STR "Wherever you are?"
+#define MHV_USER_IR_STR "Your own"
+
+#define MHV_TRIM_OFF_STR "No trim"
+#define MHV_TRIM_60_STR "Trim at -60 dB"
+#define MHV_TRIM_80_STR "Trim at -80 dB"
+#define MHV_TRIM_96_STR "Trim at -96 dB"
+
+#define MHV_QUALITY_FULL_STR "Full convolution"
+#define MHV_QUALITY_HYBRID_STR "Hybrid"
+
+#define MHV_LATENCY_ZERO_STR "Zero latency"
+#define MHV_LATENCY_LOW_CPU_STR "Low CPU"
+#define MHV_LATENCY_AUTOMATIC_STR "Automatic"
 
 #define MHV_PV_MIN_GAIN -24.0f
 #define MHV_PV_MAX_GAIN 6.0f
@@ -18,3 +46,47 @@
 #define MHV_PV_MIN_MIX 0.0f
 #define MHV_PV_MAX_MIX 100.0f
 #define MHV_INVALID_IR_INDEX -1
+#define MHV_IR_COUNT 3
+// The user's impulse response replaces the selected one while it's on, so the choice keeps its mapping
+#define MHV_PV_DEFAULT_USE_USER_IR false
+#define MHV_PV_DEFAULT_TRIM 2
+#define MHV_PV_DEFAULT_ECO false
+// The quality choice, the hybrid mode replaces the late tail with fitted delay networks
+#define MHV_QUALITY_FULL 0
+#define MHV_QUALITY_HYBRID 1
+#define MHV_PV_DEFAULT_QUALITY MHV_QUALITY_FULL
+// The morph position goes from the first embedded impulse response to the last one
+#define MHV_PV_DEFAULT_MORPH false
+#define MHV_PV_MIN_POSITION 0.0f
+#define MHV_PV_MAX_POSITION (float)(MHV_IR_COUNT - 1)
+#define MHV_PV_DEFAULT_POSITION 0.0f
+#define MHV_PV_POSITION_STEP 0.001f
+// The layers stack the embedded impulse responses at their levels, the lowest level leaves one out
+#define MHV_PV_DEFAULT_LAYERS false
+#define MHV_PV_MIN_LEVEL -48.0f
+#define MHV_PV_MAX_LEVEL 0.0f
+#define MHV_PV_DEFAULT_NEAR_LEVEL MHV_PV_MAX_LEVEL
+#define MHV_PV_DEFAULT_LEVEL MHV_PV_MIN_LEVEL
+// The latency mode choice, the automatic mode is zero latency in real-time and gathers large partitions offline
+#define MHV_LATENCY_ZERO 0
+#define MHV_LATENCY_LOW_CPU 1
+#define MHV_LATENCY_AUTOMATIC 2
+#define MHV_PV_DEFAULT_LATENCY_MODE MHV_LATENCY_AUTOMATIC
+// The pre-delay in milliseconds, it's rounded to whole samples
+#define MHV_PV_MIN_PRE_DELAY 0.0f
+#define MHV_PV_MAX_PRE_DELAY 250.0f
+#define MHV_PV_DEFAULT_PRE_DELAY 0.0f
+#define MHV_PV_PRE_DELAY_STEP 0.1f
+// The wet tone, in hertz for the cuts and in decibels for the tilt. The lowest low cut and the highest high cut are off
+#define MHV_PV_MIN_LOW_CUT 20.0f
+#define MHV_PV_MAX_LOW_CUT 1000.0f
+#define MHV_PV_MIN_HIGH_CUT 1000.0f
+#define MHV_PV_MAX_HIGH_CUT 20000.0f
+#define MHV_PV_FREQUENCY_STEP 1.0f
+#define MHV_PV_FREQUENCY_SKEW 0.3f
+#define MHV_PV_MIN_TILT -6.0f
+#define MHV_PV_MAX_TILT 6.0f
+#define MHV_PV_DEFAULT_TILT 0.0f
+
+// The state property holding the path of the user's impulse response
+#define MHV_STATE_USER_IR_PATH "userIRPath"
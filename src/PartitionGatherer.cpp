@@ -0,0 +1,69 @@
+#include "PartitionGatherer.h"
+
+PartitionGatherer::PartitionGatherer()
+{
+}
+
+PartitionGatherer::~PartitionGatherer()
+{
+}
+
+void PartitionGatherer::prepare(const size_t numChannels, const size_t partitionSize)
+{
+    m_partitionSize = partitionSize;
+    m_numChannels = numChannels;
+    // Nothing is held when the engine gets the blocks directly
+    for (auto& buffer : m_buffers)
+    {
+        if (partitionSize > 0)
+            buffer.setSize((int)numChannels, (int)partitionSize);
+        else
+            buffer = juce::AudioBuffer<float>();
+    }
+    reset();
+}
+
+void PartitionGatherer::reset() noexcept
+{
+    for (auto& buffer : m_buffers)
+        buffer.clear();
+    m_gathering = 0;
+    m_position = 0;
+}
+
+template <typename SampleType>
+size_t PartitionGatherer::exchange(const juce::dsp::AudioBlock<const SampleType>& input, juce::dsp::AudioBlock<SampleType>& output) noexcept
+{
+    jassert(m_partitionSize > 0 && !isFull());
+    const auto numChannels = juce::jmin(input.getNumChannels(), output.getNumChannels(), m_numChannels);
+    const auto numSamples = juce::jmin(input.getNumSamples(), output.getNumSamples(), m_partitionSize - m_position);
+    for (size_t channel = 0; channel < numChannels; channel++)
+    {
+        // The input is read before the output is written, so they can share their samples
+        const auto* source = input.getChannelPointer(channel);
+        auto* gathered = m_buffers[m_gathering].getWritePointer((int)channel, (int)m_position);
+        for (size_t i = 0; i < numSamples; i++)
+            gathered[i] = (float)source[i];
+        const auto* played = m_buffers[1 - m_gathering].getReadPointer((int)channel, (int)m_position);
+        auto* destination = output.getChannelPointer(channel);
+        for (size_t i = 0; i < numSamples; i++)
+            destination[i] = (SampleType)played[i];
+    }
+    m_position += numSamples;
+    return numSamples;
+}
+
+juce::dsp::AudioBlock<float> PartitionGatherer::getPartition() noexcept
+{
+    return juce::dsp::AudioBlock<float>(m_buffers[m_gathering]);
+}
+
+void PartitionGatherer::finishPartition() noexcept
+{
+    // The partition played until now is overwritten while the next one is gathered
+    m_gathering = 1 - m_gathering;
+    m_position = 0;
+}
+
+template size_t PartitionGatherer::exchange<float>(const juce::dsp::AudioBlock<const float>&, juce::dsp::AudioBlock<float>&) noexcept;
+template size_t PartitionGatherer::exchange<double>(const juce::dsp::AudioBlock<const double>&, juce::dsp::AudioBlock<double>&) noexcept;
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <juce_dsp/juce_dsp.h>
+
+// The partitions gathered in the low CPU mode and in offline renders, in samples at the engine's rate
+#define MHV_LOW_CPU_PARTITION_SIZE 1024
+#define MHV_OFFLINE_PARTITION_SIZE 2048
+// Offline renders give every pair of channels a worker thread
+#define MHV_OFFLINE_CHANNELS_PER_WORKER 2
+
+// This class feeds the convolution engine whole partitions, for the latency modes trading latency for CPU.
+// The engine is zero latency: every block it gets is transformed and multiplied with the head of the impulse
+// response, even when it only fills a small part of a partition, so small host blocks cost almost as much as
+// full partitions. Here the wet signal is gathered until a partition of the given size is full, the engine
+// processes it in one go, and its output is played while the next one is gathered. The wet signal is then
+// delayed by exactly one partition, which the plugin reports as its latency.
+// The partitions are always in single precision, like the engine: exchange() converts a double precision
+// host's samples on their way in and out.
+class PartitionGatherer
+{
+// Methods
+public:
+    PartitionGatherer();
+    ~PartitionGatherer();
+    // Allocates the partitions, a size of 0 turns the gathering off. This must not be called from the audio thread
+    void prepare(const size_t numChannels, const size_t partitionSize);
+    // Clears the partitions, the next one starts empty
+    void reset() noexcept;
+    // Returns the size of the partitions, or 0 when the gathering is off
+    size_t getPartitionSize() const noexcept { return m_partitionSize; }
+    // Copies the input to the partition being gathered and the output of the previous one to the output, up to the
+    // end of the partition. Returns how many samples were exchanged, the input and the output may be the same block
+    template <typename SampleType>
+    size_t exchange(const juce::dsp::AudioBlock<const SampleType>& input, juce::dsp::AudioBlock<SampleType>& output) noexcept;
+    // Returns true once the partition being gathered is full, it must then be processed and finished
+    bool isFull() const noexcept { return m_position == m_partitionSize; }
+    // Returns the full partition, the engine processes it in place
+    juce::dsp::AudioBlock<float> getPartition() noexcept;
+    // Makes the processed partition the one played next, and starts gathering a new one
+    void finishPartition() noexcept;
+// Variables
+private:
+    size_t m_partitionSize = 0;
+    size_t m_numChannels = 0;
+    // The partition being gathered, and the processed one being played
+    juce::AudioBuffer<float> m_buffers[2];
+    int m_gathering = 0;
+    size_t m_position = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PartitionGatherer)
+};
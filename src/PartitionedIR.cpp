@@ -0,0 +1,188 @@
+#include "PartitionedIR.h"
+
+// Fills the overview with the peaks of the audible part of the impulse response
+static void measureOverview(const juce::dsp::AudioBlock<const float>& block, const size_t decayLength,
+                            std::array<float, MHV_IR_OVERVIEW_SIZE>& overview)
+{
+    overview.fill(0.0f);
+    const auto length = juce::jmin(decayLength, block.getNumSamples());
+    if (length == 0)
+        return;
+    float highest = 0.0f;
+    for (size_t slice = 0; slice < overview.size(); slice++)
+    {
+        // The slices are rounded out, so a short impulse response still has every sample in one of them
+        const auto start = slice * length / overview.size();
+        const auto end = juce::jmax(start + 1, (slice + 1) * length / overview.size());
+        for (size_t channel = 0; channel < block.getNumChannels(); channel++)
+        {
+            const auto range = block.getSingleChannelBlock(channel).getSubBlock(start, juce::jmin(end, length) - start).findMinAndMax();
+            overview[slice] = juce::jmax(overview[slice], -range.getStart(), range.getEnd());
+        }
+        highest = juce::jmax(highest, overview[slice]);
+    }
+    if (highest > 0.0f)
+        for (auto& peak : overview)
+            peak /= highest;
+}
+
+std::shared_ptr<const PartitionedIR> PartitionedIR::create(const juce::dsp::AudioBlock<const float>& fullBlock, const double sampleRate,
+                                                           const size_t headPartitionSize, const bool hybrid)
+{
+    auto ir = std::make_shared<PartitionedIR>();
+    ir->numChannels = juce::jmax((size_t)1, fullBlock.getNumChannels());
+    // The audible length is the one of the whole impulse response, the networks keep playing after the early part
+    ir->decayLengthInSamples = PartitionedIR::getDecayLength(fullBlock, MHV_DECAY_FLOOR_DECIBELS);
+    ir->sampleRate = sampleRate;
+    measureOverview(fullBlock, ir->decayLengthInSamples, ir->overview);
+    ir->lateReverb = hybrid ? LateReverb::fit(fullBlock, sampleRate) : nullptr;
+    juce::AudioBuffer<float> earlyPart;
+    if (ir->lateReverb != nullptr)
+        earlyPart = ir->lateReverb->getEarlyPart(fullBlock);
+    const auto block = ir->lateReverb != nullptr ? juce::dsp::AudioBlock<const float>(earlyPart) : fullBlock;
+    ir->lengthInSamples = block.getNumSamples();
+    ir->segments = PartitionedIR::getLayout(headPartitionSize, ir->lengthInSamples);
+    PartitionedIR::transformSegments(ir->segments, block);
+
+    return ir;
+}
+
+void PartitionedIR::transformSegments(std::vector<Segment>& segments, const juce::dsp::AudioBlock<const float>& block)
+{
+    const auto numChannels = juce::jmax((size_t)1, block.getNumChannels());
+    const auto length = block.getNumSamples();
+    for (auto& segment : segments)
+    {
+        segment.spectra.assign(numChannels * segment.numPartitions * 2 * segment.numBins, 0.0f);
+
+        // The real only FFT needs twice the FFT size as working space
+        juce::dsp::FFT fft(PartitionedIR::getFFTOrder(segment.partitionSize));
+        std::vector<float> fftBuffer(2 * segment.fftSize);
+
+        for (size_t channel = 0; channel < block.getNumChannels(); channel++)
+        {
+            const auto* samples = block.getChannelPointer(channel);
+            for (size_t partition = 0; partition < segment.numPartitions; partition++)
+            {
+                // Each partition is zero padded to the FFT size
+                const auto start = juce::jmin(segment.offset + partition * segment.partitionSize, length);
+                const auto numSamples = juce::jmin(segment.partitionSize, length - start);
+                std::fill(fftBuffer.begin(), fftBuffer.end(), 0.0f);
+                std::copy(samples + start, samples + start + numSamples, fftBuffer.begin());
+                fft.performRealOnlyForwardTransform(fftBuffer.data(), true);
+
+                auto* re = const_cast<float*>(segment.getPartition(channel, partition));
+                PartitionedIR::splitSpectrum(fftBuffer.data(), re, re + segment.numBins, segment.numBins);
+            }
+        }
+    }
+}
+
+juce::AudioBuffer<float> PartitionedIR::getBuffer() const
+{
+    juce::AudioBuffer<float> buffer((int)numChannels, (int)lengthInSamples);
+    buffer.clear();
+    for (const auto& segment : segments)
+    {
+        juce::dsp::FFT fft(PartitionedIR::getFFTOrder(segment.partitionSize));
+        std::vector<float> fftBuffer(2 * segment.fftSize);
+        for (size_t channel = 0; channel < numChannels; channel++)
+        {
+            auto* samples = buffer.getWritePointer((int)channel);
+            for (size_t partition = 0; partition < segment.numPartitions; partition++)
+            {
+                // The partitions were zero padded, their samples are the first half of the inverse transform
+                const auto* re = segment.getPartition(channel, partition);
+                PartitionedIR::mergeSpectrum(re, re + segment.numBins, fftBuffer.data(), segment.fftSize);
+                fft.performRealOnlyInverseTransform(fftBuffer.data());
+                const auto start = juce::jmin(segment.offset + partition * segment.partitionSize, lengthInSamples);
+                const auto numSamples = juce::jmin(segment.partitionSize, lengthInSamples - start);
+                std::copy(fftBuffer.begin(), fftBuffer.begin() + (std::ptrdiff_t)numSamples, samples + start);
+            }
+        }
+    }
+    return buffer;
+}
+
+size_t PartitionedIR::getDecayLength(const juce::dsp::AudioBlock<const float>& block, const double floorDecibels)
+{
+    const auto length = block.getNumSamples();
+    std::vector<double> energies(length, 0.0);
+    for (size_t channel = 0; channel < block.getNumChannels(); channel++)
+    {
+        const auto* samples = block.getChannelPointer(channel);
+        for (size_t i = 0; i < length; i++)
+            energies[i] += (double)samples[i] * (double)samples[i];
+    }
+    double totalEnergy = 0.0;
+    for (const auto energy : energies)
+        totalEnergy += energy;
+
+    // Walk back from the end until the energy left after a sample is above the floor
+    const auto floorEnergy = totalEnergy * std::pow(10.0, floorDecibels / 10.0);
+    auto end = length;
+    for (double energyAfter = 0.0; end > 0 && energyAfter + energies[end - 1] <= floorEnergy; end--)
+        energyAfter += energies[end - 1];
+    return end;
+}
+
+std::vector<PartitionedIR::Segment> PartitionedIR::getLayout(const size_t headPartitionSize, const size_t lengthInSamples)
+{
+    std::vector<Segment> layout;
+    const auto length = juce::jmax((size_t)1, lengthInSamples);
+    size_t offset = 0;
+    auto partitionSize = headPartitionSize;
+    while (offset < length)
+    {
+        // A segment ends where the next one can start, at twice the next partition size.
+        // Once the partitions stop growing, the segment goes on until the end
+        const auto nextPartitionSize = juce::jmin(partitionSize * MHV_PARTITION_GROWTH, juce::jmax((size_t)MHV_MAX_PARTITION_SIZE, partitionSize));
+        const auto end = nextPartitionSize > partitionSize ? juce::jmin(2 * nextPartitionSize, length) : length;
+
+        Segment segment;
+        segment.partitionSize = partitionSize;
+        segment.fftSize = 2 * partitionSize;
+        segment.numBins = partitionSize + 1;
+        segment.numPartitions = (end - offset + partitionSize - 1) / partitionSize;
+        segment.offset = offset;
+        layout.push_back(std::move(segment));
+
+        offset += layout.back().numPartitions * partitionSize;
+        partitionSize = nextPartitionSize;
+    }
+    return layout;
+}
+
+int PartitionedIR::getFFTOrder(const size_t partitionSize)
+{
+    int order = 0;
+    while (((size_t)1 << order) < 2 * partitionSize)
+        order++;
+    return order;
+}
+
+void PartitionedIR::splitSpectrum(const float* interleaved, float* re, float* im, const size_t numBins) noexcept
+{
+    for (size_t i = 0; i < numBins; i++)
+    {
+        re[i] = interleaved[2 * i];
+        im[i] = interleaved[2 * i + 1];
+    }
+}
+
+void PartitionedIR::mergeSpectrum(const float* re, const float* im, float* interleaved, const size_t fftSize) noexcept
+{
+    const auto numBins = fftSize / 2 + 1;
+    for (size_t i = 0; i < numBins; i++)
+    {
+        interleaved[2 * i] = re[i];
+        interleaved[2 * i + 1] = im[i];
+    }
+
+    // The negative frequencies are the complex conjugates of the positive ones
+    for (size_t i = numBins; i < fftSize; i++)
+    {
+        interleaved[2 * i] = re[fftSize - i];
+        interleaved[2 * i + 1] = -im[fftSize - i];
+    }
+}
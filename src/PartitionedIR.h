@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+#include <juce_dsp/juce_dsp.h>
+#include "LateReverb.h"
+
+// How much larger the partitions of each segment are than the ones of the previous segment
+#define MHV_PARTITION_GROWTH 4
+// The partitions stop growing at this size, the last segment keeps it until the end of the impulse response
+#define MHV_MAX_PARTITION_SIZE 4096
+// How many impulse responses the engine can be pointing to at once: its two voices, the pending one,
+// and the ones the queued jobs of the tail were given
+#define MHV_MAX_IRS_IN_USE 48
+// The level, relative to its total energy, below which what's left of an impulse response is inaudible
+#define MHV_DECAY_FLOOR_DECIBELS -96.0
+// How many slices the overview the editor draws an impulse response from has
+#define MHV_IR_OVERVIEW_SIZE 256
+
+// This struct represents an impulse response split into segments of uniform partitions, already
+// transformed to the frequency domain. The first segment (the head) uses the engine's partition size,
+// every following one uses partitions MHV_PARTITION_GROWTH times larger, and starts at twice its own
+// partition size, so its partitions can be computed ahead of time without adding latency.
+// Every partition spectrum keeps its real parts first and then its imaginary parts (split layout),
+// which is the layout the convolution engine works with.
+// Once created it's never modified, so it can be shared between channels.
+// A four channel impulse response is a true stereo one (left to left, left to right, right to left,
+// right to right), each channel of a pair is fed by both of them. The other ones convolve every channel
+// on its own, cycling over their channels.
+// In the hybrid mode only the early part is partitioned, the late tail is played by the fitted networks.
+struct PartitionedIR
+{
+    // A part of the impulse response split into partitions of the same size
+    struct Segment
+    {
+        size_t partitionSize = 0;
+        size_t fftSize = 0;
+        size_t numBins = 0;
+        size_t numPartitions = 0;
+        // Where the segment starts in the impulse response
+        size_t offset = 0;
+        // The spectra, ordered by channel and then by partition
+        std::vector<float> spectra;
+
+        // Returns the real parts of a partition spectrum, the imaginary parts follow after numBins values
+        const float* getPartition(const size_t channel, const size_t partition) const noexcept
+        {
+            return spectra.data() + (channel * numPartitions + partition) * 2 * numBins;
+        }
+    };
+
+    std::vector<Segment> segments;
+    size_t numChannels = 0;
+    size_t lengthInSamples = 0;
+    // Where the energy left in the impulse response falls below MHV_DECAY_FLOOR_DECIBELS, its audible length
+    size_t decayLengthInSamples = 0;
+    double sampleRate = 0.0;
+    // The networks playing the late tail in the hybrid mode, or nullptr when the whole impulse response is convolved
+    std::shared_ptr<const LateReverb> lateReverb;
+    // The impulse response this one was made from when something was baked into it (the tone), or nullptr.
+    // It's kept alive with it, so its address can't be reused by another impulse response meanwhile
+    std::shared_ptr<const PartitionedIR> source;
+    // The peak of every slice of the audible part, over all the channels and relative to the highest one.
+    // It's drawn by the editor, and measured on the whole impulse response even in the hybrid mode
+    std::array<float, MHV_IR_OVERVIEW_SIZE> overview {};
+
+    // Returns true for a true stereo impulse response
+    bool isTrueStereo() const noexcept { return numChannels == 4; }
+    // Returns the first input channel feeding an output channel
+    size_t getFirstInput(const size_t output) const noexcept { return isTrueStereo() ? output - output % 2 : output; }
+    // Returns how many input channels feed an output channel, out of the engine's channel count
+    size_t getNumInputs(const size_t output, const size_t channelCount) const noexcept
+    {
+        return isTrueStereo() ? juce::jmin((size_t)2, channelCount - getFirstInput(output)) : 1;
+    }
+    // Returns the channel of the impulse response going from an input channel to an output channel
+    size_t getChannel(const size_t input, const size_t output) const noexcept
+    {
+        return isTrueStereo() ? (input % 2) * 2 + output % 2 : output % numChannels;
+    }
+
+    // Returns the partitioned part back in the time domain, without the late tail of the hybrid mode.
+    // This allocates and runs an inverse FFT for every partition, so it must not be called from the audio thread
+    juce::AudioBuffer<float> getBuffer() const;
+
+    // Returns the audible length of an impulse response, read from its backward integrated energy (its Schroeder curve)
+    static size_t getDecayLength(const juce::dsp::AudioBlock<const float>& block, const double floorDecibels);
+    // Creates the partitioned impulse response from time domain samples, which are only read. In the hybrid mode
+    // the late tail is replaced by feedback delay networks, unless the impulse response is too short for it
+    static std::shared_ptr<const PartitionedIR> create(const juce::dsp::AudioBlock<const float>& block, const double sampleRate,
+                                                       const size_t headPartitionSize, const bool hybrid = false);
+    // Fills the spectra of the segments of a layout with the partitions of time domain samples
+    static void transformSegments(std::vector<Segment>& segments, const juce::dsp::AudioBlock<const float>& block);
+    // Returns the segments (without spectra) used for an impulse response of the given length.
+    // The layout of a shorter impulse response is always a prefix of the layout of a longer one
+    static std::vector<Segment> getLayout(const size_t headPartitionSize, const size_t lengthInSamples);
+    // Returns the FFT order used for the given partition size
+    static int getFFTOrder(const size_t partitionSize);
+    // Converts the interleaved output of a real only forward FFT to the split layout
+    static void splitSpectrum(const float* interleaved, float* re, float* im, const size_t numBins) noexcept;
+    // Converts a split spectrum back to the interleaved (and symmetric) layout expected by the inverse FFT
+    static void mergeSpectrum(const float* re, const float* im, float* interleaved, const size_t fftSize) noexcept;
+};
@@ -0,0 +1,261 @@
+#include "PerfTrace.h"
+#include <cmath>
+
+const char* PerfTrace::getStageName(const Stage stage) noexcept
+{
+    switch (stage)
+    {
+        case Stage::block: return "block";
+        case Stage::parameters: return "parameters";
+        case Stage::inputGain: return "inputGain";
+        case Stage::convolution: return "convolution";
+        case Stage::rateConversion: return "rateConversion";
+        case Stage::mix: return "mix";
+        default: return "unknown";
+    }
+}
+
+#if MHV_PERF_TRACE
+
+// The thread draining the queue, so it never fills up while nobody asks for the statistics
+class PerfTrace::Collector final : public juce::Thread
+{
+public:
+    explicit Collector(PerfTrace& trace)
+        : juce::Thread("Performance trace"), m_trace(trace)
+    {
+        startThread(juce::Thread::Priority::low);
+    }
+
+    ~Collector() override
+    {
+        stopThread(-1);
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            m_trace.collect();
+            wait(MHV_TRACE_COLLECT_MS);
+        }
+    }
+
+private:
+    PerfTrace& m_trace;
+};
+
+// Gives every instance its own row in the Chrome trace
+static std::atomic<int> nextInstanceId { 1 };
+
+// Returns the bucket of a duration
+static size_t getBucket(const double nanos) noexcept
+{
+    if (nanos < 1.0)
+        return 0;
+    return (size_t)juce::jlimit(0, MHV_TRACE_NUM_BUCKETS - 1, (int)(std::log2(nanos) * MHV_TRACE_BUCKETS_PER_OCTAVE));
+}
+
+// Returns the upper bound of a bucket
+static double getBucketLimit(const size_t bucket) noexcept
+{
+    return std::exp2((double)(bucket + 1) / MHV_TRACE_BUCKETS_PER_OCTAVE);
+}
+
+// Returns the duration a proportion of the timings of a histogram are under, at the resolution of its buckets
+template <typename HistogramType>
+static double getPercentile(const HistogramType& histogram, const double proportion) noexcept
+{
+    const auto target = (juce::uint64)std::ceil(proportion * (double)histogram.count);
+    juce::uint64 count = 0;
+    for (size_t bucket = 0; bucket < histogram.buckets.size(); bucket++)
+    {
+        count += histogram.buckets[bucket];
+        if (count >= target)
+            return juce::jmin(getBucketLimit(bucket), histogram.maxNanos);
+    }
+    return histogram.maxNanos;
+}
+
+PerfTrace::PerfTrace()
+{
+    m_startTicks = readTicks();
+    m_startClockTicks = juce::Time::getHighResolutionTicks();
+    m_instanceId = nextInstanceId++;
+    m_collector = std::make_unique<Collector>(*this);
+}
+
+PerfTrace::~PerfTrace()
+{
+    m_collector.reset();
+    const auto directory = juce::SystemStats::getEnvironmentVariable("MHV_PERF_TRACE_DIR", {});
+    if (directory.isEmpty())
+        return;
+    const auto name = "MyHallwayVerb-" + juce::String(juce::Time::currentTimeMillis()) + "-" + juce::String(m_instanceId);
+    const juce::File folder(directory);
+    folder.createDirectory();
+    folder.getChildFile(name + ".txt").replaceWithText(getReport());
+    writeChromeTrace(folder.getChildFile(name + ".json"));
+}
+
+void PerfTrace::push(const Stage stage, const juce::uint64 start, const juce::uint64 end) noexcept
+{
+    const auto scope = m_fifo.write(1);
+    if (scope.blockSize1 == 0)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    m_events[(size_t)scope.startIndex1] = { start, (juce::uint32)juce::jmin(end - start, (juce::uint64)0xffffffff), stage };
+}
+
+double PerfTrace::getTicksPerNanosecond() const noexcept
+{
+   #if MHV_TRACE_USES_TSC || MHV_TRACE_USES_CNTVCT
+    // The counter is calibrated against the clock since the trace started, until then it's taken as 1 GHz
+    const auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - m_startClockTicks);
+    if (seconds < 0.01)
+        return 1.0;
+    return (double)(readTicks() - m_startTicks) / (seconds * 1.0e9);
+   #else
+    return (double)juce::Time::getHighResolutionTicksPerSecond() / 1.0e9;
+   #endif
+}
+
+void PerfTrace::collect()
+{
+    const juce::ScopedLock lock(m_lock);
+    collectLocked();
+}
+
+void PerfTrace::collectLocked()
+{
+    const auto numReady = m_fifo.getNumReady();
+    if (numReady == 0)
+        return;
+    const auto ticksPerNanosecond = getTicksPerNanosecond();
+    if (m_exported.capacity() == 0)
+        m_exported.reserve(MHV_TRACE_MAX_EXPORTED_EVENTS);
+    const auto scope = m_fifo.read(numReady);
+    scope.forEach([this, ticksPerNanosecond](const int index)
+    {
+        const auto& event = m_events[(size_t)index];
+        const auto nanos = (double)event.duration / ticksPerNanosecond;
+        auto& histogram = m_histograms[(size_t)event.stage];
+        histogram.buckets[getBucket(nanos)]++;
+        histogram.count++;
+        histogram.totalNanos += nanos;
+        histogram.maxNanos = juce::jmax(histogram.maxNanos, nanos);
+        // The oldest timings make room for the new ones
+        if (m_exported.size() < MHV_TRACE_MAX_EXPORTED_EVENTS)
+            m_exported.push_back(event);
+        else
+            m_exported[m_exportedPosition] = event;
+        m_exportedPosition = (m_exportedPosition + 1) % MHV_TRACE_MAX_EXPORTED_EVENTS;
+    });
+}
+
+std::array<PerfTrace::StageStats, (size_t)PerfTrace::Stage::count> PerfTrace::getStats()
+{
+    const juce::ScopedLock lock(m_lock);
+    collectLocked();
+    std::array<StageStats, (size_t)Stage::count> stats;
+    for (size_t stage = 0; stage < stats.size(); stage++)
+    {
+        const auto& histogram = m_histograms[stage];
+        if (histogram.count == 0)
+            continue;
+        stats[stage].count = histogram.count;
+        stats[stage].meanNanos = histogram.totalNanos / (double)histogram.count;
+        stats[stage].p50Nanos = getPercentile(histogram, 0.5);
+        stats[stage].p99Nanos = getPercentile(histogram, 0.99);
+        stats[stage].maxNanos = histogram.maxNanos;
+    }
+    return stats;
+}
+
+juce::String PerfTrace::getReport()
+{
+    const auto stats = getStats();
+    auto report = juce::String("stage").paddedRight(' ', 16) + juce::String("count").paddedLeft(' ', 12) + juce::String("mean ns").paddedLeft(' ', 12)
+                + juce::String("p50 ns").paddedLeft(' ', 12) + juce::String("p99 ns").paddedLeft(' ', 12) + juce::String("max ns").paddedLeft(' ', 12) + "\n";
+    for (size_t stage = 0; stage < stats.size(); stage++)
+    {
+        report += juce::String(getStageName((Stage)stage)).paddedRight(' ', 16) + juce::String((juce::int64)stats[stage].count).paddedLeft(' ', 12)
+                + juce::String(stats[stage].meanNanos, 0).paddedLeft(' ', 12) + juce::String(stats[stage].p50Nanos, 0).paddedLeft(' ', 12)
+                + juce::String(stats[stage].p99Nanos, 0).paddedLeft(' ', 12) + juce::String(stats[stage].maxNanos, 0).paddedLeft(' ', 12) + "\n";
+    }
+    report += "dropped timings: " + juce::String((juce::int64)m_dropped.load()) + "\n";
+    return report;
+}
+
+bool PerfTrace::writeChromeTrace(const juce::File& file)
+{
+    const juce::ScopedLock lock(m_lock);
+    collectLocked();
+    juce::FileOutputStream stream(file);
+    if (!stream.openedOk())
+        return false;
+    stream.setPosition(0);
+    stream.truncate();
+    // Complete events, in microseconds from the start of the trace, oldest first
+    const auto ticksPerMicrosecond = getTicksPerNanosecond() * 1000.0;
+    stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    const auto first = m_exported.size() < MHV_TRACE_MAX_EXPORTED_EVENTS ? 0 : m_exportedPosition;
+    for (size_t i = 0; i < m_exported.size(); i++)
+    {
+        const auto& event = m_exported[(first + i) % m_exported.size()];
+        stream << (i == 0 ? "" : ",") << "\n{\"name\":\"" << getStageName(event.stage) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << m_instanceId
+               << ",\"ts\":" << juce::String((double)(event.start - m_startTicks) / ticksPerMicrosecond, 3)
+               << ",\"dur\":" << juce::String((double)event.duration / ticksPerMicrosecond, 3) << "}";
+    }
+    stream << "\n]}\n";
+    stream.flush();
+    return stream.getStatus().wasOk();
+}
+
+void PerfTrace::reset()
+{
+    const juce::ScopedLock lock(m_lock);
+    collectLocked();
+    m_histograms = {};
+    m_exported.clear();
+    m_exportedPosition = 0;
+    m_dropped = 0;
+}
+
+#else
+
+PerfTrace::PerfTrace()
+{
+}
+
+PerfTrace::~PerfTrace()
+{
+}
+
+void PerfTrace::collect()
+{
+}
+
+std::array<PerfTrace::StageStats, (size_t)PerfTrace::Stage::count> PerfTrace::getStats()
+{
+    return {};
+}
+
+juce::String PerfTrace::getReport()
+{
+    return "The performance trace is compiled out, configure the build with -DMHV_PERF_TRACE=ON";
+}
+
+bool PerfTrace::writeChromeTrace(const juce::File& file)
+{
+    juce::ignoreUnused(file);
+    return false;
+}
+
+void PerfTrace::reset()
+{
+}
+
+#endif
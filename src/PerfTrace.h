@@ -0,0 +1,165 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <juce_core/juce_core.h>
+
+// The trace is compiled out unless the build turns it on (MHV_PERF_TRACE in CMake)
+#ifndef MHV_PERF_TRACE
+ #define MHV_PERF_TRACE 0
+#endif
+
+#if MHV_PERF_TRACE && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+ #define MHV_TRACE_USES_TSC 1
+ #if defined(_MSC_VER)
+  #include <intrin.h>
+ #else
+  #include <x86intrin.h>
+ #endif
+#elif MHV_PERF_TRACE && defined(__aarch64__)
+ #define MHV_TRACE_USES_CNTVCT 1
+#endif
+
+// How many stage timings the audio thread can queue before the collecting thread drains them, the extra ones are dropped
+#define MHV_TRACE_QUEUE_SIZE 16384
+// How many of the last timings are kept for the Chrome trace
+#define MHV_TRACE_MAX_EXPORTED_EVENTS 200000
+// How often the collecting thread drains the queue
+#define MHV_TRACE_COLLECT_MS 20
+// The histograms have this many buckets per octave, from 1 ns to 2^32 ns
+#define MHV_TRACE_BUCKETS_PER_OCTAVE 4
+#define MHV_TRACE_NUM_BUCKETS (32 * MHV_TRACE_BUCKETS_PER_OCTAVE)
+
+// This class times the stages of the audio path. The audio thread reads the CPU's cycle counter when a stage
+// starts and ends, and queues the pair in a preallocated single producer single consumer ring, which is a
+// few nanoseconds per stage and never waits. A background thread drains the ring into a log scale histogram
+// per stage, and keeps the last timings for a Chrome trace (chrome://tracing or ui.perfetto.dev).
+// Without the build flag the scopes are empty inline classes, so the instrumented code compiles to what it
+// was, and the reports say the trace isn't there. When the MHV_PERF_TRACE_DIR environment variable is set,
+// an instance writes its report and its trace there when it's deleted, which works from any host.
+class PerfTrace
+{
+public:
+    // The stages of the audio path, the block holds all the others
+    enum class Stage { block = 0, parameters, inputGain, convolution, rateConversion, mix, count };
+
+    // The statistics of a stage, in nanoseconds
+    struct StageStats
+    {
+        juce::uint64 count = 0;
+        double meanNanos = 0.0;
+        double p50Nanos = 0.0;
+        double p99Nanos = 0.0;
+        double maxNanos = 0.0;
+    };
+
+    // Times a stage from its construction to its destruction, on the audio thread
+    class ScopedStage
+    {
+    public:
+        ScopedStage(PerfTrace& trace, const Stage stage) noexcept
+           #if MHV_PERF_TRACE
+            : m_trace(trace), m_stage(stage), m_start(readTicks())
+           #endif
+        {
+            juce::ignoreUnused(trace, stage);
+        }
+
+        ~ScopedStage() noexcept
+        {
+           #if MHV_PERF_TRACE
+            m_trace.push(m_stage, m_start, readTicks());
+           #endif
+        }
+    private:
+       #if MHV_PERF_TRACE
+        PerfTrace& m_trace;
+        const Stage m_stage;
+        const juce::uint64 m_start;
+       #endif
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedStage)
+    };
+
+    PerfTrace();
+    ~PerfTrace();
+    // Calls a function and times it as a stage, it returns what the function returns
+    template <typename Function>
+    auto measure(const Stage stage, Function&& function)
+    {
+        const ScopedStage scope(*this, stage);
+        return function();
+    }
+    // Drains the queued timings into the histograms, the collecting thread does it regularly. Not for the audio thread
+    void collect();
+    // Returns the statistics of every stage, after draining the queue
+    std::array<StageStats, (size_t)Stage::count> getStats();
+    // Returns a table of the statistics, with the number of dropped timings
+    juce::String getReport();
+    // Writes the last timings as a Chrome trace, returns false if the file couldn't be written or the trace is compiled out
+    bool writeChromeTrace(const juce::File& file);
+    // Forgets everything measured so far, must not be called while the audio thread is processing
+    void reset();
+    // Returns the name of a stage, as it appears in the reports
+    static const char* getStageName(const Stage stage) noexcept;
+    // Returns true if the plugin was built with the trace
+    static constexpr bool isEnabled() noexcept { return MHV_PERF_TRACE != 0; }
+    // Reads the cycle counter, or the high resolution clock on the CPUs without an accessible one
+    static juce::uint64 readTicks() noexcept
+    {
+       #if MHV_TRACE_USES_TSC
+        return (juce::uint64)__rdtsc();
+       #elif MHV_TRACE_USES_CNTVCT
+        juce::uint64 ticks;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+        return ticks;
+       #else
+        return (juce::uint64)juce::Time::getHighResolutionTicks();
+       #endif
+    }
+private:
+#if MHV_PERF_TRACE
+    class Collector;
+    // A stage's timing, in ticks
+    struct Event
+    {
+        juce::uint64 start = 0;
+        juce::uint32 duration = 0;
+        Stage stage = Stage::block;
+    };
+    // A stage's histogram
+    struct Histogram
+    {
+        std::array<juce::uint64, MHV_TRACE_NUM_BUCKETS> buckets {};
+        juce::uint64 count = 0;
+        double totalNanos = 0.0;
+        double maxNanos = 0.0;
+    };
+    // Queues a timing, called from the audio thread
+    void push(const Stage stage, const juce::uint64 start, const juce::uint64 end) noexcept;
+    // Internal method used to drain the queue, with the lock held
+    void collectLocked();
+    // Internal method used to get how many ticks the counter makes per nanosecond
+    double getTicksPerNanosecond() const noexcept;
+
+    juce::AbstractFifo m_fifo { MHV_TRACE_QUEUE_SIZE };
+    std::array<Event, MHV_TRACE_QUEUE_SIZE> m_events;
+    std::atomic<juce::uint64> m_dropped { 0 };
+    // When the trace started, in ticks and on the high resolution clock, to calibrate the cycle counter
+    juce::uint64 m_startTicks = 0;
+    juce::int64 m_startClockTicks = 0;
+    // The instance's row in the Chrome trace
+    int m_instanceId = 0;
+    // Guards everything below, it's never taken on the audio thread
+    juce::CriticalSection m_lock;
+    std::array<Histogram, (size_t)Stage::count> m_histograms {};
+    // The last timings, in a ring once it's full
+    std::vector<Event> m_exported;
+    size_t m_exportedPosition = 0;
+    std::unique_ptr<Collector> m_collector;
+#endif
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PerfTrace)
+};
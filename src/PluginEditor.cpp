@@ -6,13 +6,33 @@
 #define JPG_WIDTH 263
 #define JPG_HEIGHT 400
 
+// Returns the height a label attached above a component gives itself, the component is laid out below it
+static int getTopLabelHeight(const juce::Label& label)
+{
+    return label.getBorderSize().getTopAndBottom() + 6 + juce::roundToInt(label.getFont().getHeight() + 0.5f);
+}
+
+// Returns the width a label attached on the left of a component gives itself, the component is laid out right of it
+static int getLeftLabelWidth(const juce::Label& label)
+{
+    return juce::roundToInt(label.getFont().getStringWidthFloat(label.getText()) + 0.5f) + label.getBorderSize().getLeftAndRight();
+}
 
 //==============================================================================
 MHVAudioProcessorEditor::MHVAudioProcessorEditor (MHVAudioProcessor& p)
     : AudioProcessorEditor (&p), processorRef (p),
     m_inputGainAttachment(p.apvts, MHV_PID_INPUT_GAIN, m_inputGainDial),
     m_outputGainAttachment(p.apvts, MHV_PID_OUTPUT_GAIN, m_outputGainDial),
-    m_dryWetAttachment(p.apvts, MHV_PID_DRY_WET, m_dryWetSlider)
+    m_dryWetAttachment(p.apvts, MHV_PID_DRY_WET, m_dryWetSlider),
+    m_positionAttachment(p.apvts, MHV_PID_POSITION, m_positionSlider),
+    m_preDelayAttachment(p.apvts, MHV_PID_PRE_DELAY, m_preDelaySlider),
+    m_lowCutAttachment(p.apvts, MHV_PID_LOW_CUT, m_lowCutSlider),
+    m_highCutAttachment(p.apvts, MHV_PID_HIGH_CUT, m_highCutSlider),
+    m_tiltAttachment(p.apvts, MHV_PID_TILT, m_tiltSlider),
+    m_ecoAttachment(p.apvts, MHV_PID_ECO, m_ecoButton),
+    m_morphAttachment(p.apvts, MHV_PID_MORPH, m_morphButton),
+    m_layersAttachment(p.apvts, MHV_PID_LAYERS, m_layersButton),
+    m_userIRAttachment(p.apvts, MHV_PID_USE_USER_IR, m_userIRButton)
 {
     m_inputGainDial.setSliderStyle(juce::Slider::RotaryHorizontalVerticalDrag);
     m_inputGainDial.setTextBoxStyle(juce::Slider::NoTextBox, false, 0, 0);
@@ -35,6 +55,99 @@ MHVAudioProcessorEditor::MHVAudioProcessorEditor (MHVAudioProcessor& p)
     m_inpulseComboBoxAttachment = std::make_unique<ComboboxAttachment>(p.apvts, MHV_PID_IR_INDEX, m_inpulseComboBox);
     addAndMakeVisible(m_inpulseComboBox);
 
+    m_userIRButton.setTooltip("Plays your own impulse response instead of the selected one");
+    addAndMakeVisible(m_userIRButton);
+
+    m_trimComboBox.addItem(MHV_TRIM_OFF_STR, 1);
+    m_trimComboBox.addItem(MHV_TRIM_60_STR, 2);
+    m_trimComboBox.addItem(MHV_TRIM_80_STR, 3);
+    m_trimComboBox.addItem(MHV_TRIM_96_STR, 4);
+    m_trimComboBoxAttachment = std::make_unique<ComboboxAttachment>(p.apvts, MHV_PID_IR_TRIM, m_trimComboBox);
+    addAndMakeVisible(m_trimComboBox);
+
+    m_loadButton.onClick = [this] { chooseUserIR(); };
+    m_loadButton.setTooltip(p.getUserIRFile().getFullPathName());
+    addAndMakeVisible(m_loadButton);
+
+    m_ecoButton.setTooltip("Convolves at a lower sample rate when the impulse responses allow it, this adds a little latency");
+    addAndMakeVisible(m_ecoButton);
+
+    m_qualityComboBox.addItem(MHV_QUALITY_FULL_STR, MHV_QUALITY_FULL + 1);
+    m_qualityComboBox.addItem(MHV_QUALITY_HYBRID_STR, MHV_QUALITY_HYBRID + 1);
+    m_qualityComboBox.setTooltip("Hybrid only convolves the early reflections, delay networks fitted to the impulse response play the late tail");
+    m_qualityComboBoxAttachment = std::make_unique<ComboboxAttachment>(p.apvts, MHV_PID_QUALITY, m_qualityComboBox);
+    addAndMakeVisible(m_qualityComboBox);
+
+    m_latencyComboBox.addItem(MHV_LATENCY_ZERO_STR, MHV_LATENCY_ZERO + 1);
+    m_latencyComboBox.addItem(MHV_LATENCY_LOW_CPU_STR, MHV_LATENCY_LOW_CPU + 1);
+    m_latencyComboBox.addItem(MHV_LATENCY_AUTOMATIC_STR, MHV_LATENCY_AUTOMATIC + 1);
+    m_latencyComboBox.setTooltip("Low CPU convolves in larger blocks and adds their latency, automatic only does it in offline renders");
+    m_latencyComboBoxAttachment = std::make_unique<ComboboxAttachment>(p.apvts, MHV_PID_LATENCY_MODE, m_latencyComboBox);
+    addAndMakeVisible(m_latencyComboBox);
+
+    m_preDelaySlider.setSliderStyle(juce::Slider::LinearHorizontal);
+    m_preDelaySlider.setTextBoxStyle(juce::Slider::NoTextBox, false, 0, 0);
+    m_preDelaySlider.setTooltip("Pre-delay, from 0 to 250 ms before the reverb starts");
+    addAndMakeVisible(m_preDelaySlider);
+
+    m_preDelayLabel.setText("Pre-delay", juce::dontSendNotification);
+    m_preDelayLabel.setFont(juce::Font(11.0f));
+    m_preDelayLabel.setBorderSize({ 0, 2, 0, 2 });
+    m_preDelayLabel.attachToComponent(&m_preDelaySlider, true);
+    addAndMakeVisible(m_preDelayLabel);
+
+    // The tone of the reverb, baked into the impulse response so it costs nothing while playing
+    m_lowCutSlider.setTooltip("Reverb low cut, all the way left is off");
+    m_highCutSlider.setTooltip("Reverb high cut, all the way right is off");
+    m_tiltSlider.setTooltip("Reverb tilt around 1 kHz, darker to the left and brighter to the right");
+    m_lowCutLabel.setText("Low cut", juce::dontSendNotification);
+    m_highCutLabel.setText("High cut", juce::dontSendNotification);
+    m_tiltLabel.setText("Tilt", juce::dontSendNotification);
+    const std::array<std::pair<juce::Slider*, juce::Label*>, 3> toneControls = { { { &m_lowCutSlider, &m_lowCutLabel },
+                                                                                   { &m_highCutSlider, &m_highCutLabel },
+                                                                                   { &m_tiltSlider, &m_tiltLabel } } };
+    for (auto [toneSlider, toneLabel] : toneControls)
+    {
+        toneSlider->setSliderStyle(juce::Slider::LinearHorizontal);
+        toneSlider->setTextBoxStyle(juce::Slider::NoTextBox, false, 0, 0);
+        addAndMakeVisible(*toneSlider);
+
+        toneLabel->setFont(juce::Font(11.0f));
+        toneLabel->setBorderSize({ 0, 2, 0, 2 });
+        toneLabel->attachToComponent(toneSlider, true);
+        addAndMakeVisible(*toneLabel);
+    }
+
+    m_morphButton.setTooltip("Blends the hallways at the position instead of using the selected impulse response");
+    addAndMakeVisible(m_morphButton);
+
+    m_positionSlider.setSliderStyle(juce::Slider::LinearHorizontal);
+    m_positionSlider.setTextBoxStyle(juce::Slider::NoTextBox, false, 0, 0);
+    m_positionSlider.setTooltip("From near, through far, to wherever you are");
+    addAndMakeVisible(m_positionSlider);
+
+    m_layersButton.setTooltip("Stacks the hallways at their levels instead, all the way down leaves one out. It costs the same as a single one");
+    addAndMakeVisible(m_layersButton);
+
+    const char* const levelIDs[MHV_IR_COUNT] = { MHV_PID_NEAR_LEVEL, MHV_PID_FAR_LEVEL, MHV_PID_WHEREVER_LEVEL };
+    const char* const levelTooltips[MHV_IR_COUNT] = { "Near level", "Far level", "Wherever you are level" };
+    const char* const levelNames[MHV_IR_COUNT] = { "Near", "Far", "Wherever" };
+    for (size_t i = 0; i < m_levelSliders.size(); i++)
+    {
+        m_levelSliders[i].setSliderStyle(juce::Slider::LinearHorizontal);
+        m_levelSliders[i].setTextBoxStyle(juce::Slider::NoTextBox, false, 0, 0);
+        m_levelSliders[i].setTooltip(levelTooltips[i]);
+        m_levelAttachments[i] = std::make_unique<SliderAttachment>(p.apvts, levelIDs[i], m_levelSliders[i]);
+        addAndMakeVisible(m_levelSliders[i]);
+
+        m_levelLabels[i].setText(levelNames[i], juce::dontSendNotification);
+        m_levelLabels[i].setFont(juce::Font(11.0f));
+        m_levelLabels[i].setBorderSize({ 0, 2, 0, 2 });
+        m_levelLabels[i].setJustificationType(juce::Justification::centred);
+        m_levelLabels[i].attachToComponent(&m_levelSliders[i], false);
+        addAndMakeVisible(m_levelLabels[i]);
+    }
+
     // Take care of the labels
     m_inputGainLabel.setText("Input Gain", juce::dontSendNotification);
     m_inputGainLabel.attachToComponent(&m_inputGainDial, false);
@@ -52,30 +165,44 @@ MHVAudioProcessorEditor::MHVAudioProcessorEditor (MHVAudioProcessor& p)
     m_inpulseLabel.attachToComponent(&m_inpulseComboBox, false);
     addAndMakeVisible(m_inpulseLabel);
 
+    addAndMakeVisible(m_waveformView);
+    addAndMakeVisible(m_inputMeter);
+    addAndMakeVisible(m_wetMeter);
+    addAndMakeVisible(m_outputMeter);
+
+    // The background covers the whole editor, so nothing behind it needs to be painted
+    setOpaque(true);
     // Set the size of the editor
     setSize(JPG_WIDTH, JPG_HEIGHT);
+    m_lastUpdateTime = juce::Time::getMillisecondCounterHiRes();
+    startTimerHz(MHV_EDITOR_REFRESH_HZ);
 }
 
 MHVAudioProcessorEditor::~MHVAudioProcessorEditor()
 {
+    stopTimer();
+    if (m_isFeedReader)
+        processorRef.getDisplayFeed().release();
 }
 
 //==============================================================================
 void MHVAudioProcessorEditor::paint (juce::Graphics& g)
 {
     // (Our component is opaque, so we must completely fill the background with a solid colour)
-    // g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
-    // g.setColour (juce::Colours::white);
-    juce::Image background = juce::ImageCache::getFromMemory(BinaryData::hallway_jpg, BinaryData::hallway_jpgSize);
-    g.drawImageAt (background, 0, 0);
-    g.setFont (15.0f);
-    // g.drawFittedText ("Hello World!", getLocalBounds(), juce::Justification::centred, 1);
+    // The image is decoded and scaled again only when the editor moves to a display of another density,
+    // the meters repaint small regions of it many times per second
+    const auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    if (m_background.isNull() || scale != m_backgroundScale)
+        updateBackground(scale);
+    g.drawImage(m_background, getLocalBounds().toFloat());
 }
 
 void MHVAudioProcessorEditor::resized()
 {
     // This is generally where you'll want to lay out the positions of any
     // subcomponents in your editor..
+    // The background is scaled again for the new size when it's painted
+    m_background = juce::Image();
     auto border = 2;
     auto area = getLocalBounds();
     // Don't worry about the magic numbers, they are not reused anywhere else
@@ -95,6 +222,102 @@ void MHVAudioProcessorEditor::resized()
     m_inpulseComboBox.setBounds(comboBoxArea);
     m_outputGainDial.setBounds(outputGainArea);
     m_dryWetSlider.setBounds(sliderArea);
-    // And we set the size of the combobox
-    m_inpulseComboBox.setSize(comboBoxArea.getWidth(), comboBoxArea.getHeight() / 12);
+    // And we set the size of the combobox, the switch of the user's impulse response takes the rest of its row
+    auto inpulseArea = comboBoxArea.withHeight(comboBoxArea.getHeight() / 12);
+    m_inpulseComboBox.setBounds(inpulseArea.removeFromLeft(inpulseArea.getWidth() * 0.6).withTrimmedRight(border));
+    m_userIRButton.setBounds(inpulseArea);
+    // The user's impulse response controls sit right below it, the trim setting takes 60% of the row
+    auto userIRArea = comboBoxArea.withTrimmedTop(m_inpulseComboBox.getHeight() + border).withHeight(m_inpulseComboBox.getHeight());
+    m_trimComboBox.setBounds(userIRArea.removeFromLeft(userIRArea.getWidth() * 0.6).withTrimmedRight(border));
+    m_loadButton.setBounds(userIRArea);
+    // The quality setting and the eco switch take the next row, in the same proportions
+    auto modeArea = userIRArea.withX(comboBoxArea.getX()).withWidth(comboBoxArea.getWidth()).translated(0, userIRArea.getHeight() + border);
+    m_qualityComboBox.setBounds(modeArea.removeFromLeft(modeArea.getWidth() * 0.6).withTrimmedRight(border));
+    m_ecoButton.setBounds(modeArea);
+    // The morph position takes the next row, with its switch on the right
+    auto morphArea = modeArea.withX(comboBoxArea.getX()).withWidth(comboBoxArea.getWidth()).translated(0, modeArea.getHeight() + border);
+    m_positionSlider.setBounds(morphArea.removeFromLeft(morphArea.getWidth() * 0.6).withTrimmedRight(border));
+    m_morphButton.setBounds(morphArea);
+    // The layers' levels share the next row, below their captions, with their switch on the right
+    const auto captionHeight = getTopLabelHeight(m_levelLabels[0]);
+    auto layersArea = morphArea.withX(comboBoxArea.getX()).withWidth(comboBoxArea.getWidth()).translated(0, morphArea.getHeight() + border + captionHeight);
+    auto levelsArea = layersArea.removeFromLeft(layersArea.getWidth() * 0.6).withTrimmedRight(border);
+    const auto levelWidth = levelsArea.getWidth() / (int)m_levelSliders.size();
+    for (auto& levelSlider : m_levelSliders)
+        levelSlider.setBounds(levelsArea.removeFromLeft(levelWidth));
+    m_layersButton.setBounds(layersArea);
+    // The latency mode takes the next row, lined up with the other menus, and the pre-delay the rest of it, after its label
+    auto latencyArea = layersArea.withX(comboBoxArea.getX()).withWidth(comboBoxArea.getWidth()).translated(0, layersArea.getHeight() + border);
+    m_latencyComboBox.setBounds(latencyArea.removeFromLeft(latencyArea.getWidth() * 0.6).withTrimmedRight(border));
+    m_preDelaySlider.setBounds(latencyArea.withTrimmedLeft(getLeftLabelWidth(m_preDelayLabel)));
+    // The tone sliders share the next row, each one after its label
+    auto toneArea = latencyArea.withX(comboBoxArea.getX()).withWidth(comboBoxArea.getWidth()).translated(0, latencyArea.getHeight() + border);
+    const auto toneWidth = toneArea.getWidth() / 3;
+    m_lowCutSlider.setBounds(toneArea.removeFromLeft(toneWidth).withTrimmedLeft(getLeftLabelWidth(m_lowCutLabel)));
+    m_highCutSlider.setBounds(toneArea.removeFromLeft(toneWidth).withTrimmedLeft(getLeftLabelWidth(m_highCutLabel)));
+    m_tiltSlider.setBounds(toneArea.removeFromLeft(toneWidth).withTrimmedLeft(getLeftLabelWidth(m_tiltLabel)));
+    // The impulse response takes two rows below them, and the meters share the next one
+    auto displayArea = comboBoxArea.withTrimmedTop(toneArea.getBottom() - comboBoxArea.getY() + border * 2);
+    m_waveformView.setBounds(displayArea.removeFromTop(modeArea.getHeight() * 2));
+    displayArea.removeFromTop(border);
+    const auto meterHeight = modeArea.getHeight() / 2;
+    for (auto* meter : { &m_inputMeter, &m_wetMeter, &m_outputMeter })
+        meter->setBounds(displayArea.removeFromTop(meterHeight).withTrimmedBottom(border / 2));
+}
+
+void MHVAudioProcessorEditor::timerCallback()
+{
+    const auto now = juce::Time::getMillisecondCounterHiRes();
+    const auto elapsedSeconds = (float)((now - m_lastUpdateTime) * 0.001);
+    m_lastUpdateTime = now;
+    // A hidden editor leaves the feed to the audio thread, it only measures while an editor reads it
+    auto& feed = processorRef.getDisplayFeed();
+    if (!isShowing())
+    {
+        if (m_isFeedReader)
+            feed.release();
+        m_isFeedReader = false;
+        return;
+    }
+    // Another editor of the same processor may be reading it, this one then tries again on the next tick
+    if (!m_isFeedReader)
+        m_isFeedReader = feed.claim();
+    if (!m_isFeedReader)
+        return;
+    DisplayFeed::Overview overview;
+    if (feed.popOverview(overview))
+        m_waveformView.setOverview(overview);
+    // Without new levels (the host stopped processing) the meters fall back
+    DisplayFeed::Levels levels;
+    feed.popLevels(levels);
+    m_inputMeter.update(levels.input, elapsedSeconds);
+    m_wetMeter.update(levels.wet, elapsedSeconds);
+    m_outputMeter.update(levels.output, elapsedSeconds);
+}
+
+void MHVAudioProcessorEditor::chooseUserIR()
+{
+    m_fileChooser = std::make_unique<juce::FileChooser>("Choose an impulse response", processorRef.getUserIRFile(), "*.wav;*.aif;*.aiff;*.flac");
+    const auto flags = juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles;
+    m_fileChooser->launchAsync(flags, [this](const juce::FileChooser& chooser)
+    {
+        const auto file = chooser.getResult();
+        if (file == juce::File())
+            return;
+        processorRef.loadUserIR(file);
+        m_loadButton.setTooltip(file.getFullPathName());
+        // Picking a file also switches it on
+        processorRef.apvts.getParameter(MHV_PID_USE_USER_IR)->setValueNotifyingHost(1.0f);
+    });
+}
+
+void MHVAudioProcessorEditor::updateBackground(const float scale)
+{
+    const auto source = juce::ImageCache::getFromMemory(BinaryData::hallway_jpg, BinaryData::hallway_jpgSize);
+    m_background = juce::Image(juce::Image::RGB, juce::roundToInt((float)getWidth() * scale),
+                               juce::roundToInt((float)getHeight() * scale), false);
+    juce::Graphics g(m_background);
+    g.setImageResamplingQuality(juce::Graphics::highResamplingQuality);
+    g.drawImage(source, m_background.getBounds().toFloat());
+    m_backgroundScale = scale;
 }
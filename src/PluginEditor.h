@@ -1,10 +1,16 @@
 #pragma once
 
 #include "PluginProcessor.h"
+#include "LevelMeter.h"
+#include "IRWaveformView.h"
+#include "array"
 #include "memory"
 
+// How many times per second the meters and the impulse response view are updated, at most
+#define MHV_EDITOR_REFRESH_HZ 30
+
 // This is the plugin's GUI class
-class MHVAudioProcessorEditor final : public juce::AudioProcessorEditor
+class MHVAudioProcessorEditor final : public juce::AudioProcessorEditor, private juce::Timer
 {
 // Variables
 private:
@@ -16,19 +22,68 @@ private:
     juce::Slider m_outputGainDial;
     juce::Slider m_dryWetSlider;
     juce::ComboBox m_inpulseComboBox;
+    juce::ComboBox m_trimComboBox;
+    juce::ToggleButton m_userIRButton { MHV_USER_IR_STR };
+    juce::TextButton m_loadButton { "Load IR..." };
+    juce::ToggleButton m_ecoButton { "Eco" };
+    juce::ComboBox m_qualityComboBox;
+    juce::ComboBox m_latencyComboBox;
+    juce::ToggleButton m_morphButton { "Morph" };
+    juce::Slider m_positionSlider;
+    juce::ToggleButton m_layersButton { "Layers" };
+    std::array<juce::Slider, MHV_IR_COUNT> m_levelSliders;
+    juce::Slider m_preDelaySlider;
+    juce::Slider m_lowCutSlider;
+    juce::Slider m_highCutSlider;
+    juce::Slider m_tiltSlider;
+    // Kept alive while the asynchronous file dialog is open
+    std::unique_ptr<juce::FileChooser> m_fileChooser;
     juce::Label m_inputGainLabel;
     juce::Label m_outputGainLabel;
     juce::Label m_dryWetLabel;
     juce::Label m_inpulseLabel;
+    // The layers' levels are captioned above their sliders, there's no room on their left
+    std::array<juce::Label, MHV_IR_COUNT> m_levelLabels;
+    juce::Label m_preDelayLabel;
+    juce::Label m_lowCutLabel;
+    juce::Label m_highCutLabel;
+    juce::Label m_tiltLabel;
+    // Shows the components' tooltips while the mouse hovers over them
+    juce::TooltipWindow m_tooltipWindow { this };
+    // What the audio thread sends through the processor's display feed
+    IRWaveformView m_waveformView;
+    LevelMeter m_inputMeter { "In" };
+    LevelMeter m_wetMeter { "Wet" };
+    LevelMeter m_outputMeter { "Out" };
+    // Whether this editor is the feed's reader, and when it last read it
+    bool m_isFeedReader = false;
+    double m_lastUpdateTime = 0.0;
+    // The background image, scaled once to the display's pixel density and opaque, so painting it is a plain copy
+    juce::Image m_background;
+    float m_backgroundScale = 0.0f;
     // Those are only used to make the type names shorters
     using APTVS = juce::AudioProcessorValueTreeState;
     using SliderAttachment = APTVS::SliderAttachment;
     using ComboboxAttachment = APTVS::ComboBoxAttachment;
+    using ButtonAttachment = APTVS::ButtonAttachment;
     // GUI components' attachments
     SliderAttachment m_inputGainAttachment;
     SliderAttachment m_outputGainAttachment;
     SliderAttachment m_dryWetAttachment;
+    SliderAttachment m_positionAttachment;
+    SliderAttachment m_preDelayAttachment;
+    SliderAttachment m_lowCutAttachment;
+    SliderAttachment m_highCutAttachment;
+    SliderAttachment m_tiltAttachment;
     std::unique_ptr<ComboboxAttachment> m_inpulseComboBoxAttachment;
+    std::unique_ptr<ComboboxAttachment> m_trimComboBoxAttachment;
+    std::unique_ptr<ComboboxAttachment> m_qualityComboBoxAttachment;
+    std::unique_ptr<ComboboxAttachment> m_latencyComboBoxAttachment;
+    std::array<std::unique_ptr<SliderAttachment>, MHV_IR_COUNT> m_levelAttachments;
+    ButtonAttachment m_ecoAttachment;
+    ButtonAttachment m_morphAttachment;
+    ButtonAttachment m_layersAttachment;
+    ButtonAttachment m_userIRAttachment;
 // Methods
 public:
     explicit MHVAudioProcessorEditor (MHVAudioProcessor&);
@@ -36,5 +91,11 @@ public:
     void paint (juce::Graphics&) override;
     void resized() override;
 private:
+    // Reads the display feed and updates the meters and the impulse response view, which repaint only what changed
+    void timerCallback() override;
+    // Internal method used to let the user pick an impulse response file, and select it once it's picked
+    void chooseUserIR();
+    // Internal method used to decode and scale the background image for a pixel density
+    void updateBackground(const float scale);
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MHVAudioProcessorEditor)
 };
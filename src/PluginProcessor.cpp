@@ -2,6 +2,16 @@
 #include "PluginEditor.h"
 #include "BinaryData.h"
 
+// Returns the tone the settings bake into the impulse response
+static IRToneShaper::Tone getTone(const ChainSettings& settings) noexcept
+{
+    IRToneShaper::Tone tone;
+    tone.lowCut = settings.lowCut;
+    tone.highCut = settings.highCut;
+    tone.tilt = settings.tilt;
+    return tone;
+}
+
 MHVAudioProcessor::MHVAudioProcessor()
      : AudioProcessor (BusesProperties()
                      #if ! JucePlugin_IsMidiEffect
@@ -12,8 +22,36 @@ MHVAudioProcessor::MHVAudioProcessor()
                      #endif
                        ),
      apvts(*this, nullptr, "Parameters", createParameterLayout()),
-     m_paramPointers(apvts)
+     m_userIRLoader(apvts.getRawParameterValue(MHV_PID_IR_TRIM), m_irUsage),
+     m_irBlender(m_irUsage),
+     m_irToneShaper(m_irUsage),
+     m_paramPointers(apvts),
+     m_paramChanges(apvts)
 {
+    // A longer impulse response needs a longer input history, which can't be allocated on the audio thread, nor on
+    // the loading thread while the message thread prepares the chain. The plugin is prepared again for it on the
+    // message thread instead, the engine keeps playing what it has until then
+    m_userIRLoader.onReserveLength = [this](const size_t lengthInSamples)
+    {
+        m_userIRLength.store(lengthInSamples);
+        triggerAsyncUpdate();
+    };
+    // The eco factor is picked when the plugin is prepared, a wider file loaded afterwards needs a lower one
+    m_userIRLoader.onDecoded = [this](double) { triggerAsyncUpdate(); };
+    // The tone is baked into whatever impulse response plays, the user's one and the blends are taken from where they're held
+    m_irToneShaper.findSource = [this](const PartitionedIR* ir)
+    {
+        auto found = m_userIRLoader.find(ir);
+        return found != nullptr ? found : m_irBlender.find(ir);
+    };
+    // The eco mode changes the engine's sample rate and the latency, the quality mode the impulse responses, and the
+    // latency mode the partition size, so the plugin is prepared again. The parameters aren't automatable, their
+    // changes come from the editor or a restored state
+    m_ecoAttachment = std::make_unique<juce::ParameterAttachment>(*apvts.getParameter(MHV_PID_ECO), [this](float) { prepareChainsAgain(); });
+    m_qualityAttachment = std::make_unique<juce::ParameterAttachment>(*apvts.getParameter(MHV_PID_QUALITY), [this](float) { prepareChainsAgain(); });
+    m_latencyModeAttachment = std::make_unique<juce::ParameterAttachment>(*apvts.getParameter(MHV_PID_LATENCY_MODE), [this](float) { prepareChainsAgain(); });
+    // The loading thread sleeps until it's asked for something, a new trim is one more request
+    m_trimAttachment = std::make_unique<juce::ParameterAttachment>(*apvts.getParameter(MHV_PID_IR_TRIM), [this](float) { m_userIRLoader.trimChanged(); });
 }
 
 MHVAudioProcessor::~MHVAudioProcessor()
@@ -54,8 +92,8 @@ bool MHVAudioProcessor::isMidiEffect() const
 
 double MHVAudioProcessor::getTailLengthSeconds() const
 {
-    // TODO: Implement this method, return the length of the current IR maybe?
-    return 0.0;
+    // The reverb tail lasts until the current impulse response has decayed
+    return m_tailLengthSeconds.load();
 }
 
 int MHVAudioProcessor::getNumPrograms()
@@ -93,29 +131,139 @@ void MHVAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
     juce::dsp::ProcessSpec spec;
     // Configure the process specification
     spec.maximumBlockSize = (unsigned int)samplesPerBlock;
-    spec.numChannels = 1;
+    // The channel count comes from the layout the host picked, it can't change without preparing again
+    spec.numChannels = (juce::uint32)juce::jmax(1, getMainBusNumInputChannels());
     spec.sampleRate = sampleRate;
+    m_processSpec = spec;
     // Prepare the chains   
     prepareChains(spec);
 }
 
 void MHVAudioProcessor::prepareChains(const juce::dsp::ProcessSpec& spec)
 {
-    // Prepare the mono reverb chains
-    for (auto& chain : chainArray)
+    // In eco mode the wet signal is convolved at a fraction of the sample rate, as low as the impulse responses allow
+    m_rateConverter.prepare(spec, getEcoFactor(spec.sampleRate));
+    auto wetSpec = RateConverter::getReducedSpec(spec, m_rateConverter.getFactor());
+
+    // The latency mode may gather the wet signal into larger partitions, the engine is then prepared for them.
+    // Offline renders also spread the channels over more worker threads
+    const auto gatheredPartitionSize = getGatheredPartitionSize(wetSpec);
+    m_preparedNonRealtime = isNonRealtime();
+    m_partitionGatherer.prepare(wetSpec.numChannels, gatheredPartitionSize);
+    if (gatheredPartitionSize > 0)
+        wetSpec.maximumBlockSize = (juce::uint32)gatheredPartitionSize;
+    const auto latency = m_rateConverter.getLatencySamples() + (int)gatheredPartitionSize * m_rateConverter.getFactor();
+    m_wetLatency = latency;
+
+    // Prepare the reverb chain, the engine converts double precision blocks (the reduced rate signal and the gathered
+    // partitions are always in floats). In the hybrid mode it also holds the delay networks playing the late tails
+    const bool hybrid = (int)m_paramPointers.quality->load() == MHV_QUALITY_HYBRID;
+    auto& convolution = chain.get<ChainPositions::PosConvolution>();
+    convolution.setUsesDoublePrecision(isUsingDoublePrecision() && m_rateConverter.getFactor() == 1 && gatheredPartitionSize == 0);
+    convolution.setUsesLateReverb(hybrid);
+    convolution.setChannelsPerWorker(isNonRealtime() ? MHV_OFFLINE_CHANNELS_PER_WORKER : MHV_CHANNELS_PER_WORKER);
+    chain.prepare(wetSpec);
+
+    // Prepare the gains and the mixer of the current precision, it uses the balanced mixing rule and delays
+    // the dry signal as much as the wet one. The other one is emptied, so the memory isn't held twice
+    // The pre-delay runs at the host's rate, before the rate conversion
+    if (isUsingDoublePrecision())
     {
-        chain.prepare(spec);
+        doubleMixer.prepare(spec, (size_t)latency);
+        mixer.release();
+        m_doublePreDelay.prepare(spec);
+        m_preDelay.release();
     }
-
-    // Prepare the mono mixer chains and et the mixing rule
-    for (auto& mixer : mixerArray)
+    else
     {
-        mixer.prepare(spec);
-        mixer.setMixingRule(juce::dsp::DryWetMixer<float>::MixingRule::balanced);
+        mixer.prepare(spec, (size_t)latency);
+        doubleMixer.release();
+        m_preDelay.prepare(spec);
+        m_doublePreDelay.release();
     }
-
-    // Update the parameters
+    setLatencySamples(latency);
+
+    // Build the impulse responses for the engine's sample rate and partition size, this is the only place
+    // where they get decoded, so switching between them on the audio thread never parses or allocates.
+    // The previous ones may be freed, the overview is sent again once the engine gets its new one
+    m_currentIR = nullptr;
+    m_irCache.prepare(m_IRDataArray, wetSpec.sampleRate, convolution.getPartitionSize(), hybrid);
+    m_userIRLoader.prepare(wetSpec.sampleRate, convolution.getPartitionSize(), hybrid);
+    // The blend is made for the current weights right away, and the tone baked into what plays, they're made again
+    // in the background when they change
+    ChainSettings settings;
+    settings.updateSettings(m_paramPointers);
+    updateBlendWeights(settings);
+    m_irBlender.prepare(m_irCache.getAll());
+    m_irToneShaper.prepare(m_irCache.getAll(), getSourceIR(settings), getTone(settings));
+    const auto* userIR = m_userIRLoader.get();
+    convolution.reserveLength(juce::jmax(m_irCache.getMaxLength(), userIR != nullptr ? userIR->lengthInSamples : (size_t)0));
+    // The engine forgets its impulse response when it's prepared, so make sure it gets set again
+    m_oldChainSettings.irIndex = MHV_INVALID_IR_INDEX;
+    // The engine starts from silence, at the start of the timeline
+    m_silentSamples = 0;
+    m_isIdle = false;
+    m_timelinePosition = 0;
+    m_paramChanges.clearScheduledChanges();
+
+    // Update the parameters, the gains start at their values instead of ramping to them, and the pre-delay at its own
     updateParameters(true);
+    mixer.reset();
+    doubleMixer.reset();
+    m_preDelay.reset();
+    m_doublePreDelay.reset();
+}
+
+void MHVAudioProcessor::prepareChainsAgain()
+{
+    if (m_processSpec.sampleRate <= 0.0)
+        return;
+    suspendProcessing(true);
+    prepareChains(m_processSpec);
+    suspendProcessing(false);
+}
+
+void MHVAudioProcessor::handleAsyncUpdate()
+{
+    if (m_processSpec.sampleRate <= 0.0)
+        return;
+    // The engine's history is only made longer when the plugin is prepared, and it may already have been meanwhile
+    const bool tooLong = m_userIRLength.load() > chain.get<ChainPositions::PosConvolution>().getReservedLength();
+    // The host switched to or from an offline render without preparing the plugin for it
+    const bool renderChanged = (int)m_paramPointers.latencyMode->load() == MHV_LATENCY_AUTOMATIC && isNonRealtime() != m_preparedNonRealtime;
+    // The file is decoded already, so its bandwidth is read without waiting
+    if (tooLong || renderChanged || getEcoFactor(m_processSpec.sampleRate) < m_rateConverter.getFactor())
+        prepareChainsAgain();
+}
+
+int MHVAudioProcessor::getEcoFactor(const double sampleRate)
+{
+    if (m_paramPointers.eco->load() < 0.5f)
+        return 1;
+    // Every impulse response must fit in the reduced band, so they can still be switched without preparing again
+    const auto bandwidth = juce::jmax(m_irCache.getMaxBandwidth(m_IRDataArray), m_userIRLoader.getBandwidth());
+    return RateConverter::getFactorFor(bandwidth, sampleRate);
+}
+
+size_t MHVAudioProcessor::getGatheredPartitionSize(const juce::dsp::ProcessSpec& wetSpec) const
+{
+    // The automatic mode only trades latency for throughput when nobody is listening
+    const auto latencyMode = (int)m_paramPointers.latencyMode->load();
+    size_t partitionSize = 0;
+    if (latencyMode == MHV_LATENCY_LOW_CPU)
+        partitionSize = MHV_LOW_CPU_PARTITION_SIZE;
+    else if (latencyMode == MHV_LATENCY_AUTOMATIC && isNonRealtime())
+        partitionSize = MHV_OFFLINE_PARTITION_SIZE;
+    // Blocks that already fill such partitions are processed as they come, without latency
+    return MultiChannelConvolution::getPartitionSizeFor(wetSpec.maximumBlockSize) < partitionSize ? partitionSize : 0;
+}
+
+void MHVAudioProcessor::setNonRealtime(bool isNonRealtime) noexcept
+{
+    AudioProcessor::setNonRealtime(isNonRealtime);
+    // The automatic latency mode picks the partition size from the flag. Most hosts call this right before
+    // prepareToPlay, the others get the plugin prepared again on the message thread
+    triggerAsyncUpdate();
 }
 
 void MHVAudioProcessor::releaseResources()
@@ -131,11 +279,9 @@ bool MHVAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) cons
     return true;
   #else
     // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
     // Some plugin hosts, such as certain GarageBand versions, will only
     // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    if (!isChannelSetSupported(layouts.getMainOutputChannelSet()))
         return false;
 
     // This checks if the input layout matches the output layout
@@ -148,11 +294,51 @@ bool MHVAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) cons
   #endif
 }
 
+bool MHVAudioProcessor::isChannelSetSupported(const juce::AudioChannelSet& channelSet)
+{
+    // Mono, stereo, the common surround and immersive beds, and discrete layouts of a reasonable size
+    const juce::AudioChannelSet namedSets[] = { juce::AudioChannelSet::mono(),
+                                                juce::AudioChannelSet::stereo(),
+                                                juce::AudioChannelSet::createLCR(),
+                                                juce::AudioChannelSet::quadraphonic(),
+                                                juce::AudioChannelSet::create5point0(),
+                                                juce::AudioChannelSet::create5point1(),
+                                                juce::AudioChannelSet::create7point0(),
+                                                juce::AudioChannelSet::create7point1(),
+                                                juce::AudioChannelSet::create7point1point4() };
+    for (const auto& namedSet : namedSets)
+    {
+        if (channelSet == namedSet)
+            return true;
+    }
+    return channelSet.isDiscreteLayout() && channelSet.size() > 0 && channelSet.size() <= MHV_MAX_CHANNEL_COUNT;
+}
+
 void MHVAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
                                       juce::MidiBuffer& midiMessages)
 {
     juce::ignoreUnused (midiMessages);
+    processBlockWithPrecision(buffer, mixer, m_preDelay);
+}
 
+void MHVAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer,
+                                      juce::MidiBuffer& midiMessages)
+{
+    juce::ignoreUnused (midiMessages);
+    processBlockWithPrecision(buffer, doubleMixer, m_doublePreDelay);
+}
+
+bool MHVAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
+
+template <typename SampleType>
+void MHVAudioProcessor::processBlockWithPrecision(juce::AudioBuffer<SampleType>& buffer, GainMixer<SampleType>& gainMixer, PreDelay<SampleType>& preDelay)
+{
+    // Everything below runs on the audio thread, the checker reports what mustn't happen here
+    const RealtimeChecker::ScopedAudioThread realtimeScope(m_realtimeChecker);
+    const PerfTrace::ScopedStage blockStage(m_perfTrace, PerfTrace::Stage::block);
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -181,12 +367,58 @@ void MHVAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     //     // ..do something to the data...
     // }
 
-    // Update the parameters
-    updateParameters();
+    // Update the parameters changed since the last block
+    m_perfTrace.measure(PerfTrace::Stage::parameters, [this] { updateParameters(); });
+
+    // The levels are only measured while an editor displays them, a new one also gets the current impulse response
+    m_isMetering = m_displayFeed.isClaimed();
+    m_wetPeak = 0.0f;
+    if (m_displayFeed.takeOverviewRequest() && m_currentIR != nullptr)
+        m_displayFeed.pushOverview(m_currentIR->overview);
+
+    // Sleep while the input is silent and the reverb has died out, the first block with a signal wakes the plugin up
+    const auto numSamples = buffer.getNumSamples();
+    const auto silenceLevel = juce::Decibels::decibelsToGain((SampleType)MHV_SILENCE_DECIBELS);
+    const auto inputPeak = buffer.getMagnitude(0, numSamples);
+    const bool inputIsSilent = inputPeak < silenceLevel;
+    m_silentSamples = inputIsSilent ? m_silentSamples + (size_t)numSamples : 0;
+    auto& convolution = chain.get<ChainPositions::PosConvolution>();
+    if (m_isIdle && inputIsSilent)
+    {
+        // The scheduled changes still land, so the settings are right when the plugin wakes up
+        for (size_t start = 0; start < (size_t)numSamples; start = applyScheduledChanges(start, (size_t)numSamples)) {}
+        buffer.clear();
+    }
+    else
+    {
+        // The gains were frozen while sleeping, they jump to their values under the quiet start of the signal,
+        // and the pre-delay starts from silence at its length
+        if (m_isIdle)
+        {
+            gainMixer.reset();
+            preDelay.reset();
+        }
+        // Process the buffer using the DSP chains, because we support only symmetric channels
+        // we can safaly assume that the number of input channels is equal to the number of output channels.
+        // The block is split where scheduled changes land, so they apply from their exact sample
+        for (size_t start = 0; start < (size_t)numSamples;)
+        {
+            const auto end = applyScheduledChanges(start, (size_t)numSamples);
+            processBufferUsingDSP(buffer, (unsigned int)totalNumInputChannels, start, end - start, gainMixer, preDelay);
+            start = end;
+        }
+        // The engine's state is left as it is, whatever input it still holds is older than the impulse response's decay
+        m_isIdle = m_silentSamples > m_decayLength && !convolution.isChangingImpulseResponse()
+                && buffer.getMagnitude(0, numSamples) < silenceLevel;
+    }
+
+    m_timelinePosition += numSamples;
+    if (m_isMetering)
+        m_displayFeed.pushLevels({ (float)inputPeak, m_wetPeak, (float)buffer.getMagnitude(0, numSamples) });
 
-    // Process the buffer using the DSP chains, because we support only symmetric channels
-    // we can safaly assume that the number of input channels is equal to the number of output channels
-    processBufferUsingDSP(buffer, (unsigned int)totalNumInputChannels);
+    // The user impulse responses, the blends and the shaped ones the engine is done with can now be freed
+    convolution.getImpulseResponsesInUse(m_irsInUse);
+    m_irUsage.finishBlock(m_irsInUse);
 }
 
 bool MHVAudioProcessor::hasEditor() const
@@ -218,10 +450,20 @@ void MHVAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
     if(tree.isValid())
     {
         apvts.replaceState(tree);
-        updateParameters(true);
+        // The user's impulse response is loaded again from its path, or unloaded if the state has none
+        m_userIRLoader.load(juce::File(apvts.state.getProperty(MHV_STATE_USER_IR_PATH).toString()));
+        // The parameters are left to the audio thread: replaceState() notifies the tracker of every one that changed,
+        // and the audio thread applies them at its next block, like the new user impulse response once it's loaded
     }
 }
 
+void MHVAudioProcessor::loadUserIR(const juce::File& file)
+{
+    // The path is saved with the rest of the state, the file itself isn't
+    apvts.state.setProperty(MHV_STATE_USER_IR_PATH, file.getFullPathName(), nullptr);
+    m_userIRLoader.load(file);
+}
+
 // This creates new instances of the plugin..
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 {
@@ -249,14 +491,111 @@ juce::AudioProcessorValueTreeState::ParameterLayout MHVAudioProcessor::createPar
     layout.add(std::make_unique<juce::AudioParameterChoice>(MHV_PID_IR_INDEX,
                                                             "Impulse Response",
                                                             juce::StringArray({MHV_NEAR_STR, MHV_FAR_STR, MHV_WHEREVER_STR}),
-                                                            0));                               
+                                                            0));
+    // Only the user's impulse response is trimmed, the embedded ones are already edited
+    layout.add(std::make_unique<juce::AudioParameterChoice>(MHV_PID_IR_TRIM,
+                                                            "Impulse Response Trim",
+                                                            juce::StringArray({MHV_TRIM_OFF_STR, MHV_TRIM_60_STR, MHV_TRIM_80_STR, MHV_TRIM_96_STR}),
+                                                            MHV_PV_DEFAULT_TRIM,
+                                                            juce::AudioParameterChoiceAttributes().withAutomatable(false)));
+    // The user's impulse response is switched on apart from the choice, so adding it didn't move the choice's values
+    layout.add(std::make_unique<juce::AudioParameterBool>(MHV_PID_USE_USER_IR,
+                                                          "Your Own Impulse Response",
+                                                          MHV_PV_DEFAULT_USE_USER_IR));
+    // The eco mode changes the latency, so it can't be automated either
+    layout.add(std::make_unique<juce::AudioParameterBool>(MHV_PID_ECO,
+                                                          "Eco Mode",
+                                                          MHV_PV_DEFAULT_ECO,
+                                                          juce::AudioParameterBoolAttributes().withAutomatable(false)));
+    // Switching the quality mode prepares the impulse responses again, it can't be automated
+    layout.add(std::make_unique<juce::AudioParameterChoice>(MHV_PID_QUALITY,
+                                                            "Quality",
+                                                            juce::StringArray({MHV_QUALITY_FULL_STR, MHV_QUALITY_HYBRID_STR}),
+                                                            MHV_PV_DEFAULT_QUALITY,
+                                                            juce::AudioParameterChoiceAttributes().withAutomatable(false)));
+    // The latency mode changes the latency and the partition size, it can't be automated either
+    layout.add(std::make_unique<juce::AudioParameterChoice>(MHV_PID_LATENCY_MODE,
+                                                            "Latency Mode",
+                                                            juce::StringArray({MHV_LATENCY_ZERO_STR, MHV_LATENCY_LOW_CPU_STR, MHV_LATENCY_AUTOMATIC_STR}),
+                                                            MHV_PV_DEFAULT_LATENCY_MODE,
+                                                            juce::AudioParameterChoiceAttributes().withAutomatable(false)));
+    // The morph blends the embedded impulse responses at the position, instead of using the selected one
+    layout.add(std::make_unique<juce::AudioParameterBool>(MHV_PID_MORPH,
+                                                          "Morph",
+                                                          MHV_PV_DEFAULT_MORPH));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(MHV_PID_POSITION,
+                                                           "Position",
+                                                           juce::NormalisableRange<float>(MHV_PV_MIN_POSITION, MHV_PV_MAX_POSITION, MHV_PV_POSITION_STEP),
+                                                           MHV_PV_DEFAULT_POSITION));
+    // The layers stack the embedded impulse responses at their levels, instead of the morph or the selected one
+    layout.add(std::make_unique<juce::AudioParameterBool>(MHV_PID_LAYERS,
+                                                          "Layers",
+                                                          MHV_PV_DEFAULT_LAYERS));
+    const juce::NormalisableRange<float> levelRange(MHV_PV_MIN_LEVEL, MHV_PV_MAX_LEVEL, MHV_PV_STEP_VALUE);
+    layout.add(std::make_unique<juce::AudioParameterFloat>(MHV_PID_NEAR_LEVEL, "Near Level", levelRange, MHV_PV_DEFAULT_NEAR_LEVEL));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(MHV_PID_FAR_LEVEL, "Far Level", levelRange, MHV_PV_DEFAULT_LEVEL));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(MHV_PID_WHEREVER_LEVEL, "Wherever Level", levelRange, MHV_PV_DEFAULT_LEVEL));
+    // The pre-delay only moves the wet signal, the impulse response and the engine are left as they are
+    layout.add(std::make_unique<juce::AudioParameterFloat>(MHV_PID_PRE_DELAY,
+                                                           "Pre-Delay",
+                                                           juce::NormalisableRange<float>(MHV_PV_MIN_PRE_DELAY, MHV_PV_MAX_PRE_DELAY, MHV_PV_PRE_DELAY_STEP),
+                                                           MHV_PV_DEFAULT_PRE_DELAY));
+    // The tone is baked into the impulse response in the background, the lowest low cut and the highest high cut are off
+    layout.add(std::make_unique<juce::AudioParameterFloat>(MHV_PID_LOW_CUT,
+                                                           "Low Cut",
+                                                           juce::NormalisableRange<float>(MHV_PV_MIN_LOW_CUT, MHV_PV_MAX_LOW_CUT, MHV_PV_FREQUENCY_STEP, MHV_PV_FREQUENCY_SKEW),
+                                                           MHV_PV_MIN_LOW_CUT));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(MHV_PID_HIGH_CUT,
+                                                           "High Cut",
+                                                           juce::NormalisableRange<float>(MHV_PV_MIN_HIGH_CUT, MHV_PV_MAX_HIGH_CUT, MHV_PV_FREQUENCY_STEP, MHV_PV_FREQUENCY_SKEW),
+                                                           MHV_PV_MAX_HIGH_CUT));
+    layout.add(std::make_unique<juce::AudioParameterFloat>(MHV_PID_TILT,
+                                                           "Tilt",
+                                                           juce::NormalisableRange<float>(MHV_PV_MIN_TILT, MHV_PV_MAX_TILT, MHV_PV_STEP_VALUE),
+                                                           MHV_PV_DEFAULT_TILT));
     return layout;
 }
 
 void MHVAudioProcessor::updateParameters(bool forceUpdate)
 {
+    // A forced update reads everything, and leaves the change tracking to the audio thread
+    const auto changes = forceUpdate ? MHV_ALL_PARAMS : m_paramChanges.fetchChanges();
     // Get the chain settings
-    m_newChainSettings.updateSettings(m_paramPointers);
+    if (changes != 0)
+        m_newChainSettings.updateSettings(m_paramPointers, changes);
+    // A new user impulse response or a new blend is applied like a parameter change
+    const bool userIRChanged = m_newChainSettings.useUserIR && m_userIRLoader.getVersion() != m_userIRVersion;
+    const bool blendChanged = m_newChainSettings.isBlending() && m_irBlender.getVersion() != m_blendVersion;
+    const bool toneChanged = !getTone(m_newChainSettings).isFlat() && m_irToneShaper.getVersion() != m_toneVersion;
+    if (changes != 0 || userIRChanged || blendChanged || toneChanged)
+        commitSettings(forceUpdate || userIRChanged || blendChanged || toneChanged);
+}
+
+size_t MHVAudioProcessor::applyScheduledChanges(const size_t start, const size_t numSamples)
+{
+    bool applied = false;
+    auto end = numSamples;
+    ParamChangeTracker::ScheduledChange change;
+    while (m_paramChanges.getNextChangeBefore(m_timelinePosition + (juce::int64)numSamples, change))
+    {
+        // The changes due before the block land at its start
+        const auto offset = (size_t)juce::jmax((juce::int64)0, change.position - m_timelinePosition);
+        if (offset > start)
+        {
+            end = offset;
+            break;
+        }
+        m_newChainSettings.setValue(m_paramPointers, change.paramIndex, change.plainValue);
+        m_paramChanges.popChange();
+        applied = true;
+    }
+    if (applied)
+        commitSettings(false);
+    return end;
+}
+
+void MHVAudioProcessor::commitSettings(const bool forceUpdate)
+{
     // Apply the parameters to the chains
     if(forceUpdate || !(m_newChainSettings == m_currentChainSettings))
     {
@@ -271,50 +610,155 @@ void MHVAudioProcessor::updateParameters(bool forceUpdate)
 
 void MHVAudioProcessor::applyChainSettings()
 {
-    for(unsigned int i = 0; i < chainArray.size(); i++)
+    // Apply the gains and the dry/wet mix to both precisions, the settings survive a change of precision
+    mixer.setInputGainDecibels(m_currentChainSettings.inputGain);
+    mixer.setOutputGainDecibels(m_currentChainSettings.outputGain);
+    mixer.setWetMixProportion(m_currentChainSettings.dryWet);
+    doubleMixer.setInputGainDecibels(m_currentChainSettings.inputGain);
+    doubleMixer.setOutputGainDecibels(m_currentChainSettings.outputGain);
+    doubleMixer.setWetMixProportion(m_currentChainSettings.dryWet);
+    // The pre-delay crossfades to its new length, the reverb then lasts that much longer
+    m_preDelay.setDelayMilliseconds(m_currentChainSettings.preDelay);
+    m_doublePreDelay.setDelayMilliseconds(m_currentChainSettings.preDelay);
+    if (!juce::approximatelyEqual(m_currentChainSettings.preDelay, m_oldChainSettings.preDelay))
+        updateTailLength();
+    // The blending thread picks the weights up, the engine gets the blend once it's published.
+    // Without the morph and the layers it stops, and the last blend is freed
+    updateBlendWeights(m_currentChainSettings);
+    // The user's impulse response, the blend and the shaped one are also updated when their threads publish new ones
+    m_blendVersion = m_irBlender.getVersion();
+    m_userIRVersion = m_userIRLoader.getVersion();
+    m_toneVersion = m_irToneShaper.getVersion();
+    // The engine only gets a new impulse response when it changed, all the channels share it.
+    // With a tone the shaping thread bakes it into the source, and the engine keeps what it plays until it's done.
+    // A flat tone stops it, and the last shaped impulse response is freed
+    const auto* source = getSourceIR(m_currentChainSettings);
+    const auto tone = getTone(m_currentChainSettings);
+    m_irToneShaper.setRequest(source, tone);
+    const auto* shaped = tone.isFlat() ? nullptr : m_irToneShaper.get(source);
+    if (shaped != nullptr)
+        updateCurrentIR(shaped);
+    else if (tone.isFlat() || m_currentIR == nullptr)
+        updateCurrentIR(source);
+}
+
+const PartitionedIR* MHVAudioProcessor::getSourceIR(const ChainSettings& settings) const noexcept
+{
+    // Until there's a blend, or when every layer is left out, the selected impulse response plays
+    const auto* blend = settings.isBlending() ? m_irBlender.get() : nullptr;
+    if (blend != nullptr)
+        return blend;
+    if (settings.useUserIR)
+        return m_userIRLoader.get();
+    if (settings.irIndex < 0 || settings.irIndex >= MHV_IR_COUNT)
+        return nullptr;
+    return m_irCache.get(m_IRDataArray[(unsigned int)settings.irIndex].index);
+}
+
+void MHVAudioProcessor::updateBlendWeights(const ChainSettings& settings) noexcept
+{
+    // The layers are normalised, so only their levels relative to each other matter
+    std::array<float, MHV_IR_COUNT> weights {};
+    if (settings.layers)
     {
-        // Apply the input gain parameter
-        chainArray[i].get<ChainPositions::PosInputGain>().setGainDecibels(m_currentChainSettings.inputGain);
-        // Apply the output gain parameter
-        chainArray[i].get<ChainPositions::PosOutputGain>().setGainDecibels(m_currentChainSettings.outputGain);
-        // Apply the dry/wet mix parameter
-        mixerArray[i].setWetMixProportion(m_currentChainSettings.dryWet);
-        // Update the current impulse response if needed
-        if (m_oldChainSettings.irIndex == MHV_INVALID_IR_INDEX || m_currentChainSettings.irIndex != m_oldChainSettings.irIndex)
-        {
-            updateCurrentIR(&m_IRDataArray[(unsigned int)m_currentChainSettings.irIndex]);
-        }
+        for (size_t i = 0; i < weights.size(); i++)
+            weights[i] = settings.levels[i] > MHV_PV_MIN_LEVEL ? juce::Decibels::decibelsToGain(settings.levels[i]) : 0.0f;
     }
+    else if (settings.morph)
+    {
+        weights = IRBlender::getWeights(settings.position);
+    }
+    m_irBlender.setWeights(weights, settings.layers);
 }
 
-void MHVAudioProcessor::processBufferUsingDSP(juce::AudioBuffer<float>& buffer, unsigned int numChannels)
+template <typename SampleType>
+void MHVAudioProcessor::processBufferUsingDSP(juce::AudioBuffer<SampleType>& buffer, const unsigned int numChannels, const size_t startSample,
+                                              const size_t numSamples, GainMixer<SampleType>& gainMixer, PreDelay<SampleType>& preDelay)
 {
-    // Create an AudioBlock to wrap the buffer
-    juce::dsp::AudioBlock<float> block(buffer);
-    // Create left and right blocks
-    for(unsigned int i = 0; i < numChannels; i++)
+    // Create an AudioBlock to wrap the buffer's active channels, over the part being processed
+    auto block = juce::dsp::AudioBlock<SampleType>(buffer).getSubsetChannelBlock(0, numChannels).getSubBlock(startSample, numSamples);
+    // The wet buffer holds the announced maximum block size, a larger block from the host is processed in parts
+    const auto maximumBlockSize = gainMixer.getMaximumBlockSize();
+    for (size_t start = 0; start < block.getNumSamples() && maximumBlockSize > 0; start += maximumBlockSize)
     {
-        auto channelBlock = block.getSingleChannelBlock(i);
-        // Push the dry samples into the chains
-        mixerArray[i].pushDrySamples(channelBlock);
-        // Create left and right context
-        juce::dsp::ProcessContextReplacing<float> context(channelBlock);
-        // Process the left and right chains
-        chainArray[i].process(context);
-        // Mix the wet samples
-        mixerArray[i].mixWetSamples(channelBlock);
+        // The dry samples stay in the host's buffer
+        auto dryBlock = block.getSubBlock(start, juce::jmin(maximumBlockSize, block.getNumSamples() - start));
+        auto wetBlock = gainMixer.getWetBlock(numChannels, dryBlock.getNumSamples());
+        // Process all the channels in one go, straight from the dry samples when there's no input gain to apply
+        // Every stage is timed when the trace is compiled in
+        const bool inputCopied = m_perfTrace.measure(PerfTrace::Stage::inputGain, [&] { return gainMixer.pushInputSamples(dryBlock, wetBlock); });
+        // The pre-delay hands back a view into its delay line, or the input itself when there's no delay
+        const bool delaying = preDelay.isDelaying();
+        const auto input = preDelay.process(inputCopied ? juce::dsp::AudioBlock<const SampleType>(wetBlock)
+                                                        : juce::dsp::AudioBlock<const SampleType>(dryBlock));
+        if (m_rateConverter.getFactor() > 1)
+        {
+            // In eco mode the engine convolves a decimated copy, which is interpolated back into the wet block
+            auto reducedBlock = m_perfTrace.measure(PerfTrace::Stage::rateConversion, [&] { return m_rateConverter.decimate(input); });
+            m_perfTrace.measure(PerfTrace::Stage::convolution, [&]
+            {
+                if (m_partitionGatherer.getPartitionSize() > 0)
+                    processGathered(juce::dsp::AudioBlock<const float>(reducedBlock), reducedBlock);
+                else
+                    chain.process(juce::dsp::ProcessContextReplacing<float>(reducedBlock));
+            });
+            m_perfTrace.measure(PerfTrace::Stage::rateConversion, [&] { m_rateConverter.interpolate(reducedBlock, wetBlock); });
+        }
+        else if (m_partitionGatherer.getPartitionSize() > 0)
+        {
+            m_perfTrace.measure(PerfTrace::Stage::convolution, [&] { processGathered(input, wetBlock); });
+        }
+        else if (inputCopied && !delaying)
+            m_perfTrace.measure(PerfTrace::Stage::convolution, [&] { chain.process(juce::dsp::ProcessContextReplacing<SampleType>(wetBlock)); });
+        else
+            m_perfTrace.measure(PerfTrace::Stage::convolution, [&] { chain.process(juce::dsp::ProcessContextNonReplacing<SampleType>(input, wetBlock)); });
+        if (m_isMetering)
+        {
+            const auto range = wetBlock.findMinAndMax();
+            m_wetPeak = juce::jmax(m_wetPeak, (float)-range.getStart(), (float)range.getEnd());
+        }
+        // Mix the wet samples back into the host's buffer, with the output gain
+        m_perfTrace.measure(PerfTrace::Stage::mix, [&] { gainMixer.mixWetSamples(dryBlock, wetBlock); });
     }
 }
 
-void MHVAudioProcessor::updateCurrentIR(const IRData* const newIRData)
+template <typename SampleType>
+void MHVAudioProcessor::processGathered(const juce::dsp::AudioBlock<const SampleType>& input, juce::dsp::AudioBlock<SampleType>& output)
 {
-    for(auto& chain : chainArray)
+    // The engine only gets whole partitions, which are played back one partition later
+    for (size_t start = 0; start < output.getNumSamples();)
     {
-        chain.get<ChainPositions::PosConvolution>().loadImpulseResponse(newIRData->data,
-                                                                        newIRData->size,
-                                                                        juce::dsp::Convolution::Stereo::no,
-                                                                        juce::dsp::Convolution::Trim::no,
-                                                                        0,
-                                                                        juce::dsp::Convolution::Normalise::yes);
+        auto outputPart = output.getSubBlock(start);
+        start += m_partitionGatherer.exchange(input.getSubBlock(start), outputPart);
+        if (m_partitionGatherer.isFull())
+        {
+            auto partition = m_partitionGatherer.getPartition();
+            chain.process(juce::dsp::ProcessContextReplacing<float>(partition));
+            m_partitionGatherer.finishPartition();
+        }
     }
+}
+
+void MHVAudioProcessor::updateCurrentIR(const PartitionedIR* const partitionedIR)
+{
+    // The impulse response was already prepared, this only publishes it to the engine, unless it already has it.
+    // A user's one longer than the engine's history waits for the plugin to be prepared again
+    auto& convolution = chain.get<ChainPositions::PosConvolution>();
+    if (partitionedIR == nullptr || partitionedIR == m_currentIR || partitionedIR->lengthInSamples > convolution.getReservedLength())
+        return;
+    convolution.setImpulseResponse(partitionedIR);
+    m_currentIR = partitionedIR;
+    if (m_displayFeed.isClaimed())
+        m_displayFeed.pushOverview(partitionedIR->overview);
+    m_irTailSeconds = (double)partitionedIR->decayLengthInSamples / partitionedIR->sampleRate;
+    updateTailLength();
+}
+
+void MHVAudioProcessor::updateTailLength()
+{
+    // The pre-delay's length is taken from the setting, so it holds before the crossfade reaches it
+    const auto tailLengthSeconds = m_irTailSeconds + (double)m_currentChainSettings.preDelay * 0.001;
+    m_tailLengthSeconds = tailLengthSeconds;
+    // The idle detection counts samples at the host's rate, and the wet signal comes out after the latency
+    m_decayLength = (size_t)std::ceil(tailLengthSeconds * m_processSpec.sampleRate) + (size_t)m_wetLatency;
 }
\ No newline at end of file
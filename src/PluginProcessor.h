@@ -2,16 +2,35 @@
 
 #include <memory>
 #include <array>
+#include <atomic>
 #include <juce_audio_processors/juce_audio_processors.h>
 #include <juce_dsp/juce_dsp.h>
 #include "BinaryData.h"
+#include "IRPack.h"
 #include "ParamDefinitions.h"
 #include "HelperStructs.h"
+#include "IRCache.h"
+#include "UserIRLoader.h"
+#include "IRBlender.h"
+#include "IRToneShaper.h"
+#include "MultiChannelConvolution.h"
+#include "GainMixer.h"
+#include "RateConverter.h"
+#include "PartitionGatherer.h"
+#include "PreDelay.h"
+#include "ParamChangeTracker.h"
+#include "RealtimeChecker.h"
+#include "DisplayFeed.h"
+#include "PerfTrace.h"
 
-#define PLUGIN_CHANNEL_COUNT 2
+// The largest discrete layout the plugin accepts, the named surround and immersive layouts go up to 7.1.4
+#define MHV_MAX_CHANNEL_COUNT 16
+// Below this level the input and the output are taken as silent, the plugin sleeps once both are
+#define MHV_SILENCE_DECIBELS -96.0f
 
 // This is the plugin's main class
-class MHVAudioProcessor final : public juce::AudioProcessor
+class MHVAudioProcessor final : public juce::AudioProcessor,
+                                private juce::AsyncUpdater
 {
 // Variables
 public:
@@ -19,16 +38,45 @@ public:
     juce::AudioProcessorValueTreeState apvts;
 private:
      // Chain element's position defined as an enum for easier access
-    enum ChainPositions { PosInputGain = 0, PosConvolution, PosOutputGain, };
+    enum ChainPositions { PosConvolution = 0, };
     // Those are only used to make the type names shorters
-    using Convolution = juce::dsp::Convolution;
-    using Gain = juce::dsp::Gain<float>;
-    using DryWetMixer = juce::dsp::DryWetMixer<float>;
-    using MonoChain = juce::dsp::ProcessorChain<Gain, Convolution, Gain>;
-    // Left and right channel's signal processing chains
-    std::array<MonoChain, PLUGIN_CHANNEL_COUNT> chainArray; 
-    // Dry/Wet mixers
-    std::array<DryWetMixer, PLUGIN_CHANNEL_COUNT> mixerArray;
+    using Convolution = MultiChannelConvolution;
+    using MultiChannelChain = juce::dsp::ProcessorChain<Convolution>;
+    // The impulse responses ready to be used by the convolution engine. It's declared before the chain,
+    // so it's destroyed after the engine's worker thread, which may still be reading them
+    IRCache m_irCache;
+    // What the engine still points to, the loader, the blender and the shaper don't free what's in it.
+    // It's declared before them, as their threads read it until they're stopped
+    IRPublisher::Usage m_irUsage;
+    // Loads the user's impulse response file in the background, it's declared before the chain for the same reason
+    UserIRLoader m_userIRLoader;
+    // The length of the user's impulse response built last, the engine's history is only made longer for it when
+    // the plugin is prepared again
+    std::atomic<size_t> m_userIRLength { 0 };
+    // Blends the embedded impulse responses in the background for the morph and the layers, it's declared before the chain too
+    IRBlender m_irBlender;
+    // Bakes the wet tone into the impulse response playing, in the background. It's declared before the chain too,
+    // and after the loader and the blender, whose impulse responses it reads
+    IRToneShaper m_irToneShaper;
+    // The wet signal processing chain, all the channels share the same convolution engine
+    MultiChannelChain chain;
+    // Apply the input gain before the chain, then the output gain and the dry/wet mix after it.
+    // There's one for each precision, only the one the host processes in holds buffers
+    GainMixer<float> mixer;
+    GainMixer<double> doubleMixer;
+    // Delays the wet signal before the engine, one for each precision like the mixers
+    PreDelay<float> m_preDelay;
+    PreDelay<double> m_doublePreDelay;
+    // Takes the wet signal to a fraction of the sample rate and back, in eco mode
+    RateConverter m_rateConverter;
+    // Feeds the engine whole partitions in the low CPU mode and in offline renders
+    PartitionGatherer m_partitionGatherer;
+    // How much the wet signal is delayed by the rate conversion and the gathering, in samples at the host's rate
+    int m_wetLatency = 0;
+    // Whether the chains were prepared for an offline render, the automatic latency mode depends on it
+    bool m_preparedNonRealtime = false;
+    // What the plugin was prepared for, switching the eco mode prepares it again with the same specification
+    juce::dsp::ProcessSpec m_processSpec {};
     // Chain settings, used to store the current old and new settings
     // When they are intialized, they are all the same and hold the default values
     ChainSettings m_oldChainSettings;
@@ -36,10 +84,46 @@ private:
     ChainSettings m_newChainSettings;
     // The plugin's parameters pointers, its's important to have it declared below the AudioProcessorValueTreeState
     const ParamPointers m_paramPointers;
-    // The array with the impulse response data
-    const std::array<const IRData, 3> m_IRDataArray = { IRData(BinaryData::NearIR_wav, BinaryData::NearIR_wavSize, 0 ),
-                                                        IRData(BinaryData::FarIR_wav, BinaryData::FarIR_wavSize, 1),
-                                                        IRData(BinaryData::WhereverIR_wav, BinaryData::WhereverIR_wavSize, 2) };
+    // Tells the audio thread which parameters changed, and holds the changes scheduled inside the blocks
+    ParamChangeTracker m_paramChanges;
+    // The samples processed since prepareToPlay, the scheduled changes are placed on this timeline
+    juce::int64 m_timelinePosition = 0;
+    // The array with the impulse response data, they're all in the pack built from res/ (see IRPack.h)
+    const std::array<const IRData, MHV_IR_COUNT> m_IRDataArray = { IRData(IRPackData::data, IRPackData::size, 0),
+                                                        IRData(IRPackData::data, IRPackData::size, 1),
+                                                        IRData(IRPackData::data, IRPackData::size, 2) };
+    // The version of the user's impulse response the engine was given last
+    juce::uint32 m_userIRVersion = 0;
+    // The same for the blend of the embedded impulse responses, and for the impulse response with the tone baked in
+    juce::uint32 m_blendVersion = 0;
+    juce::uint32 m_toneVersion = 0;
+    // What the engine reports it still points to, stored in m_irUsage after every block
+    std::array<const PartitionedIR*, MHV_MAX_IRS_IN_USE> m_irsInUse {};
+    // The audible length of the current impulse response
+    double m_irTailSeconds = 0.0;
+    // The same after the pre-delay, it's read by the host from another thread
+    std::atomic<double> m_tailLengthSeconds { 0.0 };
+    // The same in samples, for the idle detection on the audio thread
+    size_t m_decayLength = 0;
+    // How long the input has been silent, and whether the processing is skipped until it isn't anymore
+    size_t m_silentSamples = 0;
+    bool m_isIdle = false;
+    // Carries the levels and the impulse response overview to the editor
+    DisplayFeed m_displayFeed;
+    // The impulse response the engine was given last, its overview is sent again when an editor opens
+    const PartitionedIR* m_currentIR = nullptr;
+    // Whether the current block is metered, and the wet peak measured over its parts
+    bool m_isMetering = false;
+    float m_wetPeak = 0.0f;
+    // Records what processBlock must not do (allocating, freeing, locking) when built with MHV_REALTIME_CHECKS
+    RealtimeChecker m_realtimeChecker;
+    // Times the stages of processBlock when built with MHV_PERF_TRACE
+    PerfTrace m_perfTrace;
+    // Call back on the message thread when the eco, the quality, the latency mode or the trim is switched
+    std::unique_ptr<juce::ParameterAttachment> m_ecoAttachment;
+    std::unique_ptr<juce::ParameterAttachment> m_qualityAttachment;
+    std::unique_ptr<juce::ParameterAttachment> m_latencyModeAttachment;
+    std::unique_ptr<juce::ParameterAttachment> m_trimAttachment;
 // Methods
 public:
   // AudioProcessor methods overrides
@@ -50,11 +134,16 @@ public:
     ~MHVAudioProcessor() override;
     // This method gets called before the plugin starts processing audio
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
-    using AudioProcessor::processBlock;
     // This method gets called when the plugin is processing audio
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    // The same in double precision, the host then doesn't have to convert its blocks
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    // This method returns true as the plugin can process double precision blocks
+    bool supportsDoublePrecisionProcessing() const override;
     // This method gets called when the playback stop, it can be used to release resources
     void releaseResources() override;
+    // This method gets called when the host switches between real-time and offline processing
+    void setNonRealtime (bool isNonRealtime) noexcept override;
     // This returns true if the plugin supports the given bus layout
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
     // This method creates the plugin's editor
@@ -81,18 +170,75 @@ public:
   // Custom methods    
     // Creates the plugin's parameters layout
     static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
+    // Returns true if the plugin can process the given channel set, on both its input and its output
+    static bool isChannelSetSupported(const juce::AudioChannelSet& channelSet);
+    // Schedules a parameter change at a sample of the timeline (counted from prepareToPlay), the block is split there.
+    // Hosts hand the parameter changes over between blocks, this is for renders that know where they land.
+    // The changes must be scheduled in order, from one thread. Returns false for parameters that can't be scheduled
+    bool scheduleParameterChange(const juce::String& parameterID, const float plainValue, const juce::int64 position) noexcept
+    {
+        return m_paramChanges.scheduleChange(ParamChangeTracker::getParamIndex(parameterID), plainValue, position);
+    }
+    // Returns true while the plugin sleeps, its input and its reverb being silent
+    bool isIdle() const noexcept { return m_isIdle; }
+    // Returns the real-time violations processBlock made so far, they're always zero without MHV_REALTIME_CHECKS
+    RealtimeChecker::Counters getRealtimeViolations() const noexcept { return m_realtimeChecker.getCounters(); }
+    // Returns a stack trace for each of the first real-time violations
+    juce::StringArray getRealtimeViolationReports() const { return m_realtimeChecker.getReports(); }
+    // Forgets the real-time violations, must not be called while the plugin is processing
+    void resetRealtimeViolations() noexcept { m_realtimeChecker.reset(); }
+    // Returns the timings of processBlock's stages, they're empty without MHV_PERF_TRACE
+    PerfTrace& getPerfTrace() noexcept { return m_perfTrace; }
+    // Loads an impulse response file in the background and stores its path in the state, an empty file unloads it.
+    // It's used once the impulse response parameter is set to the user's one
+    void loadUserIR(const juce::File& file);
+    // Returns the user's impulse response file
+    juce::File getUserIRFile() const { return m_userIRLoader.getFile(); }
+    // Returns why the user's impulse response file couldn't be loaded, or an empty string
+    juce::String getUserIRError() const { return m_userIRLoader.getLastError(); }
+    // Returns the feed the editor reads the levels and the impulse response overview from
+    DisplayFeed& getDisplayFeed() noexcept { return m_displayFeed; }
 private:
     // Updates the plugin's parameters (update the DSP chain with the new parameters values)
-    // The update will only happen if the new parameters values are different from the current ones
+    // Only the parameters that changed since the last block are read. A forced update reads them all, it must only
+    // be used while the audio thread isn't processing
     void updateParameters(const bool forceUpdate = false);
-    // Updates the current impulse response
-    void updateCurrentIR(const IRData* newIRData);
+    // Internal method used to apply the new settings, only if they are different from the current ones
+    void commitSettings(const bool forceUpdate);
+    // Internal method used to apply the scheduled changes due at the start sample of the block,
+    // returns where the next one is due or the block's length
+    size_t applyScheduledChanges(const size_t start, const size_t numSamples);
+    // Updates the current impulse response, nothing changes if there's none
+    void updateCurrentIR(const PartitionedIR* partitionedIR);
+    // Internal method used to update the tail length from the impulse response's and the pre-delay
+    void updateTailLength();
+    // Internal method used to process a block in either precision
+    template <typename SampleType>
+    void processBlockWithPrecision(juce::AudioBuffer<SampleType>& buffer, GainMixer<SampleType>& gainMixer, PreDelay<SampleType>& preDelay);
     // Internal method used to process the buffer using the plugin's DSP chain
-    void processBufferUsingDSP(juce::AudioBuffer<float>& buffer, const unsigned int numChannels);
+    template <typename SampleType>
+    void processBufferUsingDSP(juce::AudioBuffer<SampleType>& buffer, const unsigned int numChannels, const size_t startSample,
+                               const size_t numSamples, GainMixer<SampleType>& gainMixer, PreDelay<SampleType>& preDelay);
+    // Internal method used to run the engine on the wet signal through the partition gatherer
+    template <typename SampleType>
+    void processGathered(const juce::dsp::AudioBlock<const SampleType>& input, juce::dsp::AudioBlock<SampleType>& output);
     // Internal method used to apply the plugin's settings to the DSP chain
     void applyChainSettings();
+    // Internal method used to pick the impulse response the settings play, before the tone is baked in
+    const PartitionedIR* getSourceIR(const ChainSettings& settings) const noexcept;
+    // Internal method used to hand the weights of the morph or the layers to the blending thread
+    void updateBlendWeights(const ChainSettings& settings) noexcept;
     // Internal method used to prepare the DSP chains
     void prepareChains(const juce::dsp::ProcessSpec& spec);
+    // Internal method used to prepare the DSP chains again with the same specification, the processing is suspended meanwhile
+    void prepareChainsAgain();
+    // Prepares the DSP chains again on the message thread when the user's impulse response doesn't fit them anymore,
+    // or when the host switched to or from offline processing
+    void handleAsyncUpdate() override;
+    // Internal method used to pick the factor the eco mode divides the sample rate by, 1 when it's off
+    int getEcoFactor(const double sampleRate);
+    // Internal method used to pick the size of the partitions the latency mode gathers for the engine, 0 for none
+    size_t getGatheredPartitionSize(const juce::dsp::ProcessSpec& wetSpec) const;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MHVAudioProcessor)
 };
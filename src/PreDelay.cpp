@@ -0,0 +1,131 @@
+#include "PreDelay.h"
+#include <algorithm>
+
+template <typename SampleType>
+PreDelay<SampleType>::PreDelay()
+{
+}
+
+template <typename SampleType>
+PreDelay<SampleType>::~PreDelay()
+{
+}
+
+template <typename SampleType>
+void PreDelay<SampleType>::prepare(const juce::dsp::ProcessSpec& spec)
+{
+    m_sampleRate = spec.sampleRate;
+    m_numChannels = spec.numChannels;
+    m_maximumBlockSize = spec.maximumBlockSize;
+    m_maxDelay = (size_t)std::ceil(MHV_PREDELAY_MAX_SECONDS * spec.sampleRate);
+    // The line keeps the longest delay behind the block being written
+    m_lineLength = m_maxDelay + m_maximumBlockSize;
+    m_lines.assign(m_numChannels * 2 * m_lineLength, (SampleType)0);
+    m_fadeLength = (size_t)juce::jmax(1, juce::roundToInt(MHV_PREDELAY_FADE_SECONDS * spec.sampleRate));
+    m_fadeBuffer.setSize((int)m_numChannels, (int)m_maximumBlockSize);
+    m_channelPointers.assign(m_numChannels, nullptr);
+    m_delay = 0;
+    m_targetDelay = 0;
+    m_requestedDelay = 0;
+    reset();
+}
+
+template <typename SampleType>
+void PreDelay<SampleType>::release()
+{
+    m_lines = {};
+    m_fadeBuffer = juce::AudioBuffer<SampleType>();
+    m_channelPointers = {};
+    m_numChannels = 0;
+    m_maxDelay = 0;
+    m_lineLength = 0;
+}
+
+template <typename SampleType>
+void PreDelay<SampleType>::reset() noexcept
+{
+    std::fill(m_lines.begin(), m_lines.end(), (SampleType)0);
+    m_position = 0;
+    m_blockStart = 0;
+    m_delay = m_requestedDelay;
+    m_targetDelay = m_requestedDelay;
+    m_fadePosition = 0;
+}
+
+template <typename SampleType>
+void PreDelay<SampleType>::setDelayMilliseconds(const float milliseconds) noexcept
+{
+    // A fade in progress isn't redirected, the next one starts once it's done
+    const auto delay = (size_t)juce::jmax(0, juce::roundToInt((double)milliseconds * 0.001 * m_sampleRate));
+    m_requestedDelay = juce::jmin(delay, m_maxDelay);
+}
+
+template <typename SampleType>
+const SampleType* PreDelay<SampleType>::getDelayedSamples(const size_t channel, const size_t delay) const noexcept
+{
+    // The block was just written from its start, the delayed samples start that much earlier in the line
+    const auto start = (m_blockStart + m_lineLength - delay) % m_lineLength;
+    return m_lines.data() + channel * 2 * m_lineLength + start;
+}
+
+template <typename SampleType>
+juce::dsp::AudioBlock<const SampleType> PreDelay<SampleType>::process(const juce::dsp::AudioBlock<const SampleType>& input) noexcept
+{
+    const auto numChannels = juce::jmin(input.getNumChannels(), m_numChannels);
+    const auto numSamples = input.getNumSamples();
+    jassert(numSamples <= m_maximumBlockSize);
+    const bool delaying = isDelaying();
+
+    // Write the block twice, the part past the end of the line goes to its start
+    m_blockStart = m_position;
+    const auto firstPart = juce::jmin(numSamples, m_lineLength - m_position);
+    for (size_t channel = 0; channel < numChannels; channel++)
+    {
+        const auto* samples = input.getChannelPointer(channel);
+        auto* line = m_lines.data() + channel * 2 * m_lineLength;
+        std::copy(samples, samples + firstPart, line + m_position);
+        std::copy(samples, samples + firstPart, line + m_position + m_lineLength);
+        std::copy(samples + firstPart, samples + numSamples, line);
+        std::copy(samples + firstPart, samples + numSamples, line + m_lineLength);
+    }
+    m_position = (m_position + numSamples) % m_lineLength;
+
+    // The line is kept up to date even without any delay, so a new one starts with the samples it needs
+    if (!delaying)
+        return input;
+
+    if (m_targetDelay == m_delay && m_requestedDelay != m_delay)
+        m_targetDelay = m_requestedDelay;
+    if (m_targetDelay == m_delay)
+    {
+        for (size_t channel = 0; channel < numChannels; channel++)
+            m_channelPointers[channel] = getDelayedSamples(channel, m_delay);
+        return juce::dsp::AudioBlock<const SampleType>(m_channelPointers.data(), numChannels, numSamples);
+    }
+
+    // Crossfade from the old delay to the new one, the samples past the end of the fade only hear the new one
+    const auto fadeSamples = juce::jmin(numSamples, m_fadeLength - m_fadePosition);
+    const auto step = (SampleType)1 / (SampleType)m_fadeLength;
+    for (size_t channel = 0; channel < numChannels; channel++)
+    {
+        const auto* from = getDelayedSamples(channel, m_delay);
+        const auto* to = getDelayedSamples(channel, m_targetDelay);
+        auto* output = m_fadeBuffer.getWritePointer((int)channel);
+        for (size_t i = 0; i < fadeSamples; i++)
+        {
+            const auto gain = (SampleType)(m_fadePosition + i) * step;
+            output[i] = from[i] + gain * (to[i] - from[i]);
+        }
+        std::copy(to + fadeSamples, to + numSamples, output + fadeSamples);
+    }
+    m_fadePosition += fadeSamples;
+    if (m_fadePosition == m_fadeLength)
+    {
+        m_delay = m_targetDelay;
+        m_fadePosition = 0;
+    }
+    return juce::dsp::AudioBlock<SampleType>(m_fadeBuffer).getSubsetChannelBlock(0, numChannels).getSubBlock(0, numSamples);
+}
+
+template class PreDelay<float>;
+template class PreDelay<double>;
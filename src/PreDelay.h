@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <juce_dsp/juce_dsp.h>
+
+// The longest pre-delay, the delay line is allocated for it
+#define MHV_PREDELAY_MAX_SECONDS 0.25
+// How long the old and the new delay crossfade over when the pre-delay changes
+#define MHV_PREDELAY_FADE_SECONDS 0.02
+
+// This class delays the wet signal before the convolution engine, for the pre-delay. Padding the impulse
+// response with silence would do the same, but its empty partitions would still be transformed and multiplied.
+// Here the wet signal goes through a delay line allocated once for the longest delay and the largest block,
+// and changing the delay touches neither the impulse response nor the engine's state.
+// Every sample is written twice, a line length apart, so the delayed samples of a block are always contiguous:
+// the engine reads them straight from the line, without any copy. The delay is a whole number of samples,
+// and when it changes the old and the new one crossfade into a separate buffer, so it can be automated
+// without clicks.
+template <typename SampleType>
+class PreDelay
+{
+// Methods
+public:
+    PreDelay();
+    ~PreDelay();
+    // Allocates the delay line for the longest delay, this must not be called from the audio thread
+    void prepare(const juce::dsp::ProcessSpec& spec);
+    // Frees the delay line, when the host processes in the other precision
+    void release();
+    // Clears the delay line and jumps to the target delay
+    void reset() noexcept;
+    // Sets the delay, it's reached with a crossfade
+    void setDelayMilliseconds(const float milliseconds) noexcept;
+    // Returns the delay in samples, the last one set even if it's not reached yet
+    size_t getDelaySamples() const noexcept { return m_requestedDelay; }
+    // Returns true if the next call to process() returns anything else than its input
+    bool isDelaying() const noexcept { return m_delay > 0 || m_targetDelay > 0 || m_requestedDelay > 0; }
+    // Writes a block to the delay line and returns it delayed. Without any delay the input itself is returned,
+    // otherwise the block points into the delay line (or the crossfade buffer) and is valid until the next call
+    juce::dsp::AudioBlock<const SampleType> process(const juce::dsp::AudioBlock<const SampleType>& input) noexcept;
+private:
+    // Internal method used to return the delayed samples of a channel, once the block was written
+    const SampleType* getDelayedSamples(const size_t channel, const size_t delay) const noexcept;
+// Variables
+private:
+    double m_sampleRate = 0.0;
+    size_t m_numChannels = 0;
+    size_t m_maximumBlockSize = 0;
+    size_t m_maxDelay = 0;
+    // Every channel's line holds its length twice
+    size_t m_lineLength = 0;
+    std::vector<SampleType> m_lines;
+    size_t m_position = 0;
+    size_t m_blockStart = 0;
+    // The delay played, the one it's crossfading to, and the last one set
+    size_t m_delay = 0;
+    size_t m_targetDelay = 0;
+    size_t m_requestedDelay = 0;
+    // How far the crossfade went, and the buffer it's written to
+    size_t m_fadeLength = 0;
+    size_t m_fadePosition = 0;
+    juce::AudioBuffer<SampleType> m_fadeBuffer;
+    std::vector<const SampleType*> m_channelPointers;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PreDelay)
+};
@@ -0,0 +1,191 @@
+#include "RateConverter.h"
+
+RateConverter::RateConverter()
+{
+}
+
+RateConverter::~RateConverter()
+{
+}
+
+int RateConverter::getFactorFor(const double bandwidth, const double sampleRate) noexcept
+{
+    // An impulse response whose bandwidth couldn't be measured keeps the full rate
+    if (bandwidth <= 0.0)
+        return 1;
+    for (int factor = MHV_ECO_MAX_FACTOR; factor > 1; factor--)
+    {
+        if (bandwidth <= MHV_ECO_PASSBAND * sampleRate / factor)
+            return factor;
+    }
+    return 1;
+}
+
+juce::dsp::ProcessSpec RateConverter::getReducedSpec(const juce::dsp::ProcessSpec& spec, const int factor) noexcept
+{
+    // A block keeps at most one sample more than its length divided by the factor
+    const auto divisor = (juce::uint32)juce::jmax(1, factor);
+    return { spec.sampleRate / divisor, (spec.maximumBlockSize + divisor - 1) / divisor, spec.numChannels };
+}
+
+void RateConverter::prepare(const juce::dsp::ProcessSpec& spec, const int factor)
+{
+    m_factor = juce::jlimit(1, MHV_ECO_MAX_FACTOR, factor);
+    m_numChannels = spec.numChannels;
+    if (m_factor == 1)
+    {
+        m_decimatorTaps = {};
+        m_interpolatorTaps = {};
+        m_decimatorHistory = {};
+        m_interpolatorHistory = {};
+        m_reducedBuffer = juce::AudioBuffer<float>();
+        return;
+    }
+
+    // A windowed sinc cut at the reduced rate's Nyquist frequency. It has an odd length, so its delay is a
+    // whole number of samples, and a zero tap is added to fill the last phase
+    const auto factorSize = (size_t)m_factor;
+    const auto length = MHV_ECO_TAPS_PER_PHASE * factorSize;
+    const auto numTaps = length - 1;
+    const auto centre = (double)(numTaps - 1) / 2.0;
+    std::vector<float> taps(length, 0.0f);
+    juce::dsp::WindowingFunction<float>::fillWindowingTables(taps.data(), numTaps, juce::dsp::WindowingFunction<float>::kaiser,
+                                                             false, MHV_ECO_KAISER_BETA);
+    double sum = 0.0;
+    for (size_t i = 0; i < numTaps; i++)
+    {
+        const auto x = ((double)i - centre) / (double)m_factor;
+        const auto sinc = juce::approximatelyEqual(x, 0.0) ? 1.0 : std::sin(juce::MathConstants<double>::pi * x) / (juce::MathConstants<double>::pi * x);
+        taps[i] = (float)(sinc * (double)taps[i]);
+        sum += (double)taps[i];
+    }
+    // Unity gain at DC
+    for (auto& tap : taps)
+        tap = (float)((double)tap / sum);
+
+    m_decimatorTaps.assign(taps.rbegin(), taps.rend());
+
+    // The interpolator makes up for the zeros it doesn't stuff. The impulse responses are normalised at the
+    // reduced rate, where a band limited response holds factor times less energy, so the wet level is also
+    // brought back to the one of the full rate path
+    const auto gain = (float)(m_factor * std::sqrt((double)m_factor));
+    m_interpolatorTaps.assign(length, 0.0f);
+    for (size_t phase = 0; phase < factorSize; phase++)
+    {
+        for (size_t k = 0; k < MHV_ECO_TAPS_PER_PHASE; k++)
+            m_interpolatorTaps[phase * MHV_ECO_TAPS_PER_PHASE + k] = gain * taps[phase + (MHV_ECO_TAPS_PER_PHASE - 1 - k) * factorSize];
+    }
+
+    m_decimatorHistory.assign(m_numChannels * 2 * length, 0.0f);
+    m_interpolatorHistory.assign(m_numChannels * 2 * MHV_ECO_TAPS_PER_PHASE, 0.0f);
+    m_reducedBuffer.setSize((int)m_numChannels, (int)getReducedSpec(spec, m_factor).maximumBlockSize);
+    reset();
+}
+
+void RateConverter::reset() noexcept
+{
+    std::fill(m_decimatorHistory.begin(), m_decimatorHistory.end(), 0.0f);
+    std::fill(m_interpolatorHistory.begin(), m_interpolatorHistory.end(), 0.0f);
+    m_decimatorPosition = 0;
+    m_interpolatorPosition = 0;
+    m_decimatorPhase = 0;
+    m_interpolatorPhase = 0;
+}
+
+int RateConverter::getLatencySamples() const noexcept
+{
+    // Each filter delays the signal by half its length
+    return m_factor > 1 ? (int)m_decimatorTaps.size() - 2 : 0;
+}
+
+template <typename SampleType>
+juce::dsp::AudioBlock<float> RateConverter::decimate(const juce::dsp::AudioBlock<const SampleType>& input) noexcept
+{
+    jassert(m_factor > 1);
+    const auto numChannels = juce::jmin(input.getNumChannels(), m_numChannels);
+    const auto numSamples = input.getNumSamples();
+    const auto length = m_decimatorTaps.size();
+    const auto factor = (size_t)m_factor;
+    // The samples kept are the ones falling on a reduced rate sample
+    const auto firstKept = (factor - (size_t)m_decimatorPhase) % factor;
+    const auto numKept = numSamples > firstKept ? (numSamples - firstKept + factor - 1) / factor : 0;
+    jassert(numKept <= (size_t)m_reducedBuffer.getNumSamples());
+
+    for (size_t channel = 0; channel < numChannels; channel++)
+    {
+        auto* history = m_decimatorHistory.data() + channel * 2 * length;
+        const auto* samples = input.getChannelPointer(channel);
+        auto* output = m_reducedBuffer.getWritePointer((int)channel);
+        auto position = m_decimatorPosition;
+        auto nextKept = firstKept;
+        for (size_t i = 0; i < numSamples; i++)
+        {
+            history[position] = history[position + length] = (float)samples[i];
+            if (++position == length)
+                position = 0;
+            // Only the samples kept are filtered, the history then starts at the oldest sample
+            if (i == nextKept)
+            {
+                const auto* window = history + position;
+                float sum = 0.0f;
+                for (size_t k = 0; k < length; k++)
+                    sum += window[k] * m_decimatorTaps[k];
+                *output++ = sum;
+                nextKept += factor;
+            }
+        }
+    }
+    m_decimatorPosition = (m_decimatorPosition + numSamples) % length;
+    m_decimatorPhase = (int)(((size_t)m_decimatorPhase + numSamples) % factor);
+    return juce::dsp::AudioBlock<float>(m_reducedBuffer).getSubsetChannelBlock(0, numChannels).getSubBlock(0, numKept);
+}
+
+template <typename SampleType>
+void RateConverter::interpolate(const juce::dsp::AudioBlock<const float>& reduced, juce::dsp::AudioBlock<SampleType>& output) noexcept
+{
+    jassert(m_factor > 1);
+    const auto numChannels = juce::jmin(reduced.getNumChannels(), output.getNumChannels(), m_numChannels);
+    const auto numSamples = output.getNumSamples();
+    const auto numReduced = reduced.getNumSamples();
+    const size_t length = MHV_ECO_TAPS_PER_PHASE;
+    const auto factor = (size_t)m_factor;
+
+    for (size_t channel = 0; channel < numChannels; channel++)
+    {
+        auto* history = m_interpolatorHistory.data() + channel * 2 * length;
+        const auto* samples = reduced.getChannelPointer(channel);
+        auto* result = output.getChannelPointer(channel);
+        auto position = m_interpolatorPosition;
+        auto phase = (size_t)m_interpolatorPhase;
+        size_t used = 0;
+        for (size_t i = 0; i < numSamples; i++)
+        {
+            // A reduced rate sample comes in where the decimator kept one
+            if (phase == 0 && used < numReduced)
+            {
+                history[position] = history[position + length] = samples[used++];
+                if (++position == length)
+                    position = 0;
+            }
+            const auto* window = history + position;
+            const auto* taps = m_interpolatorTaps.data() + phase * length;
+            float sum = 0.0f;
+            for (size_t k = 0; k < length; k++)
+                sum += window[k] * taps[k];
+            result[i] = (SampleType)sum;
+            if (++phase == factor)
+                phase = 0;
+        }
+        // The decimator kept as many samples as there are phases starting in this block
+        jassert(used == numReduced);
+    }
+    const auto firstPushed = (factor - (size_t)m_interpolatorPhase) % factor;
+    const auto numPushed = numSamples > firstPushed ? (numSamples - firstPushed + factor - 1) / factor : 0;
+    m_interpolatorPosition = (m_interpolatorPosition + numPushed) % length;
+    m_interpolatorPhase = (int)(((size_t)m_interpolatorPhase + numSamples) % factor);
+}
+
+template juce::dsp::AudioBlock<float> RateConverter::decimate<float>(const juce::dsp::AudioBlock<const float>&) noexcept;
+template juce::dsp::AudioBlock<float> RateConverter::decimate<double>(const juce::dsp::AudioBlock<const double>&) noexcept;
+template void RateConverter::interpolate<float>(const juce::dsp::AudioBlock<const float>&, juce::dsp::AudioBlock<float>&) noexcept;
+template void RateConverter::interpolate<double>(const juce::dsp::AudioBlock<const float>&, juce::dsp::AudioBlock<double>&) noexcept;
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <juce_dsp/juce_dsp.h>
+
+// The largest factor the eco mode divides the sample rate by
+#define MHV_ECO_MAX_FACTOR 4
+// The part of the reduced sample rate the impulse responses' bandwidth must fit in, the rest up to its
+// Nyquist frequency is the filters' transition band
+#define MHV_ECO_PASSBAND 0.4
+// The length of every phase of the filters, it sets their attenuation (about 80 dB) and the latency
+#define MHV_ECO_TAPS_PER_PHASE 24
+// The Kaiser window's beta for that attenuation
+#define MHV_ECO_KAISER_BETA 7.86f
+
+// This class takes the wet signal down to a fraction of the sample rate and back up, for the eco mode.
+// The decimator and the interpolator are polyphase FIR filters sharing one windowed sinc low-pass: the
+// decimator only computes the samples it keeps, and the interpolator only multiplies the taps that don't
+// land on the zeros it would have stuffed between the samples. The low-pass lets the band above the
+// passband fold back into the reduced band's top, which the band limited impulse response then removes,
+// so the filters stay short. Both filters have a linear phase, together they delay the wet signal by a
+// whole number of samples, which the plugin reports as its latency.
+// The reduced rate signal is always in single precision, like the convolution engine.
+class RateConverter
+{
+// Methods
+public:
+    RateConverter();
+    ~RateConverter();
+    // Returns the largest factor keeping an impulse response of the given bandwidth inside the passband
+    static int getFactorFor(const double bandwidth, const double sampleRate) noexcept;
+    // Returns the specification of the reduced rate signal, for the given full rate one
+    static juce::dsp::ProcessSpec getReducedSpec(const juce::dsp::ProcessSpec& spec, const int factor) noexcept;
+    // Designs the filters and allocates their history, a factor of 1 turns the conversion off.
+    // This must not be called from the audio thread
+    void prepare(const juce::dsp::ProcessSpec& spec, const int factor);
+    // Clears the filters' history
+    void reset() noexcept;
+    // Returns the factor the sample rate is divided by, or 1 when the conversion is off
+    int getFactor() const noexcept { return m_factor; }
+    // Returns how many samples the decimation and the interpolation delay the signal by
+    int getLatencySamples() const noexcept;
+    // Decimates a block, the returned block holds the samples kept and is valid until the next call
+    template <typename SampleType>
+    juce::dsp::AudioBlock<float> decimate(const juce::dsp::AudioBlock<const SampleType>& input) noexcept;
+    // Interpolates the block returned by decimate(), once it has been processed, back to the full rate
+    template <typename SampleType>
+    void interpolate(const juce::dsp::AudioBlock<const float>& reduced, juce::dsp::AudioBlock<SampleType>& output) noexcept;
+// Variables
+private:
+    int m_factor = 1;
+    size_t m_numChannels = 0;
+    // The low-pass taps reversed, so they line up with the decimator's history (oldest sample first)
+    std::vector<float> m_decimatorTaps;
+    // The interpolator's phases one after the other, each reversed the same way
+    std::vector<float> m_interpolatorTaps;
+    // The histories are written twice, so the last samples are always contiguous
+    std::vector<float> m_decimatorHistory;
+    std::vector<float> m_interpolatorHistory;
+    size_t m_decimatorPosition = 0;
+    size_t m_interpolatorPosition = 0;
+    // Where the next full rate sample falls between two reduced rate ones
+    int m_decimatorPhase = 0;
+    int m_interpolatorPhase = 0;
+    // Holds the reduced rate samples of the current block
+    juce::AudioBuffer<float> m_reducedBuffer;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RateConverter)
+};
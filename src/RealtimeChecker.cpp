@@ -0,0 +1,272 @@
+#include "RealtimeChecker.h"
+
+#if MHV_REALTIME_CHECKS
+ #include <cerrno>
+ #include <cstdlib>
+ #include <new>
+ #if __has_include(<execinfo.h>)
+  #include <execinfo.h>
+  #define MHV_RT_HAS_BACKTRACE 1
+ #else
+  #define MHV_RT_HAS_BACKTRACE 0
+ #endif
+ #if defined(__GLIBC__)
+  #include <dlfcn.h>
+  #include <pthread.h>
+  #define MHV_RT_HOOK_LIBC 1
+ #else
+  #define MHV_RT_HOOK_LIBC 0
+ #endif
+
+ // The thread locals use the initial-exec model, so reading them never allocates, even from a plugin that was loaded with dlopen
+ #if defined(__GNUC__)
+  #define MHV_RT_THREAD_LOCAL static thread_local __attribute__((tls_model("initial-exec")))
+ #else
+  #define MHV_RT_THREAD_LOCAL static thread_local
+ #endif
+
+// The checker of the processBlock call the thread is in, and whether the thread is already inside a hook
+MHV_RT_THREAD_LOCAL RealtimeChecker* t_currentChecker = nullptr;
+MHV_RT_THREAD_LOCAL bool t_isInsideHook = false;
+#endif
+
+RealtimeChecker::ScopedAudioThread::ScopedAudioThread(RealtimeChecker& checker) noexcept
+{
+#if MHV_REALTIME_CHECKS
+    m_previousChecker = t_currentChecker;
+    t_currentChecker = &checker;
+#else
+    juce::ignoreUnused(checker);
+#endif
+}
+
+RealtimeChecker::ScopedAudioThread::~ScopedAudioThread() noexcept
+{
+#if MHV_REALTIME_CHECKS
+    t_currentChecker = m_previousChecker;
+#endif
+}
+
+RealtimeChecker::RealtimeChecker()
+{
+#if MHV_REALTIME_CHECKS && MHV_RT_HAS_BACKTRACE
+    // The first backtrace call loads the unwinder, which allocates, so it's done here and not on the audio thread
+    void* frames[1];
+    backtrace(frames, 1);
+#endif
+}
+
+RealtimeChecker::Counters RealtimeChecker::getCounters() const noexcept
+{
+    Counters counters;
+#if MHV_REALTIME_CHECKS
+    counters.allocations = m_counters[(size_t)Violation::allocation].load();
+    counters.deallocations = m_counters[(size_t)Violation::deallocation].load();
+    counters.locks = m_counters[(size_t)Violation::lock].load();
+#endif
+    return counters;
+}
+
+juce::StringArray RealtimeChecker::getReports() const
+{
+    juce::StringArray reports;
+#if MHV_REALTIME_CHECKS
+    const auto numRecords = juce::jmin(m_numRecords.load(), MHV_RT_MAX_RECORDS);
+    for (int i = 0; i < numRecords; i++)
+    {
+        const auto& record = m_records[(size_t)i];
+        juce::String report = record.violation == Violation::allocation ? "Allocation"
+                            : record.violation == Violation::deallocation ? "Deallocation"
+                            : "Mutex lock";
+        report += " on the audio thread:\n";
+       #if MHV_RT_HAS_BACKTRACE
+        if (auto** symbols = backtrace_symbols(record.frames.data(), record.numFrames))
+        {
+            // The first frames are the checker and the hook themselves
+            for (int frame = 2; frame < record.numFrames; frame++)
+                report += "    " + juce::String(symbols[frame]) + "\n";
+            std::free(symbols);
+        }
+       #endif
+        reports.add(report);
+    }
+#endif
+    return reports;
+}
+
+void RealtimeChecker::reset() noexcept
+{
+#if MHV_REALTIME_CHECKS
+    for (auto& counter : m_counters)
+        counter = 0;
+    m_numRecords = 0;
+#endif
+}
+
+void RealtimeChecker::report(const Violation violation) noexcept
+{
+#if MHV_REALTIME_CHECKS
+    auto* checker = t_currentChecker;
+    // Whatever the checker itself does while recording isn't a violation
+    if (checker == nullptr || t_isInsideHook)
+        return;
+
+    t_isInsideHook = true;
+    checker->record(violation);
+    t_isInsideHook = false;
+#else
+    juce::ignoreUnused(violation);
+#endif
+}
+
+#if MHV_REALTIME_CHECKS
+void RealtimeChecker::record(const Violation violation) noexcept
+{
+    m_counters[(size_t)violation]++;
+
+    // Only the first violations keep their stack trace, the slots are never reused until reset()
+    const auto index = m_numRecords++;
+    if (index >= MHV_RT_MAX_RECORDS)
+        return;
+
+    auto& record = m_records[(size_t)index];
+    record.violation = violation;
+   #if MHV_RT_HAS_BACKTRACE
+    record.numFrames = backtrace(record.frames.data(), MHV_RT_MAX_FRAMES);
+   #else
+    record.numFrames = 0;
+   #endif
+}
+
+//==============================================================================
+// The hooks. With glibc, malloc & co. are replaced too and everything ends up in the __libc_* functions,
+// elsewhere only operator new and delete are checked.
+ #if MHV_RT_HOOK_LIBC
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* pointer, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void* pointer);
+}
+
+static void* allocate(const size_t size) noexcept { return __libc_malloc(size); }
+static void* allocateAligned(const size_t alignment, const size_t size) noexcept { return __libc_memalign(alignment, size); }
+static void deallocate(void* pointer) noexcept { __libc_free(pointer); }
+
+extern "C"
+{
+    void* malloc(size_t size)
+    {
+        RealtimeChecker::report(RealtimeChecker::Violation::allocation);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        RealtimeChecker::report(RealtimeChecker::Violation::allocation);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* pointer, size_t size)
+    {
+        RealtimeChecker::report(RealtimeChecker::Violation::allocation);
+        return __libc_realloc(pointer, size);
+    }
+
+    void* memalign(size_t alignment, size_t size)
+    {
+        RealtimeChecker::report(RealtimeChecker::Violation::allocation);
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size)
+    {
+        RealtimeChecker::report(RealtimeChecker::Violation::allocation);
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** pointer, size_t alignment, size_t size)
+    {
+        RealtimeChecker::report(RealtimeChecker::Violation::allocation);
+        // Unlike memalign, it refuses an alignment that isn't a power of two multiple of the pointer size
+        if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+        auto* allocated = __libc_memalign(alignment, size);
+        if (allocated == nullptr)
+            return ENOMEM;
+        *pointer = allocated;
+        return 0;
+    }
+
+    void free(void* pointer)
+    {
+        if (pointer != nullptr)
+            RealtimeChecker::report(RealtimeChecker::Violation::deallocation);
+        __libc_free(pointer);
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex)
+    {
+        // The real function is looked up once, the atomic is constant initialised so there's no static guard (which could lock)
+        using LockFunction = int (*)(pthread_mutex_t*);
+        static std::atomic<LockFunction> realLock { nullptr };
+        auto lock = realLock.load(std::memory_order_acquire);
+        if (lock == nullptr)
+        {
+            lock = (LockFunction)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+            realLock.store(lock, std::memory_order_release);
+        }
+
+        RealtimeChecker::report(RealtimeChecker::Violation::lock);
+        return lock(mutex);
+    }
+}
+ #else
+static void* allocate(const size_t size) noexcept { return std::malloc(size); }
+static void* allocateAligned(const size_t alignment, const size_t size) noexcept { return std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment); }
+static void deallocate(void* pointer) noexcept { std::free(pointer); }
+ #endif
+
+static void* checkedNew(const size_t size)
+{
+    RealtimeChecker::report(RealtimeChecker::Violation::allocation);
+    if (auto* pointer = allocate(size == 0 ? 1 : size))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+static void* checkedAlignedNew(const size_t size, const std::align_val_t alignment)
+{
+    RealtimeChecker::report(RealtimeChecker::Violation::allocation);
+    if (auto* pointer = allocateAligned((size_t)alignment, size == 0 ? 1 : size))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+static void checkedDelete(void* pointer) noexcept
+{
+    if (pointer == nullptr)
+        return;
+    RealtimeChecker::report(RealtimeChecker::Violation::deallocation);
+    deallocate(pointer);
+}
+
+void* operator new(size_t size) { return checkedNew(size); }
+void* operator new[](size_t size) { return checkedNew(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return checkedAlignedNew(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return checkedAlignedNew(size, alignment); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { try { return checkedNew(size); } catch (...) { return nullptr; } }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { try { return checkedNew(size); } catch (...) { return nullptr; } }
+void operator delete(void* pointer) noexcept { checkedDelete(pointer); }
+void operator delete[](void* pointer) noexcept { checkedDelete(pointer); }
+void operator delete(void* pointer, size_t) noexcept { checkedDelete(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { checkedDelete(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { checkedDelete(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { checkedDelete(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { checkedDelete(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { checkedDelete(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { checkedDelete(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { checkedDelete(pointer); }
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <juce_core/juce_core.h>
+
+// The checks are off unless the build turns them on (MHV_REALTIME_CHECKS in CMake)
+#ifndef MHV_REALTIME_CHECKS
+ #define MHV_REALTIME_CHECKS 0
+#endif
+
+// How many violations keep their stack trace, and how deep the traces go
+#define MHV_RT_MAX_RECORDS 64
+#define MHV_RT_MAX_FRAMES 32
+
+// This class records the calls that must not happen on the audio thread: allocations, deallocations and
+// mutex locks. When the plugin is built with MHV_REALTIME_CHECKS=1, operator new/delete, malloc & co. and
+// pthread_mutex_lock are replaced by hooks that report to the checker of the processBlock call the current
+// thread is in. Every violation is counted, and the first ones keep their stack trace.
+// Without the build flag the scope does nothing and the counters stay at zero.
+class RealtimeChecker
+{
+public:
+    enum class Violation { allocation = 0, deallocation, lock };
+
+    // The number of violations of each kind
+    struct Counters
+    {
+        juce::uint64 allocations = 0;
+        juce::uint64 deallocations = 0;
+        juce::uint64 locks = 0;
+
+        juce::uint64 getTotal() const noexcept { return allocations + deallocations + locks; }
+    };
+
+    // Marks the current thread as an audio thread for this checker while the scope is alive
+    class ScopedAudioThread
+    {
+    public:
+        explicit ScopedAudioThread(RealtimeChecker& checker) noexcept;
+        ~ScopedAudioThread() noexcept;
+    private:
+        RealtimeChecker* m_previousChecker = nullptr;
+    };
+
+    RealtimeChecker();
+    // Returns the violations counted so far
+    Counters getCounters() const noexcept;
+    // Returns a description and a stack trace for each recorded violation, this allocates
+    juce::StringArray getReports() const;
+    // Forgets all the violations, must not be called while the audio thread is in a scope
+    void reset() noexcept;
+    // Called by the hooks, records the violation if the current thread is inside a scope
+    static void report(const Violation violation) noexcept;
+    // Returns true if the plugin was built with the checks
+    static constexpr bool isEnabled() noexcept { return MHV_REALTIME_CHECKS != 0; }
+private:
+#if MHV_REALTIME_CHECKS
+    // A violation with the raw addresses of its stack trace, they're only symbolised when reported
+    struct Record
+    {
+        Violation violation = Violation::allocation;
+        int numFrames = 0;
+        std::array<void*, MHV_RT_MAX_FRAMES> frames {};
+    };
+    // Internal method used to count and record a violation
+    void record(const Violation violation) noexcept;
+
+    std::array<std::atomic<juce::uint64>, 3> m_counters {};
+    std::array<Record, MHV_RT_MAX_RECORDS> m_records {};
+    std::atomic<int> m_numRecords { 0 };
+#endif
+
+    JUCE_DECLARE_NON_COPYABLE (RealtimeChecker)
+};
@@ -0,0 +1,100 @@
+#include "Semaphore.h"
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+#elif JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+#else
+ #include <cerrno>
+ #include <ctime>
+ #include <semaphore.h>
+#endif
+
+// The platform's semaphore, kept out of the header so it doesn't pull the system headers in
+struct Semaphore::Handle
+{
+   #if JUCE_WINDOWS
+    HANDLE handle;
+   #elif JUCE_MAC || JUCE_IOS
+    dispatch_semaphore_t handle;
+   #else
+    sem_t handle;
+   #endif
+};
+
+Semaphore::Semaphore()
+    : m_handle(std::make_unique<Handle>())
+{
+   #if JUCE_WINDOWS
+    m_handle->handle = CreateSemaphoreW(nullptr, 0, LONG_MAX, nullptr);
+   #elif JUCE_MAC || JUCE_IOS
+    m_handle->handle = dispatch_semaphore_create(0);
+   #else
+    sem_init(&m_handle->handle, 0, 0);
+   #endif
+}
+
+Semaphore::~Semaphore()
+{
+   #if JUCE_WINDOWS
+    CloseHandle(m_handle->handle);
+   #elif JUCE_MAC || JUCE_IOS
+    dispatch_release(m_handle->handle);
+   #else
+    sem_destroy(&m_handle->handle);
+   #endif
+}
+
+void Semaphore::post(const size_t count) noexcept
+{
+   #if JUCE_WINDOWS
+    ReleaseSemaphore(m_handle->handle, (LONG)count, nullptr);
+   #else
+    for (size_t i = 0; i < count; i++)
+    {
+       #if JUCE_MAC || JUCE_IOS
+        dispatch_semaphore_signal(m_handle->handle);
+       #else
+        sem_post(&m_handle->handle);
+       #endif
+    }
+   #endif
+}
+
+bool Semaphore::wait(const int timeoutMilliseconds) noexcept
+{
+   #if JUCE_WINDOWS
+    return WaitForSingleObject(m_handle->handle, timeoutMilliseconds < 0 ? INFINITE : (DWORD)timeoutMilliseconds) == WAIT_OBJECT_0;
+   #elif JUCE_MAC || JUCE_IOS
+    const auto timeout = timeoutMilliseconds < 0 ? DISPATCH_TIME_FOREVER
+                                                 : dispatch_time(DISPATCH_TIME_NOW, (int64_t)timeoutMilliseconds * (int64_t)NSEC_PER_MSEC);
+    return dispatch_semaphore_wait(m_handle->handle, timeout) == 0;
+   #else
+    // A signal may interrupt the wait
+    if (timeoutMilliseconds < 0)
+    {
+        while (sem_wait(&m_handle->handle) != 0)
+        {
+            if (errno != EINTR)
+                return false;
+        }
+        return true;
+    }
+
+    timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeoutMilliseconds / 1000;
+    deadline.tv_nsec += (long)(timeoutMilliseconds % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while (sem_timedwait(&m_handle->handle, &deadline) != 0)
+    {
+        if (errno != EINTR)
+            return false;
+    }
+    return true;
+   #endif
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <juce_core/juce_core.h>
+
+// A counting semaphore. Posting it never takes a lock, so the audio thread can wake a thread waiting on it up,
+// which juce::WaitableEvent can't do
+class Semaphore
+{
+// Methods
+public:
+    Semaphore();
+    ~Semaphore();
+    // Adds to the count, waking up as many waiting threads
+    void post(const size_t count = 1) noexcept;
+    // Waits until the count isn't 0 and takes one from it, or until the timeout if it isn't negative.
+    // Returns false if it timed out
+    bool wait(const int timeoutMilliseconds = -1) noexcept;
+private:
+    struct Handle;
+// Variables
+private:
+    std::unique_ptr<Handle> m_handle;
+
+    JUCE_DECLARE_NON_COPYABLE(Semaphore)
+};
+
+// A semaphore posted once until the waiting thread wakes up, however many times it's signaled meanwhile.
+// It's used for the requests a background thread picks up from atomics: it reads them all once it's woken up
+class WakeUpSignal
+{
+// Methods
+public:
+    // Wakes the thread up, unless it's about to wake up already
+    void signal() noexcept
+    {
+        if (!m_posted.exchange(true, std::memory_order_acq_rel))
+            m_semaphore.post();
+    }
+    // Waits for a signal, or until the timeout if it isn't negative. The requests signaled before this returns
+    // are visible to the thread once it does. Returns false if it timed out
+    bool wait(const int timeoutMilliseconds = -1) noexcept
+    {
+        const auto signaled = m_semaphore.wait(timeoutMilliseconds);
+        m_posted.exchange(false, std::memory_order_acq_rel);
+        return signaled;
+    }
+// Variables
+private:
+    Semaphore m_semaphore;
+    std::atomic<bool> m_posted { false };
+};
@@ -0,0 +1,157 @@
+#include "SharedConvolutionPool.h"
+#include <algorithm>
+#include <limits>
+#include "ConvolutionTail.h"
+
+std::atomic<int> SharedConvolutionPool::s_numThreads { -1 };
+
+// A thread of the pool. It sleeps until a job is queued, and the deadlines catch the jobs it couldn't start in time
+class SharedConvolutionPool::Worker final : public juce::Thread
+{
+public:
+    explicit Worker(SharedConvolutionPool& pool)
+        : juce::Thread("Convolution pool"), m_pool(pool)
+    {
+        // Like the tails' own workers, see MHV_TAIL_WORKER_PRIORITY
+        if (!startRealtimeThread(juce::Thread::RealtimeOptions().withPriority(MHV_TAIL_WORKER_PRIORITY)))
+            startThread(juce::Thread::Priority::highest);
+    }
+
+    ~Worker() override
+    {
+        stopThread(-1);
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            m_pool.m_semaphore.wait();
+            // A post may be left over from a job another thread already ran, the pass then finds nothing
+            while (!threadShouldExit() && m_pool.runMostUrgentJob()) {}
+        }
+    }
+
+private:
+    SharedConvolutionPool& m_pool;
+};
+
+juce::String SharedConvolutionPool::Stats::toString() const
+{
+    auto text = "convolution pool: " + juce::String((int)numThreads) + " threads, " + juce::String((int)clients.size()) + " instances, queue depth "
+              + juce::String((int)queueDepth) + " (max " + juce::String((int)maxQueueDepth) + "), " + juce::String((juce::int64)jobsRun) + " jobs run, "
+              + juce::String((juce::int64)missedDeadlines) + " missed deadlines\n";
+    for (const auto& client : clients)
+    {
+        text += "  instance " + juce::String((int)client.id) + ": pool " + juce::String(client.poolSeconds * 1000.0, 1) + " ms, inline "
+              + juce::String(client.inlineSeconds * 1000.0, 1) + " ms, " + juce::String((juce::int64)client.missedDeadlines)
+              + " missed deadlines, " + juce::String((int)client.queueDepth) + " queued\n";
+    }
+    return text;
+}
+
+SharedConvolutionPool::SharedConvolutionPool()
+{
+    const auto numThreads = getNumThreadsToStart();
+    for (size_t i = 0; i < numThreads; i++)
+        m_workers.push_back(std::make_unique<Worker>(*this));
+}
+
+SharedConvolutionPool::~SharedConvolutionPool()
+{
+    // Every tail removed itself before the last instance let go of the pool
+    jassert(m_clients.empty());
+    // Every thread may be waiting on the semaphore
+    for (auto& worker : m_workers)
+        worker->signalThreadShouldExit();
+    m_semaphore.post(m_workers.size());
+    m_workers.clear();
+}
+
+void SharedConvolutionPool::setNumThreads(const int numThreads) noexcept
+{
+    s_numThreads.store(numThreads, std::memory_order_relaxed);
+}
+
+size_t SharedConvolutionPool::getNumThreadsToStart()
+{
+    auto numThreads = s_numThreads.load(std::memory_order_relaxed);
+    const auto variable = juce::SystemStats::getEnvironmentVariable(MHV_POOL_THREADS_VARIABLE, {});
+    if (numThreads < 0 && variable.isNotEmpty())
+        numThreads = variable.getIntValue();
+    // By default a core is left to the host's audio thread and another one to the rest of the system
+    if (numThreads < 0)
+        numThreads = juce::jmax(1, juce::SystemStats::getNumCpus() - 2);
+    return (size_t)juce::jlimit(0, MHV_POOL_MAX_THREADS, numThreads);
+}
+
+void SharedConvolutionPool::add(ConvolutionTail& tail)
+{
+    const juce::ScopedWriteLock lock(m_lock);
+    m_clients.push_back({ &tail, m_nextId++ });
+}
+
+void SharedConvolutionPool::remove(ConvolutionTail& tail)
+{
+    // Taking the lock for writing waits for the job a thread might be running
+    const juce::ScopedWriteLock lock(m_lock);
+    const auto client = std::find_if(m_clients.begin(), m_clients.end(), [&](const Client& candidate) { return candidate.tail == &tail; });
+    if (client == m_clients.end())
+        return;
+    m_removedMissedDeadlines += tail.getStats().missedDeadlines;
+    m_clients.erase(client);
+}
+
+SharedConvolutionPool::Stats SharedConvolutionPool::getStats() const
+{
+    Stats stats;
+    stats.numThreads = m_workers.size();
+    stats.queueDepth = m_queueDepth.load(std::memory_order_relaxed);
+    stats.maxQueueDepth = m_maxQueueDepth.load(std::memory_order_relaxed);
+    stats.jobsRun = m_jobsRun.load(std::memory_order_relaxed);
+
+    const juce::ScopedReadLock lock(m_lock);
+    stats.missedDeadlines = m_removedMissedDeadlines;
+    for (const auto& client : m_clients)
+    {
+        const auto tailStats = client.tail->getStats();
+        ClientStats clientStats;
+        clientStats.id = client.id;
+        clientStats.queueDepth = client.tail->getNumQueuedJobs();
+        clientStats.poolSeconds = tailStats.workerSeconds;
+        clientStats.inlineSeconds = tailStats.inlineSeconds;
+        clientStats.missedDeadlines = tailStats.missedDeadlines;
+        stats.missedDeadlines += tailStats.missedDeadlines;
+        stats.clients.push_back(clientStats);
+    }
+    return stats;
+}
+
+bool SharedConvolutionPool::runMostUrgentJob() noexcept
+{
+    const juce::ScopedReadLock lock(m_lock);
+
+    // The queues are scanned as they are, a job queued or taken meanwhile is seen at the next pass
+    ConvolutionTail* mostUrgent = nullptr;
+    auto earliestDeadline = std::numeric_limits<juce::int64>::max();
+    size_t queueDepth = 0;
+    for (const auto& client : m_clients)
+    {
+        queueDepth += client.tail->getNumQueuedJobs();
+        const auto deadline = client.tail->getNextDeadline();
+        if (deadline < earliestDeadline)
+        {
+            earliestDeadline = deadline;
+            mostUrgent = client.tail;
+        }
+    }
+    m_queueDepth.store(queueDepth, std::memory_order_relaxed);
+    auto maxQueueDepth = m_maxQueueDepth.load(std::memory_order_relaxed);
+    while (queueDepth > maxQueueDepth && !m_maxQueueDepth.compare_exchange_weak(maxQueueDepth, queueDepth, std::memory_order_relaxed)) {}
+
+    // Another thread or the audio thread may have taken the job in the meantime
+    if (mostUrgent == nullptr || !mostUrgent->processMostUrgentJob())
+        return false;
+    m_jobsRun.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <juce_core/juce_core.h>
+#include "Semaphore.h"
+
+class ConvolutionTail;
+
+// The most threads the pool starts, whatever the number of cores
+#define MHV_POOL_MAX_THREADS 16
+// The environment variable setting how many threads the pool starts, 0 turns the pool off
+#define MHV_POOL_THREADS_VARIABLE "MHV_POOL_THREADS"
+
+// This class runs the tail jobs (see ConvolutionTail) of all the plugin's instances in the process on a shared set
+// of threads, instead of a thread per instance. Every instance keeps its own job queues, and whichever thread
+// of the pool is free takes the job with the earliest deadline from any of them, so in a large session the late
+// partitions are spread over the cores, whatever audio thread the host runs each instance on. A job's deadline is
+// when the audio thread will need its output, in wall clock time, which orders the jobs of instances running at
+// different sample rates and block sizes.
+// A job that isn't done by its deadline is run by the audio thread, like with a thread per instance, and the pool
+// only counts the miss. The audio thread only waits for a job a thread of the pool already started, and those are
+// realtime threads, so they're only held up by other realtime work. Without any thread in the pool
+// (MHV_POOL_THREADS set to 0) every instance starts its own thread again.
+// Every instance holds the pool through a juce::SharedResourcePointer, so it's created with the first one and
+// deleted with the last one. The instances are added and removed under a lock the pool's threads hold while they
+// run a job. The audio threads only wake the threads up with a semaphore, which never locks, so an idle pool sleeps.
+class SharedConvolutionPool
+{
+public:
+    // What an instance's tail cost, since it was added to the pool
+    struct ClientStats
+    {
+        juce::uint32 id = 0;
+        // The jobs waiting for a thread right now
+        size_t queueDepth = 0;
+        // The CPU time spent on its jobs, on the pool's threads and on its audio thread
+        double poolSeconds = 0.0;
+        double inlineSeconds = 0.0;
+        juce::uint64 missedDeadlines = 0;
+    };
+    // The state of the pool. The totals include the instances that were removed since the pool started
+    struct Stats
+    {
+        size_t numThreads = 0;
+        size_t queueDepth = 0;
+        size_t maxQueueDepth = 0;
+        juce::uint64 jobsRun = 0;
+        juce::uint64 missedDeadlines = 0;
+        std::vector<ClientStats> clients;
+
+        // Returns the stats as a few lines of text, one per instance
+        juce::String toString() const;
+    };
+// Methods
+public:
+    SharedConvolutionPool();
+    ~SharedConvolutionPool();
+    // Returns how many threads the pool runs, tails run their jobs on a thread of their own when it's 0
+    size_t getNumThreads() const noexcept { return m_workers.size(); }
+    // Adds a tail whose jobs the pool runs, it must be removed before it's deleted or prepared again
+    void add(ConvolutionTail& tail);
+    // Removes a tail, once this returns no thread of the pool is running one of its jobs
+    void remove(ConvolutionTail& tail);
+    // Wakes a thread up for a job that was just queued, it never locks so it's called from the audio thread
+    void wakeUp() noexcept { m_semaphore.post(); }
+    // Returns the pool's stats, it allocates so it must not be called from the audio thread
+    Stats getStats() const;
+    // Sets how many threads the next pool starts, -1 picks it from MHV_POOL_THREADS or the number of cores.
+    // It only applies to a pool created after the call, so the tools set it before creating any processor
+    static void setNumThreads(const int numThreads) noexcept;
+    // Returns how many threads a new pool starts
+    static size_t getNumThreadsToStart();
+private:
+    class Worker;
+    // A tail in the pool
+    struct Client
+    {
+        ConvolutionTail* tail = nullptr;
+        juce::uint32 id = 0;
+    };
+    // Internal method used to run the job with the earliest deadline, returns false if there was none
+    bool runMostUrgentJob() noexcept;
+// Variables
+private:
+    // Held for reading while a job runs, and for writing while the clients change
+    mutable juce::ReadWriteLock m_lock;
+    std::vector<Client> m_clients;
+    juce::uint32 m_nextId = 1;
+    std::atomic<size_t> m_queueDepth { 0 };
+    std::atomic<size_t> m_maxQueueDepth { 0 };
+    std::atomic<juce::uint64> m_jobsRun { 0 };
+    // The misses of the tails that were removed
+    juce::uint64 m_removedMissedDeadlines = 0;
+    // Posted once per queued job, a woken up thread runs jobs until there's none left
+    Semaphore m_semaphore;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    static std::atomic<int> s_numThreads;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SharedConvolutionPool)
+};
@@ -0,0 +1,100 @@
+#include "SharedIRStore.h"
+#include "IRLoader.h"
+#include "IRPack.h"
+
+std::shared_ptr<const PartitionedIR> SharedIRStore::get(const IRData& irData, const double sampleRate, const size_t partitionSize,
+                                                        const bool normalise, const bool hybrid)
+{
+    const Key key { irData.index, sampleRate, partitionSize, normalise, hybrid };
+    std::promise<std::shared_ptr<const PartitionedIR>> promise;
+    std::shared_future<std::shared_ptr<const PartitionedIR>> building;
+    {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+
+        // The entries whose impulse response was freed are dropped on the way
+        for (auto entry = m_entries.begin(); entry != m_entries.end();)
+        {
+            if (!entry->second.building.valid() && entry->second.ir.expired())
+                entry = m_entries.erase(entry);
+            else
+                ++entry;
+        }
+
+        auto& entry = m_entries[key];
+        if (auto existing = entry.ir.lock())
+            return existing;
+        building = entry.building;
+        if (!building.valid())
+            entry.building = promise.get_future().share();
+    }
+    // Another instance is building it, it's waited for without the lock
+    if (building.valid())
+        return building.get();
+
+    std::shared_ptr<const PartitionedIR> partitionedIR;
+    try
+    {
+        partitionedIR = build(irData, sampleRate, partitionSize, normalise, hybrid);
+    }
+    catch (...)
+    {
+        // The instances waiting for it get the error too, and the next one tries again
+        {
+            const std::lock_guard<std::mutex> lock(m_mutex);
+            m_entries[key].building = {};
+        }
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        auto& entry = m_entries[key];
+        entry.ir = partitionedIR;
+        entry.building = {};
+    }
+    promise.set_value(partitionedIR);
+    return partitionedIR;
+}
+
+std::shared_ptr<const PartitionedIR> SharedIRStore::build(const IRData& irData, const double sampleRate, const size_t partitionSize,
+                                                          const bool normalise, const bool hybrid)
+{
+    // At a rate the pack holds, the samples are partitioned right where they are in the binary
+    IRPack::Entry entry;
+    if (IRPack::find(irData.data, irData.size, irData.index, sampleRate, normalise, entry))
+    {
+        const auto samples = IRPack::getSamples(irData.data, entry);
+        return PartitionedIR::create(samples.getBlock(), sampleRate, partitionSize, hybrid);
+    }
+    return PartitionedIR::create(IRLoader::load(irData, sampleRate, normalise), sampleRate, partitionSize, hybrid);
+}
+
+double SharedIRStore::getBandwidth(const IRData& irData)
+{
+    {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        const auto existing = m_bandwidths.find(irData.index);
+        if (existing != m_bandwidths.end())
+            return existing->second;
+    }
+
+    // The pack has it measured already, otherwise it's measured without the lock. Instances asking together
+    // may both measure it, they get the same value
+    IRPack::Entry entry;
+    auto bandwidth = 0.0;
+    if (IRPack::findNative(irData.data, irData.size, irData.index, entry))
+    {
+        bandwidth = entry.bandwidth;
+    }
+    else
+    {
+        double sourceSampleRate = 0.0;
+        const auto buffer = IRLoader::decode(irData, sourceSampleRate);
+        bandwidth = buffer.getNumSamples() > 0 ? IRLoader::measureBandwidth(buffer, sourceSampleRate) : 0.0;
+    }
+
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    m_bandwidths[irData.index] = bandwidth;
+    return bandwidth;
+}
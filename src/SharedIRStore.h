@@ -0,0 +1,62 @@
+#pragma once
+
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include "HelperStructs.h"
+#include "PartitionedIR.h"
+
+// This class shares the prepared embedded impulse responses between all the plugin's instances in the process.
+// Every instance holds it through a juce::SharedResourcePointer, so it's created with the first instance and
+// deleted with the last one. It only keeps weak references: an impulse response lives as long as an instance
+// uses it, and the first instance asking for given settings is the only one paying for its FFTs (and its
+// resampling, at a rate the impulse response pack doesn't hold).
+// An impulse response is built outside the store's lock, so instances preparing different ones don't wait for
+// each other, and the ones asking for an impulse response that's being built wait for that one only.
+// A prepared impulse response is never modified, so the instances and their channels read it without locking.
+class SharedIRStore
+{
+// Methods
+public:
+    // Returns the impulse response prepared for the given settings, building it if no instance holds it.
+    // This may decode and allocate, so it must not be called from the audio thread
+    std::shared_ptr<const PartitionedIR> get(const IRData& irData, const double sampleRate, const size_t partitionSize,
+                                             const bool normalise = true, const bool hybrid = false);
+    // Returns the bandwidth of the impulse response at its own sample rate, it's measured once for the whole process.
+    // It's read from the impulse response pack, other data may be decoded, so it must not be called from the audio thread
+    double getBandwidth(const IRData& irData);
+private:
+    // What an impulse response is prepared for
+    struct Key
+    {
+        unsigned int irIndex = 0;
+        double sampleRate = 0.0;
+        size_t partitionSize = 0;
+        bool normalise = true;
+        bool hybrid = false;
+
+        bool operator<(const Key& other) const noexcept
+        {
+            return std::tie(irIndex, sampleRate, partitionSize, normalise, hybrid)
+                 < std::tie(other.irIndex, other.sampleRate, other.partitionSize, other.normalise, other.hybrid);
+        }
+    };
+    // An impulse response held by an instance, or being built by one
+    struct Entry
+    {
+        std::weak_ptr<const PartitionedIR> ir;
+        // Only valid while it's built, the other instances asking for it wait on it
+        std::shared_future<std::shared_ptr<const PartitionedIR>> building;
+    };
+    // Internal method used to build an impulse response, this decodes, resamples and transforms it
+    static std::shared_ptr<const PartitionedIR> build(const IRData& irData, const double sampleRate, const size_t partitionSize,
+                                                      const bool normalise, const bool hybrid);
+// Variables
+private:
+    // Only held to look the entries up and update them, never while an impulse response is built or measured
+    std::mutex m_mutex;
+    std::map<Key, Entry> m_entries;
+    std::map<unsigned int, double> m_bandwidths;
+};
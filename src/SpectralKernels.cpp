@@ -0,0 +1,357 @@
+#include "SpectralKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+ #define MHV_KERNELS_X86 1
+ #include <immintrin.h>
+ #if defined(_MSC_VER)
+  #include <intrin.h>
+ #else
+  #include <cpuid.h>
+ #endif
+#else
+ #define MHV_KERNELS_X86 0
+#endif
+
+// GCC and Clang only emit the AVX instructions in the functions marked for them,
+// so the rest of the binary still runs on any x86-64 CPU. The SSE2 ones are marked too,
+// a 32-bit build doesn't enable SSE2 by default
+#if defined(__GNUC__)
+ #define MHV_KERNEL_TARGET(isa) __attribute__((target(isa)))
+#else
+ #define MHV_KERNEL_TARGET(isa)
+#endif
+
+//==============================================================================
+// Scalar kernels, they're also used for the samples left after the last full vector
+
+static void multiplyAccumulateScalar(float* accRe, float* accIm, const float* xRe, const float* xIm,
+                                     const float* hRe, const float* hIm, const size_t numBins) noexcept
+{
+    for (size_t i = 0; i < numBins; i++)
+    {
+        const auto re = xRe[i] * hRe[i] - xIm[i] * hIm[i];
+        const auto im = xRe[i] * hIm[i] + xIm[i] * hRe[i];
+        accRe[i] += re;
+        accIm[i] += im;
+    }
+}
+
+static void addScalar(float* output, const float* a, const float* b, const size_t numSamples) noexcept
+{
+    for (size_t i = 0; i < numSamples; i++)
+        output[i] = a[i] + b[i];
+}
+
+static void mixScalar(float* output, const float* a, const float aGain, const float aStep,
+                      const float* b, const float bGain, const float bStep, const size_t numSamples) noexcept
+{
+    for (size_t i = 0; i < numSamples; i++)
+        output[i] = a[i] * (aGain + (float)i * aStep) + b[i] * (bGain + (float)i * bStep);
+}
+
+static void scaleScalar(float* output, const float* a, const float gain, const float step, const size_t numSamples) noexcept
+{
+    for (size_t i = 0; i < numSamples; i++)
+        output[i] = a[i] * (gain + (float)i * step);
+}
+
+#if MHV_KERNELS_X86
+//==============================================================================
+// SSE2 kernels, 4 floats at a time
+
+MHV_KERNEL_TARGET("sse2")
+static void multiplyAccumulateSSE2(float* accRe, float* accIm, const float* xRe, const float* xIm,
+                                   const float* hRe, const float* hIm, const size_t numBins) noexcept
+{
+    size_t i = 0;
+    for (; i + 4 <= numBins; i += 4)
+    {
+        const auto xr = _mm_loadu_ps(xRe + i);
+        const auto xi = _mm_loadu_ps(xIm + i);
+        const auto hr = _mm_loadu_ps(hRe + i);
+        const auto hi = _mm_loadu_ps(hIm + i);
+        const auto re = _mm_sub_ps(_mm_mul_ps(xr, hr), _mm_mul_ps(xi, hi));
+        const auto im = _mm_add_ps(_mm_mul_ps(xr, hi), _mm_mul_ps(xi, hr));
+        _mm_storeu_ps(accRe + i, _mm_add_ps(_mm_loadu_ps(accRe + i), re));
+        _mm_storeu_ps(accIm + i, _mm_add_ps(_mm_loadu_ps(accIm + i), im));
+    }
+    multiplyAccumulateScalar(accRe + i, accIm + i, xRe + i, xIm + i, hRe + i, hIm + i, numBins - i);
+}
+
+MHV_KERNEL_TARGET("sse2")
+static void addSSE2(float* output, const float* a, const float* b, const size_t numSamples) noexcept
+{
+    size_t i = 0;
+    for (; i + 4 <= numSamples; i += 4)
+        _mm_storeu_ps(output + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    addScalar(output + i, a + i, b + i, numSamples - i);
+}
+
+MHV_KERNEL_TARGET("sse2")
+static void mixSSE2(float* output, const float* a, const float aGain, const float aStep,
+                    const float* b, const float bGain, const float bStep, const size_t numSamples) noexcept
+{
+    const auto aSteps = _mm_set1_ps(aStep);
+    const auto bSteps = _mm_set1_ps(bStep);
+    auto index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    size_t i = 0;
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const auto aGains = _mm_add_ps(_mm_set1_ps(aGain), _mm_mul_ps(index, aSteps));
+        const auto bGains = _mm_add_ps(_mm_set1_ps(bGain), _mm_mul_ps(index, bSteps));
+        _mm_storeu_ps(output + i, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a + i), aGains), _mm_mul_ps(_mm_loadu_ps(b + i), bGains)));
+        index = _mm_add_ps(index, _mm_set1_ps(4.0f));
+    }
+    mixScalar(output + i, a + i, aGain + (float)i * aStep, aStep, b + i, bGain + (float)i * bStep, bStep, numSamples - i);
+}
+
+MHV_KERNEL_TARGET("sse2")
+static void scaleSSE2(float* output, const float* a, const float gain, const float step, const size_t numSamples) noexcept
+{
+    const auto steps = _mm_set1_ps(step);
+    auto index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    size_t i = 0;
+    for (; i + 4 <= numSamples; i += 4)
+    {
+        const auto gains = _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(index, steps));
+        _mm_storeu_ps(output + i, _mm_mul_ps(_mm_loadu_ps(a + i), gains));
+        index = _mm_add_ps(index, _mm_set1_ps(4.0f));
+    }
+    scaleScalar(output + i, a + i, gain + (float)i * step, step, numSamples - i);
+}
+
+//==============================================================================
+// AVX2 kernels, 8 floats at a time with fused multiply-adds
+
+MHV_KERNEL_TARGET("avx2,fma")
+static void multiplyAccumulateAVX2(float* accRe, float* accIm, const float* xRe, const float* xIm,
+                                   const float* hRe, const float* hIm, const size_t numBins) noexcept
+{
+    size_t i = 0;
+    for (; i + 8 <= numBins; i += 8)
+    {
+        const auto xr = _mm256_loadu_ps(xRe + i);
+        const auto xi = _mm256_loadu_ps(xIm + i);
+        const auto hr = _mm256_loadu_ps(hRe + i);
+        const auto hi = _mm256_loadu_ps(hIm + i);
+        const auto re = _mm256_fmsub_ps(xr, hr, _mm256_mul_ps(xi, hi));
+        const auto im = _mm256_fmadd_ps(xr, hi, _mm256_mul_ps(xi, hr));
+        _mm256_storeu_ps(accRe + i, _mm256_add_ps(_mm256_loadu_ps(accRe + i), re));
+        _mm256_storeu_ps(accIm + i, _mm256_add_ps(_mm256_loadu_ps(accIm + i), im));
+    }
+    multiplyAccumulateScalar(accRe + i, accIm + i, xRe + i, xIm + i, hRe + i, hIm + i, numBins - i);
+}
+
+MHV_KERNEL_TARGET("avx2,fma")
+static void addAVX2(float* output, const float* a, const float* b, const size_t numSamples) noexcept
+{
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+        _mm256_storeu_ps(output + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    addScalar(output + i, a + i, b + i, numSamples - i);
+}
+
+MHV_KERNEL_TARGET("avx2,fma")
+static void mixAVX2(float* output, const float* a, const float aGain, const float aStep,
+                    const float* b, const float bGain, const float bStep, const size_t numSamples) noexcept
+{
+    const auto aSteps = _mm256_set1_ps(aStep);
+    const auto bSteps = _mm256_set1_ps(bStep);
+    auto index = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        const auto aGains = _mm256_fmadd_ps(index, aSteps, _mm256_set1_ps(aGain));
+        const auto bGains = _mm256_fmadd_ps(index, bSteps, _mm256_set1_ps(bGain));
+        _mm256_storeu_ps(output + i, _mm256_fmadd_ps(_mm256_loadu_ps(a + i), aGains, _mm256_mul_ps(_mm256_loadu_ps(b + i), bGains)));
+        index = _mm256_add_ps(index, _mm256_set1_ps(8.0f));
+    }
+    mixScalar(output + i, a + i, aGain + (float)i * aStep, aStep, b + i, bGain + (float)i * bStep, bStep, numSamples - i);
+}
+
+MHV_KERNEL_TARGET("avx2,fma")
+static void scaleAVX2(float* output, const float* a, const float gain, const float step, const size_t numSamples) noexcept
+{
+    const auto steps = _mm256_set1_ps(step);
+    auto index = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    size_t i = 0;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        const auto gains = _mm256_fmadd_ps(index, steps, _mm256_set1_ps(gain));
+        _mm256_storeu_ps(output + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), gains));
+        index = _mm256_add_ps(index, _mm256_set1_ps(8.0f));
+    }
+    scaleScalar(output + i, a + i, gain + (float)i * step, step, numSamples - i);
+}
+
+//==============================================================================
+// AVX-512 kernels, 16 floats at a time with fused multiply-adds
+
+MHV_KERNEL_TARGET("avx512f")
+static void multiplyAccumulateAVX512(float* accRe, float* accIm, const float* xRe, const float* xIm,
+                                     const float* hRe, const float* hIm, const size_t numBins) noexcept
+{
+    size_t i = 0;
+    for (; i + 16 <= numBins; i += 16)
+    {
+        const auto xr = _mm512_loadu_ps(xRe + i);
+        const auto xi = _mm512_loadu_ps(xIm + i);
+        const auto hr = _mm512_loadu_ps(hRe + i);
+        const auto hi = _mm512_loadu_ps(hIm + i);
+        const auto re = _mm512_fmsub_ps(xr, hr, _mm512_mul_ps(xi, hi));
+        const auto im = _mm512_fmadd_ps(xr, hi, _mm512_mul_ps(xi, hr));
+        _mm512_storeu_ps(accRe + i, _mm512_add_ps(_mm512_loadu_ps(accRe + i), re));
+        _mm512_storeu_ps(accIm + i, _mm512_add_ps(_mm512_loadu_ps(accIm + i), im));
+    }
+    multiplyAccumulateScalar(accRe + i, accIm + i, xRe + i, xIm + i, hRe + i, hIm + i, numBins - i);
+}
+
+MHV_KERNEL_TARGET("avx512f")
+static void addAVX512(float* output, const float* a, const float* b, const size_t numSamples) noexcept
+{
+    size_t i = 0;
+    for (; i + 16 <= numSamples; i += 16)
+        _mm512_storeu_ps(output + i, _mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+    addScalar(output + i, a + i, b + i, numSamples - i);
+}
+
+MHV_KERNEL_TARGET("avx512f")
+static void mixAVX512(float* output, const float* a, const float aGain, const float aStep,
+                      const float* b, const float bGain, const float bStep, const size_t numSamples) noexcept
+{
+    const auto aSteps = _mm512_set1_ps(aStep);
+    const auto bSteps = _mm512_set1_ps(bStep);
+    auto index = _mm512_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f);
+    size_t i = 0;
+    for (; i + 16 <= numSamples; i += 16)
+    {
+        const auto aGains = _mm512_fmadd_ps(index, aSteps, _mm512_set1_ps(aGain));
+        const auto bGains = _mm512_fmadd_ps(index, bSteps, _mm512_set1_ps(bGain));
+        _mm512_storeu_ps(output + i, _mm512_fmadd_ps(_mm512_loadu_ps(a + i), aGains, _mm512_mul_ps(_mm512_loadu_ps(b + i), bGains)));
+        index = _mm512_add_ps(index, _mm512_set1_ps(16.0f));
+    }
+    mixScalar(output + i, a + i, aGain + (float)i * aStep, aStep, b + i, bGain + (float)i * bStep, bStep, numSamples - i);
+}
+
+MHV_KERNEL_TARGET("avx512f")
+static void scaleAVX512(float* output, const float* a, const float gain, const float step, const size_t numSamples) noexcept
+{
+    const auto steps = _mm512_set1_ps(step);
+    auto index = _mm512_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f);
+    size_t i = 0;
+    for (; i + 16 <= numSamples; i += 16)
+    {
+        const auto gains = _mm512_fmadd_ps(index, steps, _mm512_set1_ps(gain));
+        _mm512_storeu_ps(output + i, _mm512_mul_ps(_mm512_loadu_ps(a + i), gains));
+        index = _mm512_add_ps(index, _mm512_set1_ps(16.0f));
+    }
+    scaleScalar(output + i, a + i, gain + (float)i * step, step, numSamples - i);
+}
+
+//==============================================================================
+// CPU detection
+
+static void readCPUID(const unsigned int leaf, const unsigned int subleaf, unsigned int (&registers)[4]) noexcept
+{
+   #if defined(_MSC_VER)
+    int values[4] = {};
+    __cpuidex(values, (int)leaf, (int)subleaf);
+    for (size_t i = 0; i < 4; i++)
+        registers[i] = (unsigned int)values[i];
+   #else
+    registers[0] = registers[1] = registers[2] = registers[3] = 0;
+    __get_cpuid_count(leaf, subleaf, &registers[0], &registers[1], &registers[2], &registers[3]);
+   #endif
+}
+
+// Returns the register states the OS saves on a context switch, the AVX registers can't be used without it
+static juce::uint64 readXCR0() noexcept
+{
+   #if defined(_MSC_VER)
+    return (juce::uint64)_xgetbv(0);
+   #else
+    unsigned int low = 0, high = 0;
+    __asm__ volatile ("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    return ((juce::uint64)high << 32) | low;
+   #endif
+}
+
+static bool isSupported(const SpectralKernels::Variant variant) noexcept
+{
+    unsigned int leaf1[4], leaf7[4];
+    readCPUID(0, 0, leaf1);
+    const auto maxLeaf = leaf1[0];
+    readCPUID(1, 0, leaf1);
+    if (maxLeaf >= 7)
+        readCPUID(7, 0, leaf7);
+    else
+        leaf7[0] = leaf7[1] = leaf7[2] = leaf7[3] = 0;
+
+    const bool hasSSE2 = (leaf1[3] & (1u << 26)) != 0;
+    const bool hasOSXSave = (leaf1[2] & (1u << 27)) != 0;
+    const auto xcr0 = hasOSXSave ? readXCR0() : 0;
+    // XMM and YMM state, then the opmask and ZMM states on top of it
+    const bool osSavesAVX = (xcr0 & 0x06) == 0x06;
+    const bool osSavesAVX512 = (xcr0 & 0xe6) == 0xe6;
+
+    switch (variant)
+    {
+        case SpectralKernels::Variant::scalar:
+            return true;
+        case SpectralKernels::Variant::sse2:
+            return hasSSE2;
+        case SpectralKernels::Variant::avx2:
+            return osSavesAVX && (leaf1[2] & (1u << 28)) != 0 && (leaf1[2] & (1u << 12)) != 0 && (leaf7[1] & (1u << 5)) != 0;
+        case SpectralKernels::Variant::avx512:
+            return osSavesAVX512 && (leaf7[1] & (1u << 16)) != 0;
+    }
+    return false;
+}
+#else
+static bool isSupported(const SpectralKernels::Variant variant) noexcept
+{
+    return variant == SpectralKernels::Variant::scalar;
+}
+#endif
+
+//==============================================================================
+static const SpectralKernels::Table kernelTables[] =
+{
+    { SpectralKernels::Variant::scalar, "scalar", multiplyAccumulateScalar, addScalar, mixScalar, scaleScalar },
+   #if MHV_KERNELS_X86
+    { SpectralKernels::Variant::sse2, "sse2", multiplyAccumulateSSE2, addSSE2, mixSSE2, scaleSSE2 },
+    { SpectralKernels::Variant::avx2, "avx2", multiplyAccumulateAVX2, addAVX2, mixAVX2, scaleAVX2 },
+    { SpectralKernels::Variant::avx512, "avx512", multiplyAccumulateAVX512, addAVX512, mixAVX512, scaleAVX512 },
+   #endif
+};
+
+// Picks the most capable variant the CPU supports, the tables are ordered from the least to the most capable
+static const SpectralKernels::Table* pickKernels() noexcept
+{
+    const SpectralKernels::Table* best = &kernelTables[0];
+    for (const auto& table : kernelTables)
+    {
+        if (isSupported(table.variant))
+            best = &table;
+    }
+    return best;
+}
+
+// The choice is made once, when the binary is loaded, so the audio thread only reads a pointer
+static const SpectralKernels::Table* const selectedKernels = pickKernels();
+
+const SpectralKernels::Table& SpectralKernels::get() noexcept
+{
+    // Something running before this file's static initialisation gets the scalar kernels
+    return selectedKernels != nullptr ? *selectedKernels : kernelTables[0];
+}
+
+const SpectralKernels::Table* SpectralKernels::get(const Variant variant) noexcept
+{
+    for (const auto& table : kernelTables)
+    {
+        if (table.variant == variant)
+            return isSupported(variant) ? &table : nullptr;
+    }
+    return nullptr;
+}
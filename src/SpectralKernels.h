@@ -0,0 +1,44 @@
+#pragma once
+
+#include <juce_core/juce_core.h>
+
+// How far a vectorised kernel may be from the scalar one, relative to the magnitude of the terms it sums
+// (the fused multiply-adds round differently, so the results aren't always bit exact)
+#define MHV_KERNEL_TOLERANCE 1.0e-6f
+
+// This struct holds the vectorised loops the convolution spends its time in, with SSE2, AVX2 (with FMA)
+// and AVX-512 variants and a scalar fallback. The best variant the CPU supports is picked from CPUID
+// when the plugin is loaded, so the same binary runs on any x86-64 machine. Other architectures use
+// the scalar loops, which the compiler vectorises for them.
+// All the kernels accept unaligned pointers, and the output may be the same buffer as an input.
+struct SpectralKernels
+{
+    enum class Variant { scalar = 0, sse2, avx2, avx512 };
+
+    // acc += x * h, on split complex spectra
+    using MultiplyAccumulate = void (*)(float* accRe, float* accIm, const float* xRe, const float* xIm,
+                                        const float* hRe, const float* hIm, const size_t numBins) noexcept;
+    // output = a + b
+    using Add = void (*)(float* output, const float* a, const float* b, const size_t numSamples) noexcept;
+    // output = a * (aGain + i * aStep) + b * (bGain + i * bStep), a mix of two signals with linear gain ramps
+    using Mix = void (*)(float* output, const float* a, const float aGain, const float aStep,
+                         const float* b, const float bGain, const float bStep, const size_t numSamples) noexcept;
+    // output = a * (gain + i * step), a linear gain ramp
+    using Scale = void (*)(float* output, const float* a, const float gain, const float step, const size_t numSamples) noexcept;
+
+    // The kernels of a variant
+    struct Table
+    {
+        Variant variant = Variant::scalar;
+        const char* name = "";
+        MultiplyAccumulate multiplyAccumulate = nullptr;
+        Add add = nullptr;
+        Mix mix = nullptr;
+        Scale scale = nullptr;
+    };
+
+    // Returns the kernels picked for this CPU
+    static const Table& get() noexcept;
+    // Returns the kernels of a variant, or nullptr if the CPU (or the build) can't run it
+    static const Table* get(const Variant variant) noexcept;
+};
@@ -0,0 +1,173 @@
+#include "UserIRLoader.h"
+#include "IRLoader.h"
+
+// The thread decoding and preparing the user's impulse response. It sleeps until a file is requested or the
+// trim changes, and only polls while replaced impulse responses wait to be freed
+class UserIRLoader::Worker final : public juce::Thread
+{
+public:
+    explicit Worker(UserIRLoader& loader)
+        : juce::Thread("User impulse response"), m_loader(loader)
+    {
+        startThread(juce::Thread::Priority::low);
+    }
+
+    ~Worker() override
+    {
+        signalThreadShouldExit();
+        m_loader.m_wakeUp.signal();
+        stopThread(-1);
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            bool didWork = false;
+            bool hasRetired = false;
+            {
+                const juce::ScopedLock lock(m_loader.m_lock);
+                didWork = m_loader.processRequests();
+                m_loader.m_publisher.collectGarbage();
+                hasRetired = m_loader.m_publisher.hasRetired();
+            }
+            if (!didWork)
+                m_loader.m_wakeUp.wait(hasRetired ? MHV_USER_IR_POLL_MS : -1);
+        }
+    }
+
+private:
+    UserIRLoader& m_loader;
+};
+
+UserIRLoader::UserIRLoader(std::atomic<float>* trimParameter, const IRPublisher::Usage& usage)
+    : m_trimParameter(trimParameter), m_publisher(usage)
+{
+}
+
+UserIRLoader::~UserIRLoader()
+{
+    // A long decoding stops at its next chunk
+    m_newRequest = true;
+    m_worker.reset();
+}
+
+void UserIRLoader::load(const juce::File& file)
+{
+    // Set before taking the lock, so a file still being decoded is given up instead of waited for
+    m_newRequest = true;
+    const juce::ScopedLock lock(m_lock);
+    m_requestedFile = file;
+    m_loadRequested = true;
+    // Most instances never load a file, they never start the thread
+    if (m_worker == nullptr)
+        m_worker = std::make_unique<Worker>(*this);
+    m_wakeUp.signal();
+}
+
+juce::File UserIRLoader::getFile() const
+{
+    const juce::ScopedLock lock(m_lock);
+    return m_requestedFile;
+}
+
+juce::String UserIRLoader::getLastError() const
+{
+    const juce::ScopedLock lock(m_lock);
+    return m_lastError;
+}
+
+void UserIRLoader::prepare(const double sampleRate, const size_t partitionSize, const bool hybrid)
+{
+    const juce::ScopedLock lock(m_lock);
+    const bool settingsChanged = !juce::approximatelyEqual(sampleRate, m_sampleRate) || partitionSize != m_partitionSize || hybrid != m_hybrid;
+    m_sampleRate = sampleRate;
+    m_partitionSize = partitionSize;
+    m_hybrid = hybrid;
+    // A file restored with the state is loaded now, so an offline render starts with it
+    const bool rebuilt = processRequests();
+    if (settingsChanged && !rebuilt)
+        rebuild();
+}
+
+std::shared_ptr<const PartitionedIR> UserIRLoader::find(const PartitionedIR* ir) const
+{
+    const juce::ScopedLock lock(m_lock);
+    return m_publisher.find(ir);
+}
+
+double UserIRLoader::getBandwidth()
+{
+    const juce::ScopedLock lock(m_lock);
+    decodeRequestedFile();
+    return m_sourceBandwidth;
+}
+
+bool UserIRLoader::decodeRequestedFile()
+{
+    if (!m_loadRequested)
+        return false;
+
+    m_loadRequested = false;
+    m_newRequest = false;
+    m_source = {};
+    m_sourceSampleRate = 0.0;
+    m_sourceBandwidth = 0.0;
+    m_lastError = {};
+    if (m_requestedFile != juce::File())
+    {
+        double sourceSampleRate = 0.0;
+        auto source = IRLoader::decodeFile(m_requestedFile, sourceSampleRate, MHV_MAX_USER_IR_SECONDS,
+                                           [this] { return m_newRequest.load(); }, m_lastError);
+        // A newer file was asked for meanwhile, it's loaded on the next pass
+        if (m_newRequest)
+            return true;
+        m_source = std::move(source);
+        m_sourceSampleRate = sourceSampleRate;
+        if (m_source.getNumSamples() > 0)
+            m_sourceBandwidth = IRLoader::measureBandwidth(m_source, m_sourceSampleRate);
+        if (onDecoded)
+            onDecoded(m_sourceBandwidth);
+    }
+    // The new file is trimmed whatever the setting
+    m_trimChoice = -1;
+    return true;
+}
+
+bool UserIRLoader::processRequests()
+{
+    bool didWork = decodeRequestedFile();
+    // The decoding was given up for a newer file, which is loaded on the next pass
+    if (m_newRequest)
+        return didWork;
+
+    const auto trimChoice = m_trimParameter != nullptr ? (int)m_trimParameter->load() : 0;
+    if (trimChoice != m_trimChoice)
+    {
+        m_trimChoice = trimChoice;
+        rebuild();
+        didWork = true;
+    }
+    return didWork;
+}
+
+void UserIRLoader::rebuild()
+{
+    // Nothing can be built before the sample rate and the partition size are known
+    if (m_sampleRate <= 0.0 || m_partitionSize == 0)
+        return;
+    if (m_source.getNumSamples() == 0)
+    {
+        m_publisher.publish(nullptr);
+        return;
+    }
+
+    auto buffer = m_source;
+    IRLoader::trim(buffer, m_sourceSampleRate, IRLoader::getTrimFloorDecibels(m_trimChoice));
+    buffer = IRLoader::resample(buffer, m_sourceSampleRate, m_sampleRate);
+    IRLoader::normalise(buffer);
+    std::shared_ptr<const PartitionedIR> ir = PartitionedIR::create(buffer, m_sampleRate, m_partitionSize, m_hybrid);
+    if (onReserveLength)
+        onReserveLength(ir->lengthInSamples);
+    m_publisher.publish(std::move(ir));
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "IRPublisher.h"
+#include "Semaphore.h"
+
+// Longer user impulse response files are cut to this length
+#define MHV_MAX_USER_IR_SECONDS 30.0
+// How often the loading thread looks for impulse responses it can free, while some wait to be
+#define MHV_USER_IR_POLL_MS 50
+
+// This class loads the user's impulse response file on a background thread: it's decoded through a memory
+// mapping, trimmed, resampled, normalised and partitioned there, then handed to the audio thread with an
+// atomic pointer and retired once the engine is done with it (see IRPublisher). The decoded file is kept, so new
+// settings only redo the cheap steps. The thread is only started by the first load, and sleeps until it's asked for something.
+class UserIRLoader
+{
+// Methods
+public:
+    // The trim parameter is read by the loading thread, a new value trims the impulse response again.
+    // The usage is where the audio thread says which impulse responses the engine still points to
+    UserIRLoader(std::atomic<float>* trimParameter, const IRPublisher::Usage& usage);
+    ~UserIRLoader();
+    // Loads a file in the background, an empty file unloads the current one
+    void load(const juce::File& file);
+    // Wakes the loading thread up to trim the file again, called when the trim parameter changed
+    void trimChanged() noexcept { m_wakeUp.signal(); }
+    // Returns the file requested last
+    juce::File getFile() const;
+    // Returns why the last file couldn't be loaded, or an empty string if it was loaded
+    juce::String getLastError() const;
+    // Returns the bandwidth of the file, or 0 if there's none. A load still waiting is decoded first,
+    // so this blocks and must not be called from the audio thread
+    double getBandwidth();
+    // Builds the impulse response for new settings (with its late tail fitted in the hybrid mode), a load still waiting
+    // is done first. This blocks and allocates, so it must not be called from the audio thread
+    void prepare(const double sampleRate, const size_t partitionSize, const bool hybrid);
+    // Returns the impulse response ready for the engine, or nullptr if there's none. Called from the audio thread
+    const PartitionedIR* get() const noexcept { return m_publisher.get(); }
+    // Returns a number that changes each time a new impulse response is published
+    juce::uint32 getVersion() const noexcept { return m_publisher.getVersion(); }
+    // Returns an impulse response this class published, if it's still held (published or waiting to be freed), or nullptr.
+    // It's used by the threads that build on it, this takes a lock so it must not be called from the audio thread
+    std::shared_ptr<const PartitionedIR> find(const PartitionedIR* ir) const;
+    // Called on the loading thread with the length of an impulse response before it's published, so the plugin can be
+    // prepared again for a longer one. The engine may be being prepared meanwhile, so it must not be touched from here
+    std::function<void(size_t)> onReserveLength;
+    // Called with the bandwidth of a file once it's decoded, on the loading thread or the one asking for the bandwidth
+    std::function<void(double)> onDecoded;
+private:
+    class Worker;
+    // Internal method used to handle a new file or trim setting, returns true if it did anything
+    bool processRequests();
+    // Internal method used to decode the file requested last, returns true if there was one
+    bool decodeRequestedFile();
+    // Internal method used to trim, resample and partition the decoded file, and publish the result
+    void rebuild();
+// Variables
+private:
+    // Guards everything but the atomics, it's never taken on the audio thread
+    mutable juce::CriticalSection m_lock;
+    std::atomic<float>* m_trimParameter;
+    juce::File m_requestedFile;
+    bool m_loadRequested = false;
+    // The new request that should stop the decoding of the current one
+    std::atomic<bool> m_newRequest { false };
+    juce::String m_lastError;
+    juce::AudioBuffer<float> m_source;
+    double m_sourceSampleRate = 0.0;
+    double m_sourceBandwidth = 0.0;
+    int m_trimChoice = -1;
+    double m_sampleRate = 0.0;
+    size_t m_partitionSize = 0;
+    bool m_hybrid = false;
+    IRPublisher m_publisher;
+    WakeUpSignal m_wakeUp;
+    std::unique_ptr<Worker> m_worker;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (UserIRLoader)
+};
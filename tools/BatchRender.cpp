@@ -0,0 +1,336 @@
+// Headless batch renderer, runs the plugin's processor over WAV files without an audio device or a display.
+//
+// Usage: MyHallwayVerbRender [options] input1.wav [input2.wav ...]
+//   --inputGain=<dB>     Input gain
+//   --outputGain=<dB>    Output gain
+//   --dryWet=<percent>   Dry/wet mix
+//   --irIndex=<0..2>     Impulse response (Near, Far, Wherever)
+//   --irFile=<file>      Your own impulse response file, it's switched on unless --useUserIR says otherwise
+//   --useUserIR=<0|1>    Play your own impulse response instead of --irIndex
+//   --irTrim=<0..3>      Trim of your own impulse response (none, -60 dB, -80 dB, -96 dB)
+//   --eco=<0|1>          Eco mode, the wet signal is convolved at a reduced sample rate
+//   --quality=<0|1>      Full convolution or hybrid, where fitted delay networks play the late tail
+//   --latencyMode=<0..2> Zero latency, low CPU or automatic (the default, large partitions on every core for a render)
+//   --morph=<0|1>        Blend the embedded impulse responses at --position instead of using --irIndex
+//   --position=<0..2>    Morph position (Near, Far, Wherever and in between)
+//   --layers=<0|1>       Stack the embedded impulse responses at --nearLevel, --farLevel and --whereverLevel (dB)
+//   --preDelay=<ms>      Pre-delay of the wet signal, from 0 to 250 ms
+//   --lowCut=<Hz>        Low cut of the wet signal, from 20 (off) to 1000 Hz
+//   --highCut=<Hz>       High cut of the wet signal, from 1000 to 20000 Hz (off)
+//   --tilt=<dB>          Tilt of the wet signal around 1 kHz, from -6 to 6 dB
+//   --automation=<file>  Parameter changes, one "seconds parameterID value" line each, they land on their exact sample
+//   --output=<dir>       Where the rendered files go (defaults to each input's folder)
+//   --block=<samples>    Processing block size (defaults to 4096)
+//   --tail=<seconds>     How long to keep rendering after the input ends (defaults to the reverb tail)
+//   --threads=<count>    Worker threads, each one owns a processor (defaults to the CPU count)
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <vector>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include "HeadlessHelpers.h"
+
+// A parameter change at a time of the render
+struct AutomationEvent
+{
+    double seconds = 0.0;
+    juce::String parameterID;
+    float value = 0.0f;
+};
+
+// The settings shared by all the render jobs
+struct RenderSettings
+{
+    std::vector<std::pair<juce::String, float>> parameters;
+    std::vector<AutomationEvent> automation;
+    juce::File outputDirectory;
+    juce::File irFile;
+    int blockSize = 4096;
+    double tailSeconds = -1.0;
+    int numThreads = juce::SystemStats::getNumCpus();
+};
+
+// The outcome of a single render job
+struct RenderResult
+{
+    bool succeeded = false;
+    juce::String message;
+    double audioSeconds = 0.0;
+    double wallSeconds = 0.0;
+};
+
+// Streams a file through the processor in large blocks and writes the result, reverb tail included
+static RenderResult renderFile(MHVAudioProcessor& processor, const juce::File& inputFile, const RenderSettings& settings)
+{
+    RenderResult result;
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(inputFile));
+    if (reader == nullptr)
+    {
+        result.message = "can't read the file";
+        return result;
+    }
+
+    // The processor's layout follows the file, only the layouts the plugin supports can be rendered
+    const auto numChannels = (int)reader->numChannels;
+    if (!HeadlessHelpers::setChannelCount(processor, numChannels))
+    {
+        result.message = "unsupported channel count (" + juce::String(numChannels) + ")";
+        return result;
+    }
+
+    const auto outputDirectory = settings.outputDirectory == juce::File() ? inputFile.getParentDirectory() : settings.outputDirectory;
+    const auto outputFile = outputDirectory.getChildFile(inputFile.getFileNameWithoutExtension() + "_mhv.wav");
+    outputFile.deleteFile();
+    auto outputStream = outputFile.createOutputStream();
+    if (outputStream == nullptr)
+    {
+        result.message = "can't write " + outputFile.getFullPathName();
+        return result;
+    }
+
+    juce::WavAudioFormat wavFormat;
+    const auto bitsPerSample = (reader->bitsPerSample == 16 || reader->bitsPerSample == 32) ? (int)reader->bitsPerSample : 24;
+    std::unique_ptr<juce::AudioFormatWriter> writer(wavFormat.createWriterFor(outputStream.get(), reader->sampleRate, (unsigned int)numChannels, bitsPerSample, {}, 0));
+    if (writer == nullptr)
+    {
+        result.message = "can't create the WAV writer";
+        return result;
+    }
+    // The writer owns the stream now
+    outputStream.release();
+
+    // The parameters are set first, so the render doesn't start with a crossfade from the default impulse response.
+    // It's an offline render, the processor can take its time
+    for (const auto& [parameterID, value] : settings.parameters)
+        HeadlessHelpers::setParameter(processor, parameterID, value);
+    HeadlessHelpers::prepare(processor, reader->sampleRate, settings.blockSize, true);
+    // The user's impulse response is decoded by then
+    if (processor.getUserIRError().isNotEmpty())
+    {
+        result.message = processor.getUserIRError();
+        return result;
+    }
+
+    const auto tailSeconds = settings.tailSeconds >= 0.0 ? settings.tailSeconds : processor.getTailLengthSeconds();
+    const auto inputLength = reader->lengthInSamples;
+    const auto outputLength = inputLength + (juce::int64)std::ceil(tailSeconds * reader->sampleRate);
+    // The processor's latency is rendered on top and dropped from the start, so the file lines up with its input
+    const auto latency = (juce::int64)processor.getLatencySamples();
+    const auto totalLength = outputLength + latency;
+
+    juce::AudioBuffer<float> buffer(numChannels, settings.blockSize);
+    juce::MidiBuffer midiBuffer;
+    size_t nextEvent = 0;
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    int numSamples = 0;
+    for (juce::int64 position = 0; position < totalLength; position += numSamples)
+    {
+        numSamples = (int)juce::jmin((juce::int64)settings.blockSize, totalLength - position);
+        // The changes due in this block are scheduled just before it. If the queue fills up, the block is cut
+        // before the first change that didn't fit, and the rest are scheduled before the next one
+        for (; nextEvent < settings.automation.size(); nextEvent++)
+        {
+            const auto& event = settings.automation[nextEvent];
+            const auto eventPosition = (juce::int64)std::llround(event.seconds * reader->sampleRate);
+            if (eventPosition >= position + numSamples)
+                break;
+            if (!processor.scheduleParameterChange(event.parameterID, event.value, eventPosition))
+            {
+                // More changes than the queue holds on the same sample can't be split
+                if (eventPosition <= position)
+                {
+                    processor.releaseResources();
+                    result.message = "too many parameter changes at " + juce::String(event.seconds) + " s for the change queue";
+                    return result;
+                }
+                numSamples = (int)(eventPosition - position);
+                break;
+            }
+        }
+
+        buffer.setSize(numChannels, numSamples, false, false, true);
+        buffer.clear();
+        // Past the end of the input the processor is fed silence, so the tail rings out
+        if (position < inputLength)
+            reader->read(&buffer, 0, (int)juce::jmin((juce::int64)numSamples, inputLength - position), position, true, true);
+
+        processor.processBlock(buffer, midiBuffer);
+        const auto skipped = (int)juce::jlimit((juce::int64)0, (juce::int64)numSamples, latency - position);
+        writer->writeFromAudioSampleBuffer(buffer, skipped, numSamples - skipped);
+    }
+    result.wallSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+    processor.releaseResources();
+
+    result.succeeded = writer->flush();
+    result.audioSeconds = (double)outputLength / reader->sampleRate;
+    result.message = outputFile.getFullPathName();
+    return result;
+}
+
+// A worker thread owning its own processor, it keeps taking files until there are none left
+class RenderWorker final : public juce::Thread
+{
+public:
+    RenderWorker(const std::vector<juce::File>& files, std::atomic<size_t>& nextFile, std::atomic<int>& numFailures,
+                 std::mutex& outputMutex, const RenderSettings& settings)
+        : juce::Thread("Render worker"), m_files(files), m_nextFile(nextFile), m_numFailures(numFailures),
+          m_outputMutex(outputMutex), m_settings(settings), m_processor(std::make_unique<MHVAudioProcessor>())
+    {
+        if (settings.irFile != juce::File())
+            m_processor->loadUserIR(settings.irFile);
+    }
+
+    ~RenderWorker() override
+    {
+        stopThread(-1);
+    }
+
+    void run() override
+    {
+        for (auto index = m_nextFile++; index < m_files.size() && !threadShouldExit(); index = m_nextFile++)
+        {
+            const auto& file = m_files[index];
+            const auto result = renderFile(*m_processor, file, m_settings);
+
+            std::lock_guard<std::mutex> lock(m_outputMutex);
+            if (!result.succeeded)
+            {
+                m_numFailures++;
+                std::cerr << file.getFileName() << ": " << result.message << std::endl;
+                continue;
+            }
+            const auto realTimeFactor = result.wallSeconds > 0.0 ? result.audioSeconds / result.wallSeconds : 0.0;
+            std::cout << file.getFileName() << ": " << juce::String(result.audioSeconds, 2) << " s of audio in "
+                      << juce::String(result.wallSeconds, 3) << " s (" << juce::String(realTimeFactor, 1)
+                      << "x real-time) -> " << result.message << std::endl;
+        }
+    }
+
+private:
+    const std::vector<juce::File>& m_files;
+    std::atomic<size_t>& m_nextFile;
+    std::atomic<int>& m_numFailures;
+    std::mutex& m_outputMutex;
+    const RenderSettings& m_settings;
+    // The processor is created on the main thread, where the message manager lives
+    std::unique_ptr<MHVAudioProcessor> m_processor;
+};
+
+// Reads an automation file, returns false with a message if it can't be used
+static bool readAutomation(const juce::File& file, std::vector<AutomationEvent>& automation, juce::String& error)
+{
+    if (!file.existsAsFile())
+    {
+        error = "can't read " + file.getFullPathName();
+        return false;
+    }
+
+    juce::StringArray lines;
+    file.readLines(lines);
+    for (int i = 0; i < lines.size(); i++)
+    {
+        // Empty lines and # comments are skipped
+        const auto line = lines[i].upToFirstOccurrenceOf("#", false, false).trim();
+        if (line.isEmpty())
+            continue;
+        const auto tokens = juce::StringArray::fromTokens(line, true);
+        if (tokens.size() != 3 || ParamChangeTracker::getParamIndex(tokens[1]) < 0)
+        {
+            error = file.getFileName() + " line " + juce::String(i + 1) + ": expected \"seconds parameterID value\" with one of "
+                  + ParamChangeTracker::getParamIDs().joinIntoString(", ");
+            return false;
+        }
+        automation.push_back({ juce::jmax(0.0, tokens[0].getDoubleValue()), tokens[1], tokens[2].getFloatValue() });
+    }
+    // The processor takes them in order, the ones at the same time keep the file's order
+    std::stable_sort(automation.begin(), automation.end(), [](const AutomationEvent& a, const AutomationEvent& b) { return a.seconds < b.seconds; });
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    RenderSettings settings;
+    std::vector<juce::File> files;
+    const juce::StringArray parameterIDs = { MHV_PID_INPUT_GAIN, MHV_PID_OUTPUT_GAIN, MHV_PID_DRY_WET, MHV_PID_IR_INDEX, MHV_PID_USE_USER_IR, MHV_PID_IR_TRIM, MHV_PID_ECO, MHV_PID_QUALITY,
+                                          MHV_PID_MORPH, MHV_PID_POSITION, MHV_PID_LATENCY_MODE, MHV_PID_LAYERS, MHV_PID_NEAR_LEVEL,
+                                          MHV_PID_FAR_LEVEL, MHV_PID_WHEREVER_LEVEL, MHV_PID_PRE_DELAY,
+                                          MHV_PID_LOW_CUT, MHV_PID_HIGH_CUT, MHV_PID_TILT };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const juce::String argument(argv[i]);
+        if (!argument.startsWith("--"))
+        {
+            files.push_back(juce::File::getCurrentWorkingDirectory().getChildFile(argument));
+            continue;
+        }
+
+        const auto name = argument.substring(2).upToFirstOccurrenceOf("=", false, false);
+        const auto value = argument.fromFirstOccurrenceOf("=", false, false);
+        if (parameterIDs.contains(name))
+            settings.parameters.emplace_back(name, value.getFloatValue());
+        else if (name == "irFile")
+        {
+            settings.irFile = juce::File::getCurrentWorkingDirectory().getChildFile(value);
+            // Switched on before any --useUserIR, which then wins whatever the order
+            settings.parameters.insert(settings.parameters.begin(), { MHV_PID_USE_USER_IR, 1.0f });
+        }
+        else if (name == "automation")
+        {
+            juce::String error;
+            if (!readAutomation(juce::File::getCurrentWorkingDirectory().getChildFile(value), settings.automation, error))
+            {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+        }
+        else if (name == "output")
+            settings.outputDirectory = juce::File::getCurrentWorkingDirectory().getChildFile(value);
+        else if (name == "block")
+            settings.blockSize = juce::jmax(1, value.getIntValue());
+        else if (name == "tail")
+            settings.tailSeconds = juce::jmax(0.0, value.getDoubleValue());
+        else if (name == "threads")
+            settings.numThreads = juce::jmax(1, value.getIntValue());
+        else
+        {
+            std::cerr << "Unknown option " << argument << std::endl;
+            return 1;
+        }
+    }
+
+    if (files.empty())
+    {
+        std::cerr << "Usage: MyHallwayVerbRender [--inputGain=dB] [--outputGain=dB] [--dryWet=%] [--irIndex=0..2]" << std::endl
+                  << "                           [--irFile=file] [--useUserIR=0|1] [--irTrim=0..3] [--eco=0|1] [--quality=0|1] [--latencyMode=0..2] [--morph=0|1] [--position=0..2] [--layers=0|1] [--nearLevel=dB] [--farLevel=dB] [--whereverLevel=dB] [--preDelay=ms] [--lowCut=Hz] [--highCut=Hz] [--tilt=dB] [--automation=file] [--output=dir] [--block=samples] [--tail=seconds] [--threads=count] files..." << std::endl;
+        return 1;
+    }
+
+    if (settings.outputDirectory != juce::File())
+        settings.outputDirectory.createDirectory();
+
+    // The parameters need a message manager, but nothing here needs a display
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    std::atomic<size_t> nextFile { 0 };
+    std::atomic<int> numFailures { 0 };
+    std::mutex outputMutex;
+
+    const auto numWorkers = juce::jmin(settings.numThreads, (int)files.size());
+    std::vector<std::unique_ptr<RenderWorker>> workers;
+    for (int i = 0; i < numWorkers; i++)
+        workers.push_back(std::make_unique<RenderWorker>(files, nextFile, numFailures, outputMutex, settings));
+
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    for (auto& worker : workers)
+        worker->startThread();
+    for (auto& worker : workers)
+        worker->waitForThreadToExit(-1);
+
+    const auto wallSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+    std::cout << files.size() << " file(s) on " << numWorkers << " thread(s) in " << juce::String(wallSeconds, 2) << " s" << std::endl;
+    return numFailures > 0 ? 1 : 0;
+}
@@ -0,0 +1,495 @@
+// Headless benchmark for the plugin's processor.
+//
+// Usage: MyHallwayVerbBenchmark [options]
+//   --rates=<list>         Sample rates (defaults to 44100,48000,88200,96000,192000)
+//   --blocks=<list>        Block sizes (defaults to 16,32,64,128,256,512,1024,2048,4096)
+//   --layouts=<list>       mono, stereo, dualmono (stereo with identical channels), 5.1, 7.1 and/or 7.1.4,
+//                          defaults to mono,stereo
+//   --irs=<list>           Impulse response indices (defaults to 0,1,2)
+//   --mixes=<list>         Dry/wet percentages (defaults to 0,100)
+//   --eco                  Runs every case in eco mode, their names end with /eco
+//   --hybrid               Runs every case in the hybrid quality mode, their names end with /hybrid
+//   --lowcpu               Runs every case in the low CPU latency mode, their names end with /lowcpu
+//   --offline              Prepares the processBlock cases for an offline render, where the automatic latency mode
+//                          gathers large partitions, their names end with /offline
+//   --seconds=<seconds>    Audio rendered per case (defaults to 0.5)
+//   --json=<file>          Writes the results as JSON
+//   --compare=<file>       Compares the results with a previous JSON file
+//   --threshold=<percent>  With --compare, fails if a case got slower than this (defaults to 10)
+//   --trace=<file>         Prints the time spent in each stage of processBlock and writes the last timings as a
+//                          Chrome trace, in a build configured with -DMHV_PERF_TRACE=ON
+//   --poolThreads=<count>  Threads of the shared convolution pool, 0 gives every instance its own tail thread
+//                          (defaults to MHV_POOL_THREADS, or the number of cores minus 2)
+//
+// Every processBlock case reports ns/sample, the real-time factor and the p50/p99/p99.9/max block times.
+// The cost of an impulse response switch, of a sleeping instance fed silence and of prepareToPlay are
+// measured as separate cases. The shared convolution pool's stats are printed at the end.
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <vector>
+#include "HeadlessHelpers.h"
+#include "SharedConvolutionPool.h"
+
+// The measurements of a benchmark case, times are in microseconds
+struct BenchmarkResult
+{
+    juce::String name;
+    double nsPerSample = 0.0;
+    double realTimeFactor = 0.0;
+    double meanMicros = 0.0;
+    double p50Micros = 0.0;
+    double p99Micros = 0.0;
+    double p999Micros = 0.0;
+    double maxMicros = 0.0;
+};
+
+// The benchmark's settings
+struct BenchmarkSettings
+{
+    std::vector<double> sampleRates = { 44100.0, 48000.0, 88200.0, 96000.0, 192000.0 };
+    std::vector<int> blockSizes = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+    juce::StringArray layouts = { "mono", "stereo" };
+    std::vector<int> irIndices = { 0, 1, 2 };
+    std::vector<float> mixes = { 0.0f, 100.0f };
+    bool eco = false;
+    bool hybrid = false;
+    bool lowCPU = false;
+    bool offline = false;
+    double seconds = 0.5;
+    juce::File jsonFile;
+    juce::File compareFile;
+    double threshold = 10.0;
+    int poolThreads = -1;
+    juce::File traceFile;
+};
+
+// Returns the elapsed time since the given ticks in microseconds
+static double microsecondsSince(const juce::int64 startTicks)
+{
+    return juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks) * 1.0e6;
+}
+
+// Fills the timing statistics from the individual timings
+static void computeStatistics(BenchmarkResult& result, std::vector<double> timings)
+{
+    if (timings.empty())
+        return;
+
+    std::sort(timings.begin(), timings.end());
+    const auto percentile = [&timings](const double fraction)
+    {
+        return timings[juce::jmin(timings.size() - 1, (size_t)(fraction * (double)(timings.size() - 1) + 0.5))];
+    };
+    double total = 0.0;
+    for (const auto timing : timings)
+        total += timing;
+
+    result.meanMicros = total / (double)timings.size();
+    result.p50Micros = percentile(0.5);
+    result.p99Micros = percentile(0.99);
+    result.p999Micros = percentile(0.999);
+    result.maxMicros = timings.back();
+}
+
+// Fills the buffer with white noise, a dual mono layout gets the same noise on every channel
+static void fillWithNoise(juce::AudioBuffer<float>& buffer, juce::Random& random, const bool identicalChannels)
+{
+    for (int channel = 0; channel < buffer.getNumChannels(); channel++)
+    {
+        auto* samples = buffer.getWritePointer(channel);
+        if (identicalChannels && channel > 0)
+        {
+            std::copy(buffer.getReadPointer(0), buffer.getReadPointer(0) + buffer.getNumSamples(), samples);
+            continue;
+        }
+        for (int i = 0; i < buffer.getNumSamples(); i++)
+            samples[i] = random.nextFloat() * 0.5f - 0.25f;
+    }
+}
+
+// Measures the steady state cost of processBlock for one configuration
+static BenchmarkResult benchmarkProcessing(MHVAudioProcessor& processor, const double sampleRate, const int blockSize,
+                                           const juce::String& layout, const int irIndex, const float mix, const double seconds,
+                                           const bool nonRealtime)
+{
+    BenchmarkResult result;
+    result.name = "process/sr=" + juce::String((int)sampleRate) + "/bs=" + juce::String(blockSize) + "/" + layout
+                + "/ir=" + juce::String(irIndex) + "/mix=" + juce::String((int)mix);
+
+    const std::map<juce::String, int> channelCounts = { { "mono", 1 }, { "stereo", 2 }, { "dualmono", 2 }, { "5.1", 6 }, { "7.1", 8 }, { "7.1.4", 12 } };
+    const auto channelCount = channelCounts.find(layout);
+    if (channelCount == channelCounts.end())
+        return result;
+    const auto numChannels = channelCount->second;
+    if (!HeadlessHelpers::setChannelCount(processor, numChannels))
+        return result;
+
+    HeadlessHelpers::setParameter(processor, MHV_PID_IR_INDEX, (float)irIndex);
+    HeadlessHelpers::setParameter(processor, MHV_PID_DRY_WET, mix);
+    HeadlessHelpers::prepare(processor, sampleRate, blockSize, nonRealtime);
+
+    // The input is generated up front, so only the processing gets timed
+    const auto numBlocks = juce::jmax(64, (int)std::ceil(seconds * sampleRate / blockSize));
+    const auto numWarmUpBlocks = juce::jmax(16, numBlocks / 10);
+    juce::Random random(0x4d4856);
+    juce::AudioBuffer<float> source(numChannels, blockSize * 16);
+    fillWithNoise(source, random, layout == "dualmono");
+    juce::AudioBuffer<float> buffer(numChannels, blockSize);
+    juce::MidiBuffer midiBuffer;
+
+    std::vector<double> timings;
+    timings.reserve((size_t)numBlocks);
+    double totalMicros = 0.0;
+    for (int block = 0; block < numWarmUpBlocks + numBlocks; block++)
+    {
+        for (int channel = 0; channel < numChannels; channel++)
+            buffer.copyFrom(channel, 0, source, channel, (block % 16) * blockSize, blockSize);
+
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+        processor.processBlock(buffer, midiBuffer);
+        const auto micros = microsecondsSince(startTicks);
+        if (block < numWarmUpBlocks)
+            continue;
+        timings.push_back(micros);
+        totalMicros += micros;
+    }
+
+    const auto numSamples = (double)numBlocks * blockSize;
+    result.nsPerSample = totalMicros * 1000.0 / numSamples;
+    result.realTimeFactor = totalMicros > 0.0 ? (numSamples / sampleRate) * 1.0e6 / totalMicros : 0.0;
+    computeStatistics(result, timings);
+    processor.releaseResources();
+    return result;
+}
+
+// Measures the block in which the impulse response changes, plus the extra cost of the crossfade that follows
+static std::vector<BenchmarkResult> benchmarkIRSwitch(MHVAudioProcessor& processor, const double sampleRate, const int blockSize)
+{
+    const auto caseName = "/sr=" + juce::String((int)sampleRate) + "/bs=" + juce::String(blockSize);
+    BenchmarkResult switchResult, crossfadeResult;
+    switchResult.name = "irSwitch/block" + caseName;
+    crossfadeResult.name = "irSwitch/window" + caseName;
+
+    HeadlessHelpers::setChannelCount(processor, 2);
+    HeadlessHelpers::setParameter(processor, MHV_PID_IR_INDEX, 0.0f);
+    HeadlessHelpers::setParameter(processor, MHV_PID_DRY_WET, 100.0f);
+    HeadlessHelpers::prepare(processor, sampleRate, blockSize, false);
+
+    juce::Random random(0x4d4856);
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    juce::MidiBuffer midiBuffer;
+    // The window covers the crossfade, with some margin for the partition boundary
+    const auto windowBlocks = juce::jmax(4, (int)std::ceil(0.1 * sampleRate / blockSize));
+    const auto processWindow = [&]()
+    {
+        double total = 0.0;
+        for (int block = 0; block < windowBlocks; block++)
+        {
+            fillWithNoise(buffer, random, false);
+            const auto startTicks = juce::Time::getHighResolutionTicks();
+            processor.processBlock(buffer, midiBuffer);
+            total += microsecondsSince(startTicks);
+        }
+        return total;
+    };
+
+    std::vector<double> switchTimings, extraTimings;
+    processWindow();
+    for (int iteration = 0; iteration < 30; iteration++)
+    {
+        // A steady window first, then the same window starting with a switch
+        const auto steadyMicros = processWindow();
+        HeadlessHelpers::setParameter(processor, MHV_PID_IR_INDEX, (float)((iteration + 1) % MHV_IR_COUNT));
+        fillWithNoise(buffer, random, false);
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+        processor.processBlock(buffer, midiBuffer);
+        const auto switchMicros = microsecondsSince(startTicks);
+        const auto switchWindowMicros = switchMicros + processWindow();
+        switchTimings.push_back(switchMicros);
+        extraTimings.push_back(juce::jmax(0.0, switchWindowMicros - steadyMicros));
+    }
+
+    computeStatistics(switchResult, switchTimings);
+    computeStatistics(crossfadeResult, extraTimings);
+    processor.releaseResources();
+    return { switchResult, crossfadeResult };
+}
+
+// Measures processBlock on silence once the reverb has died out and the processor sleeps
+static BenchmarkResult benchmarkIdle(MHVAudioProcessor& processor, const double sampleRate, const int blockSize, const double seconds)
+{
+    BenchmarkResult result;
+    result.name = "idle/sr=" + juce::String((int)sampleRate) + "/bs=" + juce::String(blockSize);
+
+    HeadlessHelpers::setChannelCount(processor, 2);
+    HeadlessHelpers::setParameter(processor, MHV_PID_IR_INDEX, 0.0f);
+    HeadlessHelpers::setParameter(processor, MHV_PID_DRY_WET, 50.0f);
+    HeadlessHelpers::prepare(processor, sampleRate, blockSize, false);
+
+    juce::Random random(0x4d4856);
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    juce::MidiBuffer midiBuffer;
+    // Some signal, then silence until the tail has died out
+    for (int block = 0; block < (int)std::ceil(0.5 * sampleRate / blockSize); block++)
+    {
+        fillWithNoise(buffer, random, false);
+        processor.processBlock(buffer, midiBuffer);
+    }
+    const auto maxSilentBlocks = (int)std::ceil((processor.getTailLengthSeconds() + 1.0) * sampleRate / blockSize);
+    for (int block = 0; block < maxSilentBlocks && !processor.isIdle(); block++)
+    {
+        buffer.clear();
+        processor.processBlock(buffer, midiBuffer);
+    }
+    if (!processor.isIdle())
+        std::cerr << result.name << ": the processor didn't fall asleep" << std::endl;
+
+    const auto numBlocks = juce::jmax(64, (int)std::ceil(seconds * sampleRate / blockSize));
+    std::vector<double> timings;
+    timings.reserve((size_t)numBlocks);
+    double totalMicros = 0.0;
+    for (int block = 0; block < numBlocks; block++)
+    {
+        buffer.clear();
+        const auto startTicks = juce::Time::getHighResolutionTicks();
+        processor.processBlock(buffer, midiBuffer);
+        const auto micros = microsecondsSince(startTicks);
+        timings.push_back(micros);
+        totalMicros += micros;
+    }
+
+    const auto numSamples = (double)numBlocks * blockSize;
+    result.nsPerSample = totalMicros * 1000.0 / numSamples;
+    result.realTimeFactor = totalMicros > 0.0 ? (numSamples / sampleRate) * 1.0e6 / totalMicros : 0.0;
+    computeStatistics(result, timings);
+    processor.releaseResources();
+    return result;
+}
+
+// Measures prepareToPlay on fresh instances (cold) and when it's called again with the same settings (warm)
+static std::vector<BenchmarkResult> benchmarkPrepare(const double sampleRate, const int blockSize, const bool eco, const bool hybrid,
+                                                     const bool lowCPU)
+{
+    const auto caseName = "/sr=" + juce::String((int)sampleRate) + "/bs=" + juce::String(blockSize);
+    BenchmarkResult coldResult, warmResult;
+    coldResult.name = "prepare/cold" + caseName;
+    warmResult.name = "prepare/warm" + caseName;
+
+    std::vector<double> coldTimings, warmTimings;
+    for (int iteration = 0; iteration < 5; iteration++)
+    {
+        MHVAudioProcessor processor;
+        HeadlessHelpers::setChannelCount(processor, 2);
+        HeadlessHelpers::setParameter(processor, MHV_PID_ECO, eco ? 1.0f : 0.0f);
+        HeadlessHelpers::setParameter(processor, MHV_PID_QUALITY, (float)(hybrid ? MHV_QUALITY_HYBRID : MHV_QUALITY_FULL));
+        HeadlessHelpers::setParameter(processor, MHV_PID_LATENCY_MODE, (float)(lowCPU ? MHV_LATENCY_LOW_CPU : MHV_LATENCY_AUTOMATIC));
+        auto startTicks = juce::Time::getHighResolutionTicks();
+        HeadlessHelpers::prepare(processor, sampleRate, blockSize, false);
+        coldTimings.push_back(microsecondsSince(startTicks));
+
+        startTicks = juce::Time::getHighResolutionTicks();
+        HeadlessHelpers::prepare(processor, sampleRate, blockSize, false);
+        warmTimings.push_back(microsecondsSince(startTicks));
+    }
+
+    computeStatistics(coldResult, coldTimings);
+    computeStatistics(warmResult, warmTimings);
+    return { coldResult, warmResult };
+}
+
+// Converts the results to JSON, along with a description of the machine
+static juce::String resultsToJSON(const std::vector<BenchmarkResult>& results)
+{
+    juce::Array<juce::var> resultArray;
+    for (const auto& result : results)
+    {
+        auto* object = new juce::DynamicObject();
+        object->setProperty("name", result.name);
+        object->setProperty("nsPerSample", result.nsPerSample);
+        object->setProperty("realTimeFactor", result.realTimeFactor);
+        object->setProperty("meanMicros", result.meanMicros);
+        object->setProperty("p50Micros", result.p50Micros);
+        object->setProperty("p99Micros", result.p99Micros);
+        object->setProperty("p999Micros", result.p999Micros);
+        object->setProperty("maxMicros", result.maxMicros);
+        resultArray.add(juce::var(object));
+    }
+
+    auto* root = new juce::DynamicObject();
+    root->setProperty("formatVersion", 1);
+    root->setProperty("date", juce::Time::getCurrentTime().toISO8601(true));
+    root->setProperty("cpu", juce::SystemStats::getCpuModel());
+    root->setProperty("numCpus", juce::SystemStats::getNumCpus());
+    root->setProperty("os", juce::SystemStats::getOperatingSystemName());
+    root->setProperty("juce", juce::SystemStats::getJUCEVersion());
+    root->setProperty("results", resultArray);
+    return juce::JSON::toString(juce::var(root));
+}
+
+// Prints the cases that exist in both runs, returns false if any of them got slower than the threshold
+static bool compareResults(const std::vector<BenchmarkResult>& results, const juce::File& previousFile, const double threshold)
+{
+    const auto previous = juce::JSON::parse(previousFile.loadFileAsString());
+    std::map<juce::String, const juce::var*> previousResults;
+    if (const auto* previousArray = previous["results"].getArray())
+    {
+        for (const auto& result : *previousArray)
+            previousResults[result["name"].toString()] = &result;
+    }
+
+    bool passed = true;
+    std::cout << std::endl << "Comparison with " << previousFile.getFullPathName() << std::endl;
+    for (const auto& result : results)
+    {
+        const auto found = previousResults.find(result.name);
+        if (found == previousResults.end())
+            continue;
+
+        // The processing cases are compared per sample, the other ones by their mean time
+        const auto& old = *found->second;
+        const auto oldValue = result.nsPerSample > 0.0 ? (double)old["nsPerSample"] : (double)old["meanMicros"];
+        const auto newValue = result.nsPerSample > 0.0 ? result.nsPerSample : result.meanMicros;
+        const auto oldP99 = (double)old["p99Micros"];
+        if (oldValue <= 0.0)
+            continue;
+
+        const auto change = (newValue / oldValue - 1.0) * 100.0;
+        const auto p99Change = oldP99 > 0.0 ? (result.p99Micros / oldP99 - 1.0) * 100.0 : 0.0;
+        const bool regressed = change > threshold;
+        passed = passed && !regressed;
+        std::cout << result.name.paddedRight(' ', 48) << " mean " << juce::String(change, 1) << "%  p99 "
+                  << juce::String(p99Change, 1) << "%" << (regressed ? "  REGRESSION" : "") << std::endl;
+    }
+    return passed;
+}
+
+// Parses a comma separated list of numbers
+template <typename NumberType>
+static std::vector<NumberType> parseList(const juce::String& text)
+{
+    std::vector<NumberType> values;
+    for (const auto& token : juce::StringArray::fromTokens(text, ",", ""))
+    {
+        if (token.trim().isNotEmpty())
+            values.push_back((NumberType)token.getDoubleValue());
+    }
+    return values;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkSettings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        const juce::String argument(argv[i]);
+        const auto name = argument.substring(2).upToFirstOccurrenceOf("=", false, false);
+        const auto value = argument.fromFirstOccurrenceOf("=", false, false);
+        if (name == "rates")
+            settings.sampleRates = parseList<double>(value);
+        else if (name == "blocks")
+            settings.blockSizes = parseList<int>(value);
+        else if (name == "layouts")
+            settings.layouts = juce::StringArray::fromTokens(value, ",", "");
+        else if (name == "irs")
+            settings.irIndices = parseList<int>(value);
+        else if (name == "mixes")
+            settings.mixes = parseList<float>(value);
+        else if (name == "eco")
+            settings.eco = true;
+        else if (name == "hybrid")
+            settings.hybrid = true;
+        else if (name == "lowcpu")
+            settings.lowCPU = true;
+        else if (name == "offline")
+            settings.offline = true;
+        else if (name == "seconds")
+            settings.seconds = juce::jmax(0.01, value.getDoubleValue());
+        else if (name == "json")
+            settings.jsonFile = juce::File::getCurrentWorkingDirectory().getChildFile(value);
+        else if (name == "compare")
+            settings.compareFile = juce::File::getCurrentWorkingDirectory().getChildFile(value);
+        else if (name == "threshold")
+            settings.threshold = value.getDoubleValue();
+        else if (name == "trace")
+            settings.traceFile = juce::File::getCurrentWorkingDirectory().getChildFile(value);
+        else if (name == "poolThreads")
+            settings.poolThreads = juce::jmax(0, value.getIntValue());
+        else
+        {
+            std::cerr << "Unknown option " << argument << std::endl;
+            return 1;
+        }
+    }
+
+    // The parameters need a message manager, but nothing here needs a display
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    // The pool is held for the whole run, so its totals cover every case
+    SharedConvolutionPool::setNumThreads(settings.poolThreads);
+    juce::SharedResourcePointer<SharedConvolutionPool> pool;
+    MHVAudioProcessor processor;
+    HeadlessHelpers::setParameter(processor, MHV_PID_ECO, settings.eco ? 1.0f : 0.0f);
+    HeadlessHelpers::setParameter(processor, MHV_PID_QUALITY, (float)(settings.hybrid ? MHV_QUALITY_HYBRID : MHV_QUALITY_FULL));
+    HeadlessHelpers::setParameter(processor, MHV_PID_LATENCY_MODE, (float)(settings.lowCPU ? MHV_LATENCY_LOW_CPU : MHV_LATENCY_AUTOMATIC));
+    std::vector<BenchmarkResult> results;
+    const auto report = [&results, &settings](BenchmarkResult result)
+    {
+        // The eco, hybrid and latency mode cases never get compared with the full rate, full convolution, zero latency ones
+        if (settings.eco)
+            result.name += "/eco";
+        if (settings.hybrid)
+            result.name += "/hybrid";
+        if (settings.lowCPU)
+            result.name += "/lowcpu";
+        results.push_back(result);
+        std::cout << result.name.paddedRight(' ', 48);
+        if (result.nsPerSample > 0.0)
+            std::cout << juce::String(result.nsPerSample, 2).paddedLeft(' ', 9) << " ns/sample"
+                      << juce::String(result.realTimeFactor, 1).paddedLeft(' ', 9) << "x RT";
+        std::cout << "  mean " << juce::String(result.meanMicros, 1) << " us  p50 " << juce::String(result.p50Micros, 1)
+                  << "  p99 " << juce::String(result.p99Micros, 1) << "  p99.9 " << juce::String(result.p999Micros, 1)
+                  << "  max " << juce::String(result.maxMicros, 1) << std::endl;
+    };
+
+    for (const auto sampleRate : settings.sampleRates)
+        for (const auto blockSize : settings.blockSizes)
+            for (const auto& layout : settings.layouts)
+                for (const auto irIndex : settings.irIndices)
+                    for (const auto mix : settings.mixes)
+                    {
+                        auto result = benchmarkProcessing(processor, sampleRate, blockSize, layout, irIndex, mix, settings.seconds, settings.offline);
+                        if (settings.offline)
+                            result.name += "/offline";
+                        report(result);
+                    }
+
+    for (const auto sampleRate : settings.sampleRates)
+    {
+        for (const auto blockSize : settings.blockSizes)
+        {
+            for (const auto& result : benchmarkIRSwitch(processor, sampleRate, blockSize))
+                report(result);
+            report(benchmarkIdle(processor, sampleRate, blockSize, settings.seconds));
+        }
+        for (const auto& result : benchmarkPrepare(sampleRate, settings.blockSizes.empty() ? 512 : settings.blockSizes.front(), settings.eco, settings.hybrid, settings.lowCPU))
+            report(result);
+    }
+
+    if (settings.jsonFile != juce::File())
+        settings.jsonFile.replaceWithText(resultsToJSON(results));
+
+    // The stages of every processBlock call above, prepareToPlay resets nothing
+    if (settings.traceFile != juce::File())
+    {
+        std::cout << std::endl << processor.getPerfTrace().getReport();
+        if (PerfTrace::isEnabled() && !processor.getPerfTrace().writeChromeTrace(settings.traceFile))
+            std::cerr << "Couldn't write " << settings.traceFile.getFullPathName() << std::endl;
+    }
+
+    std::cout << std::endl << pool->getStats().toString();
+
+    if (settings.compareFile.existsAsFile())
+        return compareResults(results, settings.compareFile, settings.threshold) ? 0 : 1;
+    return 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "PluginProcessor.h"
+
+// Helpers shared by the headless tools, they drive the processor the way a host would
+struct HeadlessHelpers
+{
+    // Sets a parameter from its plain (not normalised) value, returns false if the parameter doesn't exist
+    static bool setParameter(MHVAudioProcessor& processor, const juce::String& parameterID, const float value)
+    {
+        auto* parameter = processor.apvts.getParameter(parameterID);
+        if (parameter == nullptr)
+            return false;
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+        return true;
+    }
+
+    // Sets matching input and output layouts with the given channel count, returns false if the plugin rejects them.
+    // Twelve channels are taken as a 7.1.4 bed, the other counts get JUCE's usual layout for them
+    static bool setChannelCount(MHVAudioProcessor& processor, const int numChannels)
+    {
+        const auto channelSet = numChannels == 12 ? juce::AudioChannelSet::create7point1point4()
+                                                  : juce::AudioChannelSet::canonicalChannelSet(numChannels);
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add(channelSet);
+        layout.outputBuses.add(channelSet);
+        return processor.setBusesLayout(layout);
+    }
+
+    // Prepares the processor for the given settings
+    static void prepare(MHVAudioProcessor& processor, const double sampleRate, const int blockSize, const bool nonRealtime)
+    {
+        processor.setNonRealtime(nonRealtime);
+        processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+    }
+};
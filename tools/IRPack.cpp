@@ -0,0 +1,103 @@
+// Builds the impulse response pack embedded in the plugin, it runs as a build step on the WAV files in res/.
+//
+// Usage: MyHallwayVerbIRPack --output=<file.cpp> ir0.wav [ir1.wav ...]
+//   --output=<file.cpp>  Where the source defining IRPackData is written
+//
+// The pack is written as an array in a C++ source rather than embedded as binary data, so it can be declared
+// with the alignment its samples rely on.
+// The impulse responses get their index from their order on the command line, so it must follow the
+// m_IRDataArray of the processor. See IRPack.h for what the pack holds. The exit code is non-zero on failure.
+
+#include <iostream>
+#include <string>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include "IRPack.h"
+#include "IRLoader.h"
+
+// Impulse responses longer than this are cut, like the user's ones
+#define MHV_IR_PACK_MAX_SECONDS 30.0
+
+// Writes the pack as a C++ source defining IRPackData, returns false if the file can't be written
+static bool writeSource(const juce::File& output, const juce::MemoryBlock& pack)
+{
+    output.deleteFile();
+    juce::FileOutputStream stream(output);
+    if (!stream.openedOk())
+        return false;
+
+    stream << "// Generated by MyHallwayVerbIRPack from the impulse responses in res/, don't edit\n\n"
+           << "#include \"IRPack.h\"\n\n"
+           << "alignas(MHV_IR_PACK_ALIGNMENT) const unsigned char IRPackData::data[] =\n{\n";
+    const auto* bytes = static_cast<const unsigned char*>(pack.getData());
+    std::string line;
+    for (size_t i = 0; i < pack.getSize(); i++)
+    {
+        line += std::to_string((int)bytes[i]);
+        line += ',';
+        if (i % 32 == 31 || i + 1 == pack.getSize())
+        {
+            line += '\n';
+            stream.write(line.data(), line.size());
+            line.clear();
+        }
+    }
+    stream << "};\n\nconst size_t IRPackData::size = " << juce::String((juce::int64)pack.getSize()) << ";\n";
+    stream.flush();
+    return !stream.getStatus().failed();
+}
+
+int main(int argc, char* argv[])
+{
+    juce::File output;
+    std::vector<juce::File> files;
+    for (int i = 1; i < argc; i++)
+    {
+        const juce::String argument(argv[i]);
+        if (!argument.startsWith("--"))
+        {
+            files.push_back(juce::File::getCurrentWorkingDirectory().getChildFile(argument));
+            continue;
+        }
+
+        const auto name = argument.substring(2).upToFirstOccurrenceOf("=", false, false);
+        const auto value = argument.fromFirstOccurrenceOf("=", false, false);
+        if (name == "output")
+            output = juce::File::getCurrentWorkingDirectory().getChildFile(value);
+        else
+        {
+            std::cerr << "Unknown option " << argument << std::endl;
+            return 1;
+        }
+    }
+
+    if (output == juce::File() || files.empty())
+    {
+        std::cerr << "Usage: MyHallwayVerbIRPack --output=file.cpp ir0.wav [ir1.wav ...]" << std::endl;
+        return 1;
+    }
+
+    std::vector<IRPack::Source> sources;
+    for (const auto& file : files)
+    {
+        IRPack::Source source;
+        source.irIndex = (unsigned int)sources.size();
+        juce::String error;
+        source.buffer = IRLoader::decodeFile(file, source.sampleRate, MHV_IR_PACK_MAX_SECONDS, []() { return false; }, error);
+        if (source.buffer.getNumSamples() == 0)
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        sources.push_back(std::move(source));
+    }
+
+    const auto pack = IRPack::build(sources);
+    output.getParentDirectory().createDirectory();
+    if (!writeSource(output, pack))
+    {
+        std::cerr << "Can't write " << output.getFullPathName() << std::endl;
+        return 1;
+    }
+    std::cout << "Packed " << files.size() << " impulse responses into " << output.getFullPathName() << " (" << pack.getSize() << " bytes)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,188 @@
+// Checks every SIMD kernel variant the CPU supports against the scalar one, and times them.
+//
+// Usage: MyHallwayVerbKernelCheck [--iterations=<count>]
+//   --iterations=<count>  Random cases per kernel (defaults to 2000)
+//
+// The lengths and the buffer offsets are random, so the vector loops, their scalar remainders and
+// unaligned accesses are all covered. A kernel fails if it's further from the scalar result than
+// MHV_KERNEL_TOLERANCE times the magnitude of the terms it sums. The exit code is non-zero on failure.
+
+#include <iostream>
+#include <vector>
+#include "SpectralKernels.h"
+
+// The largest spectrum a kernel gets in the plugin (MHV_MAX_PARTITION_SIZE + 1 bins), plus room for the offsets
+#define MHV_CHECK_MAX_LENGTH 4097
+#define MHV_CHECK_MAX_OFFSET 15
+// How many partitions are accumulated in a multiply-accumulate case, like a pass over the history
+#define MHV_CHECK_NUM_PARTITIONS 8
+
+// A buffer filled with random values in [-1, 1]
+static std::vector<float> makeRandomBuffer(juce::Random& random)
+{
+    std::vector<float> buffer(MHV_CHECK_MAX_LENGTH + MHV_CHECK_MAX_OFFSET);
+    for (auto& value : buffer)
+        value = random.nextFloat() * 2.0f - 1.0f;
+    return buffer;
+}
+
+// Returns how many times over the tolerance the worst value is, it passes below 1
+static double getWorstError(const std::vector<float>& result, const std::vector<float>& reference, const std::vector<float>& magnitudes, const size_t numValues)
+{
+    double worst = 0.0;
+    for (size_t i = 0; i < numValues; i++)
+    {
+        const auto allowed = (double)MHV_KERNEL_TOLERANCE * juce::jmax(1.0, (double)magnitudes[i]);
+        worst = juce::jmax(worst, std::abs((double)result[i] - (double)reference[i]) / allowed);
+    }
+    return worst;
+}
+
+// Checks the kernels of a variant, returns the worst error of each kernel
+static std::vector<double> checkVariant(const SpectralKernels::Table& kernels, const SpectralKernels::Table& scalar, const int iterations)
+{
+    juce::Random random(42);
+    std::vector<double> worstErrors(4, 0.0);
+    std::vector<float> result(MHV_CHECK_MAX_LENGTH * 2), reference(MHV_CHECK_MAX_LENGTH * 2), magnitudes(MHV_CHECK_MAX_LENGTH * 2);
+
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        const auto length = (size_t)random.nextInt(MHV_CHECK_MAX_LENGTH) + 1;
+        const auto offset = [&random]() { return (size_t)random.nextInt(MHV_CHECK_MAX_OFFSET + 1); };
+
+        // Multiply-accumulate over a few partitions, the accumulators are split in their real and imaginary halves
+        {
+            const auto start = makeRandomBuffer(random);
+            const auto resultOffset = offset();
+            std::fill(magnitudes.begin(), magnitudes.end(), 0.0f);
+            for (size_t i = 0; i < length; i++)
+            {
+                result[i] = reference[i] = start[i];
+                result[length + i] = reference[length + i] = start[length / 2 + i];
+                magnitudes[i] = std::abs(start[i]);
+                magnitudes[length + i] = std::abs(start[length / 2 + i]);
+            }
+            std::vector<float> shiftedResult(2 * length + resultOffset);
+            std::copy(result.begin(), result.begin() + (std::ptrdiff_t)(2 * length), shiftedResult.begin() + (std::ptrdiff_t)resultOffset);
+            auto* accRe = shiftedResult.data() + resultOffset;
+
+            for (int partition = 0; partition < MHV_CHECK_NUM_PARTITIONS; partition++)
+            {
+                const auto xRe = makeRandomBuffer(random), xIm = makeRandomBuffer(random);
+                const auto hRe = makeRandomBuffer(random), hIm = makeRandomBuffer(random);
+                const auto xOffset = offset(), hOffset = offset();
+                kernels.multiplyAccumulate(accRe, accRe + length, xRe.data() + xOffset, xIm.data() + xOffset, hRe.data() + hOffset, hIm.data() + hOffset, length);
+                scalar.multiplyAccumulate(reference.data(), reference.data() + length, xRe.data() + xOffset, xIm.data() + xOffset, hRe.data() + hOffset, hIm.data() + hOffset, length);
+                for (size_t i = 0; i < length; i++)
+                {
+                    const auto xr = xRe[xOffset + i], xi = xIm[xOffset + i], hr = hRe[hOffset + i], hi = hIm[hOffset + i];
+                    magnitudes[i] += std::abs(xr * hr) + std::abs(xi * hi);
+                    magnitudes[length + i] += std::abs(xr * hi) + std::abs(xi * hr);
+                }
+            }
+            std::copy(accRe, accRe + 2 * length, result.begin());
+            worstErrors[0] = juce::jmax(worstErrors[0], getWorstError(result, reference, magnitudes, 2 * length));
+        }
+
+        // Add, in place like the overlap-add does
+        {
+            const auto a = makeRandomBuffer(random), b = makeRandomBuffer(random);
+            const auto aOffset = offset(), bOffset = offset();
+            auto inPlace = a;
+            kernels.add(inPlace.data() + aOffset, inPlace.data() + aOffset, b.data() + bOffset, length);
+            scalar.add(reference.data(), a.data() + aOffset, b.data() + bOffset, length);
+            for (size_t i = 0; i < length; i++)
+                magnitudes[i] = std::abs(a[aOffset + i]) + std::abs(b[bOffset + i]);
+            std::copy(inPlace.begin() + (std::ptrdiff_t)aOffset, inPlace.begin() + (std::ptrdiff_t)(aOffset + length), result.begin());
+            worstErrors[1] = juce::jmax(worstErrors[1], getWorstError(result, reference, magnitudes, length));
+        }
+
+        // Mix with ramps, like a crossfade
+        {
+            const auto a = makeRandomBuffer(random), b = makeRandomBuffer(random);
+            const auto aOffset = offset(), bOffset = offset();
+            const auto aGain = random.nextFloat(), bGain = random.nextFloat();
+            const auto aStep = (random.nextFloat() - 0.5f) / (float)length, bStep = (random.nextFloat() - 0.5f) / (float)length;
+            kernels.mix(result.data(), a.data() + aOffset, aGain, aStep, b.data() + bOffset, bGain, bStep, length);
+            scalar.mix(reference.data(), a.data() + aOffset, aGain, aStep, b.data() + bOffset, bGain, bStep, length);
+            for (size_t i = 0; i < length; i++)
+            {
+                magnitudes[i] = std::abs(a[aOffset + i]) * (std::abs(aGain) + (float)i * std::abs(aStep))
+                              + std::abs(b[bOffset + i]) * (std::abs(bGain) + (float)i * std::abs(bStep));
+            }
+            worstErrors[2] = juce::jmax(worstErrors[2], getWorstError(result, reference, magnitudes, length));
+        }
+
+        // Scale with a ramp, in place like the input gain does
+        {
+            const auto a = makeRandomBuffer(random);
+            const auto aOffset = offset();
+            const auto gain = random.nextFloat(), step = (random.nextFloat() - 0.5f) / (float)length;
+            auto inPlace = a;
+            kernels.scale(inPlace.data() + aOffset, inPlace.data() + aOffset, gain, step, length);
+            scalar.scale(reference.data(), a.data() + aOffset, gain, step, length);
+            for (size_t i = 0; i < length; i++)
+                magnitudes[i] = std::abs(a[aOffset + i]) * (std::abs(gain) + (float)i * std::abs(step));
+            std::copy(inPlace.begin() + (std::ptrdiff_t)aOffset, inPlace.begin() + (std::ptrdiff_t)(aOffset + length), result.begin());
+            worstErrors[3] = juce::jmax(worstErrors[3], getWorstError(result, reference, magnitudes, length));
+        }
+    }
+    return worstErrors;
+}
+
+// Returns the time a multiply-accumulate takes per bin, in nanoseconds
+static double timeMultiplyAccumulate(const SpectralKernels::Table& kernels)
+{
+    juce::Random random(7);
+    const auto numBins = (size_t)MHV_CHECK_MAX_LENGTH;
+    const auto x = makeRandomBuffer(random), h = makeRandomBuffer(random);
+    std::vector<float> acc(2 * numBins, 0.0f);
+    const int repetitions = 20000;
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    for (int i = 0; i < repetitions; i++)
+        kernels.multiplyAccumulate(acc.data(), acc.data() + numBins, x.data(), h.data(), h.data(), x.data(), numBins);
+    const auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+    // Keep the result alive, so the loop isn't optimised away
+    volatile float sink = acc[0];
+    juce::ignoreUnused(sink);
+    return seconds * 1.0e9 / (double)(repetitions * (int)numBins);
+}
+
+int main(int argc, char* argv[])
+{
+    int iterations = 2000;
+    for (int i = 1; i < argc; i++)
+    {
+        const juce::String argument(argv[i]);
+        if (argument.startsWith("--iterations="))
+        {
+            iterations = juce::jmax(1, argument.fromFirstOccurrenceOf("=", false, false).getIntValue());
+        }
+        else
+        {
+            std::cerr << "Usage: MyHallwayVerbKernelCheck [--iterations=count]" << std::endl;
+            return 1;
+        }
+    }
+
+    const auto& scalar = *SpectralKernels::get(SpectralKernels::Variant::scalar);
+    std::cout << "Selected kernels: " << SpectralKernels::get().name << std::endl;
+
+    bool failed = false;
+    for (const auto variant : { SpectralKernels::Variant::scalar, SpectralKernels::Variant::sse2, SpectralKernels::Variant::avx2, SpectralKernels::Variant::avx512 })
+    {
+        const auto* kernels = SpectralKernels::get(variant);
+        if (kernels == nullptr)
+            continue;
+
+        // The errors are in units of the tolerance
+        const auto worstErrors = checkVariant(*kernels, scalar, iterations);
+        const bool passed = worstErrors[0] < 1.0 && worstErrors[1] < 1.0 && worstErrors[2] < 1.0 && worstErrors[3] < 1.0;
+        failed = failed || !passed;
+        std::cout << juce::String(kernels->name).paddedRight(' ', 8) << (passed ? "  ok    " : "  FAILED")
+                  << "  multiplyAccumulate " << juce::String(worstErrors[0], 3) << "  add " << juce::String(worstErrors[1], 3)
+                  << "  mix " << juce::String(worstErrors[2], 3) << "  scale " << juce::String(worstErrors[3], 3) << " (x tolerance)  "
+                  << juce::String(timeMultiplyAccumulate(*kernels), 3) << " ns/bin" << std::endl;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+// Real-time safety check, automates every parameter of the processor and fails if processBlock allocates,
+// frees memory or locks a mutex. It only works in a build configured with -DMHV_REALTIME_CHECKS=ON.
+//
+// Usage: MyHallwayVerbRealtimeCheck [options]
+//   --rates=<list>       Sample rates (defaults to 44100,48000,96000)
+//   --blocks=<list>      Block sizes (defaults to 1,32,100,512,4096)
+//   --layouts=<list>     Channel counts (defaults to 1,2,12, twelve channels being a 7.1.4 bed)
+//   --precisions=<list>  Sample precisions in bits (defaults to 32,64)
+//   --blocksPerScript=<count>  Blocks processed by each automation script (defaults to 64)
+//
+// For every configuration, each parameter goes through a stepped sweep, jumps between its extremes,
+// random values and a slow ramp, then all the parameters are randomised together. The parameters are
+// changed between blocks, like a host would from another thread. The parameters a host can't automate
+// prepare the processor again when they change, so they're never moved while it processes: every one of
+// their values is prepared, and the other parameters are randomised.
+
+#include <functional>
+#include <iostream>
+#include <vector>
+#include "HeadlessHelpers.h"
+
+// The check's settings
+struct CheckSettings
+{
+    std::vector<double> sampleRates = { 44100.0, 48000.0, 96000.0 };
+    std::vector<int> blockSizes = { 1, 32, 100, 512, 4096 };
+    std::vector<int> layouts = { 1, 2, 12 };
+    std::vector<int> precisions = { 32, 64 };
+    int blocksPerScript = 64;
+};
+
+// An automation script returns the normalised value of a parameter for a block
+using AutomationScript = std::function<float(int block, int numBlocks, juce::Random& random)>;
+
+// Returns the scripts every parameter goes through
+static std::vector<std::pair<juce::String, AutomationScript>> getScripts()
+{
+    return {
+        { "sweep", [](int block, int numBlocks, juce::Random&) { return (float)(block * 8 / numBlocks) / 7.0f; } },
+        { "jumps", [](int block, int, juce::Random&) { return block % 2 == 0 ? 0.0f : 1.0f; } },
+        { "random", [](int, int, juce::Random& random) { return random.nextFloat(); } },
+        { "ramp", [](int block, int numBlocks, juce::Random&) { return (float)block / (float)juce::jmax(1, numBlocks - 1); } }
+    };
+}
+
+// Parses a comma separated list of numbers
+template <typename Type>
+static std::vector<Type> parseList(const juce::String& text)
+{
+    std::vector<Type> values;
+    for (const auto& token : juce::StringArray::fromTokens(text, ",", ""))
+        values.push_back((Type)token.getDoubleValue());
+    return values;
+}
+
+// Processes blocks of noise while the script moves the parameters, returns false if processBlock broke the rules
+template <typename SampleType>
+static bool runScript(MHVAudioProcessor& processor, const juce::String& name, const std::vector<juce::RangedAudioParameter*>& parameters,
+                      const AutomationScript& script, juce::AudioBuffer<SampleType>& buffer, const int numBlocks, juce::Random& random)
+{
+    juce::MidiBuffer midiBuffer;
+    processor.resetRealtimeViolations();
+    for (int block = 0; block < numBlocks; block++)
+    {
+        for (auto* parameter : parameters)
+            parameter->setValueNotifyingHost(script(block, numBlocks, random));
+
+        for (int channel = 0; channel < buffer.getNumChannels(); channel++)
+        {
+            auto* samples = buffer.getWritePointer(channel);
+            for (int sample = 0; sample < buffer.getNumSamples(); sample++)
+                samples[sample] = (SampleType)(random.nextFloat() * 2.0f - 1.0f);
+        }
+        processor.processBlock(buffer, midiBuffer);
+    }
+
+    const auto violations = processor.getRealtimeViolations();
+    if (violations.getTotal() == 0)
+        return true;
+
+    std::cout << "FAILED " << name << ": " << (juce::int64)violations.allocations << " allocation(s), "
+              << (juce::int64)violations.deallocations << " deallocation(s), " << (juce::int64)violations.locks << " lock(s)" << std::endl;
+    for (const auto& report : processor.getRealtimeViolationReports())
+        std::cout << report;
+    return false;
+}
+
+int main(int argc, char* argv[])
+{
+    if (!RealtimeChecker::isEnabled())
+    {
+        std::cerr << "MyHallwayVerbRealtimeCheck needs a build configured with -DMHV_REALTIME_CHECKS=ON" << std::endl;
+        return 1;
+    }
+
+    CheckSettings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        const juce::String argument(argv[i]);
+        const auto name = argument.substring(2).upToFirstOccurrenceOf("=", false, false);
+        const auto value = argument.fromFirstOccurrenceOf("=", false, false);
+        if (name == "rates")
+            settings.sampleRates = parseList<double>(value);
+        else if (name == "blocks")
+            settings.blockSizes = parseList<int>(value);
+        else if (name == "layouts")
+            settings.layouts = parseList<int>(value);
+        else if (name == "precisions")
+            settings.precisions = parseList<int>(value);
+        else if (name == "blocksPerScript")
+            settings.blocksPerScript = juce::jmax(1, value.getIntValue());
+        else
+        {
+            std::cerr << "Unknown option " << argument << std::endl;
+            return 1;
+        }
+    }
+
+    // The parameters need a message manager, but nothing here needs a display
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    MHVAudioProcessor processor;
+    juce::Random random(1234);
+    const auto scripts = getScripts();
+
+    std::vector<juce::RangedAudioParameter*> allParameters;
+    std::vector<juce::RangedAudioParameter*> modeParameters;
+    for (auto* parameter : processor.getParameters())
+        if (auto* rangedParameter = dynamic_cast<juce::RangedAudioParameter*>(parameter))
+            (rangedParameter->isAutomatable() ? allParameters : modeParameters).push_back(rangedParameter);
+
+    int numFailures = 0;
+    int numScripts = 0;
+    for (const auto numChannels : settings.layouts)
+    {
+        if (!HeadlessHelpers::setChannelCount(processor, numChannels))
+        {
+            std::cerr << "Unsupported channel count " << numChannels << std::endl;
+            return 1;
+        }
+
+        for (const auto sampleRate : settings.sampleRates)
+        {
+            for (const auto blockSize : settings.blockSizes)
+            {
+                for (const auto precision : settings.precisions)
+                {
+                    const auto prefix = juce::String(numChannels) + "ch/" + juce::String((int)sampleRate) + "Hz/"
+                                      + juce::String(blockSize) + "/" + juce::String(precision) + "bit/";
+                    // The same scripts run in both precisions, the buffer type picks the processBlock overload
+                    const auto runScripts = [&](auto& buffer)
+                    {
+                        // Each parameter on its own
+                        for (auto* parameter : allParameters)
+                        {
+                            for (const auto& [scriptName, script] : scripts)
+                            {
+                                numScripts++;
+                                if (!runScript(processor, prefix + parameter->getParameterID() + "/" + scriptName, { parameter }, script,
+                                               buffer, settings.blocksPerScript, random))
+                                    numFailures++;
+                            }
+                        }
+
+                        // Everything at once
+                        numScripts++;
+                        if (!runScript(processor, prefix + "all/random", allParameters, scripts[2].second, buffer, settings.blocksPerScript, random))
+                            numFailures++;
+
+                        // Everything at once again, in every value of the modes, switched between two prepares
+                        for (auto* mode : modeParameters)
+                        {
+                            const auto numValues = mode->getNumSteps();
+                            for (int value = 0; value < numValues; value++)
+                            {
+                                mode->setValueNotifyingHost((float)value / (float)juce::jmax(1, numValues - 1));
+                                HeadlessHelpers::prepare(processor, sampleRate, blockSize, false);
+                                numScripts++;
+                                if (!runScript(processor, prefix + mode->getParameterID() + "=" + juce::String(value) + "/all/random", allParameters,
+                                               scripts[2].second, buffer, settings.blocksPerScript, random))
+                                    numFailures++;
+                            }
+                            mode->setValueNotifyingHost(mode->getDefaultValue());
+                            HeadlessHelpers::prepare(processor, sampleRate, blockSize, false);
+                        }
+                    };
+
+                    processor.setProcessingPrecision(precision == 64 ? juce::AudioProcessor::doublePrecision : juce::AudioProcessor::singlePrecision);
+                    HeadlessHelpers::prepare(processor, sampleRate, blockSize, false);
+                    if (precision == 64)
+                    {
+                        juce::AudioBuffer<double> buffer(numChannels, blockSize);
+                        runScripts(buffer);
+                    }
+                    else
+                    {
+                        juce::AudioBuffer<float> buffer(numChannels, blockSize);
+                        runScripts(buffer);
+                    }
+                    processor.releaseResources();
+                }
+            }
+        }
+    }
+
+    std::cout << numScripts - numFailures << "/" << numScripts << " automation script(s) passed" << std::endl;
+    return numFailures > 0 ? 1 : 0;
+}